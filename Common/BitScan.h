@@ -21,6 +21,34 @@ inline uint32_t clz32(uint32_t value) {
 	return 31 ^ (uint32_t)index;
 }
 
+inline uint32_t clz64_nonzero(uint64_t value) {
+#if PPSSPP_ARCH(64BIT)
+	DWORD index;
+	BitScanReverse64(&index, value);
+	return 63 ^ (uint32_t)index;
+#else
+	uint32_t hi = (uint32_t)(value >> 32);
+	return hi ? clz32_nonzero(hi) : 32 + clz32_nonzero((uint32_t)value);
+#endif
+}
+
+inline uint32_t ctz64_nonzero(uint64_t value) {
+#if PPSSPP_ARCH(64BIT)
+	DWORD index;
+	BitScanForward64(&index, value);
+	return (uint32_t)index;
+#else
+	DWORD index;
+	uint32_t lo = (uint32_t)value;
+	if (lo) {
+		BitScanForward(&index, lo);
+		return (uint32_t)index;
+	}
+	BitScanForward(&index, (uint32_t)(value >> 32));
+	return 32 + (uint32_t)index;
+#endif
+}
+
 #else
 
 // Use this if you know the value is non-zero.
@@ -34,4 +62,12 @@ inline uint32_t clz32(uint32_t value) {
 	return __builtin_clz(value);
 }
 
+inline uint32_t clz64_nonzero(uint64_t value) {
+	return __builtin_clzll(value);
+}
+
+inline uint32_t ctz64_nonzero(uint64_t value) {
+	return __builtin_ctzll(value);
+}
+
 #endif
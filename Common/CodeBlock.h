@@ -87,6 +87,21 @@ template<class T> class CodeBlock : public CodeBlockCommon, public T {
 		T::SetCodePointer(region, writableRegion);
 	}
 
+	// Emits into another block's space, starting at offset. Offsets are relative to the same base, so code
+	// can be handed over between the two. The owner keeps the memory, call ReleaseSharedCodeSpace() when done.
+	void ShareCodeSpace(const CodeBlock &owner, size_t offset) {
+		region = owner.region;
+		region_size = owner.region_size;
+		writableRegion = owner.writableRegion;
+		ResetCodePtr(offset);
+	}
+
+	void ReleaseSharedCodeSpace() {
+		region = nullptr;
+		writableRegion = nullptr;
+		region_size = 0;
+	}
+
 	// Always clear code space with breakpoints, so that if someone accidentally executes
 	// uninitialized, it just breaks into the debugger.
 	void ClearCodeSpace(int offset) {
@@ -2,6 +2,7 @@
 // Taken from http://panthema.net/2007/0328-ZLibString.html
 
 
+#include <algorithm>
 #include <string>
 #include <stdexcept>
 #include <cstring>
@@ -98,3 +99,66 @@ bool decompress_string(const std::string& str, std::string *dest) {
 	*dest = outstring;
 	return true;
 }
+
+// Reads the extra length bytes that follow a length of 15 in an LZ4 token.
+static bool lz4_read_length(const uint8_t *&ip, const uint8_t *iend, size_t *length) {
+	uint8_t b;
+	do {
+		if (ip >= iend)
+			return false;
+		b = *ip++;
+		*length += b;
+	} while (b == 255);
+	return true;
+}
+
+bool decompress_lz4_block(const uint8_t *src, size_t srcSize, uint8_t *dst, size_t dstSize, size_t *outSize) {
+	const uint8_t *ip = src;
+	const uint8_t *const iend = src + srcSize;
+	uint8_t *op = dst;
+	uint8_t *const oend = dst + dstSize;
+
+	while (ip < iend) {
+		// Each sequence is a token, literals, and a match to copy from earlier output.
+		const uint8_t token = *ip++;
+		size_t literals = token >> 4;
+		if (literals == 15 && !lz4_read_length(ip, iend, &literals))
+			return false;
+		if ((size_t)(iend - ip) < literals || (size_t)(oend - op) < literals)
+			return false;
+		memcpy(op, ip, literals);
+		ip += literals;
+		op += literals;
+
+		// The last sequence has no match.
+		if (ip == iend || op == oend)
+			break;
+
+		if (iend - ip < 2)
+			return false;
+		const size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > (size_t)(op - dst))
+			return false;
+
+		size_t matchLength = token & 15;
+		if (matchLength == 15 && !lz4_read_length(ip, iend, &matchLength))
+			return false;
+		matchLength += 4;
+		if ((size_t)(oend - op) < matchLength)
+			return false;
+
+		// The match may overlap what it produces, in which case it repeats with a period of offset.
+		// Copying from the start of the match in growing steps never overlaps.
+		const uint8_t *match = op - offset;
+		while (matchLength > 0) {
+			const size_t step = std::min(matchLength, (size_t)(op - match));
+			memcpy(op, match, step);
+			op += step;
+			matchLength -= step;
+		}
+	}
+
+	*outSize = op - dst;
+	return true;
+}
@@ -1,7 +1,13 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
 // inflate/deflate convenience wrapper. Uses zlib.
 bool compress_string(const std::string& str, std::string *dest, int compressionlevel = 9);
 bool decompress_string(const std::string& str, std::string *dest);
+
+// Decompresses a raw LZ4 block (no frame header.) Stops once dst is full, so padding after the
+// block is ignored. Returns false on malformed data, or if it doesn't fit in dst.
+bool decompress_lz4_block(const uint8_t *src, size_t srcSize, uint8_t *dst, size_t dstSize, size_t *outSize);
@@ -15,6 +15,8 @@
 // Official SVN repository and contact information can be found at
 // http://code.google.com/p/dolphin-emu/
 
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <cstring>
 #include <snappy-c.h>
@@ -24,6 +26,9 @@
 #include "Common/Serialize/SerializeFuncs.h"
 #include "Common/File/FileUtil.h"
 #include "Common/StringUtils.h"
+#include "Common/Thread/ParallelLoop.h"
+#include "Common/Thread/Promise.h"
+#include "Common/Thread/ThreadManager.h"
 
 enum class SerializeCompressType {
 	NONE = 0,
@@ -31,7 +36,14 @@ enum class SerializeCompressType {
 	ZSTD = 2,
 };
 
-static constexpr SerializeCompressType SAVE_TYPE = SerializeCompressType::ZSTD;
+// Growable buffers start at least this large, and at least double when they grow.
+static constexpr size_t MIN_GROWABLE_SIZE = 1024 * 1024;
+// Streaming writes fill buffers of this size, unless a single write needs more.
+static constexpr size_t STREAMING_BUFFER_SIZE = 4 * 1024 * 1024;
+// Each frame is compressed separately, so this is a tradeoff between parallelism and ratio.
+static constexpr size_t STREAMING_FRAME_SIZE = 2 * 1024 * 1024;
+
+size_t CChunkFileReader::saveSizeHint_ = 0;
 
 void PointerWrap::RewindForWrite(u8 *writePtr) {
 	_assert_(mode == MODE_MEASURE);
@@ -42,8 +54,100 @@ void PointerWrap::RewindForWrite(u8 *writePtr) {
 	ptrStart_ = writePtr;
 }
 
+void PointerWrap::BeginGrowableWrite(u8 *buffer, size_t capacity) {
+	_assert_(mode == MODE_WRITE);
+	growVector_ = nullptr;
+	*ptr = buffer;
+	ptrStart_ = buffer;
+	growEnd_ = buffer ? buffer + capacity : nullptr;
+	// A null growEnd_ means not growable, so allocate something right away.
+	if (!growEnd_)
+		GrowBuffer(0);
+}
+
+void PointerWrap::BeginGrowableWrite(std::vector<u8> *buffer) {
+	_assert_(mode == MODE_WRITE);
+	// Only the slack is zero-filled, so reusing a vector across saves is cheap.
+	buffer->resize(std::max(buffer->capacity(), MIN_GROWABLE_SIZE));
+	growVector_ = buffer;
+	*ptr = buffer->data();
+	ptrStart_ = buffer->data();
+	growEnd_ = ptrStart_ + buffer->size();
+}
+
+void PointerWrap::BeginStreamingWrite(PointerWrapSink *sink) {
+	_assert_(mode == MODE_WRITE);
+	growVector_ = nullptr;
+	sink_ = sink;
+	flushedBytes_ = 0;
+	*ptr = nullptr;
+	ptrStart_ = nullptr;
+	growEnd_ = nullptr;
+	GrowBuffer(0);
+}
+
+void PointerWrap::EndGrowableWrite() {
+	if (growVector_)
+		growVector_->resize(error == ERROR_FAILURE ? 0 : Offset());
+	if (sink_ && ptrStart_) {
+		size_t used = *ptr - ptrStart_;
+		sink_->Write(ptrStart_, used);
+		flushedBytes_ += used;
+		ptrStart_ = *ptr;
+	}
+	growVector_ = nullptr;
+	sink_ = nullptr;
+	growEnd_ = nullptr;
+}
+
+void PointerWrap::GrowBuffer(size_t size) {
+	if (sink_) {
+		// Pass on what we have so far, and continue in a fresh buffer.
+		if (ptrStart_) {
+			size_t used = *ptr - ptrStart_;
+			sink_->Write(ptrStart_, used);
+			flushedBytes_ += used;
+		}
+		size_t capacity = 0;
+		u8 *start = sink_->Allocate(size, &capacity);
+		ptrStart_ = start;
+		*ptr = start;
+		growEnd_ = start ? start + capacity : nullptr;
+		if (!start) {
+			ERROR_LOG(Log::SaveState, "Savestate failure: unable to allocate %d bytes", (int)size);
+			SetError(ERROR_FAILURE);
+		}
+		return;
+	}
+
+	size_t offset = Offset();
+	size_t capacity = std::max(offset + size, std::max((size_t)(growEnd_ - ptrStart_) * 2, MIN_GROWABLE_SIZE));
+
+	u8 *start;
+	if (growVector_) {
+		growVector_->resize(capacity);
+		start = growVector_->data();
+	} else {
+		start = (u8 *)realloc(ptrStart_, capacity);
+		if (!start) {
+			// The old buffer is still valid, so it can be freed as usual.
+			ERROR_LOG(Log::SaveState, "Savestate failure: unable to grow buffer to %d bytes", (int)capacity);
+			SetError(ERROR_FAILURE);
+			return;
+		}
+	}
+
+	ptrStart_ = start;
+	*ptr = start + offset;
+	growEnd_ = start + capacity;
+}
+
 bool PointerWrap::CheckAfterWrite() {
 	_assert_(error != ERROR_NONE || mode == MODE_WRITE);
+	if (error == ERROR_FAILURE) {
+		WARN_LOG(Log::SaveState, "CheckAfterWrite: Failed during write");
+		return false;
+	}
 	size_t offset = Offset();
 	if (measuredSize_ != 0 && offset != measuredSize_) {
 		WARN_LOG(Log::SaveState, "CheckAfterWrite: Size mismatch! %d but expected %d", (int)offset, (int)measuredSize_);
@@ -85,7 +189,7 @@ PointerWrapSection PointerWrap::Section(const char *title, int minVer, int ver)
 				SetError(ERROR_FAILURE);
 				return PointerWrapSection(*this, -1, title);
 			}
-		} else {
+		} else if (!growEnd_) {
 			WARN_LOG(Log::SaveState, "Writing savestate without checkpoints. This is OK but should be fixed.");
 		}
 		curCheckpoint_++;
@@ -130,6 +234,7 @@ void PointerWrap::SetError(Error error_) {
 }
 
 bool PointerWrap::ExpectVoid(void *data, int size) {
+	ReserveWrite(size);
 	switch (mode) {
 	case MODE_READ:	if (memcmp(data, *ptr, size) != 0) return false; break;
 	case MODE_WRITE: memcpy(*ptr, data, size); break;
@@ -145,6 +250,7 @@ bool PointerWrap::ExpectVoid(void *data, int size) {
 }
 
 void PointerWrap::DoVoid(void *data, int size) {
+	ReserveWrite(size);
 	switch (mode) {
 	case MODE_READ:	memcpy(data, *ptr, size); break;
 	case MODE_WRITE: memcpy(*ptr, data, size); break;
@@ -170,6 +276,7 @@ void Do(PointerWrap &p, std::string &x) {
 		p.SetError(PointerWrap::ERROR_FAILURE);
 		return;
 	}
+	p.ReserveWrite(stringLen);
 
 	switch (p.mode) {
 	case PointerWrap::MODE_READ: x = (char*)*p.ptr; break;
@@ -190,6 +297,7 @@ void Do(PointerWrap &p, std::wstring &x) {
 		p.SetError(PointerWrap::ERROR_FAILURE);
 		return;
 	}
+	p.ReserveWrite(stringLen);
 
 	auto read = [&]() {
 		std::wstring r;
@@ -218,6 +326,7 @@ void Do(PointerWrap &p, std::u16string &x) {
 		p.SetError(PointerWrap::ERROR_FAILURE);
 		return;
 	}
+	p.ReserveWrite(stringLen);
 
 	auto read = [&]() {
 		std::u16string r;
@@ -334,6 +443,86 @@ CChunkFileReader::Error CChunkFileReader::LoadFileHeader(File::IOFile &pFile, SC
 	return ERROR_NONE;
 }
 
+// States are saved as a series of independent zstd frames (see StreamingSaveFile), so they
+// can be decompressed in parallel. Older states are a single frame.
+// Moves a finished temp file over filename. If that fails, the old file stays, or failing that, the temp file does.
+static bool ReplaceWithTempFile(const Path &tempFilename, const Path &filename) {
+#if !defined(_WIN32) && !defined(HAVE_LIBRETRO_VFS)
+	// rename() atomically replaces the target here, content URIs can't do that though.
+	bool canReplace = filename.Type() == PathType::NATIVE || !File::Exists(filename);
+#else
+	bool canReplace = !File::Exists(filename);
+#endif
+	if (canReplace) {
+		if (File::Rename(tempFilename, filename))
+			return true;
+		File::Delete(tempFilename);
+		return false;
+	}
+
+	// The target can't be replaced directly, so move the old file out of the way first.
+	Path backupFilename = filename.WithExtraExtension(".bak");
+	File::Delete(backupFilename, true);
+	if (!File::Rename(filename, backupFilename)) {
+		File::Delete(tempFilename);
+		return false;
+	}
+	if (File::Rename(tempFilename, filename)) {
+		File::Delete(backupFilename);
+		return true;
+	}
+	// Put the old one back. If even that fails, keep the new one around rather than losing both.
+	if (File::Rename(backupFilename, filename))
+		File::Delete(tempFilename);
+	return false;
+}
+
+static bool DecompressZstdFrames(u8 *dst, size_t *dstSize, const u8 *src, size_t srcSize) {
+	struct FrameInfo {
+		size_t srcOffset;
+		size_t srcSize;
+		size_t dstOffset;
+		size_t dstSize;
+	};
+	std::vector<FrameInfo> frames;
+
+	size_t srcPos = 0;
+	size_t dstPos = 0;
+	while (srcPos < srcSize) {
+		size_t frameSize = ZSTD_findFrameCompressedSize(src + srcPos, srcSize - srcPos);
+		unsigned long long contentSize = ZSTD_getFrameContentSize(src + srcPos, srcSize - srcPos);
+		if (ZSTD_isError(frameSize) || contentSize == ZSTD_CONTENTSIZE_UNKNOWN || contentSize == ZSTD_CONTENTSIZE_ERROR || contentSize > *dstSize - dstPos) {
+			// Can't split it up, so leave it to zstd.
+			frames.clear();
+			break;
+		}
+		frames.push_back(FrameInfo{ srcPos, frameSize, dstPos, (size_t)contentSize });
+		srcPos += frameSize;
+		dstPos += (size_t)contentSize;
+	}
+
+	if (frames.size() <= 1) {
+		size_t status = ZSTD_decompress(dst, *dstSize, src, srcSize);
+		if (ZSTD_isError(status))
+			return false;
+		*dstSize = status;
+		return true;
+	}
+
+	std::atomic<bool> failed{};
+	ParallelRangeLoop(&g_threadManager, [&](int l, int h) {
+		for (int i = l; i < h; ++i) {
+			const FrameInfo &frame = frames[i];
+			size_t status = ZSTD_decompress(dst + frame.dstOffset, frame.dstSize, src + frame.srcOffset, frame.srcSize);
+			if (ZSTD_isError(status) || status != frame.dstSize)
+				failed = true;
+		}
+	}, 0, (int)frames.size(), 1);
+
+	*dstSize = dstPos;
+	return !failed;
+}
+
 CChunkFileReader::Error CChunkFileReader::GetFileTitle(const Path &filename, std::string *title) {
 	if (!File::Exists(filename)) {
 		ERROR_LOG(Log::SaveState, "ChunkReader: File doesn't exist");
@@ -377,11 +566,7 @@ CChunkFileReader::Error CChunkFileReader::LoadFile(const Path &filename, std::st
 			auto status = snappy_uncompress((const char *)buffer, sz, (char *)uncomp_buffer, &uncomp_size);
 			success = status == SNAPPY_OK;
 		} else if (SerializeCompressType(header.Compress) == SerializeCompressType::ZSTD) {
-			size_t status = ZSTD_decompress((char *)uncomp_buffer, uncomp_size, (const char *)buffer, sz);
-			success = !ZSTD_isError(status);
-			if (success) {
-				uncomp_size = status;
-			}
+			success = DecompressZstdFrames(uncomp_buffer, &uncomp_size, buffer, sz);
 		} else {
 			ERROR_LOG(Log::SaveState, "ChunkReader: Unexpected compression type %d", header.Compress);
 		}
@@ -413,112 +598,234 @@ CChunkFileReader::Error CChunkFileReader::LoadFile(const Path &filename, std::st
 	return ERROR_NONE;
 }
 
-// Takes ownership of buffer.
-CChunkFileReader::Error CChunkFileReader::SaveFile(const Path &filename, const std::string &title, const char *gitVersion, u8 *buffer, size_t sz) {
+CChunkFileReader::Error CChunkFileReader::StreamingSaveFile::Open(const Path &filename, const std::string &title, const char *gitVersion) {
 	INFO_LOG(Log::SaveState, "ChunkReader: Writing %s", filename.c_str());
 
-	File::IOFile pFile(filename, "wb");
-	if (!pFile) {
+	filename_ = filename;
+	tempFilename_ = filename.WithExtraExtension(".tmp");
+	file_ = new File::IOFile(tempFilename_, "wb");
+	if (!*file_) {
 		ERROR_LOG(Log::SaveState, "ChunkReader: Error opening file for write");
-		free(buffer);
 		return ERROR_BAD_FILE;
 	}
 
-	// Make sure we can allocate a buffer to compress before compressing.
-	size_t write_len;
-	SerializeCompressType usedType = SAVE_TYPE;
-	switch (usedType) {
-	case SerializeCompressType::NONE:
-		write_len = 0;
-		break;
-	case SerializeCompressType::SNAPPY:
-		write_len = snappy_max_compressed_length(sz);
-		break;
-	case SerializeCompressType::ZSTD:
-		write_len = ZSTD_compressBound(sz);
-		break;
-	}
-	u8 *compressed_buffer = write_len == 0 ? nullptr : (u8 *)malloc(write_len);
-	u8 *write_buffer = buffer;
-	if (!compressed_buffer) {
-		if (write_len != 0)
-			ERROR_LOG(Log::SaveState, "ChunkReader: Unable to allocate compressed buffer");
-		// We'll save uncompressed.  Better than not saving...
-		write_len = sz;
-		usedType = SerializeCompressType::NONE;
-	} else {
-		bool success = true;
-		switch (usedType) {
-		case SerializeCompressType::NONE:
-			_assert_(false);
-			break;
-		case SerializeCompressType::SNAPPY:
-			success = snappy_compress((const char *)buffer, sz, (char *)compressed_buffer, &write_len) == SNAPPY_OK;
-			break;
-		case SerializeCompressType::ZSTD:
-			{
-				auto ctx = ZSTD_createCCtx();
-				if (!ctx) {
-					success = false;
-				} else {
-					// TODO: If free disk space is low, we could max this out to 22?
-					ZSTD_CCtx_setParameter(ctx, ZSTD_c_compressionLevel, ZSTD_CLEVEL_DEFAULT);
-					ZSTD_CCtx_setParameter(ctx, ZSTD_c_checksumFlag, 1);
-					ZSTD_CCtx_setPledgedSrcSize(ctx, sz);
-					write_len = ZSTD_compress2(ctx, compressed_buffer, write_len, buffer, sz);
-					success = !ZSTD_isError(write_len);
-				}
-				ZSTD_freeCCtx(ctx);
-			}
-			break;
-		}
-
-		if (success) {
-			free(buffer);
-			write_buffer = compressed_buffer;
-		} else {
-			ERROR_LOG(Log::SaveState, "ChunkReader: Compression failed");
-			free(compressed_buffer);
-
-			// We can still save uncompressed.
-			write_len = sz;
-			usedType = SerializeCompressType::NONE;
-		}
-	}
+	// Keep enough frames in flight to keep all threads busy, but not the whole state.
+	maxPending_ = std::max(4, g_threadManager.GetNumLooperThreads() * 2);
 
-	// Create header
-	SChunkHeader header{};
-	header.Compress = (int)usedType;
-	header.Revision = REVISION_CURRENT;
-	header.ExpectedSize = (u32)write_len;
-	header.UncompressedSize = (u32)sz;
-	truncate_cpy(header.GitVersion, gitVersion);
+	header_.Compress = (int)SerializeCompressType::ZSTD;
+	header_.Revision = REVISION_CURRENT;
+	truncate_cpy(header_.GitVersion, gitVersion);
 
 	// Setup the fixed-length title.
 	char titleFixed[128]{};
 	truncate_cpy(titleFixed, title.c_str());
 
-	// Now let's start writing out the file...
-	if (!pFile.WriteArray(&header, 1)) {
+	// The sizes aren't known yet, so the header gets written again in Finish.
+	if (!file_->WriteArray(&header_, 1)) {
 		ERROR_LOG(Log::SaveState, "ChunkReader: Failed writing header");
-		free(write_buffer);
+		failed_ = true;
 		return ERROR_BAD_FILE;
 	}
-	if (!pFile.WriteArray(titleFixed, sizeof(titleFixed))) {
+	if (!file_->WriteArray(titleFixed, sizeof(titleFixed))) {
 		ERROR_LOG(Log::SaveState, "ChunkReader: Failed writing title");
-		free(write_buffer);
+		failed_ = true;
 		return ERROR_BAD_FILE;
 	}
+	return ERROR_NONE;
+}
+
+struct CChunkFileReader::StreamingSaveFile::Frame {
+	// Shared by all the frames cut from the same buffer, which is freed after the last one.
+	std::shared_ptr<u8> input;
+	const u8 *src;
+	size_t srcSize;
+	u8 *compressed = nullptr;
+	size_t compressedSize = 0;
+	Promise<Frame *> *done = nullptr;
+};
+
+u8 *CChunkFileReader::StreamingSaveFile::Allocate(size_t minSize, size_t *capacity) {
+	*capacity = std::max(minSize, STREAMING_BUFFER_SIZE);
+	return (u8 *)malloc(*capacity);
+}
+
+void CChunkFileReader::StreamingSaveFile::Write(u8 *buffer, size_t size) {
+	if (size == 0 || failed_) {
+		free(buffer);
+		return;
+	}
+
+	QueueFrames(std::shared_ptr<u8>(buffer, free), buffer, size);
+}
+
+void CChunkFileReader::StreamingSaveFile::QueueFrames(const std::shared_ptr<u8> &owner, const u8 *data, size_t size) {
+	for (size_t pos = 0; pos < size; pos += STREAMING_FRAME_SIZE) {
+		Frame *frame = new Frame();
+		frame->input = owner;
+		frame->src = data + pos;
+		frame->srcSize = std::min(size - pos, STREAMING_FRAME_SIZE);
+		frame->done = Promise<Frame *>::Spawn(&g_threadManager, [this, frame]() {
+			Compress(frame);
+			return frame;
+		}, TaskType::CPU_COMPUTE);
+		frames_.push_back(frame);
+		uncompressedSize_ += frame->srcSize;
+
+		WriteFrames(maxPending_);
+	}
+}
+
+void CChunkFileReader::StreamingSaveFile::Compress(Frame *frame) {
+	ZSTD_CCtx *ctx = nullptr;
+	{
+		std::lock_guard<std::mutex> guard(contextLock_);
+		if (!contexts_.empty()) {
+			ctx = contexts_.back();
+			contexts_.pop_back();
+		}
+	}
+	if (!ctx) {
+		ctx = ZSTD_createCCtx();
+		if (!ctx) {
+			// WriteFrames will store it uncompressed.
+			return;
+		}
+		ZSTD_CCtx_setParameter(ctx, ZSTD_c_compressionLevel, ZSTD_CLEVEL_DEFAULT);
+		ZSTD_CCtx_setParameter(ctx, ZSTD_c_checksumFlag, 1);
+	}
+
+	size_t bound = ZSTD_compressBound(frame->srcSize);
+	frame->compressed = (u8 *)malloc(bound);
+	if (frame->compressed) {
+		size_t result = ZSTD_compress2(ctx, frame->compressed, bound, frame->src, frame->srcSize);
+		if (ZSTD_isError(result)) {
+			free(frame->compressed);
+			frame->compressed = nullptr;
+		} else {
+			frame->compressedSize = result;
+		}
+	}
+	// Let the input go as soon as possible, unless it has to be stored as is.
+	if (frame->compressed)
+		frame->input.reset();
+
+	std::lock_guard<std::mutex> guard(contextLock_);
+	contexts_.push_back(ctx);
+}
 
-	if (!pFile.WriteBytes(write_buffer, write_len)) {
-		ERROR_LOG(Log::SaveState, "ChunkReader: Failed writing compressed data");
-		free(write_buffer);
+void CChunkFileReader::StreamingSaveFile::WriteFrames(size_t maxPending) {
+	// Frames have to go out in order, so only the oldest ones can be written.
+	while (!frames_.empty()) {
+		Frame *frame = frames_.front();
+		if (frames_.size() > maxPending) {
+			frame->done->BlockUntilReady();
+		} else if (!frame->done->Poll()) {
+			break;
+		}
+		frames_.pop_front();
+
+		if (!frame->compressed) {
+			// We can still save uncompressed.  Better than not saving...
+			ERROR_LOG(Log::SaveState, "ChunkReader: Compression failed");
+			if (!failed_ && !WriteStoredFrame(frame->src, frame->srcSize)) {
+				ERROR_LOG(Log::SaveState, "ChunkReader: Failed writing uncompressed data");
+				failed_ = true;
+			}
+		} else if (!failed_ && !file_->WriteBytes(frame->compressed, frame->compressedSize)) {
+			ERROR_LOG(Log::SaveState, "ChunkReader: Failed writing compressed data");
+			failed_ = true;
+		}
+		compressedSize_ += frame->compressedSize;
+
+		free(frame->compressed);
+		delete frame->done;
+		delete frame;
+	}
+}
+
+// Writes the data as a zstd frame of raw blocks, so the file is still one valid zstd stream.
+bool CChunkFileReader::StreamingSaveFile::WriteStoredFrame(const u8 *data, size_t size) {
+	// Magic, then a single segment frame with a 4 byte content size and no checksum.
+	const u8 header[9] = {
+		0x28, 0xB5, 0x2F, 0xFD, 0xA0,
+		(u8)size, (u8)(size >> 8), (u8)(size >> 16), (u8)(size >> 24),
+	};
+	if (!file_->WriteBytes(header, sizeof(header)))
+		return false;
+	compressedSize_ += sizeof(header);
+
+	// Raw blocks can't be larger than 128 KB.
+	const size_t MAX_BLOCK_SIZE = 128 * 1024;
+	size_t pos = 0;
+	do {
+		size_t blockSize = std::min(size - pos, MAX_BLOCK_SIZE);
+		bool last = pos + blockSize == size;
+		// The block type is 0 for raw, in bits 1-2.
+		u32 blockHeader = (u32)(blockSize << 3) | (last ? 1 : 0);
+		const u8 blockHeaderBytes[3] = { (u8)blockHeader, (u8)(blockHeader >> 8), (u8)(blockHeader >> 16) };
+		if (!file_->WriteBytes(blockHeaderBytes, sizeof(blockHeaderBytes)) || !file_->WriteBytes(data + pos, blockSize))
+			return false;
+		compressedSize_ += sizeof(blockHeaderBytes) + blockSize;
+		pos += blockSize;
+	} while (pos < size);
+	return true;
+}
+
+CChunkFileReader::Error CChunkFileReader::StreamingSaveFile::Finish(bool success) {
+	WriteFrames(0);
+
+	if (success && !failed_) {
+		if (uncompressedSize_ > 0xFFFFFFFF || compressedSize_ > 0xFFFFFFFF) {
+			ERROR_LOG(Log::SaveState, "ChunkReader: State too large");
+			failed_ = true;
+		} else {
+			header_.ExpectedSize = (u32)compressedSize_;
+			header_.UncompressedSize = (u32)uncompressedSize_;
+			if (!file_->Seek(0, SEEK_SET) || !file_->WriteArray(&header_, 1)) {
+				ERROR_LOG(Log::SaveState, "ChunkReader: Failed writing header");
+				failed_ = true;
+			}
+		}
+	}
+
+	bool closed = file_->Close();
+	delete file_;
+	file_ = nullptr;
+
+	if (!success || failed_ || !closed) {
+		// Don't leave a truncated state behind, but keep the previous one.
+		File::Delete(tempFilename_);
+		return success ? ERROR_BAD_FILE : ERROR_BROKEN_STATE;
+	}
+
+	// Only now replace the old file.
+	if (!ReplaceWithTempFile(tempFilename_, filename_)) {
+		ERROR_LOG(Log::SaveState, "ChunkReader: Failed to move %s into place", tempFilename_.c_str());
 		return ERROR_BAD_FILE;
-	} else if (sz != write_len) {
-		INFO_LOG(Log::SaveState, "Savestate: Compressed %i bytes into %i", (int)sz, (int)write_len);
 	}
-	free(write_buffer);
 
-	INFO_LOG(Log::SaveState, "ChunkReader: Done writing %s", filename.c_str());
+	INFO_LOG(Log::SaveState, "Savestate: Compressed %i bytes into %i", (int)uncompressedSize_, (int)compressedSize_);
+	INFO_LOG(Log::SaveState, "ChunkReader: Done writing %s", filename_.c_str());
 	return ERROR_NONE;
 }
+
+CChunkFileReader::Error CChunkFileReader::SaveFile(const Path &filename, const std::string &title, const char *gitVersion, const u8 *buffer, size_t sz) {
+	StreamingSaveFile file;
+	Error error = file.Open(filename, title, gitVersion);
+	if (error != ERROR_NONE)
+		return error;
+	file.QueueFrames(nullptr, buffer, sz);
+	return file.Finish(true);
+}
+
+CChunkFileReader::StreamingSaveFile::~StreamingSaveFile() {
+	// Normally Finish has taken care of these, but the tasks still need to be waited for.
+	failed_ = true;
+	WriteFrames(0);
+	if (file_) {
+		delete file_;
+		File::Delete(tempFilename_, true);
+	}
+	for (ZSTD_CCtx *ctx : contexts_)
+		ZSTD_freeCCtx(ctx);
+}
@@ -31,6 +31,9 @@
 
 #include <string>
 #include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <cstdlib>
 
@@ -43,8 +46,21 @@ namespace File {
 class IOFile;
 };
 
+struct ZSTD_CCtx_s;
+
 class PointerWrap;
 
+// Receives the output of a streaming write, see PointerWrap::BeginStreamingWrite.
+class PointerWrapSink {
+public:
+	virtual ~PointerWrapSink() {}
+	// Returns a malloc'd buffer with room for at least minSize bytes, or null on failure.
+	virtual u8 *Allocate(size_t minSize, size_t *capacity) = 0;
+	// Takes ownership of a buffer from Allocate, of which the first size bytes were written.
+	// Buffers are passed back in order.
+	virtual void Write(u8 *buffer, size_t size) = 0;
+};
+
 class PointerWrapSection
 {
 public:
@@ -123,6 +139,23 @@ class PointerWrap
 	void RewindForWrite(u8 *writePtr);
 	bool CheckAfterWrite();
 
+	// Starts MODE_WRITE without a measure pass, into a buffer that grows as needed.
+	// The malloc version takes ownership of the buffer (which can be null) and may realloc it,
+	// so use GetBufferStart to get it back. The vector version uses all of its capacity, and leaves
+	// it sized to the written data in EndGrowableWrite.
+	void BeginGrowableWrite(u8 *buffer, size_t capacity);
+	void BeginGrowableWrite(std::vector<u8> *buffer);
+	// Same, but when a buffer fills up, it's handed to the sink and we continue in a new one.
+	// Nothing can be read back, and GetBufferStart is only the start of the current buffer.
+	void BeginStreamingWrite(PointerWrapSink *sink);
+	void EndGrowableWrite();
+
+	// Makes room for size more bytes when writing into a growable buffer. May move *ptr.
+	void ReserveWrite(size_t size) {
+		if (growEnd_ && mode == MODE_WRITE && (size_t)(growEnd_ - *ptr) < size)
+			GrowBuffer(size);
+	}
+
 	// The returned object can be compared against the version that was loaded.
 	// This can be used to support versions as old as minVer.
 	// Version = 0 means the section was not found.
@@ -148,18 +181,28 @@ class PointerWrap
 
 	void SkipBytes(size_t bytes) {
 		// Should work in all modes.
+		ReserveWrite(bytes);
 		*ptr += bytes;
 	}
 
-	size_t Offset() const { return *ptr - ptrStart_; }
+	size_t Offset() const { return flushedBytes_ + (*ptr - ptrStart_); }
+	u8 *GetBufferStart() const { return ptrStart_; }
 
 private:
+	void GrowBuffer(size_t size);
+
 	const char *firstBadSectionTitle_ = nullptr;
 	const char *curTitle_;
 	u8 *ptrStart_;
 	std::vector<SerializeCheckpoint> checkpoints_;
 	size_t curCheckpoint_ = 0;
 	size_t measuredSize_ = 0;
+	// Only set while writing into a growable buffer.
+	u8 *growEnd_ = nullptr;
+	std::vector<u8> *growVector_ = nullptr;
+	PointerWrapSink *sink_ = nullptr;
+	// Bytes already handed to sink_.
+	size_t flushedBytes_ = 0;
 };
 
 class CChunkFileReader
@@ -197,56 +240,55 @@ class CChunkFileReader
 		return (size_t)ptr;
 	}
 
-	// If *saved is null, will allocate storage using malloc.
+	// If *saved is null, will allocate storage using malloc, and save in a single pass.
 	// If it's not null, it will be used, but only hope can save you from overruns at the end. For libretro.
 	template<class T>
 	static Error MeasureAndSavePtr(T &_class, u8 **saved, size_t *savedSize)
 	{
 		u8 *ptr = nullptr;
+		if (!*saved) {
+			PointerWrap p(&ptr, PointerWrap::MODE_WRITE);
+			p.BeginGrowableWrite((u8 *)malloc(saveSizeHint_), saveSizeHint_);
+			_class.DoState(p);
+			p.EndGrowableWrite();
+
+			if (!p.CheckAfterWrite()) {
+				free(p.GetBufferStart());
+				return ERROR_BROKEN_STATE;
+			}
+			*saved = p.GetBufferStart();
+			*savedSize = saveSizeHint_ = p.Offset();
+			return ERROR_NONE;
+		}
+
 		PointerWrap p(&ptr, PointerWrap::MODE_MEASURE);
 		_class.DoState(p);
 		_assert_(p.error == PointerWrap::ERROR_NONE);
 
 		size_t measuredSize = p.Offset();
-		u8 *data;
-		if (*saved) {
-			data = *saved;
-		} else {
-			data = (u8 *)malloc(measuredSize);
-			if (!data)
-				return ERROR_BAD_ALLOC;
-		}
-
+		u8 *data = *saved;
 		p.RewindForWrite(data);
 		_class.DoState(p);
 
 		if (p.CheckAfterWrite()) {
-			*saved = data;
 			*savedSize = measuredSize;
 			return ERROR_NONE;
 		} else {
-			if (!*saved) {
-				free(data);
-			}
 			return ERROR_BROKEN_STATE;
 		}
 	}
 
 	// Duplicate of the above but takes and modifies a vector. Less invasive
 	// than modifying the rewind manager to keep things in something else than vectors.
+	// Saves in a single pass, reusing the vector's capacity from last time.
 	template<class T>
 	static Error MeasureAndSavePtr(T &_class, std::vector<u8> *saved)
 	{
 		u8 *ptr = nullptr;
-		PointerWrap p(&ptr, PointerWrap::MODE_MEASURE);
-		_class.DoState(p);
-		_assert_(p.error == PointerWrap::ERROR_NONE);
-
-		size_t measuredSize = p.Offset();
-		saved->resize(measuredSize);
-		u8 *data = saved->data();
-		p.RewindForWrite(data);
+		PointerWrap p(&ptr, PointerWrap::MODE_WRITE);
+		p.BeginGrowableWrite(saved);
 		_class.DoState(p);
+		p.EndGrowableWrite();
 		if (p.CheckAfterWrite()) {
 			return ERROR_NONE;
 		} else {
@@ -280,14 +322,18 @@ class CChunkFileReader
 	template<class T>
 	static Error Save(const Path &filename, const std::string &title, const char *gitVersion, T& _class)
 	{
-		u8 *buffer = nullptr;
-		size_t sz = 0;
-		Error error = MeasureAndSavePtr(_class, &buffer, &sz);
+		// The state is compressed and written out while it's being serialized.
+		StreamingSaveFile file;
+		Error error = file.Open(filename, title, gitVersion);
+		if (error != ERROR_NONE)
+			return error;
 
-		// SaveFile takes ownership of buffer (malloc/free)
-		if (error == ERROR_NONE)
-			error = SaveFile(filename, title, gitVersion, buffer, sz);
-		return error;
+		u8 *ptr = nullptr;
+		PointerWrap p(&ptr, PointerWrap::MODE_WRITE);
+		p.BeginStreamingWrite(&file);
+		_class.DoState(p);
+		p.EndGrowableWrite();
+		return file.Finish(p.CheckAfterWrite());
 	}
 
 	template <class T>
@@ -314,6 +360,9 @@ class CChunkFileReader
 		return ERROR_NONE;
 	}
 
+	// Compresses and writes out a state that was already serialized, for example by MeasureAndSavePtr.
+	static Error SaveFile(const Path &filename, const std::string &title, const char *gitVersion, const u8 *buffer, size_t sz);
+
 	static Error GetFileTitle(const Path &filename, std::string *title);
 
 private:
@@ -332,7 +381,48 @@ class CChunkFileReader
 		REVISION_CURRENT = REVISION_TITLE,
 	};
 
+	// Splits the state into independent zstd frames, which are compressed on the thread manager
+	// and written out in order. Any zstd decoder can read the result as a single stream, and
+	// LoadFile decompresses the frames in parallel.
+	class StreamingSaveFile : public PointerWrapSink {
+	public:
+		~StreamingSaveFile();
+
+		// Writes to a temporary file next to filename, which replaces it in Finish.
+		Error Open(const Path &filename, const std::string &title, const char *gitVersion);
+		// Waits for the remaining frames and fills in the header, then moves the file into place.
+		// On failure the temporary file is deleted, and any existing file is left alone.
+		Error Finish(bool success);
+
+		u8 *Allocate(size_t minSize, size_t *capacity) override;
+		void Write(u8 *buffer, size_t size) override;
+
+	private:
+		struct Frame;
+		friend class CChunkFileReader;
+		// The frames keep owner alive until they're compressed. It can be null if data outlives us.
+		void QueueFrames(const std::shared_ptr<u8> &owner, const u8 *data, size_t size);
+		void Compress(Frame *frame);
+		void WriteFrames(size_t maxPending);
+		bool WriteStoredFrame(const u8 *data, size_t size);
+
+		File::IOFile *file_ = nullptr;
+		Path filename_;
+		Path tempFilename_;
+		SChunkHeader header_{};
+		std::deque<Frame *> frames_;
+		size_t maxPending_ = 0;
+		size_t uncompressedSize_ = 0;
+		size_t compressedSize_ = 0;
+		bool failed_ = false;
+
+		std::mutex contextLock_;
+		std::vector<ZSTD_CCtx_s *> contexts_;
+	};
+
 	static Error LoadFile(const Path &filename, std::string *gitVersion, u8 *&buffer, size_t &sz, std::string *failureReason);
-	static Error SaveFile(const Path &filename, const std::string &title, const char *gitVersion, u8 *buffer, size_t sz);
 	static Error LoadFileHeader(File::IOFile &pFile, SChunkHeader &header, std::string *title);
+
+	// Size of the last single pass save, to start the next one with a buffer of the right size.
+	static size_t saveSizeHint_;
 };
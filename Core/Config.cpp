@@ -195,6 +195,14 @@ static bool DefaultEnableStateUndo() {
 	return true;
 }
 
+static int DefaultRewindBufferSize() {
+#if PPSSPP_PLATFORM(ANDROID) || PPSSPP_PLATFORM(IOS)
+	return 128;
+#else
+	return 512;
+#endif
+}
+
 static float DefaultGameGridScale() {
 #if PPSSPP_PLATFORM(IOS)
 	return 1.25f;
@@ -268,10 +276,14 @@ static const ConfigSetting generalSettings[] = {
 	ConfigSetting("StateSlot", SETTING(g_Config, iCurrentStateSlot), 0, CfgFlag::PER_GAME),
 	ConfigSetting("EnableStateUndo", SETTING(g_Config, bEnableStateUndo), &DefaultEnableStateUndo, CfgFlag::PER_GAME),
 	ConfigSetting("ConfirmLoadState", SETTING(g_Config, bConfirmLoadState), false, CfgFlag::DEFAULT),
+	ConfigSetting("SaveStatesInBackground", SETTING(g_Config, bSaveStatesInBackground), false, CfgFlag::DEFAULT),
 	ConfigSetting("StateLoadUndoGame", SETTING(g_Config, sStateLoadUndoGame), "NA", CfgFlag::DEFAULT),
 	ConfigSetting("StateUndoLastSaveGame", SETTING(g_Config, sStateUndoLastSaveGame), "NA", CfgFlag::DEFAULT),
 	ConfigSetting("StateUndoLastSaveSlot", SETTING(g_Config, iStateUndoLastSaveSlot), -5, CfgFlag::DEFAULT), // Start with an "invalid" value
 	ConfigSetting("RewindSnapshotInterval", SETTING(g_Config, iRewindSnapshotInterval), 0, CfgFlag::PER_GAME),
+	ConfigSetting("RewindEveryFrame", SETTING(g_Config, bRewindEveryFrame), false, CfgFlag::PER_GAME),
+	ConfigSetting("RewindBufferSizeMB", SETTING(g_Config, iRewindBufferSizeMB), &DefaultRewindBufferSize, CfgFlag::DEFAULT),
+	ConfigSetting("RunAheadFrames", SETTING(g_Config, iRunAheadFrames), 0, CfgFlag::PER_GAME),
 	ConfigSetting("SaveStateSlotCount", SETTING(g_Config, iSaveStateSlotCount), 5, CfgFlag::DEFAULT),
 
 	ConfigSetting("ShowRegionOnGameIcon", SETTING(g_Config, bShowRegionOnGameIcon), false, CfgFlag::DEFAULT),
@@ -296,6 +308,11 @@ static const ConfigSetting generalSettings[] = {
 	ConfigSetting("AutoSaveSymbolMap", SETTING(g_Config, bAutoSaveSymbolMap), false, CfgFlag::PER_GAME),
 	ConfigSetting("CompressSymbols", SETTING(g_Config, bCompressSymbols), true, CfgFlag::DEFAULT),
 	ConfigSetting("CacheFullIsoInRam", SETTING(g_Config, bCacheFullIsoInRam), false, CfgFlag::PER_GAME),
+	ConfigSetting("CSOFrameCacheSizeKB", SETTING(g_Config, iCSOFrameCacheSizeKB), 4096, CfgFlag::DEFAULT),
+	ConfigSetting("CHDHunkCacheSizeKB", SETTING(g_Config, iCHDHunkCacheSizeKB), 4096, CfgFlag::DEFAULT),
+	ConfigSetting("CHDReadaheadKB", SETTING(g_Config, iCHDReadaheadKB), 256, CfgFlag::DEFAULT),
+	ConfigSetting("DiscReadaheadProfile", SETTING(g_Config, bDiscReadaheadProfile), false, CfgFlag::DEFAULT),
+	ConfigSetting("MemoryMapDiscImages", SETTING(g_Config, bMemoryMapDiscImages), true, CfgFlag::DEFAULT),
 	ConfigSetting("RemoteISOPort", SETTING(g_Config, iRemoteISOPort), 0, CfgFlag::DEFAULT),
 	ConfigSetting("LastRemoteISOServer", SETTING(g_Config, sLastRemoteISOServer), "", CfgFlag::DEFAULT),
 	ConfigSetting("LastRemoteISOPort", SETTING(g_Config, iLastRemoteISOPort), 0, CfgFlag::DEFAULT),
@@ -407,6 +424,14 @@ static const ConfigSetting cpuSettings[] = {
 	ConfigSetting("HideSlowWarnings", SETTING(g_Config, bHideSlowWarnings), false, CfgFlag::DEFAULT),
 	ConfigSetting("HideStateWarnings", SETTING(g_Config, bHideStateWarnings), false, CfgFlag::DEFAULT),
 	ConfigSetting("JitDisableFlags", SETTING(g_Config, uJitDisableFlags), (uint32_t)0, CfgFlag::PER_GAME),
+	ConfigSetting("IRBlockDiskCache", SETTING(g_Config, bIRBlockDiskCache), true, CfgFlag::DEFAULT),
+	ConfigSetting("JitTierUpThreshold", SETTING(g_Config, iJitTierUpThreshold), 0, CfgFlag::PER_GAME),
+	ConfigSetting("JitBackgroundCompile", SETTING(g_Config, bJitBackgroundCompile), false, CfgFlag::PER_GAME),
+	ConfigSetting("JitTraces", SETTING(g_Config, bJitTraces), true, CfgFlag::PER_GAME),
+	ConfigSetting("IRThreadedDispatch", SETTING(g_Config, bIRThreadedDispatch), true, CfgFlag::DEFAULT),
+	ConfigSetting("JitInlineLeafFunctions", SETTING(g_Config, bJitInlineLeafFunctions), false, CfgFlag::PER_GAME),
+	ConfigSetting("JitPrewarm", SETTING(g_Config, bJitPrewarm), false, CfgFlag::PER_GAME),
+	ConfigSetting("JitStaticAllocX64", SETTING(g_Config, bJitStaticAllocX64), false, CfgFlag::PER_GAME),
 	ConfigSetting("CPUSpeed", SETTING(g_Config, iLockedCPUSpeed), 0, CfgFlag::PER_GAME | CfgFlag::REPORT),
 };
 
@@ -1133,6 +1158,7 @@ static const ConfigSetting debuggerSettings[] = {
 	ConfigSetting("FuncHashMap", SETTING(g_Config, bFuncHashMap), false, CfgFlag::DEFAULT),
 	ConfigSetting("SkipFuncHashMap", SETTING(g_Config, sSkipFuncHashMap), "", CfgFlag::DEFAULT),
 	ConfigSetting("MemInfoDetailed", SETTING(g_Config, bDebugMemInfoDetailed), false, CfgFlag::DEFAULT),
+	ConfigSetting("MemInfoAllocsOnly", SETTING(g_Config, bDebugMemInfoAllocsOnly), false, CfgFlag::DEFAULT),
 };
 
 static const ConfigSetting jitSettings[] = {
@@ -221,6 +221,14 @@ struct Config : public ConfigBlock {
 	bool bHideSlowWarnings;
 	bool bHideStateWarnings;
 	uint32_t uJitDisableFlags;
+	bool bIRBlockDiskCache;  // Hidden ini-only setting. Saves compiled IR blocks between runs.
+	int iJitTierUpThreshold;  // Hidden ini-only setting. IR jit blocks are interpreted this many times before compiling, 0 to always compile.
+	bool bJitBackgroundCompile;  // Hidden ini-only setting. IR jit blocks are interpreted while a worker thread compiles them.
+	bool bJitTraces;  // Hidden ini-only setting. In tiered mode, hot blocks are compiled together with their usual successors.
+	bool bIRThreadedDispatch;  // Hidden ini-only setting. The IR interpreter jumps directly between op handlers instead of using a switch.
+	bool bJitInlineLeafFunctions;  // Hidden ini-only setting, off by default until it has seen more testing. Short leaf functions are compiled into their callers' IR blocks.
+	bool bJitPrewarm;  // Hidden ini-only setting. Functions found at module load are compiled to IR on worker threads ahead of time.
+	bool bJitStaticAllocX64;  // Hidden ini-only setting. The x64 IR jit keeps a few hot MIPS registers in host registers across blocks.
 
 	bool bDisableHTTPS;
 
@@ -231,6 +239,11 @@ struct Config : public ConfigBlock {
 	bool bAutoSaveSymbolMap;
 	bool bCompressSymbols;
 	bool bCacheFullIsoInRam;
+	int iCSOFrameCacheSizeKB;  // Hidden ini-only setting. Size of the cache of decompressed CSO frames.
+	int iCHDHunkCacheSizeKB;  // Hidden ini-only setting. Size of the cache of decompressed CHD hunks.
+	int iCHDReadaheadKB;  // Hidden ini-only setting. How far past sequential reads CHD hunks are decompressed ahead of time, 0 to disable.
+	bool bDiscReadaheadProfile;  // Hidden ini-only setting. Records the order of disc reads per game, and prefetches in that order on later boots.
+	bool bMemoryMapDiscImages;  // Hidden ini-only setting. Reads local ISOs through a memory mapping where supported, and uses it instead of a RAM copy for CacheFullIsoInRam.
 	int iRemoteISOPort; // Also used for serving a local remote debugger.
 	std::string sLastRemoteISOServer;
 	int iLastRemoteISOPort;
@@ -341,9 +354,13 @@ struct Config : public ConfigBlock {
 	int iMaxRecent;
 	int iCurrentStateSlot;
 	int iRewindSnapshotInterval;
+	bool bRewindEveryFrame;
+	int iRewindBufferSizeMB;
+	int iRunAheadFrames;
 	bool bUISound;
 	bool bEnableStateUndo;
 	bool bConfirmLoadState;
+	bool bSaveStatesInBackground;
 	std::string sStateLoadUndoGame;
 	std::string sStateUndoLastSaveGame;
 	int iStateUndoLastSaveSlot;
@@ -645,6 +662,8 @@ struct Config : public ConfigBlock {
 	bool bFuncHashMap;
 	std::string sSkipFuncHashMap;
 	bool bDebugMemInfoDetailed;
+	// Skips write and texture tracking, only keeping allocations (unless a debugger wants detail.)
+	bool bDebugMemInfoAllocsOnly;
 
 	// Volatile development settings
 	// Overlays
@@ -82,6 +82,9 @@ struct CoreParameter {
 	// Freeze-frame. For nvidia perfhud profiling. Developers only.
 	bool freezeNext = false;
 	bool frozen = false;
+	// Set while loading a run-ahead state, which restores memory page by page instead of
+	// wholesale, so the jit and GPU caches can be kept.
+	bool keepCachesOnLoad = false;
 
 	FileLoader *mountIsoLoader = nullptr;
 	IdentifiedFileType fileType = IdentifiedFileType::UNKNOWN;
@@ -15,6 +15,7 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include <algorithm>
 #include <atomic>
 #include <climits>
 #include <cstdio>
@@ -25,6 +26,8 @@
 
 #include "Common/Profiler/Profiler.h"
 
+#include "Common/BitScan.h"
+
 #include "Common/Serialize/Serializer.h"
 #include "Common/Serialize/SerializeList.h"
 #include "Core/CoreTiming.h"
@@ -49,8 +52,64 @@ static std::set<int> usedEventTypes;
 static std::set<int> restoredEventTypes;
 static int nextEventTypeRestoreId = -1;
 
-static Event *first;
-static Event *eventPool = 0;
+// Pending events live in a pool of slots, and are queued in a hierarchical timing wheel with
+// a level per 12 bits of the time. Scheduling is an append to the bucket for the highest digit that
+// differs from the wheel's current time, and a bucket is only cascaded into the levels below once
+// it's the earliest and due, so every event moves a couple of times at most. The next few events
+// are taken out ahead into a small sorted list, which is where most rescheduled events land.
+// Events at the same time fire in the order they were scheduled, like the old sorted list.
+struct EventSlot {
+	BaseEvent ev;
+	u64 order;
+	// Intrusive hash chain by type and userdata, so events can be unscheduled without a search.
+	int prevInChain;
+	int nextInChain;
+	int nextInBucket;
+	bool queued;
+	// Unscheduled events are only marked, and dropped when they come up.
+	bool cancelled;
+};
+
+struct QueuedEvent {
+	s64 time;
+	int slot;
+};
+
+struct WheelBucket {
+	int head;
+	int tail;
+};
+
+enum {
+	WHEEL_BITS = 12,
+	WHEEL_LEVELS = (64 + WHEEL_BITS - 1) / WHEEL_BITS,
+	WHEEL_BUCKETS = 1 << WHEEL_BITS,
+	NEAR_EVENTS = 32,
+};
+
+static std::vector<EventSlot> eventSlots;
+static std::vector<int> freeSlots;
+// A bucket is only valid while its bit is set.
+static WheelBucket wheel[WHEEL_LEVELS][WHEEL_BUCKETS];
+static u64 wheelUsed[WHEEL_LEVELS][WHEEL_BUCKETS / 64];
+// Which words of wheelUsed have any bits set, per level, and which levels have any.
+static u64 wheelUsedWords[WHEEL_LEVELS];
+static u32 usedWheelLevels;
+// The last time taken out, or the start of the last bucket cascaded.
+static u64 wheelKey = 0x8000000000000000ULL;
+// Events scheduled before wheelKey, which happens when an earlier event shows up after the wheel
+// has moved on to the next one. There are usually few, so they go in a plain min-heap.
+static std::vector<QueuedEvent> lateEvents;
+// Heads of the hash chains. Always a power of two, and at least as many as slots.
+static std::vector<int> eventChains;
+// Number of pending events per type, for IsScheduled().
+static std::vector<int> eventTypeCounts;
+static int queuedEvents;
+static int cancelledEvents;
+static u64 nextEventOrder;
+// The earliest pending events, latest first, kept out of the wheel. With only a few pending,
+// this is all that's used, and firing and rescheduling is about as cheap as the old sorted list.
+static std::vector<QueuedEvent> nearEvents;
 
 // Downcount has been moved to currentMIPS, to save a couple of clocks in every ARM JIT block
 // as we can already reach that structure through a register.
@@ -105,28 +164,378 @@ u64 GetGlobalTimeUs() {
 	return lastGlobalTimeUs + usSinceLast;
 }
 
-const Event *GetFirstEvent() {
-	return first;
+static inline bool EventBefore(const QueuedEvent &a, const QueuedEvent &b) {
+	return a.time < b.time || (a.time == b.time && eventSlots[a.slot].order < eventSlots[b.slot].order);
 }
 
-const std::vector<EventType> &GetEventTypes() {
-	return event_types;
+static void LateSiftUp(int index) {
+	const QueuedEvent entry = lateEvents[index];
+	while (index > 0) {
+		int parent = (index - 1) / 2;
+		if (!EventBefore(entry, lateEvents[parent]))
+			break;
+		lateEvents[index] = lateEvents[parent];
+		index = parent;
+	}
+	lateEvents[index] = entry;
 }
 
-Event* GetNewEvent()
-{
-	if(!eventPool)
-		return new Event;
+static void LateSiftDown(int index) {
+	const int size = (int)lateEvents.size();
+	const QueuedEvent entry = lateEvents[index];
+	while (true) {
+		int child = index * 2 + 1;
+		if (child >= size)
+			break;
+		if (child + 1 < size && EventBefore(lateEvents[child + 1], lateEvents[child]))
+			child++;
+		if (!EventBefore(lateEvents[child], entry))
+			break;
+		lateEvents[index] = lateEvents[child];
+		index = child;
+	}
+	lateEvents[index] = entry;
+}
 
-	Event* ev = eventPool;
-	eventPool = ev->next;
-	return ev;
+static void LatePop() {
+	lateEvents[0] = lateEvents.back();
+	lateEvents.pop_back();
+	if (!lateEvents.empty())
+		LateSiftDown(0);
 }
 
-void FreeEvent(Event* ev)
-{
-	ev->next = eventPool;
-	eventPool = ev;
+// Flips the sign bit so that times sort as unsigned.
+static inline u64 EventKey(s64 time) {
+	return (u64)time ^ 0x8000000000000000ULL;
+}
+
+static inline s64 EventKeyTime(u64 key) {
+	return (s64)(key ^ 0x8000000000000000ULL);
+}
+
+static inline bool IsWheelBucketUsed(int level, int bucket) {
+	return (wheelUsed[level][bucket / 64] & (1ULL << (bucket & 63))) != 0;
+}
+
+// Only valid if the level has anything in it.
+static inline int LowestWheelBucket(int level) {
+	const int word = ctz64_nonzero(wheelUsedWords[level]);
+	return word * 64 + ctz64_nonzero(wheelUsed[level][word]);
+}
+
+static void ClearWheelBucket(int level, int bucket) {
+	u64 &used = wheelUsed[level][bucket / 64];
+	used &= ~(1ULL << (bucket & 63));
+	if (used == 0) {
+		wheelUsedWords[level] &= ~(1ULL << (bucket / 64));
+		if (wheelUsedWords[level] == 0)
+			usedWheelLevels &= ~(1U << level);
+	}
+}
+
+// Appends to the bucket, or puts it first if it's known to be before everything in it.
+static void WheelPush(int slot, u64 key, bool first = false) {
+	const int level = key == wheelKey ? 0 : (63 - clz64_nonzero(key ^ wheelKey)) / WHEEL_BITS;
+	const int bucket = (int)(key >> (level * WHEEL_BITS)) & (WHEEL_BUCKETS - 1);
+	WheelBucket &b = wheel[level][bucket];
+	u64 &used = wheelUsed[level][bucket / 64];
+	const u64 bit = 1ULL << (bucket & 63);
+	if (!(used & bit)) {
+		b.head = slot;
+		b.tail = slot;
+		eventSlots[slot].nextInBucket = -1;
+		used |= bit;
+		wheelUsedWords[level] |= 1ULL << (bucket / 64);
+		usedWheelLevels |= 1U << level;
+	} else if (first) {
+		eventSlots[slot].nextInBucket = b.head;
+		b.head = slot;
+	} else {
+		eventSlots[b.tail].nextInBucket = slot;
+		b.tail = slot;
+		eventSlots[slot].nextInBucket = -1;
+	}
+}
+
+static int WheelPopHead(int level, int bucket) {
+	WheelBucket &b = wheel[level][bucket];
+	const int slot = b.head;
+	b.head = eventSlots[slot].nextInBucket;
+	if (b.head == -1)
+		ClearWheelBucket(level, bucket);
+	return slot;
+}
+
+static void QueueEventSlot(int slot, bool first = false) {
+	const s64 time = eventSlots[slot].ev.time;
+	const u64 key = EventKey(time);
+	if (key < wheelKey) {
+		lateEvents.push_back(QueuedEvent{ time, slot });
+		LateSiftUp((int)lateEvents.size() - 1);
+	} else {
+		WheelPush(slot, key, first);
+	}
+}
+
+static inline u32 EventChain(int type, u64 userdata) {
+	u64 hash = (userdata ^ ((u64)(u32)type << 40)) * 0x9E3779B97F4A7C15ULL;
+	return (u32)(hash >> 32) & (u32)(eventChains.size() - 1);
+}
+
+static inline void CountEventType(int type, int diff) {
+	if (type >= 0) {
+		if (type >= (int)eventTypeCounts.size())
+			eventTypeCounts.resize(type + 1);
+		eventTypeCounts[type] += diff;
+	}
+}
+
+static void LinkEventSlot(int slot) {
+	EventSlot &es = eventSlots[slot];
+	int &head = eventChains[EventChain(es.ev.type, es.ev.userdata)];
+	es.prevInChain = -1;
+	es.nextInChain = head;
+	if (head != -1)
+		eventSlots[head].prevInChain = slot;
+	head = slot;
+}
+
+static void UnlinkEventSlot(int slot) {
+	EventSlot &es = eventSlots[slot];
+	if (es.nextInChain != -1)
+		eventSlots[es.nextInChain].prevInChain = es.prevInChain;
+	if (es.prevInChain != -1)
+		eventSlots[es.prevInChain].nextInChain = es.nextInChain;
+	else
+		eventChains[EventChain(es.ev.type, es.ev.userdata)] = es.nextInChain;
+}
+
+static void RehashEvents(size_t chains) {
+	eventChains.assign(chains, -1);
+	for (int slot = 0; slot < (int)eventSlots.size(); ++slot) {
+		if (eventSlots[slot].queued && !eventSlots[slot].cancelled)
+			LinkEventSlot(slot);
+	}
+}
+
+static void ReleaseEventSlot(int slot) {
+	EventSlot &es = eventSlots[slot];
+	if (es.cancelled)
+		cancelledEvents--;
+	else
+		CountEventType(es.ev.type, -1);
+	es.queued = false;
+	queuedEvents--;
+	freeSlots.push_back(slot);
+}
+
+// Moves a bucket down into the levels below, starting the wheel at its first possible time.
+static void CascadeWheelBucket(int level, int bucket) {
+	const int shift = level * WHEEL_BITS;
+	const u64 above = level == WHEEL_LEVELS - 1 ? 0 : wheelKey & (~0ULL << (shift + WHEEL_BITS));
+	int slot = wheel[level][bucket].head;
+	ClearWheelBucket(level, bucket);
+	wheelKey = above | ((u64)bucket << shift);
+	while (slot != -1) {
+		const int next = eventSlots[slot].nextInBucket;
+		if (eventSlots[slot].cancelled)
+			ReleaseEventSlot(slot);
+		else
+			WheelPush(slot, EventKey(eventSlots[slot].ev.time));
+		slot = next;
+	}
+}
+
+// Takes the earliest event out of the late events and the wheel, or returns -1 if there are none.
+static int TakeQueuedEvent() {
+	while (!lateEvents.empty()) {
+		const int slot = lateEvents[0].slot;
+		LatePop();
+		if (!eventSlots[slot].cancelled)
+			return slot;
+		ReleaseEventSlot(slot);
+	}
+
+	while (usedWheelLevels != 0) {
+		const int level = ctz64_nonzero(usedWheelLevels);
+		const int bucket = LowestWheelBucket(level);
+		if (level != 0) {
+			CascadeWheelBucket(level, bucket);
+			continue;
+		}
+
+		const int slot = WheelPopHead(0, bucket);
+		wheelKey = (wheelKey & ~(u64)(WHEEL_BUCKETS - 1)) | (u64)bucket;
+		if (!eventSlots[slot].cancelled)
+			return slot;
+		ReleaseEventSlot(slot);
+	}
+	return -1;
+}
+
+static void CancelEventSlot(int slot) {
+	EventSlot &es = eventSlots[slot];
+	UnlinkEventSlot(slot);
+	CountEventType(es.ev.type, -1);
+	es.cancelled = true;
+	cancelledEvents++;
+}
+
+static inline bool HasQueuedEvents() {
+	return usedWheelLevels != 0 || !lateEvents.empty();
+}
+
+static void InsertNearEvent(const QueuedEvent &entry) {
+	// Goes before anything at the same time, since those fire first.
+	auto it = nearEvents.begin();
+	while (it != nearEvents.end() && it->time > entry.time)
+		++it;
+	nearEvents.insert(it, entry);
+
+	if (nearEvents.size() > NEAR_EVENTS) {
+		// The latest is still before everything queued, so it goes back first in line.
+		QueueEventSlot(nearEvents.front().slot, true);
+		nearEvents.erase(nearEvents.begin());
+	}
+}
+
+// Returns the earliest pending event, leaving it at the back of nearEvents, or -1 if none.
+static int NextEventSlot() {
+	while (true) {
+		if (nearEvents.empty()) {
+			while (nearEvents.size() < NEAR_EVENTS) {
+				const int slot = TakeQueuedEvent();
+				if (slot == -1)
+					break;
+				nearEvents.push_back(QueuedEvent{ eventSlots[slot].ev.time, slot });
+			}
+			if (nearEvents.empty())
+				return -1;
+			std::reverse(nearEvents.begin(), nearEvents.end());
+		}
+
+		const int slot = nearEvents.back().slot;
+		if (!eventSlots[slot].cancelled)
+			return slot;
+		ReleaseEventSlot(slot);
+		nearEvents.pop_back();
+	}
+}
+
+static bool NextEventTime(s64 *time) {
+	const int slot = NextEventSlot();
+	if (slot == -1)
+		return false;
+	*time = eventSlots[slot].ev.time;
+	return true;
+}
+
+// Takes out the earliest event if it's due by now, and returns its slot, or -1.
+// The slot stays valid until the next event is scheduled.
+static int TakeDueEvent(s64 now) {
+	const int slot = NextEventSlot();
+	if (slot == -1 || eventSlots[slot].ev.time > now)
+		return -1;
+	nearEvents.pop_back();
+	UnlinkEventSlot(slot);
+	ReleaseEventSlot(slot);
+	return slot;
+}
+
+// Gets rid of cancelled events all at once, when they make up most of the queue.
+static void CompactEvents() {
+	for (int level = 0; level < WHEEL_LEVELS; ++level) {
+		if (!(usedWheelLevels & (1U << level)))
+			continue;
+		for (int bucket = 0; bucket < WHEEL_BUCKETS; ++bucket) {
+			if (!IsWheelBucketUsed(level, bucket))
+				continue;
+			// Rebuilding it in place keeps the order.
+			int slot = wheel[level][bucket].head;
+			ClearWheelBucket(level, bucket);
+			while (slot != -1) {
+				const int next = eventSlots[slot].nextInBucket;
+				if (eventSlots[slot].cancelled)
+					ReleaseEventSlot(slot);
+				else
+					WheelPush(slot, EventKey(eventSlots[slot].ev.time));
+				slot = next;
+			}
+		}
+	}
+
+	size_t count = 0;
+	for (const QueuedEvent &entry : lateEvents) {
+		if (eventSlots[entry.slot].cancelled)
+			ReleaseEventSlot(entry.slot);
+		else
+			lateEvents[count++] = entry;
+	}
+	lateEvents.resize(count);
+	for (int i = (int)count / 2 - 1; i >= 0; --i)
+		LateSiftDown(i);
+
+	count = 0;
+	for (const QueuedEvent &entry : nearEvents) {
+		if (eventSlots[entry.slot].cancelled)
+			ReleaseEventSlot(entry.slot);
+		else
+			nearEvents[count++] = entry;
+	}
+	nearEvents.resize(count);
+}
+
+static void AddEvent(const BaseEvent &ev) {
+	if (cancelledEvents > 32 && cancelledEvents > queuedEvents / 2)
+		CompactEvents();
+
+	int slot;
+	if (!freeSlots.empty()) {
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+	} else {
+		slot = (int)eventSlots.size();
+		eventSlots.push_back(EventSlot{});
+	}
+
+	EventSlot &es = eventSlots[slot];
+	es.ev = ev;
+	es.order = nextEventOrder++;
+	es.queued = true;
+	es.cancelled = false;
+	queuedEvents++;
+	CountEventType(ev.type, 1);
+	// With nothing queued, or if it's before the latest near event, it belongs with them.
+	if (!HasQueuedEvents() || (!nearEvents.empty() && ev.time < nearEvents.front().time))
+		InsertNearEvent(QueuedEvent{ ev.time, slot });
+	else
+		QueueEventSlot(slot);
+
+	if (eventSlots.size() > eventChains.size())
+		RehashEvents(std::max((size_t)64, eventChains.size() * 2));
+	else
+		LinkEventSlot(slot);
+}
+
+std::vector<BaseEvent> GetPendingEvents() {
+	std::vector<QueuedEvent> sorted;
+	sorted.reserve(queuedEvents);
+	for (int slot = 0; slot < (int)eventSlots.size(); ++slot) {
+		const EventSlot &es = eventSlots[slot];
+		if (es.queued && !es.cancelled)
+			sorted.push_back(QueuedEvent{ es.ev.time, slot });
+	}
+	std::sort(sorted.begin(), sorted.end(), EventBefore);
+
+	std::vector<BaseEvent> events;
+	events.reserve(sorted.size());
+	for (const QueuedEvent &entry : sorted)
+		events.push_back(eventSlots[entry.slot].ev);
+	return events;
+}
+
+const std::vector<EventType> &GetEventTypes() {
+	return event_types;
 }
 
 int RegisterEvent(const char *name, TimedCallback callback) {
@@ -172,7 +581,7 @@ void RestoreRegisterEvent(int &event_type, const char *name, TimedCallback callb
 }
 
 void UnregisterAllEvents() {
-	_dbg_assert_msg_(first == nullptr, "Unregistering events with events pending - this isn't good.");
+	_dbg_assert_msg_(queuedEvents == 0, "Unregistering events with events pending - this isn't good.");
 	event_types.clear();
 	usedEventTypes.clear();
 	restoredEventTypes.clear();
@@ -194,11 +603,14 @@ void Shutdown()
 	ClearPendingEvents();
 	UnregisterAllEvents();
 
-	while (eventPool) {
-		Event *ev = eventPool;
-		eventPool = ev->next;
-		delete ev;
-	}
+	eventSlots.clear();
+	eventSlots.shrink_to_fit();
+	freeSlots.clear();
+	freeSlots.shrink_to_fit();
+	lateEvents.shrink_to_fit();
+	nearEvents.shrink_to_fit();
+	eventChains.clear();
+	eventChains.shrink_to_fit();
 }
  
 u64 GetTicks()
@@ -218,30 +630,22 @@ u64 GetIdleTicks()
 
 void ClearPendingEvents()
 {
-	while (first)
-	{
-		Event *e = first->next;
-		FreeEvent(first);
-		first = e;
-	}
-}
-
-void AddEventToQueue(Event* ne)
-{
-	Event* prev = NULL;
-	Event** pNext = &first;
-	for(;;)
-	{
-		Event*& next = *pNext;
-		if(!next || ne->time < next->time)
-		{
-			ne->next = next;
-			next = ne;
-			break;
-		}
-		prev = next;
-		pNext = &prev->next;
+	freeSlots.clear();
+	for (int slot = (int)eventSlots.size() - 1; slot >= 0; --slot) {
+		eventSlots[slot].queued = false;
+		freeSlots.push_back(slot);
 	}
+	memset(wheelUsed, 0, sizeof(wheelUsed));
+	memset(wheelUsedWords, 0, sizeof(wheelUsedWords));
+	usedWheelLevels = 0;
+	wheelKey = EventKey(0);
+	lateEvents.clear();
+	nearEvents.clear();
+	std::fill(eventChains.begin(), eventChains.end(), -1);
+	eventTypeCounts.clear();
+	queuedEvents = 0;
+	cancelledEvents = 0;
+	nextEventOrder = 0;
 }
 
 // This must be run ONLY from within the cpu thread
@@ -249,123 +653,67 @@ void AddEventToQueue(Event* ne)
 // than Advance
 void ScheduleEvent(s64 cyclesIntoFuture, int event_type, u64 userdata)
 {
-	Event *ne = GetNewEvent();
-	ne->userdata = userdata;
-	ne->type = event_type;
-	ne->time = GetTicks() + cyclesIntoFuture;
-	AddEventToQueue(ne);
+	BaseEvent ev;
+	ev.time = GetTicks() + cyclesIntoFuture;
+	ev.userdata = userdata;
+	ev.type = event_type;
+	AddEvent(ev);
 }
 
 // Returns cycles left in timer.
 s64 UnscheduleEvent(int event_type, u64 userdata)
 {
-	s64 result = 0;
-	if (!first)
-		return result;
-	while(first)
-	{
-		if (first->type == event_type && first->userdata == userdata)
-		{
-			result = first->time - GetTicks();
-
-			Event *next = first->next;
-			FreeEvent(first);
-			first = next;
-		}
-		else
-		{
-			break;
-		}
-	}
-	if (!first)
-		return result;
-	Event *prev = first;
-	Event *ptr = prev->next;
-	while (ptr)
-	{
-		if (ptr->type == event_type && ptr->userdata == userdata)
-		{
-			result = ptr->time - GetTicks();
-
-			prev->next = ptr->next;
-			FreeEvent(ptr);
-			ptr = prev->next;
-		}
-		else
-		{
-			prev = ptr;
-			ptr = ptr->next;
+	if (eventChains.empty())
+		return 0;
+
+	// If there are several, the result is from the one that would've fired last.
+	bool found = false;
+	s64 lastTime = 0;
+	int slot = eventChains[EventChain(event_type, userdata)];
+	while (slot != -1) {
+		const EventSlot &es = eventSlots[slot];
+		const int next = es.nextInChain;
+		if (es.ev.type == event_type && es.ev.userdata == userdata) {
+			if (!found || es.ev.time > lastTime)
+				lastTime = es.ev.time;
+			found = true;
+			CancelEventSlot(slot);
 		}
+		slot = next;
 	}
-
-	return result;
+	return found ? lastTime - GetTicks() : 0;
 }
 
 bool IsScheduled(int event_type) {
-	if (!first)
-		return false;
-	Event *e = first;
-	while (e) {
-		if (e->type == event_type)
-			return true;
-		e = e->next;
-	}
-	return false;
+	return event_type >= 0 && event_type < (int)eventTypeCounts.size() && eventTypeCounts[event_type] != 0;
 }
 
 void RemoveEvent(int event_type)
 {
-	if (!first)
+	if (!IsScheduled(event_type))
 		return;
-	while(first)
-	{
-		if (first->type == event_type)
-		{
-			Event *next = first->next;
-			FreeEvent(first);
-			first = next;
-		}
-		else
-		{
-			break;
-		}
-	}
-	if (!first)
-		return;
-	Event *prev = first;
-	Event *ptr = prev->next;
-	while (ptr)
-	{
-		if (ptr->type == event_type)
-		{
-			prev->next = ptr->next;
-			FreeEvent(ptr);
-			ptr = prev->next;
-		}
-		else
-		{
-			prev = ptr;
-			ptr = ptr->next;
-		}
+	for (int slot = 0; slot < (int)eventSlots.size(); ++slot) {
+		const EventSlot &es = eventSlots[slot];
+		if (es.queued && !es.cancelled && es.ev.type == event_type)
+			CancelEventSlot(slot);
 	}
 }
 
 void ProcessEvents() {
-	while (first) {
-		if (first->time <= (s64)GetTicks()) {
-			// INFO_LOG(Log::CPU, "%s (%lld, %lld) ", first->name ? first->name : "?", (u64)GetTicks(), (u64)first->time);
-			Event *evt = first;
-			first = first->next;
-			if (evt->type >= 0 && evt->type < event_types.size()) {
-				event_types[evt->type].callback(evt->userdata, (int)(GetTicks() - evt->time));
-			} else {
-				_dbg_assert_msg_(false, "Bad event type %d", evt->type);
-			}
-			FreeEvent(evt);
-		} else {
+	while (true) {
+		const int slot = TakeDueEvent((s64)GetTicks());
+		if (slot == -1) {
 			// Caught up to the current time.
 			break;
 		}
+		// INFO_LOG(Log::CPU, "%s (%lld, %lld) ", first->name ? first->name : "?", (u64)GetTicks(), (u64)first->time);
+		// It's already out of the queue, since the callback may well schedule new events.
+		const BaseEvent evt = eventSlots[slot].ev;
+		if (evt.type >= 0 && evt.type < event_types.size()) {
+			event_types[evt.type].callback(evt.userdata, (int)(GetTicks() - evt.time));
+		} else {
+			_dbg_assert_msg_(false, "Bad event type %d", evt.type);
+		}
 	}
 }
 
@@ -391,7 +739,8 @@ void Advance() {
 
 	ProcessEvents();
 
-	if (!first) {
+	s64 firstTime;
+	if (!NextEventTime(&firstTime)) {
 		// This should never happen in PPSSPP.
 		if (slicelength < 10000) {
 			slicelength += 10000;
@@ -399,7 +748,7 @@ void Advance() {
 		}
 	} else {
 		// Note that events can eat cycles as well.
-		int target = (int)(first->time - globalTimer);
+		int target = (int)(firstTime - globalTimer);
 		if (target > MAX_SLICE_LENGTH)
 			target = MAX_SLICE_LENGTH;
 
@@ -410,10 +759,8 @@ void Advance() {
 }
 
 void LogPendingEvents() {
-	Event *ptr = first;
-	while (ptr) {
-		//INFO_LOG(Log::CPU, "PENDING: Now: %lld Pending: %lld Type: %d", globalTimer, ptr->time, ptr->type);
-		ptr = ptr->next;
+	for (const BaseEvent &ev : GetPendingEvents()) {
+		DEBUG_LOG(Log::CPU, "PENDING: Now: %lld Pending: %lld Type: %d", (long long)globalTimer, (long long)ev.time, ev.type);
 	}
 }
 
@@ -422,9 +769,10 @@ void Idle(int maxIdle) {
 	if (maxIdle != 0 && cyclesDown > maxIdle)
 		cyclesDown = maxIdle;
 
-	if (first && cyclesDown > 0) {
+	s64 firstTime;
+	if (NextEventTime(&firstTime) && cyclesDown > 0) {
 		int cyclesExecuted = slicelength - currentMIPS->downcount;
-		int cyclesNextEvent = (int) (first->time - globalTimer);
+		int cyclesNextEvent = (int) (firstTime - globalTimer);
 
 		if (cyclesNextEvent < cyclesExecuted + cyclesDown)
 			cyclesDown = cyclesNextEvent - cyclesExecuted;
@@ -443,23 +791,20 @@ void Idle(int maxIdle) {
 }
 
 std::string GetScheduledEventsSummary() {
-	Event *ptr = first;
 	std::string text = "Scheduled events\n";
 	text.reserve(1000);
-	while (ptr) {
-		unsigned int t = ptr->type;
+	for (const BaseEvent &ev : GetPendingEvents()) {
+		unsigned int t = ev.type;
 		if (t >= event_types.size()) {
 			_dbg_assert_msg_(false, "Invalid event type %d", t);
-			ptr = ptr->next;
 			continue;
 		}
 		const char *name = event_types[t].name;
 		if (!name)
 			name = "[unknown]";
 		char temp[512];
-		snprintf(temp, sizeof(temp), "%s : %i %08x%08x\n", name, (int)ptr->time, (u32)(ptr->userdata >> 32), (u32)(ptr->userdata));
+		snprintf(temp, sizeof(temp), "%s : %i %08x%08x\n", name, (int)ev.time, (u32)(ev.userdata >> 32), (u32)(ev.userdata));
 		text += temp;
-		ptr = ptr->next;
 	}
 	return text;
 }
@@ -477,6 +822,36 @@ void Event_DoStateOld(PointerWrap &p, BaseEvent *ev) {
 	usedEventTypes.insert(ev->type);
 }
 
+// Same format as DoLinkedList() used to write: a 1 marker before each event, in firing order, then a 0.
+static void DoEventQueue(PointerWrap &p, void (*doEvent)(PointerWrap &, BaseEvent *)) {
+	if (p.mode == PointerWrap::MODE_READ) {
+		ClearPendingEvents();
+		while (true) {
+			u8 shouldExist = 0;
+			Do(p, shouldExist);
+			if (shouldExist != 1) {
+				if (shouldExist != 0) {
+					WARN_LOG(Log::SaveState, "Savestate failure: incorrect item marker %d", shouldExist);
+					p.SetError(p.ERROR_FAILURE);
+				}
+				break;
+			}
+			BaseEvent ev{};
+			doEvent(p, &ev);
+			// Loaded in order, so equal times keep their order too.
+			AddEvent(ev);
+		}
+	} else {
+		for (BaseEvent ev : GetPendingEvents()) {
+			u8 shouldExist = 1;
+			Do(p, shouldExist);
+			doEvent(p, &ev);
+		}
+		u8 shouldExist = 0;
+		Do(p, shouldExist);
+	}
+}
+
 void DoState(PointerWrap &p) {
 	auto s = p.Section("CoreTiming", 1, 3);
 	if (!s)
@@ -500,14 +875,9 @@ void DoState(PointerWrap &p) {
 	usedEventTypes.clear();
 	restoredEventTypes.clear();
 
-	if (s >= 3) {
-		DoLinkedList<BaseEvent, GetNewEvent, FreeEvent, Event_DoState>(p, first, (Event **)nullptr);
-		// This is here because we previously stored a second queue of "threadsafe" events. Gone now. Remove in the next section version upgrade.
-		DoIgnoreUnusedLinkedList(p);
-	} else {
-		DoLinkedList<BaseEvent, GetNewEvent, FreeEvent, Event_DoStateOld>(p, first, (Event **)nullptr);
-		DoIgnoreUnusedLinkedList(p);
-	}
+	DoEventQueue(p, s >= 3 ? &Event_DoState : &Event_DoStateOld);
+	// This is here because we previously stored a second queue of "threadsafe" events. Gone now. Remove in the next section version upgrade.
+	DoIgnoreUnusedLinkedList(p);
 
 	Do(p, CPU_HZ);
 	Do(p, slicelength);
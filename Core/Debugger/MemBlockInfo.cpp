@@ -18,9 +18,12 @@
 #include <algorithm>
 #include <atomic>
 #include <cstring>
+#include <map>
 #include <mutex>
 #include <condition_variable>
+#include <string>
 #include <thread>
+#include <unordered_set>
 
 #include "Common/Log.h"
 #include "Common/Serialize/Serializer.h"
@@ -44,6 +47,7 @@ class MemSlabMap {
 	const char *FastFindWriteTag(MemBlockFlags flags, uint32_t addr, uint32_t size);
 	void Reset();
 	void DoState(PointerWrap &p);
+	void CollectTags(std::unordered_set<const char *> &tags) const;
 
 private:
 	struct Slab {
@@ -54,7 +58,8 @@ class MemSlabMap {
 		bool allocated = false;
 		// Intentionally not save stated.
 		bool bulkStorage = false;
-		char tag[128]{};
+		// Interned, so equal tags are equal pointers.
+		const char *tag = "";
 		Slab *prev = nullptr;
 		Slab *next = nullptr;
 
@@ -62,8 +67,6 @@ class MemSlabMap {
 	};
 
 	static constexpr uint32_t MAX_SIZE = 0x40000000;
-	static constexpr uint32_t SLICES = 65536;
-	static constexpr uint32_t SLICE_SIZE = MAX_SIZE / SLICES;
 
 	Slab *FindSlab(uint32_t addr);
 	void Clear();
@@ -72,11 +75,11 @@ class MemSlabMap {
 	void MergeAdjacent(Slab *slab);
 	static inline bool Same(const Slab *a, const Slab *b);
 	void Merge(Slab *a, Slab *b);
-	void FillHeads(Slab *slab);
 
 	Slab *first_ = nullptr;
 	Slab *lastFind_ = nullptr;
-	std::vector<Slab *> heads_;
+	// Slabs never overlap, so an index by start address finds the one covering any address.
+	std::map<uint32_t, Slab *> index_;
 	Slab *bulkStorage_ = nullptr;
 };
 
@@ -113,6 +116,25 @@ static std::atomic<bool> flushThreadPending;
 static std::mutex flushLock;
 static std::condition_variable flushCond;
 
+// Tags repeat a lot (and used to be copied on every split), so slabs share interned copies.
+static std::mutex tagPoolLock;
+static std::unordered_set<std::string> tagPool;
+static const char *lastInternedTag = "";
+static size_t tagPoolCompactSize = 4096;
+
+static const char *InternMemTag(const char *tag) {
+	if (tag[0] == '\0')
+		return "";
+
+	std::lock_guard<std::mutex> guard(tagPoolLock);
+	// Batches are usually runs of the same tag.
+	if (strcmp(lastInternedTag, tag) == 0)
+		return lastInternedTag;
+	std::string str(tag, strnlen(tag, 127));
+	lastInternedTag = tagPool.insert(std::move(str)).first->c_str();
+	return lastInternedTag;
+}
+
 MemSlabMap::MemSlabMap() {
 	Reset();
 }
@@ -125,6 +147,7 @@ bool MemSlabMap::Mark(uint32_t addr, uint32_t size, uint64_t ticks, uint32_t pc,
 	uint32_t end = addr + size;
 	Slab *slab = FindSlab(addr);
 	Slab *firstMatch = nullptr;
+	const char *internedTag = tag ? InternMemTag(tag) : nullptr;
 	while (slab != nullptr && slab->start < end) {
 		if (slab->start < addr)
 			slab = Split(slab, addr - slab->start);
@@ -138,8 +161,8 @@ bool MemSlabMap::Mark(uint32_t addr, uint32_t size, uint64_t ticks, uint32_t pc,
 			slab->ticks = ticks;
 			slab->pc = pc;
 		}
-		if (tag)
-			truncate_cpy(slab->tag, tag);
+		if (internedTag)
+			slab->tag = internedTag;
 
 		// Move on to the next one.
 		if (firstMatch == nullptr)
@@ -188,7 +211,12 @@ void MemSlabMap::Reset() {
 	first_->end = MAX_SIZE;
 	lastFind_ = first_;
 
-	heads_.resize(SLICES, first_);
+	index_[first_->start] = first_;
+}
+
+void MemSlabMap::CollectTags(std::unordered_set<const char *> &tags) const {
+	for (const Slab *slab = first_; slab != nullptr; slab = slab->next)
+		tags.insert(slab->tag);
 }
 
 void MemSlabMap::DoState(PointerWrap &p) {
@@ -198,18 +226,18 @@ void MemSlabMap::DoState(PointerWrap &p) {
 
 	int count = 0;
 	if (p.mode == p.MODE_READ) {
-		// Since heads_ is a static size, let's avoid clearing it.
-		// This helps in case a debugger call happens concurrently.
 		Slab *old = first_;
 		Slab *oldBulk = bulkStorage_;
 		Do(p, count);
 
+		// Build the new index on the side and swap it in at the end.
+		std::map<uint32_t, Slab *> index;
 		first_ = new Slab();
 		first_->DoState(p);
 		lastFind_ = first_;
 		--count;
 
-		FillHeads(first_);
+		index.emplace(first_->start, first_);
 
 		bulkStorage_ = new Slab[count];
 
@@ -222,8 +250,9 @@ void MemSlabMap::DoState(PointerWrap &p) {
 			slab->next->prev = slab;
 			slab = slab->next;
 
-			FillHeads(slab);
+			index.emplace_hint(index.end(), slab->start, slab);
 		}
+		index_.swap(index);
 
 		// Now that it's entirely disconnected, delete the old slabs.
 		while (old != nullptr) {
@@ -261,16 +290,24 @@ void MemSlabMap::Slab::DoState(PointerWrap &p) {
 	Do(p, ticks);
 	Do(p, pc);
 	Do(p, allocated);
+	// The tag is still stored as a fixed buffer, so the format doesn't change.
+	char tagBuf[128]{};
+	if (p.mode != PointerWrap::MODE_READ)
+		truncate_cpy(tagBuf, tag);
 	if (s >= 3) {
-		Do(p, tag);
+		Do(p, tagBuf);
 	} else if (s >= 2) {
 		char shortTag[32];
 		Do(p, shortTag);
-		memcpy(tag, shortTag, sizeof(shortTag));
+		memcpy(tagBuf, shortTag, sizeof(shortTag));
 	} else {
 		std::string stringTag;
 		Do(p, stringTag);
-		truncate_cpy(tag, stringTag);
+		truncate_cpy(tagBuf, stringTag);
+	}
+	if (p.mode == PointerWrap::MODE_READ) {
+		tagBuf[sizeof(tagBuf) - 1] = '\0';
+		tag = InternMemTag(tagBuf);
 	}
 }
 
@@ -286,22 +323,28 @@ void MemSlabMap::Clear() {
 	bulkStorage_ = nullptr;
 	first_ = nullptr;
 	lastFind_ = nullptr;
-	heads_.clear();
+	index_.clear();
 }
 
 MemSlabMap::Slab *MemSlabMap::FindSlab(uint32_t addr) {
-	// Jump ahead using our index.
-	Slab *slab = heads_[addr / SLICE_SIZE];
-	// We often move forward, so check the last find.
-	if (lastFind_->start > slab->start && lastFind_->start <= addr)
-		slab = lastFind_;
-
-	while (slab != nullptr && slab->start <= addr) {
-		if (slab->end > addr) {
-			lastFind_ = slab;
+	// We often hit the same or the next slab, check the last find first.
+	Slab *slab = lastFind_;
+	if (slab != nullptr && slab->start <= addr) {
+		if (slab->end > addr)
 			return slab;
+		if (slab->next != nullptr && slab->next->end > addr) {
+			lastFind_ = slab->next;
+			return slab->next;
 		}
-		slab = slab->next;
+	}
+
+	auto it = index_.upper_bound(addr);
+	if (it == index_.begin())
+		return nullptr;
+	slab = std::prev(it)->second;
+	if (slab->end > addr) {
+		lastFind_ = slab;
+		return slab;
 	}
 	return nullptr;
 }
@@ -313,7 +356,7 @@ MemSlabMap::Slab *MemSlabMap::Split(Slab *slab, uint32_t size) {
 	next->ticks = slab->ticks;
 	next->pc = slab->pc;
 	next->allocated = slab->allocated;
-	truncate_cpy(next->tag, slab->tag);
+	next->tag = slab->tag;
 	next->prev = slab;
 	next->next = slab->next;
 
@@ -321,8 +364,7 @@ MemSlabMap::Slab *MemSlabMap::Split(Slab *slab, uint32_t size) {
 	if (next->next)
 		next->next->prev = next;
 
-	// If the split is big, we might have to update our index.
-	FillHeads(next);
+	index_.emplace(next->start, next);
 
 	slab->end = slab->start + size;
 	return next;
@@ -333,7 +375,7 @@ bool MemSlabMap::Same(const Slab *a, const Slab *b) {
 		return false;
 	if (a->pc != b->pc)
 		return false;
-	if (strcmp(a->tag, b->tag))
+	if (a->tag != b->tag)
 		return false;
 	return true;
 }
@@ -352,13 +394,16 @@ void MemSlabMap::Merge(Slab *a, Slab *b) {
 		_assert_(a->end == b->start);
 		a->end = b->end;
 		a->next = b->next;
+		index_.erase(b->start);
 
 		if (a->next)
 			a->next->prev = a;
 	} else if (a->prev == b) {
 		_assert_(b->end == a->start);
+		index_.erase(a->start);
 		a->start = b->start;
 		a->prev = b->prev;
+		index_[a->start] = a;
 
 		if (a->prev)
 			a->prev->next = a;
@@ -367,8 +412,6 @@ void MemSlabMap::Merge(Slab *a, Slab *b) {
 	} else {
 		_assert_(false);
 	}
-	// Take over index entries b had.
-	FillHeads(a);
 	if (b->ticks > a->ticks) {
 		a->ticks = b->ticks;
 		// In case we ignore PC for same.
@@ -380,35 +423,41 @@ void MemSlabMap::Merge(Slab *a, Slab *b) {
 		delete b;
 }
 
-void MemSlabMap::FillHeads(Slab *slab) {
-	uint32_t slice = slab->start / SLICE_SIZE;
-	uint32_t endSlice = (slab->end - 1) / SLICE_SIZE;
+size_t FormatMemWriteTagAtNoFlush(char *buf, size_t sz, const char *prefix, uint32_t start, uint32_t size);
 
-	// For the first slice, only replace if it's the one we're removing.
-	if (slab->start == slice * SLICE_SIZE) {
-		heads_[slice] = slab;
-	}
+// Drops interned tags that no slab uses anymore.  Call with pendingReadMutex held.
+static void CompactMemTags() {
+	std::lock_guard<std::mutex> guard(tagPoolLock);
+	if (tagPool.size() < tagPoolCompactSize)
+		return;
 
-	// Now replace all the rest - we definitely cover the start of them.
-	Slab **next = &heads_[slice + 1];
-	// We want to set slice + 1 through endSlice, inclusive.
-	size_t c = endSlice - slice;
-	for (size_t i = 0; i < c; ++i) {
-		next[i] = slab;
+	std::unordered_set<const char *> used;
+	allocMap.CollectTags(used);
+	suballocMap.CollectTags(used);
+	writeMap.CollectTags(used);
+	textureMap.CollectTags(used);
+
+	for (auto it = tagPool.begin(); it != tagPool.end(); ) {
+		if (used.count(it->c_str()) == 0)
+			it = tagPool.erase(it);
+		else
+			++it;
 	}
+	lastInternedTag = "";
+	tagPoolCompactSize = std::max((size_t)4096, tagPool.size() * 2);
 }
 
-size_t FormatMemWriteTagAtNoFlush(char *buf, size_t sz, const char *prefix, uint32_t start, uint32_t size);
-
 void FlushPendingMemInfo() {
 	// This lock prevents us from another thread reading while we're busy flushing.
 	std::lock_guard<std::mutex> guard(pendingReadMutex);
-	std::vector<PendingNotifyMem> thisBatch;
+	// Swap buffers rather than reallocating, both keep their capacity.
+	static std::vector<PendingNotifyMem> thisBatch;
+	thisBatch.clear();
 	{
 		std::lock_guard<std::mutex> guard(pendingWriteMutex);
-		thisBatch = std::move(pendingNotifies);
-		pendingNotifies.clear();
-		pendingNotifies.reserve(MAX_PENDING_NOTIFIES);
+		std::swap(thisBatch, pendingNotifies);
+		if (pendingNotifies.capacity() < MAX_PENDING_NOTIFIES)
+			pendingNotifies.reserve(MAX_PENDING_NOTIFIES);
 
 		pendingNotifyMinAddr1 = 0xFFFFFFFF;
 		pendingNotifyMaxAddr1 = 0;
@@ -444,6 +493,8 @@ void FlushPendingMemInfo() {
 			writeMap.Mark(info.start, info.size, info.ticks, info.pc, true, info.tag);
 		}
 	}
+
+	CompactMemTags();
 }
 
 static inline uint32_t NormalizeAddress(uint32_t addr) {
@@ -490,7 +541,10 @@ void NotifyMemInfoPC(MemBlockFlags flags, uint32_t start, uint32_t size, uint32_
 
 	bool needFlush = false;
 	// When the setting is off, we skip smaller info to keep things fast.
-	if (MemBlockInfoDetailed(size) && flags != MemBlockFlags::READ) {
+	// Allocations are cheap and rare enough to track even in allocs only mode.
+	const MemBlockFlags allocFlags = MemBlockFlags::ALLOC | MemBlockFlags::SUB_ALLOC | MemBlockFlags::FREE | MemBlockFlags::SUB_FREE;
+	bool track = (flags & allocFlags) ? size >= MEMINFO_MIN_SIZE || MemBlockInfoDetailed() : MemBlockInfoDetailed(size);
+	if (track && flags != MemBlockFlags::READ) {
 		PendingNotifyMem info{ flags, start, size };
 		info.ticks = CoreTiming::GetTicks();
 		info.pc = pc;
@@ -590,6 +644,8 @@ std::vector<MemBlockInfo> FindMemInfo(uint32_t start, uint32_t size) {
 	if (pendingNotifyMinAddr2 < start + size && pendingNotifyMaxAddr2 >= start)
 		FlushPendingMemInfo();
 
+	// The flush thread may be splitting and merging slabs, and the tags are copied out under the lock.
+	std::lock_guard<std::mutex> guard(pendingReadMutex);
 	std::vector<MemBlockInfo> results;
 	allocMap.Find(MemBlockFlags::ALLOC, start, size, results);
 	suballocMap.Find(MemBlockFlags::SUB_ALLOC, start, size, results);
@@ -606,6 +662,7 @@ std::vector<MemBlockInfo> FindMemInfoByFlag(MemBlockFlags flags, uint32_t start,
 	if (pendingNotifyMinAddr2 < start + size && pendingNotifyMaxAddr2 >= start)
 		FlushPendingMemInfo();
 
+	std::lock_guard<std::mutex> guard(pendingReadMutex);
 	std::vector<MemBlockInfo> results;
 	if (flags & MemBlockFlags::ALLOC)
 		allocMap.Find(MemBlockFlags::ALLOC, start, size, results);
@@ -618,16 +675,10 @@ std::vector<MemBlockInfo> FindMemInfoByFlag(MemBlockFlags flags, uint32_t start,
 	return results;
 }
 
-static const char *FindWriteTagByFlag(MemBlockFlags flags, uint32_t start, uint32_t size, bool flush = true) {
+// Call with pendingReadMutex held, the tag may be freed by the next flush.
+static const char *FindWriteTagByFlag(MemBlockFlags flags, uint32_t start, uint32_t size) {
 	start = NormalizeAddress(start);
 
-	if (flush) {
-		if (pendingNotifyMinAddr1 < start + size && pendingNotifyMaxAddr1 >= start)
-			FlushPendingMemInfo();
-		if (pendingNotifyMinAddr2 < start + size && pendingNotifyMaxAddr2 >= start)
-			FlushPendingMemInfo();
-	}
-
 	if (flags & MemBlockFlags::ALLOC) {
 		const char *tag = allocMap.FastFindWriteTag(MemBlockFlags::ALLOC, start, size);
 		if (tag)
@@ -652,25 +703,24 @@ static const char *FindWriteTagByFlag(MemBlockFlags flags, uint32_t start, uint3
 }
 
 size_t FormatMemWriteTagAt(char *buf, size_t sz, const char *prefix, uint32_t start, uint32_t size) {
-	const char *tag = FindWriteTagByFlag(MemBlockFlags::WRITE, start, size);
-	if (tag && strcmp(tag, "MemInit") != 0) {
-		return snprintf(buf, sz, "%s%s", prefix, tag);
-	}
-	// Fall back to alloc and texture, especially for VRAM.  We prefer write above.
-	tag = FindWriteTagByFlag(MemBlockFlags::ALLOC | MemBlockFlags::TEXTURE, start, size);
-	if (tag) {
-		return snprintf(buf, sz, "%s%s", prefix, tag);
-	}
-	return snprintf(buf, sz, "%s%08x_size_%08x", prefix, start, size);
+	const uint32_t normalized = NormalizeAddress(start);
+	if (pendingNotifyMinAddr1 < normalized + size && pendingNotifyMaxAddr1 >= normalized)
+		FlushPendingMemInfo();
+	if (pendingNotifyMinAddr2 < normalized + size && pendingNotifyMaxAddr2 >= normalized)
+		FlushPendingMemInfo();
+
+	std::lock_guard<std::mutex> guard(pendingReadMutex);
+	return FormatMemWriteTagAtNoFlush(buf, sz, prefix, start, size);
 }
 
+// Call with pendingReadMutex held.
 size_t FormatMemWriteTagAtNoFlush(char *buf, size_t sz, const char *prefix, uint32_t start, uint32_t size) {
-	const char *tag = FindWriteTagByFlag(MemBlockFlags::WRITE, start, size, false);
+	const char *tag = FindWriteTagByFlag(MemBlockFlags::WRITE, start, size);
 	if (tag && strcmp(tag, "MemInit") != 0) {
 		return snprintf(buf, sz, "%s%s", prefix, tag);
 	}
 	// Fall back to alloc and texture, especially for VRAM.  We prefer write above.
-	tag = FindWriteTagByFlag(MemBlockFlags::ALLOC | MemBlockFlags::TEXTURE, start, size, false);
+	tag = FindWriteTagByFlag(MemBlockFlags::ALLOC | MemBlockFlags::TEXTURE, start, size);
 	if (tag) {
 		return snprintf(buf, sz, "%s%s", prefix, tag);
 	}
@@ -714,6 +764,10 @@ void MemBlockInfoShutdown() {
 		writeMap.Reset();
 		textureMap.Reset();
 		pendingNotifies.clear();
+
+		std::lock_guard<std::mutex> guardT(tagPoolLock);
+		tagPool.clear();
+		lastInternedTag = "";
 	}
 
 	if (flushThreadRunning.load()) {
@@ -731,6 +785,7 @@ void MemBlockInfoDoState(PointerWrap &p) {
 		return;
 
 	FlushPendingMemInfo();
+	std::lock_guard<std::mutex> guard(pendingReadMutex);
 	allocMap.DoState(p);
 	suballocMap.DoState(p);
 	writeMap.DoState(p);
@@ -749,3 +804,7 @@ void MemBlockReleaseDetailed() {
 bool MemBlockInfoDetailed() {
 	return g_Config.bDebugMemInfoDetailed || detailedOverride != 0;
 }
+
+bool MemBlockInfoAllocsOnly() {
+	return g_Config.bDebugMemInfoAllocsOnly && !MemBlockInfoDetailed();
+}
@@ -79,11 +79,14 @@ void MemBlockInfoDoState(PointerWrap &p);
 void MemBlockOverrideDetailed();
 void MemBlockReleaseDetailed();
 bool MemBlockInfoDetailed();
+// Only allocations are tracked, writes and textures are skipped.  Detailed mode overrides this.
+bool MemBlockInfoAllocsOnly();
 
+// Whether a write, copy or texture of this size should be tagged.
 static inline bool MemBlockInfoDetailed(uint32_t size) {
-	return size >= MEMINFO_MIN_SIZE || MemBlockInfoDetailed();
+	return size >= MEMINFO_MIN_SIZE ? !MemBlockInfoAllocsOnly() : MemBlockInfoDetailed();
 }
 
 static inline bool MemBlockInfoDetailed(uint32_t size1, uint32_t size2) {
-	return size1 >= MEMINFO_MIN_SIZE || size2 >= MEMINFO_MIN_SIZE || MemBlockInfoDetailed();
+	return size1 >= MEMINFO_MIN_SIZE || size2 >= MEMINFO_MIN_SIZE ? !MemBlockInfoAllocsOnly() : MemBlockInfoDetailed();
 }
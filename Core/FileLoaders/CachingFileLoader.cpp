@@ -20,7 +20,6 @@
 #include <thread>
 
 #include "Common/Thread/ThreadUtil.h"
-#include "Common/TimeUtil.h"
 #include "Core/FileLoaders/CachingFileLoader.h"
 
 // Takes ownership of backend.
@@ -80,7 +79,7 @@ size_t CachingFileLoader::ReadAt(s64 absolutePos, size_t bytes, void *data, Flag
 	size_t readSize = 0;
 	if ((flags & Flags::HINT_UNCACHED) != 0) {
 		readSize = backend_->ReadAt(absolutePos, bytes, data, flags);
-	} else {
+	} else if (bytes != 0) {
 		readSize = ReadFromCache(absolutePos, bytes, data);
 		// While in case the cache size is too small for the entire read.
 		while (readSize < bytes) {
@@ -88,7 +87,8 @@ size_t CachingFileLoader::ReadAt(s64 absolutePos, size_t bytes, void *data, Flag
 			size_t bytesFromCache = ReadFromCache(absolutePos + readSize, bytes - readSize, (u8 *)data + readSize);
 			readSize += bytesFromCache;
 			if (bytesFromCache == 0) {
-				// We can't read any more.
+				// Either the backend failed, or another thread evicted the block already. Read directly.
+				readSize += backend_->ReadAt(absolutePos + readSize, bytes - readSize, (u8 *)data + readSize, flags);
 				break;
 			}
 		}
@@ -100,47 +100,65 @@ size_t CachingFileLoader::ReadAt(s64 absolutePos, size_t bytes, void *data, Flag
 }
 
 void CachingFileLoader::InitCache() {
-	cacheSize_ = 0;
-	oldestGeneration_ = 0;
-	generation_ = 0;
+	numBlocks_ = (u32)((filesize_ + BLOCK_SIZE - 1) >> BLOCK_SHIFT);
+	blockSlots_.reset(new std::atomic<u32>[numBlocks_]);
+	for (u32 i = 0; i < numBlocks_; ++i) {
+		blockSlots_[i].store(NO_SLOT, std::memory_order_relaxed);
+	}
+	slots_.reset(new Slot[MAX_BLOCKS_CACHED]);
+	usedSlots_ = 0;
+	clockHand_ = 0;
 }
 
 void CachingFileLoader::ShutdownCache() {
 	// TODO: Maybe add some hint that deletion is coming soon?
 	// We can't delete while the thread is running, so have to wait.
 	// This should only happen from the menu.
-	while (aheadThreadRunning_) {
-		sleep_ms(1, "shutdown-cache-poll");
+	{
+		std::lock_guard<std::mutex> guard(aheadMutex_);
+		if (aheadThread_.joinable())
+			aheadThread_.join();
 	}
-	if (aheadThread_.joinable())
-		aheadThread_.join();
 
-	std::lock_guard<std::recursive_mutex> guard(blocksMutex_);
-	for (const auto &block : blocks_) {
-		delete [] block.second.ptr;
+	std::lock_guard<std::mutex> guard(insertMutex_);
+	for (u32 i = 0; i < usedSlots_; ++i) {
+		delete [] slots_[i].data;
 	}
-	blocks_.clear();
-	cacheSize_ = 0;
+	slots_.reset();
+	blockSlots_.reset();
+	usedSlots_ = 0;
 }
 
 size_t CachingFileLoader::ReadFromCache(s64 pos, size_t bytes, void *data) {
-	s64 cacheStartPos = pos >> BLOCK_SHIFT;
-	s64 cacheEndPos = (pos + bytes - 1) >> BLOCK_SHIFT;
-	// TODO: Smarter.
+	const u32 cacheStartPos = (u32)(pos >> BLOCK_SHIFT);
+	const u32 cacheEndPos = (u32)((pos + bytes - 1) >> BLOCK_SHIFT);
 	size_t readSize = 0;
-	size_t offset = (size_t)(pos - (cacheStartPos << BLOCK_SHIFT));
+	size_t offset = (size_t)(pos - ((s64)cacheStartPos << BLOCK_SHIFT));
 	u8 *p = (u8 *)data;
 
-	std::lock_guard<std::recursive_mutex> guard(blocksMutex_);
-	for (s64 i = cacheStartPos; i <= cacheEndPos; ++i) {
-		auto block = blocks_.find(i);
-		if (block == blocks_.end()) {
+	for (u32 i = cacheStartPos; i <= cacheEndPos && i < numBlocks_; ++i) {
+		const u32 slotIndex = blockSlots_[i].load(std::memory_order_acquire);
+		if (slotIndex == NO_SLOT) {
+			return readSize;
+		}
+		Slot &slot = slots_[slotIndex];
+		const u32 version = slot.version.load(std::memory_order_acquire);
+		if ((version & 1) != 0 || slot.block.load(std::memory_order_relaxed) != i) {
+			// Being evicted right now.
 			return readSize;
 		}
-		block->second.generation = generation_;
 
 		size_t toRead = std::min(bytes - readSize, (size_t)BLOCK_SIZE - offset);
-		memcpy(p + readSize, block->second.ptr + offset, toRead);
+		memcpy(p + readSize, slot.data + offset, toRead);
+
+		// If the slot was reused while we copied, what we got may be torn. Count it as a miss.
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.version.load(std::memory_order_relaxed) != version) {
+			return readSize;
+		}
+		if (!slot.referenced.load(std::memory_order_relaxed)) {
+			slot.referenced.store(true, std::memory_order_relaxed);
+		}
 		readSize += toRead;
 
 		// Don't need an offset after the first read.
@@ -150,14 +168,12 @@ size_t CachingFileLoader::ReadFromCache(s64 pos, size_t bytes, void *data) {
 }
 
 void CachingFileLoader::SaveIntoCache(s64 pos, size_t bytes, Flags flags, bool readingAhead) {
-	s64 cacheStartPos = pos >> BLOCK_SHIFT;
-	s64 cacheEndPos = (pos + bytes - 1) >> BLOCK_SHIFT;
+	const u32 cacheStartPos = (u32)(pos >> BLOCK_SHIFT);
+	const u32 cacheEndPos = std::min((u32)((pos + bytes - 1) >> BLOCK_SHIFT), numBlocks_ - 1);
 
-	std::lock_guard<std::recursive_mutex> guard(blocksMutex_);
 	size_t blocksToRead = 0;
-	for (s64 i = cacheStartPos; i <= cacheEndPos; ++i) {
-		auto block = blocks_.find(i);
-		if (block != blocks_.end()) {
+	for (u32 i = cacheStartPos; i <= cacheEndPos; ++i) {
+		if (blockSlots_[i].load(std::memory_order_relaxed) != NO_SLOT) {
 			break;
 		}
 		++blocksToRead;
@@ -166,104 +182,87 @@ void CachingFileLoader::SaveIntoCache(s64 pos, size_t bytes, Flags flags, bool r
 		}
 	}
 
-	if (!MakeCacheSpaceFor(blocksToRead, readingAhead) || blocksToRead == 0) {
+	if (blocksToRead == 0 || (readingAhead && usedSlots_ + blocksToRead > MAX_BLOCKS_CACHED)) {
 		return;
 	}
 
-	if (blocksToRead == 1) {
-		blocksMutex_.unlock();
-
-		u8 *buf = new u8[BLOCK_SIZE];
-		backend_->ReadAt(cacheStartPos << BLOCK_SHIFT, BLOCK_SIZE, buf, flags);
+	u8 *wholeRead = new u8[blocksToRead << BLOCK_SHIFT];
+	size_t bytesRead = backend_->ReadAt((s64)cacheStartPos << BLOCK_SHIFT, blocksToRead << BLOCK_SHIFT, wholeRead, flags);
+	// In case there was an error, let's not cache blocks that failed to read.
+	const size_t blocksActuallyRead = std::min(blocksToRead, (bytesRead + BLOCK_SIZE - 1) >> BLOCK_SHIFT);
+	if (bytesRead < (blocksActuallyRead << BLOCK_SHIFT)) {
+		memset(wholeRead + bytesRead, 0, (blocksActuallyRead << BLOCK_SHIFT) - bytesRead);
+	}
 
-		blocksMutex_.lock();
-		// While blocksMutex_ was unlocked, another thread may have read.
-		// If so, free the one we just read.
-		if (blocks_.find(cacheStartPos) == blocks_.end()) {
-			blocks_[cacheStartPos] = BlockInfo{buf};
-		} else {
-			delete [] buf;
+	std::lock_guard<std::mutex> guard(insertMutex_);
+	for (size_t i = 0; i < blocksActuallyRead; ++i) {
+		const u32 block = cacheStartPos + (u32)i;
+		if (blockSlots_[block].load(std::memory_order_relaxed) != NO_SLOT) {
+			// Written while we were busy, just skip it.  Keep the existing block.
+			continue;
 		}
-	} else {
-		blocksMutex_.unlock();
-
-		u8 *wholeRead = new u8[blocksToRead << BLOCK_SHIFT];
-		backend_->ReadAt(cacheStartPos << BLOCK_SHIFT, blocksToRead << BLOCK_SHIFT, wholeRead, flags);
-
-		blocksMutex_.lock();
-		for (size_t i = 0; i < blocksToRead; ++i) {
-			if (blocks_.find(cacheStartPos + i) != blocks_.end()) {
-				// Written while we were busy, just skip it.  Keep the existing block.
-				continue;
-			}
-			u8 *buf = new u8[BLOCK_SIZE];
-			memcpy(buf, wholeRead + (i << BLOCK_SHIFT), BLOCK_SIZE);
-			blocks_[cacheStartPos + i] = BlockInfo{buf};
+		const u32 slotIndex = AllocateSlot(readingAhead);
+		if (slotIndex == NO_SLOT) {
+			break;
 		}
-		delete[] wholeRead;
-	}
 
-	cacheSize_ += blocksToRead;
-	++generation_;
+		Slot &slot = slots_[slotIndex];
+		memcpy(slot.data, wholeRead + (i << BLOCK_SHIFT), BLOCK_SIZE);
+		slot.block.store(block, std::memory_order_relaxed);
+		// Blocks we only guessed we'd need go first, unless they get used.
+		slot.referenced.store(!readingAhead, std::memory_order_relaxed);
+		slot.version.fetch_add(1, std::memory_order_release);
+		blockSlots_[block].store(slotIndex, std::memory_order_release);
+	}
+	delete[] wholeRead;
 }
 
-bool CachingFileLoader::MakeCacheSpaceFor(size_t blocks, bool readingAhead) {
-	size_t goal = MAX_BLOCKS_CACHED - blocks;
-
-	if (readingAhead && cacheSize_ > goal) {
-		return false;
+u32 CachingFileLoader::AllocateSlot(bool readingAhead) {
+	u32 slotIndex;
+	if (usedSlots_ < MAX_BLOCKS_CACHED) {
+		slotIndex = usedSlots_;
+		slots_[slotIndex].data = new u8[BLOCK_SIZE];
+		usedSlots_ = slotIndex + 1;
+		// Same as an evicted slot, it's odd until filled.
+		slots_[slotIndex].version.store(1, std::memory_order_relaxed);
+		return slotIndex;
+	}
+	if (readingAhead) {
+		// Don't push out blocks for a guess.
+		return NO_SLOT;
 	}
 
-	std::lock_guard<std::recursive_mutex> guard(blocksMutex_);
-	while (cacheSize_ > goal) {
-		u64 minGeneration = generation_;
-
-		// We increment the iterator inside because we delete things inside.
-		for (auto it = blocks_.begin(); it != blocks_.end(); ) {
-			// Check for the minimum seen generation.
-			// TODO: Do this smarter?
-			if (it->second.generation != 0 && it->second.generation < minGeneration) {
-				minGeneration = it->second.generation;
-			}
-
-			// 0 means it was never used yet or was the first read (e.g. block descriptor.)
-			if (it->second.generation == oldestGeneration_ || it->second.generation == 0) {
-				s64 pos = it->first;
-				delete it->second.ptr;
-				blocks_.erase(it);
-				--cacheSize_;
-
-				// Our iterator is invalid now.  Keep going?
-				if (cacheSize_ > goal) {
-					// This finds the one at that position.
-					it = blocks_.lower_bound(pos);
-				} else {
-					break;
-				}
-			} else {
-				++it;
-			}
+	// Skip over referenced slots, clearing them as we go.  At most one lap before we find one.
+	while (true) {
+		slotIndex = clockHand_;
+		clockHand_ = (clockHand_ + 1) % MAX_BLOCKS_CACHED;
+		Slot &slot = slots_[slotIndex];
+		if (slot.referenced.load(std::memory_order_relaxed)) {
+			slot.referenced.store(false, std::memory_order_relaxed);
+			continue;
 		}
 
-		// If we didn't find any, update to the lowest we did find.
-		oldestGeneration_ = minGeneration;
+		// Unpublish first, then make the version odd so any reader in the middle of a copy will retry.
+		blockSlots_[slot.block.load(std::memory_order_relaxed)].store(NO_SLOT, std::memory_order_relaxed);
+		slot.version.fetch_add(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		return slotIndex;
 	}
-
-	return true;
 }
 
 void CachingFileLoader::StartReadAhead(s64 pos) {
-	std::lock_guard<std::recursive_mutex> guard(blocksMutex_);
-	if (aheadThreadRunning_) {
-		// Already going.
+	if (usedSlots_ + BLOCK_READAHEAD > MAX_BLOCKS_CACHED) {
+		// Not enough space to readahead.
 		return;
 	}
-	if (cacheSize_ + BLOCK_READAHEAD > MAX_BLOCKS_CACHED) {
-		// Not enough space to readahead.
+	bool expected = false;
+	if (!aheadThreadRunning_.compare_exchange_strong(expected, true)) {
+		// Already going.
 		return;
 	}
 
-	aheadThreadRunning_ = true;
+	std::lock_guard<std::mutex> guard(aheadMutex_);
+	// The last one already said it's done, so this won't wait long.
 	if (aheadThread_.joinable())
 		aheadThread_.join();
 	aheadThread_ = std::thread([this, pos] {
@@ -271,15 +270,12 @@ void CachingFileLoader::StartReadAhead(s64 pos) {
 
 		AndroidJNIThreadContext jniContext;
 
-		std::unique_lock<std::recursive_mutex> guard(blocksMutex_);
-		s64 cacheStartPos = pos >> BLOCK_SHIFT;
-		s64 cacheEndPos = cacheStartPos + BLOCK_READAHEAD - 1;
+		const u32 cacheStartPos = (u32)(pos >> BLOCK_SHIFT);
+		const u32 cacheEndPos = std::min(cacheStartPos + BLOCK_READAHEAD - 1, numBlocks_ - 1);
 
-		for (s64 i = cacheStartPos; i <= cacheEndPos; ++i) {
-			auto block = blocks_.find(i);
-			if (block == blocks_.end()) {
-				guard.unlock();
-				SaveIntoCache(i << BLOCK_SHIFT, BLOCK_SIZE * BLOCK_READAHEAD, Flags::NONE, true);
+		for (u32 i = cacheStartPos; i <= cacheEndPos; ++i) {
+			if (blockSlots_[i].load(std::memory_order_relaxed) == NO_SLOT) {
+				SaveIntoCache((s64)i << BLOCK_SHIFT, BLOCK_SIZE * BLOCK_READAHEAD, Flags::NONE, true);
 				break;
 			}
 		}
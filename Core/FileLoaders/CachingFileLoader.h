@@ -17,13 +17,19 @@
 
 #pragma once
 
-#include <map>
+#include <atomic>
+#include <memory>
 #include <mutex>
 #include <thread>
 
 #include "Common/CommonTypes.h"
 #include "Core/Loaders.h"
 
+// Keeps recently read 64 KB blocks of the file in RAM, and reads a few blocks ahead on a thread.
+// The block table is flat and each entry is published atomically, so cache hits never take a lock.
+// Slot buffers are only ever reused, not freed, and each has a seqlock style version: a reader copies
+// the data and then checks the version didn't change, treating it as a miss if the slot was evicted
+// meanwhile. Eviction uses a clock over the slots with a referenced bit.
 class CachingFileLoader : public ProxiedFileLoader {
 public:
 	CachingFileLoader(FileLoader *backend);
@@ -46,7 +52,8 @@ class CachingFileLoader : public ProxiedFileLoader {
 	size_t ReadFromCache(s64 pos, size_t bytes, void *data);
 	// Guaranteed to read at least one block into the cache.
 	void SaveIntoCache(s64 pos, size_t bytes, Flags flags, bool readingAhead = false);
-	bool MakeCacheSpaceFor(size_t blocks, bool readingAhead);
+	// Call with insertMutex_ held. Returns NO_SLOT if readingAhead and the cache is full.
+	u32 AllocateSlot(bool readingAhead);
 	void StartReadAhead(s64 pos);
 
 	enum {
@@ -57,21 +64,32 @@ class CachingFileLoader : public ProxiedFileLoader {
 		BLOCK_READAHEAD = 4,
 	};
 
+	static constexpr u32 NO_SLOT = 0xFFFFFFFF;
+
+	struct Slot {
+		// Odd while the slot is being refilled.
+		std::atomic<u32> version{};
+		std::atomic<u32> block{ NO_SLOT };
+		// Set on every hit, cleared as the clock hand passes.
+		std::atomic<bool> referenced{};
+		u8 *data = nullptr;
+	};
+
 	s64 filesize_ = 0;
 	int exists_ = -1;
 	int isDirectory_ = -1;
-	u64 generation_ = 0;
-	u64 oldestGeneration_ = 0;
-	size_t cacheSize_ = 0;
 
-	struct BlockInfo {
-		u8 *ptr;
-		u64 generation;
-	};
+	// Indexed by block number, holds the slot index or NO_SLOT.
+	std::unique_ptr<std::atomic<u32>[]> blockSlots_;
+	u32 numBlocks_ = 0;
+	std::unique_ptr<Slot[]> slots_;
+	// Only changed with insertMutex_ held.
+	std::atomic<u32> usedSlots_{};
+	u32 clockHand_ = 0;
+	std::mutex insertMutex_;
 
-	std::map<s64, BlockInfo> blocks_;
-	std::recursive_mutex blocksMutex_;
-	bool aheadThreadRunning_ = false;
+	std::atomic<bool> aheadThreadRunning_{};
 	std::thread aheadThread_;
+	std::mutex aheadMutex_;
 	std::once_flag preparedFlag_;
 };
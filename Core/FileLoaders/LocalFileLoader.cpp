@@ -18,9 +18,15 @@
 
 #include "ppsspp_config.h"
 
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
 #include "Common/Log.h"
 #include "Common/File/FileUtil.h"
 #include "Common/File/DirListing.h"
+#include "Common/Thread/ThreadUtil.h"
+#include "Common/TimeUtil.h"
 #include "Core/Util/DarwinFileSystemServices.h"
 #include "Core/FileLoaders/LocalFileLoader.h"
 
@@ -41,6 +47,56 @@
 #include <streams/file_stream.h>
 #endif
 
+#ifdef LOCAL_FILE_LOADER_MMAP
+#include <atomic>
+#include <csetjmp>
+#include <csignal>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Once reads have been contiguous for this long, we ask the kernel to read ahead of them.
+static const s64 MMAP_SEQUENTIAL_THRESHOLD = 256 * 1024;
+static const s64 MMAP_WILLNEED_WINDOW = 4 * 1024 * 1024;
+// Populating is done in steps, so shutting down doesn't have to wait for the whole file.
+static const size_t MMAP_POPULATE_CHUNK = 16 * 1024 * 1024;
+
+static std::mutex g_mappedLock;
+static std::vector<LocalFileLoader *> g_mappedLoaders;
+
+// If the file is truncated, or its storage fails or goes away (SD card, USB, network share), touching
+// the mapping raises SIGBUS instead of returning a short read. Mapped reads catch it and fall back.
+static thread_local sigjmp_buf *t_mappedReadJump = nullptr;
+static struct sigaction g_oldSigbusAction;
+static std::once_flag g_sigbusHandlerOnce;
+
+static void MappedReadSigbusHandler(int sig, siginfo_t *info, void *context) {
+	if (t_mappedReadJump) {
+		siglongjmp(*t_mappedReadJump, 1);
+	}
+
+	// Not from a mapped read, so hand it to whoever was there before.
+	if (g_oldSigbusAction.sa_flags & SA_SIGINFO) {
+		g_oldSigbusAction.sa_sigaction(sig, info, context);
+	} else if (g_oldSigbusAction.sa_handler == SIG_DFL) {
+		sigaction(SIGBUS, &g_oldSigbusAction, nullptr);
+		raise(sig);
+	} else if (g_oldSigbusAction.sa_handler != SIG_IGN) {
+		g_oldSigbusAction.sa_handler(sig);
+	}
+}
+
+static void InstallSigbusHandler() {
+	std::call_once(g_sigbusHandlerOnce, [] {
+		struct sigaction sa{};
+		sa.sa_sigaction = &MappedReadSigbusHandler;
+		// No need to restore the signal mask after jumping out, if it was never blocked.
+		sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+		sigemptyset(&sa.sa_mask);
+		sigaction(SIGBUS, &sa, &g_oldSigbusAction);
+	});
+}
+#endif
+
 #if !defined(_WIN32) && !defined(HAVE_LIBRETRO_VFS)
 
 void LocalFileLoader::DetectSizeFd() {
@@ -131,6 +187,9 @@ LocalFileLoader::LocalFileLoader(const Path &filename)
 }
 
 LocalFileLoader::~LocalFileLoader() {
+#ifdef LOCAL_FILE_LOADER_MMAP
+	Unmap();
+#endif
 #if defined(HAVE_LIBRETRO_VFS)
 	if (file_ != nullptr) {
 		fclose(file_);
@@ -184,6 +243,20 @@ size_t LocalFileLoader::ReadAt(s64 absolutePos, size_t bytes, size_t count, void
 		return 0;
 	}
 
+#ifdef LOCAL_FILE_LOADER_MMAP
+	if (mapped_ && !mapFailed_) {
+		if (absolutePos < 0 || (u64)absolutePos >= filesize_) {
+			return 0;
+		}
+		const size_t readSize = (size_t)std::min((u64)(bytes * count), filesize_ - (u64)absolutePos);
+		AdviseSequential(absolutePos, readSize);
+		if (ReadMapped(absolutePos, readSize, data)) {
+			return readSize / bytes;
+		}
+		// Otherwise, the regular read below reports the error properly.
+	}
+#endif
+
 #if defined(HAVE_LIBRETRO_VFS)
 	std::lock_guard<std::mutex> guard(readLock_);
 	File::Fseek(file_, absolutePos, SEEK_SET);
@@ -222,3 +295,156 @@ size_t LocalFileLoader::ReadAt(s64 absolutePos, size_t bytes, size_t count, void
 	return result == TRUE ? (size_t)read / bytes : -1;
 #endif
 }
+
+#ifdef LOCAL_FILE_LOADER_MMAP
+
+bool LocalFileLoader::MapIntoMemory(bool populate) {
+	if (mapped_) {
+		return true;
+	}
+	if (fd_ == -1 || filesize_ == 0 || filesize_ > (u64)SIZE_MAX) {
+		return false;
+	}
+
+	InstallSigbusHandler();
+	void *ptr = mmap(nullptr, (size_t)filesize_, PROT_READ, MAP_SHARED, fd_, 0);
+	if (ptr == MAP_FAILED) {
+		WARN_LOG(Log::FileSystem, "LocalFileLoader: unable to map %s (errno %d), using regular reads", filename_.c_str(), errno);
+		return false;
+	}
+	mapped_ = (u8 *)ptr;
+
+	if (populate) {
+		populateCancel_ = false;
+		populateThread_ = std::thread([this] {
+			SetCurrentThreadName("FileLoaderPopulate");
+
+			double start = time_now_d();
+			for (size_t pos = 0; pos < filesize_ && !populateCancel_; pos += MMAP_POPULATE_CHUNK) {
+				const size_t len = (size_t)std::min((u64)MMAP_POPULATE_CHUNK, filesize_ - pos);
+#ifdef MADV_POPULATE_READ
+				// Older kernels don't have this, and just asking nicely will have to do.
+				if (madvise(mapped_ + pos, len, MADV_POPULATE_READ) == 0)
+					continue;
+#endif
+				madvise(mapped_ + pos, len, MADV_WILLNEED);
+			}
+			INFO_LOG(Log::FileSystem, "LocalFileLoader: populated %s in %0.1f ms, %d MB resident", filename_.c_str(), (time_now_d() - start) * 1000.0, (int)(ResidentBytes() >> 20));
+		});
+	}
+
+	std::lock_guard<std::mutex> guard(g_mappedLock);
+	g_mappedLoaders.push_back(this);
+	INFO_LOG(Log::FileSystem, "LocalFileLoader: mapped %s (%d MB)", filename_.c_str(), (int)(filesize_ >> 20));
+	return true;
+}
+
+void LocalFileLoader::Unmap() {
+	if (!mapped_) {
+		return;
+	}
+
+	populateCancel_ = true;
+	if (populateThread_.joinable())
+		populateThread_.join();
+
+	{
+		std::lock_guard<std::mutex> guard(g_mappedLock);
+		g_mappedLoaders.erase(std::remove(g_mappedLoaders.begin(), g_mappedLoaders.end(), this), g_mappedLoaders.end());
+	}
+	munmap(mapped_, (size_t)filesize_);
+	mapped_ = nullptr;
+}
+
+bool LocalFileLoader::ReadMapped(s64 pos, size_t bytes, void *data) {
+	sigjmp_buf jump;
+	if (sigsetjmp(jump, 0) != 0) {
+		t_mappedReadJump = nullptr;
+		if (!mapFailed_.exchange(true)) {
+			ERROR_LOG(Log::FileSystem, "LocalFileLoader: error reading mapped %s at %lld, switching to regular reads", filename_.c_str(), (long long)pos);
+		}
+		return false;
+	}
+
+	t_mappedReadJump = &jump;
+	// Keep the compiler from moving the copy outside the guarded range.
+	std::atomic_signal_fence(std::memory_order_seq_cst);
+	memcpy(data, mapped_ + pos, bytes);
+	std::atomic_signal_fence(std::memory_order_seq_cst);
+	t_mappedReadJump = nullptr;
+	return true;
+}
+
+void LocalFileLoader::AdviseSequential(s64 pos, size_t bytes) {
+	// Several threads may read, but these are only hints, so races don't matter much.
+	s64 sequential = (s64)bytes;
+	if (nextReadPos_.exchange(pos + (s64)bytes, std::memory_order_relaxed) == pos) {
+		sequential += sequentialBytes_.fetch_add((s64)bytes, std::memory_order_relaxed);
+	} else {
+		sequentialBytes_.store((s64)bytes, std::memory_order_relaxed);
+	}
+	if (sequential < MMAP_SEQUENTIAL_THRESHOLD) {
+		return;
+	}
+
+	// Top up the window once less than half of it is left.
+	const s64 end = pos + (s64)bytes;
+	const s64 adviseEnd = willNeedEnd_.load(std::memory_order_relaxed);
+	if (end + MMAP_WILLNEED_WINDOW / 2 <= adviseEnd) {
+		return;
+	}
+	static const s64 pageMask = ~((s64)sysconf(_SC_PAGESIZE) - 1);
+	const s64 start = std::max(end, adviseEnd) & pageMask;
+	const s64 newEnd = std::min(end + MMAP_WILLNEED_WINDOW, (s64)filesize_);
+	if (newEnd > start) {
+		madvise(mapped_ + start, (size_t)(newEnd - start), MADV_WILLNEED);
+		willNeedEnd_.store(newEnd, std::memory_order_relaxed);
+	}
+}
+
+u64 LocalFileLoader::ResidentBytes() const {
+	const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	std::vector<unsigned char> pages((size_t)((filesize_ + pageSize - 1) / pageSize));
+	if (mincore(mapped_, (size_t)filesize_, pages.data()) != 0) {
+		return 0;
+	}
+	u64 resident = 0;
+	for (unsigned char p : pages) {
+		resident += p & 1;
+	}
+	return std::min(resident * pageSize, filesize_);
+}
+
+void LocalFileLoader::GetMappedStats(u64 *mappedBytes, u64 *residentBytes) {
+	// Checking residency walks the page tables, so don't do it every frame.
+	static double lastTime = 0.0;
+	static u64 lastMapped = 0;
+	static u64 lastResident = 0;
+
+	std::lock_guard<std::mutex> guard(g_mappedLock);
+	double now = time_now_d();
+	if (now >= lastTime + 1.0) {
+		lastMapped = 0;
+		lastResident = 0;
+		for (const LocalFileLoader *loader : g_mappedLoaders) {
+			lastMapped += loader->filesize_;
+			lastResident += loader->ResidentBytes();
+		}
+		lastTime = now;
+	}
+	*mappedBytes = lastMapped;
+	*residentBytes = lastResident;
+}
+
+#else
+
+bool LocalFileLoader::MapIntoMemory(bool populate) {
+	return false;
+}
+
+void LocalFileLoader::GetMappedStats(u64 *mappedBytes, u64 *residentBytes) {
+	*mappedBytes = 0;
+	*residentBytes = 0;
+}
+
+#endif
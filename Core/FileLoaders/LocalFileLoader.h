@@ -17,7 +17,11 @@
 
 #pragma once
 
+#include "ppsspp_config.h"
+
+#include <atomic>
 #include <mutex>
+#include <thread>
 
 #include "Common/CommonTypes.h"
 #include "Common/File/Path.h"
@@ -28,6 +32,10 @@
 typedef void *HANDLE;
 #endif
 
+#if PPSSPP_PLATFORM(LINUX) && !PPSSPP_PLATFORM(ANDROID) && !defined(HAVE_LIBRETRO_VFS)
+#define LOCAL_FILE_LOADER_MMAP
+#endif
+
 class LocalFileLoader : public FileLoader {
 public:
 	LocalFileLoader(const Path &filename);
@@ -41,7 +49,32 @@ class LocalFileLoader : public FileLoader {
 	}
 	size_t ReadAt(s64 absolutePos, size_t bytes, size_t count, void *data, Flags flags = Flags::NONE) override;
 
+	// Maps the whole file, so reads are copied straight out of the page cache without a syscall.
+	// With populate, the whole file is faulted in on a thread, which does the job of RamCachingFileLoader
+	// without a second copy. Returns false if unsupported (only on Linux so far) or if mapping fails.
+	bool MapIntoMemory(bool populate);
+
+	// Totals over all mapped files, for the debug overlay.
+	static void GetMappedStats(u64 *mappedBytes, u64 *residentBytes);
+
 private:
+#ifdef LOCAL_FILE_LOADER_MMAP
+	void Unmap();
+	// Returns false if the mapping couldn't be read, like after an I/O error.
+	bool ReadMapped(s64 pos, size_t bytes, void *data);
+	void AdviseSequential(s64 pos, size_t bytes);
+	u64 ResidentBytes() const;
+
+	u8 *mapped_ = nullptr;
+	std::thread populateThread_;
+	std::atomic<bool> populateCancel_{};
+	// Set once a mapped read has failed, after which we only use regular reads.
+	std::atomic<bool> mapFailed_{};
+	// Where the last read ended, how far reads have been contiguous, and how far we've asked the kernel to read ahead.
+	std::atomic<s64> nextReadPos_{};
+	std::atomic<s64> sequentialBytes_{};
+	std::atomic<s64> willNeedEnd_{};
+#endif
 #ifdef HAVE_LIBRETRO_VFS
 	FILE *file_ = nullptr;
 #elif !defined(_WIN32)
@@ -0,0 +1,292 @@
+// Copyright (c) 2026- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <algorithm>
+
+#include "Common/File/FileUtil.h"
+#include "Common/File/Path.h"
+#include "Common/Log.h"
+#include "Common/Thread/ThreadUtil.h"
+#include "Core/FileLoaders/PrefetchingFileLoader.h"
+#include "Core/System.h"
+
+#define READAHEAD_PROFILE_MAGIC 0x46504152  // "RAPF"
+#define READAHEAD_PROFILE_VERSION 1
+
+struct ReadaheadProfileHeader {
+	u32 magic;
+	u32 version;
+	// The same disc as a CSO or an ISO reads at different offsets, so this must match.
+	u64 filesize;
+	u32 numRuns;
+	u32 reserved;
+};
+
+static Path ProfileFilename(const std::string &discID) {
+	return GetSysDirectory(DIRECTORY_APP_CACHE) / (discID + ".readahead");
+}
+
+// Takes ownership of backend.
+PrefetchingFileLoader::PrefetchingFileLoader(FileLoader *backend)
+	: ProxiedFileLoader(backend) {
+	filesize_ = backend->FileSize();
+	if (filesize_ > 0) {
+		blockState_.resize((size_t)((filesize_ + BLOCK_SIZE - 1) >> BLOCK_SHIFT));
+	}
+}
+
+PrefetchingFileLoader::~PrefetchingFileLoader() {
+	StopThread();
+	if (discID_.empty()) {
+		return;
+	}
+
+	if (!profile_.empty()) {
+		INFO_LOG(Log::Loader, "Readahead: prefetched %d blocks, %d were read by the game in time, %d were not", prefetchedBlocks_, hitBlocks_, missedBlocks_);
+	}
+	if (dirty_) {
+		File::CreateFullPath(GetSysDirectory(DIRECTORY_APP_CACHE));
+		SaveProfile(ProfileFilename(discID_));
+	}
+}
+
+void PrefetchingFileLoader::Start(const std::string &discID) {
+	if (discID.empty() || blockState_.empty()) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> guard(mutex_);
+	discID_ = discID;
+	if (!LoadProfile(ProfileFilename(discID_))) {
+		dirty_ = true;
+		return;
+	}
+
+	// The reads so far (mounting, PARAM.SFO) happened before we had a profile to check against.
+	dirty_ = false;
+	for (size_t block = 0; block < blockState_.size(); ++block) {
+		if (blockState_[block] != BLOCK_READ)
+			continue;
+		if (blockRun_[block] == NO_RUN)
+			dirty_ = true;
+		else
+			cursor_ = std::max(cursor_, blockRun_[block]);
+	}
+	next_ = cursor_;
+
+	cancel_ = false;
+	thread_ = std::thread([this] {
+		SetCurrentThreadName("FileLoaderPrefetch");
+
+		AndroidJNIThreadContext jniContext;
+
+		PrefetchLoop();
+	});
+}
+
+void PrefetchingFileLoader::StopThread() {
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		cancel_ = true;
+	}
+	cond_.notify_one();
+	if (thread_.joinable())
+		thread_.join();
+}
+
+void PrefetchingFileLoader::Cancel() {
+	StopThread();
+	ProxiedFileLoader::Cancel();
+}
+
+size_t PrefetchingFileLoader::ReadAt(s64 absolutePos, size_t bytes, void *data, Flags flags) {
+	if ((flags & Flags::HINT_UNCACHED) == 0 && bytes != 0 && absolutePos >= 0 && absolutePos < filesize_) {
+		const u32 first = (u32)(absolutePos >> BLOCK_SHIFT);
+		const u32 last = (u32)((std::min(absolutePos + (s64)bytes, filesize_) - 1) >> BLOCK_SHIFT);
+
+		std::lock_guard<std::mutex> guard(mutex_);
+		const u32 oldCursor = cursor_;
+		for (u32 block = first; block <= last; ++block) {
+			if (blockState_[block] == BLOCK_READ)
+				continue;
+
+			const u32 run = blockRun_.empty() ? NO_RUN : blockRun_[block];
+			if (blockState_[block] == BLOCK_PREFETCHED) {
+				hitBlocks_++;
+			} else if (!profile_.empty()) {
+				missedBlocks_++;
+			}
+			if (run == NO_RUN) {
+				dirty_ = true;
+			} else if (run > cursor_) {
+				cursor_ = run;
+			}
+
+			blockState_[block] = BLOCK_READ;
+			AppendBlock(session_, block);
+		}
+
+		if (cursor_ != oldCursor) {
+			// No point fetching what the game has already gone past.
+			next_ = std::max(next_, cursor_);
+			cond_.notify_one();
+		}
+	}
+
+	return backend_->ReadAt(absolutePos, bytes, data, flags);
+}
+
+void PrefetchingFileLoader::AppendBlock(std::vector<Run> &runs, u32 block) {
+	if (!runs.empty() && runs.back().start + runs.back().count == block) {
+		runs.back().count++;
+	} else if (runs.size() < MAX_PROFILE_RUNS) {
+		runs.push_back({ block, 1 });
+	}
+}
+
+void PrefetchingFileLoader::PrefetchLoop() {
+	std::vector<u8> buffer((size_t)MAX_BLOCKS_PER_READ << BLOCK_SHIFT);
+
+	std::unique_lock<std::mutex> guard(mutex_);
+	while (!cancel_ && next_ < profile_.size()) {
+		if (profileBlockPos_[next_] - profileBlockPos_[cursor_] >= MAX_BLOCKS_AHEAD) {
+			// Far enough ahead, wait for the game to catch up.
+			cond_.wait(guard);
+			continue;
+		}
+
+		const Run run = profile_[next_];
+		const u32 end = run.start + run.count;
+		u32 block = run.start;
+		while (block < end && blockState_[block] != BLOCK_UNTOUCHED)
+			++block;
+		if (block == end) {
+			next_++;
+			continue;
+		}
+		u32 count = 1;
+		while (block + count < end && count < MAX_BLOCKS_PER_READ && blockState_[block + count] == BLOCK_UNTOUCHED)
+			++count;
+
+		const s64 pos = (s64)block << BLOCK_SHIFT;
+		const size_t bytes = (size_t)std::min((s64)count << BLOCK_SHIFT, filesize_ - pos);
+		guard.unlock();
+		size_t bytesRead = backend_->ReadAt(pos, bytes, buffer.data());
+		guard.lock();
+
+		for (u32 i = 0; i < count; ++i) {
+			if (blockState_[block + i] == BLOCK_UNTOUCHED) {
+				blockState_[block + i] = BLOCK_PREFETCHED;
+				prefetchedBlocks_++;
+			}
+		}
+		if (bytesRead == 0) {
+			WARN_LOG(Log::Loader, "Readahead: read failed at %lld, stopping", (long long)pos);
+			break;
+		}
+	}
+}
+
+bool PrefetchingFileLoader::LoadProfile(const Path &filename) {
+	profile_.clear();
+	profileBlockPos_.clear();
+	blockRun_.clear();
+
+	File::IOFile f(filename, "rb");
+	if (!f.IsOpen()) {
+		return false;
+	}
+
+	ReadaheadProfileHeader header;
+	if (!f.ReadArray(&header, 1) || header.magic != READAHEAD_PROFILE_MAGIC || header.version != READAHEAD_PROFILE_VERSION) {
+		WARN_LOG(Log::Loader, "Readahead: bad header in %s, ignoring", filename.c_str());
+		return false;
+	}
+	if (header.filesize != (u64)filesize_) {
+		// Probably a different dump of the same game. We'll just overwrite it on save.
+		INFO_LOG(Log::Loader, "Readahead: %s was recorded with a different image, ignoring", filename.c_str());
+		return false;
+	}
+	if (header.numRuns > MAX_PROFILE_RUNS) {
+		ERROR_LOG(Log::Loader, "Readahead: corrupt header in %s", filename.c_str());
+		return false;
+	}
+
+	std::vector<Run> runs(header.numRuns);
+	if (!f.ReadArray(runs.data(), runs.size())) {
+		ERROR_LOG(Log::Loader, "Readahead: truncated file %s", filename.c_str());
+		return false;
+	}
+
+	blockRun_.assign(blockState_.size(), NO_RUN);
+	u32 blockPos = 0;
+	for (const Run &run : runs) {
+		if (run.count == 0 || run.start >= blockState_.size() || run.count > blockState_.size() - run.start) {
+			ERROR_LOG(Log::Loader, "Readahead: invalid run in %s", filename.c_str());
+			profile_.clear();
+			profileBlockPos_.clear();
+			blockRun_.clear();
+			return false;
+		}
+		for (u32 i = 0; i < run.count; ++i) {
+			if (blockRun_[run.start + i] == NO_RUN)
+				blockRun_[run.start + i] = (u32)profile_.size();
+		}
+		profile_.push_back(run);
+		profileBlockPos_.push_back(blockPos);
+		blockPos += run.count;
+	}
+	profileBlockPos_.push_back(blockPos);
+
+	INFO_LOG(Log::Loader, "Readahead: loaded %d blocks in %d runs from %s", blockPos, (int)profile_.size(), filename.c_str());
+	return !profile_.empty();
+}
+
+bool PrefetchingFileLoader::SaveProfile(const Path &filename) {
+	// What we read this time goes first, then whatever the old profile had that we didn't get to.
+	std::vector<Run> runs = session_;
+	for (const Run &run : profile_) {
+		for (u32 i = 0; i < run.count; ++i) {
+			if (blockState_[run.start + i] != BLOCK_READ)
+				AppendBlock(runs, run.start + i);
+		}
+	}
+
+	File::IOFile f(filename, "wb");
+	if (!f.IsOpen()) {
+		WARN_LOG(Log::Loader, "Readahead: unable to write %s", filename.c_str());
+		return false;
+	}
+
+	ReadaheadProfileHeader header{};
+	header.magic = READAHEAD_PROFILE_MAGIC;
+	header.version = READAHEAD_PROFILE_VERSION;
+	header.filesize = (u64)filesize_;
+	header.numRuns = (u32)runs.size();
+
+	bool success = f.WriteArray(&header, 1);
+	success = success && f.WriteArray(runs.data(), runs.size());
+	f.Close();
+
+	if (success) {
+		INFO_LOG(Log::Loader, "Readahead: saved %d runs to %s", (int)runs.size(), filename.c_str());
+	} else {
+		// Don't leave a half-written file around.
+		File::Delete(filename);
+	}
+	return success;
+}
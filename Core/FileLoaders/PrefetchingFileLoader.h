@@ -0,0 +1,111 @@
+// Copyright (c) 2026- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Common/CommonTypes.h"
+#include "Core/Loaders.h"
+
+// Learns the order a game reads its disc image in, and replays it ahead of the game on later boots.
+// The blocks read during a session are recorded in the order they were first read, and saved per disc ID
+// in the app cache. Next time, a thread reads them through the backend in the same order, staying a bit
+// ahead of where the game is in the recording. This warms whatever is below: the RAM or disk cache, or
+// just the OS file cache for local files.
+class PrefetchingFileLoader : public ProxiedFileLoader {
+public:
+	PrefetchingFileLoader(FileLoader *backend);
+	~PrefetchingFileLoader();
+
+	// Call once the disc ID is known. Loads the profile and starts prefetching.
+	void Start(const std::string &discID);
+
+	size_t ReadAt(s64 absolutePos, size_t bytes, size_t count, void *data, Flags flags = Flags::NONE) override {
+		return ReadAt(absolutePos, bytes * count, data, flags) / bytes;
+	}
+	size_t ReadAt(s64 absolutePos, size_t bytes, void *data, Flags flags = Flags::NONE) override;
+
+	void Cancel() override;
+
+	// A stretch of blocks, in the order they were read.
+	struct Run {
+		u32 start;
+		u32 count;
+	};
+
+	// Normally only used by Start() and on shutdown, with the profile of the disc ID.
+	// LoadProfile() returns false and leaves the profile empty if the file is missing or doesn't match.
+	bool LoadProfile(const Path &filename);
+	// Saves this session's order, followed by whatever the old profile had that wasn't read this time.
+	bool SaveProfile(const Path &filename);
+	const std::vector<Run> &Profile() const { return profile_; }
+
+private:
+	// Appends a block to a list of runs, extending the last run if it's contiguous.
+	static void AppendBlock(std::vector<Run> &runs, u32 block);
+
+	void StopThread();
+	void PrefetchLoop();
+
+	enum {
+		BLOCK_SIZE = 65536,
+		BLOCK_SHIFT = 16,
+		MAX_BLOCKS_PER_READ = 16,
+		// How far ahead of the game we read, 32 MB.
+		MAX_BLOCKS_AHEAD = 512,
+		MAX_PROFILE_RUNS = 65536,
+	};
+
+	enum BlockState : u8 {
+		BLOCK_UNTOUCHED = 0,
+		BLOCK_PREFETCHED = 1,
+		BLOCK_READ = 2,
+	};
+
+	static constexpr u32 NO_RUN = 0xFFFFFFFF;
+
+	std::string discID_;
+	s64 filesize_ = 0;
+
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	std::thread thread_;
+	bool cancel_ = false;
+
+	// The profile from earlier sessions, and where each of its runs starts, counted in blocks.
+	std::vector<Run> profile_;
+	std::vector<u32> profileBlockPos_;
+	std::vector<u32> blockRun_;
+	// The run the game has reached, and the next one to prefetch.
+	u32 cursor_ = 0;
+	u32 next_ = 0;
+
+	// What this session has read, in order.
+	std::vector<Run> session_;
+	std::vector<u8> blockState_;
+	// Set once the game reads something the profile didn't have.
+	bool dirty_ = false;
+
+	int prefetchedBlocks_ = 0;
+	int hitBlocks_ = 0;
+	int missedBlocks_ = 0;
+};
@@ -17,9 +17,11 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cstring>
 #include <vector>
 
+#include "Common/Data/Encoding/Compression.h"
 #include "Common/Data/Text/I18n.h"
 #include "Common/System/OSD.h"
 #include "Common/Log.h"
@@ -28,6 +30,9 @@
 #include "Common/File/FileUtil.h"
 #include "Common/File/DirListing.h"
 #include "Common/StringUtils.h"
+#include "Common/Thread/ParallelLoop.h"
+#include "Common/Thread/ThreadManager.h"
+#include "Core/Config.h"
 #include "Core/Loaders.h"
 #include "Core/FileSystems/BlockDevices.h"
 #include "Core/FileSystems/ISOFileSystem.h"
@@ -511,12 +516,108 @@ typedef struct ciso_header
 // TODO: Need much better error handling.
 
 static const u32 CSO_READ_BUFFER_SIZE = 256 * 1024;
+// Below this many frames, handing them to other threads costs more than it saves.
+static const int CSO_MIN_PARALLEL_FRAMES = 16;
+
+void DecompressedFrameCache::Init(u32 frameSize, size_t maxBytes) {
+	frameSize_ = frameSize;
+	const u32 capacity = (u32)std::max((size_t)1, maxBytes / frameSize);
+	data_.resize((size_t)capacity * frameSize);
+	slots_.resize(capacity);
+	lookup_.clear();
+	lookup_.reserve(capacity);
+	used_ = 0;
+	head_ = NONE;
+	tail_ = NONE;
+}
+
+void DecompressedFrameCache::Unlink(u32 slot) {
+	Slot &s = slots_[slot];
+	if (s.prev != NONE)
+		slots_[s.prev].next = s.next;
+	else
+		head_ = s.next;
+	if (s.next != NONE)
+		slots_[s.next].prev = s.prev;
+	else
+		tail_ = s.prev;
+}
+
+void DecompressedFrameCache::LinkFront(u32 slot) {
+	Slot &s = slots_[slot];
+	s.prev = NONE;
+	s.next = head_;
+	if (head_ != NONE)
+		slots_[head_].prev = slot;
+	else
+		tail_ = slot;
+	head_ = slot;
+}
+
+void DecompressedFrameCache::LinkBack(u32 slot) {
+	Slot &s = slots_[slot];
+	s.next = NONE;
+	s.prev = tail_;
+	if (tail_ != NONE)
+		slots_[tail_].next = slot;
+	else
+		head_ = slot;
+	tail_ = slot;
+}
+
+const u8 *DecompressedFrameCache::Find(u32 frame) {
+	auto it = lookup_.find(frame);
+	if (it == lookup_.end())
+		return nullptr;
+	const u32 slot = it->second;
+	if (slot != head_) {
+		Unlink(slot);
+		LinkFront(slot);
+	}
+	return SlotData(slot);
+}
+
+u8 *DecompressedFrameCache::Insert(u32 frame) {
+	auto it = lookup_.find(frame);
+	if (it != lookup_.end()) {
+		Unlink(it->second);
+		LinkFront(it->second);
+		return SlotData(it->second);
+	}
+
+	u32 slot;
+	if (used_ < slots_.size()) {
+		slot = used_++;
+	} else {
+		slot = tail_;
+		Unlink(slot);
+		if (slots_[slot].frame != NONE)
+			lookup_.erase(slots_[slot].frame);
+	}
+	slots_[slot].frame = frame;
+	LinkFront(slot);
+	lookup_[frame] = slot;
+	return SlotData(slot);
+}
+
+void DecompressedFrameCache::Remove(u32 frame) {
+	auto it = lookup_.find(frame);
+	if (it == lookup_.end())
+		return;
+	const u32 slot = it->second;
+	lookup_.erase(it);
+	// Reuse it first.
+	slots_[slot].frame = NONE;
+	Unlink(slot);
+	LinkBack(slot);
+}
 
 CISOFileBlockDevice::CISOFileBlockDevice(FileLoader *fileLoader)
 	: BlockDevice(fileLoader)
 {
 	// CISO format is fairly simple, but most tools do not write the header_size.
-	// NOTE: CSOv2 isn't actually a thing. It was partially implemented in maxcso but it has never been in active use.
+	// CSOv2 comes from maxcso. Frames that don't shrink are stored plain, and the high bit of
+	// the index marks LZ4 instead of deflate.
 
 	CISO_H hdr;
 	size_t readSize = fileLoader->ReadAt(0, sizeof(CISO_H), 1, &hdr);
@@ -524,7 +625,7 @@ CISOFileBlockDevice::CISOFileBlockDevice(FileLoader *fileLoader)
 		errorString_ = "Invalid CSO!";
 		return;
 	}
-	if (hdr.ver > 1) {
+	if (hdr.ver > 2) {
 		errorString_ = "CSO version too high!";
 		return;
 	}
@@ -550,12 +651,17 @@ CISOFileBlockDevice::CISOFileBlockDevice(FileLoader *fileLoader)
 	VERBOSE_LOG(Log::Loader, "CSO numBlocks=%i numFrames=%i align=%i", numBlocks, numFrames, indexShift);
 
 	// We might read a bit of alignment too, so be prepared.
-	if (frameSize + (1 << indexShift) < CSO_READ_BUFFER_SIZE)
-		readBuffer = new u8[CSO_READ_BUFFER_SIZE];
-	else
-		readBuffer = new u8[frameSize + (1 << indexShift)];
-	zlibBuffer = new u8[frameSize + (1 << indexShift)];
-	zlibBufferFrame = numFrames;
+	readBufferSize_ = std::max(CSO_READ_BUFFER_SIZE, frameSize + (1 << indexShift));
+	readBuffer = new u8[readBufferSize_];
+	frameCache_.Init(frameSize, (size_t)std::max(g_Config.iCSOFrameCacheSizeKB, 0) * 1024);
+
+	zstream_ = new z_stream{};
+	if (inflateInit2(zstream_, -15) != Z_OK) {
+		errorString_ = StringFromFormat("Unable to initialize inflate: %s", zstream_->msg ? zstream_->msg : "?");
+		delete zstream_;
+		zstream_ = nullptr;
+		return;
+	}
 
 	const u32 indexSize = numFrames + 1;
 	const size_t headerEnd = hdr.ver > 1 ? (size_t)hdr.header_size : sizeof(hdr);
@@ -600,7 +706,52 @@ CISOFileBlockDevice::~CISOFileBlockDevice()
 {
 	delete [] index;
 	delete [] readBuffer;
-	delete [] zlibBuffer;
+	if (zstream_) {
+		inflateEnd(zstream_);
+		delete zstream_;
+	}
+}
+
+CISOFileBlockDevice::FrameType CISOFileBlockDevice::GetFrameType(u32 frame, u32 compressedSize) const {
+	if (ver_ >= 2) {
+		// CSO v2+ requires blocks be uncompressed if large enough to be.  High bit means LZ4.
+		if (compressedSize >= frameSize)
+			return FrameType::PLAIN;
+		return (index[frame] & 0x80000000) != 0 ? FrameType::LZ4 : FrameType::DEFLATE;
+	}
+	return (index[frame] & 0x80000000) != 0 ? FrameType::PLAIN : FrameType::DEFLATE;
+}
+
+bool CISOFileBlockDevice::DecompressFrame(z_stream_s *z, u32 frame, const u8 *src, u32 srcSize, u8 *dst) const {
+	if (GetFrameType(frame, srcSize) == FrameType::LZ4) {
+		size_t outSize = 0;
+		if (!decompress_lz4_block(src, srcSize, dst, frameSize, &outSize)) {
+			ERROR_LOG(Log::Loader, "LZ4 frame %d: corrupt data", frame);
+			return false;
+		}
+		if (outSize != frameSize) {
+			ERROR_LOG(Log::Loader, "LZ4 frame %d: block size error %d != %d", frame, (u32)outSize, frameSize);
+			return false;
+		}
+		return true;
+	}
+
+	inflateReset(z);
+	z->avail_in = srcSize;
+	z->next_in = const_cast<u8 *>(src);
+	z->avail_out = frameSize;
+	z->next_out = dst;
+
+	int status = inflate(z, Z_FINISH);
+	if (status != Z_STREAM_END) {
+		ERROR_LOG(Log::Loader, "Inflate frame %d: failed - %s[%d]", frame, (z->msg) ? z->msg : "error", status);
+		return false;
+	}
+	if (z->total_out != frameSize) {
+		ERROR_LOG(Log::Loader, "Inflate frame %d: block size error %d != %d", frame, (u32)z->total_out, frameSize);
+		return false;
+	}
+	return true;
 }
 
 bool CISOFileBlockDevice::ReadBlock(int blockNumber, u8 *outPtr, bool uncached)
@@ -612,65 +763,38 @@ bool CISOFileBlockDevice::ReadBlock(int blockNumber, u8 *outPtr, bool uncached)
 	}
 
 	const u32 frameNumber = blockNumber >> blockShift;
-	const u32 idx = index[frameNumber];
-	const u32 indexPos = idx & 0x7FFFFFFF;
+	const u32 indexPos = index[frameNumber] & 0x7FFFFFFF;
 	const u32 nextIndexPos = index[frameNumber + 1] & 0x7FFFFFFF;
-	z_stream z{};
 
 	const u64 compressedReadPos = (u64)indexPos << indexShift;
 	const u64 compressedReadEnd = (u64)nextIndexPos << indexShift;
 	const size_t compressedReadSize = (size_t)(compressedReadEnd - compressedReadPos);
 	const u32 compressedOffset = (blockNumber & ((1 << blockShift) - 1)) * GetBlockSize();
 
-	bool plain = (idx & 0x80000000) != 0;
-	if (ver_ >= 2) {
-		// CSO v2+ requires blocks be uncompressed if large enough to be.  High bit means other things.
-		plain = compressedReadSize >= frameSize;
-	}
-	if (plain) {
+	if (GetFrameType(frameNumber, (u32)compressedReadSize) == FrameType::PLAIN) {
 		int readSize = (u32)fileLoader_->ReadAt(compressedReadPos + compressedOffset, 1, GetBlockSize(), outPtr, flags);
 		if (readSize < GetBlockSize())
 			memset(outPtr + readSize, 0, GetBlockSize() - readSize);
-	} else if (zlibBufferFrame == frameNumber) {
+	} else if (const u8 *cached = frameCache_.Find(frameNumber)) {
 		// We already have it.  Just apply the offset and copy.
-		memcpy(outPtr, zlibBuffer + compressedOffset, GetBlockSize());
+		memcpy(outPtr, cached + compressedOffset, GetBlockSize());
 	} else {
-		const u32 readSize = (u32)fileLoader_->ReadAt(compressedReadPos, 1, compressedReadSize, readBuffer, flags);
-
-		z.zalloc = Z_NULL;
-		z.zfree = Z_NULL;
-		z.opaque = Z_NULL;
-		if (inflateInit2(&z, -15) != Z_OK) {
-			ERROR_LOG(Log::Loader, "GetBlockSize() ERROR: %s\n", (z.msg) ? z.msg : "?");
+		if (compressedReadSize > readBufferSize_) {
+			ERROR_LOG(Log::Loader, "block %d: compressed frame too large (%d bytes)", blockNumber, (int)compressedReadSize);
 			NotifyReadError();
-			return false;
-		}
-		z.avail_in = readSize;
-		z.next_out = frameSize == (u32)GetBlockSize() ? outPtr : zlibBuffer;
-		z.avail_out = frameSize;
-		z.next_in = readBuffer;
-
-		int status = inflate(&z, Z_FINISH);
-		if (status != Z_STREAM_END) {
-			ERROR_LOG(Log::Loader, "block %d: inflate : %s[%d]\n", blockNumber, (z.msg) ? z.msg : "error", status);
-			NotifyReadError();
-			inflateEnd(&z);
 			memset(outPtr, 0, GetBlockSize());
 			return false;
 		}
-		if (z.total_out != frameSize) {
-			ERROR_LOG(Log::Loader, "block %d: block size error %d != %d\n", blockNumber, (u32)z.total_out, frameSize);
+		const u32 readSize = (u32)fileLoader_->ReadAt(compressedReadPos, 1, compressedReadSize, readBuffer, flags);
+
+		u8 *frameBuffer = frameCache_.Insert(frameNumber);
+		if (!DecompressFrame(zstream_, frameNumber, readBuffer, readSize, frameBuffer)) {
+			frameCache_.Remove(frameNumber);
 			NotifyReadError();
-			inflateEnd(&z);
 			memset(outPtr, 0, GetBlockSize());
 			return false;
 		}
-		inflateEnd(&z);
-
-		if (frameSize != (u32)GetBlockSize()) {
-			zlibBufferFrame = frameNumber;
-			memcpy(outPtr, zlibBuffer + compressedOffset, GetBlockSize());
-		}
+		memcpy(outPtr, frameBuffer + compressedOffset, GetBlockSize());
 	}
 	return true;
 }
@@ -692,81 +816,104 @@ bool CISOFileBlockDevice::ReadBlocks(u32 minBlock, int count, u8 *outPtr) {
 
 	const u32 minFrameNumber = minBlock >> blockShift;
 	const u32 lastFrameNumber = lastBlock >> blockShift;
-	const u32 afterLastIndexPos = index[lastFrameNumber + 1] & 0x7FFFFFFF;
-	const u64 totalReadEnd = (u64)afterLastIndexPos << indexShift;
-
-	z_stream z{};
-	if (inflateInit2(&z, -15) != Z_OK) {
-		ERROR_LOG(Log::Loader, "Unable to initialize inflate: %s\n", (z.msg) ? z.msg : "?");
-		return false;
-	}
+	// Large streaming reads would only flush out frames that are more likely to be read again.
+	const bool cacheFullFrames = lastFrameNumber - minFrameNumber < frameCache_.Capacity() / 4;
+
+	// Whole frames that need decompressing go straight to outPtr, possibly on several threads.
+	struct PendingFrame {
+		u32 frame;
+		const u8 *src;
+		u32 srcSize;
+		u8 *dst;
+		bool ok;
+	};
+	std::vector<PendingFrame> pending;
+	std::atomic<bool> failed{};
 
-	u64 readBufferStart = 0;
-	u64 readBufferEnd = 0;
 	u32 block = minBlock;
 	const u32 blocksPerFrame = 1 << blockShift;
-	for (u32 frame = minFrameNumber; frame <= lastFrameNumber; ++frame) {
-		const u32 idx = index[frame];
-		const u32 indexPos = idx & 0x7FFFFFFF;
-		const u32 nextIndexPos = index[frame + 1] & 0x7FFFFFFF;
-
-		const u64 frameReadPos = (u64)indexPos << indexShift;
-		const u64 frameReadEnd = (u64)nextIndexPos << indexShift;
-		const u32 frameReadSize = (u32)(frameReadEnd - frameReadPos);
-		const u32 frameBlockOffset = block & ((1 << blockShift) - 1);
-		const u32 frameBlocks = std::min(lastBlock - block + 1, blocksPerFrame - frameBlockOffset);
-
-		if (frameReadEnd > readBufferEnd) {
-			const s64 maxNeeded = totalReadEnd - frameReadPos;
-			const size_t chunkSize = (size_t)std::min(maxNeeded, (s64)std::max(frameReadSize, CSO_READ_BUFFER_SIZE));
-
-			const u32 readSize = (u32)fileLoader_->ReadAt(frameReadPos, 1, chunkSize, readBuffer);
-			if (readSize < chunkSize) {
-				memset(readBuffer + readSize, 0, chunkSize - readSize);
+	u32 frame = minFrameNumber;
+	while (frame <= lastFrameNumber) {
+		// Read as many frames as fit in the buffer at once.
+		const u64 batchReadPos = (u64)(index[frame] & 0x7FFFFFFF) << indexShift;
+		u32 batchEnd = frame + 1;
+		while (batchEnd <= lastFrameNumber && ((u64)(index[batchEnd + 1] & 0x7FFFFFFF) << indexShift) - batchReadPos <= readBufferSize_)
+			++batchEnd;
+		const u64 batchReadEnd = (u64)(index[batchEnd] & 0x7FFFFFFF) << indexShift;
+		const size_t chunkSize = (size_t)std::min(batchReadEnd - batchReadPos, (u64)readBufferSize_);
+
+		const u32 readSize = (u32)fileLoader_->ReadAt(batchReadPos, 1, chunkSize, readBuffer);
+		if (readSize < chunkSize) {
+			memset(readBuffer + readSize, 0, chunkSize - readSize);
+		}
+
+		pending.clear();
+		for (; frame < batchEnd; ++frame) {
+			const u64 frameReadPos = (u64)(index[frame] & 0x7FFFFFFF) << indexShift;
+			const u64 frameReadEnd = (u64)(index[frame + 1] & 0x7FFFFFFF) << indexShift;
+			const u32 frameReadSize = (u32)std::min(frameReadEnd - frameReadPos, (u64)chunkSize - (frameReadPos - batchReadPos));
+			const u32 frameBlockOffset = block & ((1 << blockShift) - 1);
+			const u32 frameBlocks = std::min(lastBlock - block + 1, blocksPerFrame - frameBlockOffset);
+			const u8 *rawBuffer = &readBuffer[frameReadPos - batchReadPos];
+
+			if (GetFrameType(frame, frameReadSize) == FrameType::PLAIN) {
+				memcpy(outPtr, rawBuffer + frameBlockOffset * GetBlockSize(), frameBlocks * GetBlockSize());
+			} else if (const u8 *cached = frameCache_.Find(frame)) {
+				memcpy(outPtr, cached + frameBlockOffset * GetBlockSize(), frameBlocks * GetBlockSize());
+			} else if (frameBlocks == blocksPerFrame) {
+				pending.push_back(PendingFrame{ frame, rawBuffer, frameReadSize, outPtr, false });
+			} else {
+				// Partial frames go through the cache, since we'll likely want the rest soon.
+				u8 *frameBuffer = frameCache_.Insert(frame);
+				if (DecompressFrame(zstream_, frame, rawBuffer, frameReadSize, frameBuffer)) {
+					memcpy(outPtr, frameBuffer + frameBlockOffset * GetBlockSize(), frameBlocks * GetBlockSize());
+				} else {
+					frameCache_.Remove(frame);
+					failed = true;
+					memset(outPtr, 0, frameBlocks * GetBlockSize());
+				}
 			}
 
-			readBufferStart = frameReadPos;
-			readBufferEnd = frameReadPos + readSize;
+			block += frameBlocks;
+			outPtr += frameBlocks * GetBlockSize();
 		}
 
-		u8 *rawBuffer = &readBuffer[frameReadPos - readBufferStart];
-		bool plain = (idx & 0x80000000) != 0;
-		if (ver_ >= 2) {
-			// CSO v2+ requires blocks be uncompressed if large enough to be.  High bit means other things.
-			plain = frameReadSize >= frameSize;
+		auto decompressRange = [&](z_stream_s *z, int l, int h) {
+			for (int i = l; i < h; ++i) {
+				PendingFrame &p = pending[i];
+				p.ok = z && DecompressFrame(z, p.frame, p.src, p.srcSize, p.dst);
+				if (!p.ok) {
+					failed = true;
+					memset(p.dst, 0, frameSize);
+				}
+			}
+		};
+		if (pending.size() >= CSO_MIN_PARALLEL_FRAMES && g_threadManager.GetNumLooperThreads() > 1) {
+			ParallelRangeLoop(&g_threadManager, [&](int l, int h) {
+				z_stream z{};
+				if (inflateInit2(&z, -15) != Z_OK) {
+					ERROR_LOG(Log::Loader, "Unable to initialize inflate: %s", (z.msg) ? z.msg : "?");
+					decompressRange(nullptr, l, h);
+					return;
+				}
+				decompressRange(&z, l, h);
+				inflateEnd(&z);
+			}, 0, (int)pending.size(), CSO_MIN_PARALLEL_FRAMES / 2, TaskPriority::HIGH);
+		} else {
+			decompressRange(zstream_, 0, (int)pending.size());
 		}
 
-		if (plain) {
-			memcpy(outPtr, rawBuffer + frameBlockOffset * GetBlockSize(), frameBlocks * GetBlockSize());
-		} else {
-			z.avail_in = frameReadSize;
-			z.next_out = frameBlocks == blocksPerFrame ? outPtr : zlibBuffer;
-			z.avail_out = frameSize;
-			z.next_in = rawBuffer;
-
-			int status = inflate(&z, Z_FINISH);
-			if (status != Z_STREAM_END) {
-				ERROR_LOG(Log::Loader, "Inflate frame %d: failed - %s[%d]\n", frame, (z.msg) ? z.msg : "error", status);
-				NotifyReadError();
-				memset(outPtr, 0, frameBlocks * GetBlockSize());
-			} else if (z.total_out != frameSize) {
-				ERROR_LOG(Log::Loader, "Inflate frame %d: block size error %d != %d\n", frame, (u32)z.total_out, frameSize);
-				NotifyReadError();
-				memset(outPtr, 0, frameBlocks * GetBlockSize());
-			} else if (frameBlocks != blocksPerFrame) {
-				memcpy(outPtr, zlibBuffer + frameBlockOffset * GetBlockSize(), frameBlocks * GetBlockSize());
-				// In case we end up reusing it in a single read later.
-				zlibBufferFrame = frame;
+		if (cacheFullFrames) {
+			for (const PendingFrame &p : pending) {
+				if (p.ok)
+					memcpy(frameCache_.Insert(p.frame), p.dst, frameSize);
 			}
-
-			inflateReset(&z);
 		}
-
-		block += frameBlocks;
-		outPtr += frameBlocks * GetBlockSize();
 	}
 
-	inflateEnd(&z);
+	if (failed) {
+		NotifyReadError();
+	}
 	return true;
 }
 
@@ -955,29 +1102,41 @@ bool NPDRMDemoBlockDevice::ReadBlock(int blockNumber, u8 *outPtr, bool uncached)
 	return true;
 }
 
-struct CHDImpl {
-	chd_file *chd = nullptr;
-	const chd_header *header = nullptr;
-};
+// Below this many hunks, handing them to other threads costs more than it saves.
+static const int CHD_MIN_PARALLEL_HUNKS = 8;
+// Each extra handle has its own copy of the hunk map and codec state, so keep the count down.
+static const int CHD_MAX_DECODE_HANDLES = 4;
 
 struct ExtendedCoreFile {
 	core_file core;  // Must be the first struct member, for some tricky pointer casts.
 	uint64_t seekPos;
 };
 
-CHDFileBlockDevice::CHDFileBlockDevice(FileLoader *fileLoader)
-	: BlockDevice(fileLoader), impl_(new CHDImpl()) {
-	Path paths[8];
-	paths[0] = fileLoader->GetPath();
-	int depth = 0;
+struct CHDHandle {
+	ExtendedCoreFile *coreFile = nullptr;
+	chd_file *chd = nullptr;
+};
+
+struct CHDImpl {
+	chd_file *chd = nullptr;
+	const chd_header *header = nullptr;
 
-	core_file_ = new ExtendedCoreFile();
-	core_file_->core.argp = fileLoader;
-	core_file_->core.fsize = [](core_file *file) -> uint64_t {
+	// A chd_file can only decode one hunk at a time, so decoding on several threads needs more of them.
+	// They're opened on first use, and are all back in here between reads.
+	std::mutex handleLock;
+	std::vector<CHDHandle> freeHandles;
+	// Held while a worker decodes with chd, when it couldn't get a handle of its own.
+	std::mutex chdLock;
+};
+
+static ExtendedCoreFile *CreateCoreFile(FileLoader *fileLoader) {
+	ExtendedCoreFile *coreFile = new ExtendedCoreFile();
+	coreFile->core.argp = fileLoader;
+	coreFile->core.fsize = [](core_file *file) -> uint64_t {
 		FileLoader *loader = (FileLoader *)file->argp;
 		return loader->FileSize();
 	};
-	core_file_->core.fseek = [](core_file *file, int64_t offset, int seekType) -> int {
+	coreFile->core.fseek = [](core_file *file, int64_t offset, int seekType) -> int {
 		ExtendedCoreFile *coreFile = (ExtendedCoreFile *)file;
 		switch (seekType) {
 		case SEEK_SET:
@@ -997,7 +1156,7 @@ CHDFileBlockDevice::CHDFileBlockDevice(FileLoader *fileLoader)
 		}
 		return 0;
 	};
-	core_file_->core.fread = [](void *out_data, size_t size, size_t count, core_file *file) {
+	coreFile->core.fread = [](void *out_data, size_t size, size_t count, core_file *file) {
 		ExtendedCoreFile *coreFile = (ExtendedCoreFile *)file;
 		FileLoader *loader = (FileLoader *)file->argp;
 		uint64_t totalSize = size * count;
@@ -1005,11 +1164,50 @@ CHDFileBlockDevice::CHDFileBlockDevice(FileLoader *fileLoader)
 		coreFile->seekPos += totalSize;
 		return size * count;
 	};
-	core_file_->core.fclose = [](core_file *file) {
+	coreFile->core.fclose = [](core_file *file) {
 		ExtendedCoreFile *coreFile = (ExtendedCoreFile *)file;
 		delete coreFile;
 		return 0;
 	};
+	return coreFile;
+}
+
+// Returns false if no handle could be opened, nothing needs to be released then.
+static bool AcquireCHDHandle(CHDImpl *impl, FileLoader *fileLoader, CHDHandle *handle) {
+	{
+		std::lock_guard<std::mutex> guard(impl->handleLock);
+		if (!impl->freeHandles.empty()) {
+			*handle = impl->freeHandles.back();
+			impl->freeHandles.pop_back();
+			return true;
+		}
+	}
+
+	handle->coreFile = CreateCoreFile(fileLoader);
+	handle->chd = nullptr;
+	chd_error err = chd_open_core_file(&handle->coreFile->core, CHD_OPEN_READ, NULL, &handle->chd);
+	if (err != CHDERR_NONE) {
+		// Don't keep it around, the next read might well succeed in opening one.
+		ERROR_LOG(Log::Loader, "Unable to open another CHD handle: %s", chd_error_string(err));
+		delete handle->coreFile;
+		*handle = CHDHandle();
+		return false;
+	}
+	return true;
+}
+
+static void ReleaseCHDHandle(CHDImpl *impl, const CHDHandle &handle) {
+	std::lock_guard<std::mutex> guard(impl->handleLock);
+	impl->freeHandles.push_back(handle);
+}
+
+CHDFileBlockDevice::CHDFileBlockDevice(FileLoader *fileLoader)
+	: BlockDevice(fileLoader), impl_(new CHDImpl()) {
+	Path paths[8];
+	paths[0] = fileLoader->GetPath();
+	int depth = 0;
+
+	core_file_ = CreateCoreFile(fileLoader);
 
 	/*
 	// TODO: Support parent/child CHD files.
@@ -1072,55 +1270,171 @@ CHDFileBlockDevice::CHDFileBlockDevice(FileLoader *fileLoader)
 	impl_->chd = file;
 	impl_->header = chd_get_header(impl_->chd);
 
-	readBuffer = new u8[impl_->header->hunkbytes];
-	currentHunk = -1;
-	blocksPerHunk = impl_->header->hunkbytes / impl_->header->unitbytes;
+	if (impl_->header->unitbytes < (u32)GetBlockSize() || impl_->header->hunkbytes < impl_->header->unitbytes) {
+		errorString_ = StringFromFormat("CHD error: %s: unsupported unit size %d", paths[depth].c_str(), impl_->header->unitbytes);
+		return;
+	}
+
+	const u32 hunkBytes = impl_->header->hunkbytes;
+	blocksPerHunk = hunkBytes / impl_->header->unitbytes;
 	numBlocks = impl_->header->unitcount;
 
+	hunkCache_.Init(hunkBytes, (size_t)std::max(g_Config.iCHDHunkCacheSizeKB, 0) * 1024);
+	// Don't let read ahead hunks push out more than half the cache.
+	readaheadHunks_ = std::min((u32)std::max(g_Config.iCHDReadaheadKB, 0) * 1024 / hunkBytes, hunkCache_.Capacity() / 2);
+
 	_dbg_assert_(errorString_.empty());
 }
 
 CHDFileBlockDevice::~CHDFileBlockDevice() {
+	for (const CHDHandle &handle : impl_->freeHandles) {
+		chd_close(handle.chd);
+		delete handle.coreFile;
+	}
 	if (impl_->chd) {
 		chd_close(impl_->chd);
-		delete[] readBuffer;
 	}
+	// libchdr doesn't close core files it didn't open itself.
+	delete core_file_;
 }
 
 bool CHDFileBlockDevice::ReadBlock(int blockNumber, u8 *outPtr, bool uncached) {
-	if (!impl_->chd) {
-		ERROR_LOG(Log::Loader, "ReadBlock: CHD not open. %s", fileLoader_->GetPath().c_str());
-		return false;
-	}
 	if ((u32)blockNumber >= numBlocks) {
 		memset(outPtr, 0, GetBlockSize());
 		return false;
 	}
-	u32 hunk = blockNumber / blocksPerHunk;
-	u32 blockInHunk = blockNumber % blocksPerHunk;
-
-	if (currentHunk != hunk) {
-		chd_error err = chd_read(impl_->chd, hunk, readBuffer);
-		if (err != CHDERR_NONE) {
-			ERROR_LOG(Log::Loader, "CHD read failed: %d %d %s", blockNumber, hunk, chd_error_string(err));
-			NotifyReadError();
-		}
-		currentHunk = hunk;
-	}
-	memcpy(outPtr, readBuffer + blockInHunk * impl_->header->unitbytes, GetBlockSize());
-	return true;
+	return ReadBlocks(blockNumber, 1, outPtr);
 }
 
 bool CHDFileBlockDevice::ReadBlocks(u32 minBlock, int count, u8 *outPtr) {
+	if (!impl_->chd) {
+		ERROR_LOG(Log::Loader, "ReadBlocks: CHD not open. %s", fileLoader_->GetPath().c_str());
+		return false;
+	}
 	if (minBlock >= numBlocks) {
 		memset(outPtr, 0, GetBlockSize() * count);
 		return false;
 	}
 
-	for (int i = 0; i < count; i++) {
-		if (!ReadBlock(minBlock + i, outPtr + i * GetBlockSize())) {
-			return false;
+	const u32 lastBlock = std::min(minBlock + count, numBlocks) - 1;
+	const u32 missingBlocks = count - (lastBlock + 1 - minBlock);
+	if (missingBlocks != 0) {
+		memset(outPtr + GetBlockSize() * (count - missingBlocks), 0, GetBlockSize() * missingBlocks);
+	}
+
+	const u32 unitBytes = impl_->header->unitbytes;
+	const u32 hunkBytes = impl_->header->hunkbytes;
+	const u32 firstHunk = minBlock / blocksPerHunk;
+	const u32 lastHunk = lastBlock / blocksPerHunk;
+	// Large streaming reads would only flush out hunks that are more likely to be read again.
+	const bool cacheFullHunks = lastHunk - firstHunk < hunkCache_.Capacity() / 4;
+
+	// When the game streams, decode a bit past what it asks for. Top up once half of that is used,
+	// so there's a batch worth spreading over threads rather than one hunk per read.
+	u32 readaheadEnd = lastHunk;
+	if (readaheadHunks_ != 0 && minBlock == nextBlock_) {
+		if (lastHunk + readaheadHunks_ / 2 >= readaheadEnd_) {
+			readaheadEnd = std::min(lastHunk + readaheadHunks_, impl_->header->totalhunks - 1);
+			readaheadEnd_ = readaheadEnd;
+		}
+	} else {
+		readaheadEnd_ = lastHunk;
+	}
+	nextBlock_ = lastBlock + 1;
+
+	// Only the part of a hunk that's wanted is copied out, from wherever it ends up.
+	auto copyWanted = [&](u32 hunk, const u8 *src) {
+		const u32 hunkFirstBlock = hunk * blocksPerHunk;
+		const u32 start = std::max(minBlock, hunkFirstBlock);
+		const u32 end = std::min(lastBlock + 1, hunkFirstBlock + blocksPerHunk);
+		if (unitBytes == (u32)GetBlockSize()) {
+			memcpy(outPtr + (size_t)(start - minBlock) * unitBytes, src + (size_t)(start - hunkFirstBlock) * unitBytes, (size_t)(end - start) * unitBytes);
+			return;
+		}
+		// Units can be bigger than our blocks (like CD images), only the start of each one is copied.
+		for (u32 block = start; block < end; ++block) {
+			memcpy(outPtr + (size_t)(block - minBlock) * GetBlockSize(), src + (size_t)(block - hunkFirstBlock) * unitBytes, GetBlockSize());
 		}
+	};
+
+	// Whole hunks are decoded straight to outPtr, the rest to scratch_.
+	struct PendingHunk {
+		u32 hunk;
+		u8 *dst;
+		bool whole;
+		bool ok;
+	};
+	std::vector<PendingHunk> pending;
+	size_t scratchHunks = 0;
+	for (u32 hunk = firstHunk; hunk <= readaheadEnd; ++hunk) {
+		const u32 hunkFirstBlock = hunk * blocksPerHunk;
+		const bool wanted = hunk <= lastHunk;
+		if (const u8 *cached = hunkCache_.Find(hunk)) {
+			if (wanted)
+				copyWanted(hunk, cached);
+			continue;
+		}
+		// Only if the hunk has the same layout as outPtr, of course.
+		if (wanted && unitBytes == (u32)GetBlockSize() && hunkFirstBlock >= minBlock && hunkFirstBlock + blocksPerHunk - 1 <= lastBlock) {
+			pending.push_back(PendingHunk{ hunk, outPtr + (size_t)(hunkFirstBlock - minBlock) * unitBytes, true, false });
+		} else {
+			pending.push_back(PendingHunk{ hunk, nullptr, false, false });
+			scratchHunks++;
+		}
+	}
+
+	if (scratch_.size() < scratchHunks * hunkBytes) {
+		scratch_.resize(scratchHunks * hunkBytes);
+	}
+	u8 *scratchPtr = scratch_.data();
+	for (PendingHunk &p : pending) {
+		if (!p.whole) {
+			p.dst = scratchPtr;
+			scratchPtr += hunkBytes;
+		}
+	}
+
+	std::atomic<bool> failed{};
+	auto decodeRange = [&](chd_file *chd, int l, int h) {
+		for (int i = l; i < h; ++i) {
+			PendingHunk &p = pending[i];
+			chd_error err = chd_read(chd, p.hunk, p.dst);
+			p.ok = err == CHDERR_NONE;
+			if (!p.ok) {
+				ERROR_LOG(Log::Loader, "CHD read failed: %d %s", p.hunk, chd_error_string(err));
+				failed = true;
+				memset(p.dst, 0, hunkBytes);
+			}
+		}
+	};
+	if (pending.size() >= CHD_MIN_PARALLEL_HUNKS && g_threadManager.GetNumLooperThreads() > 1) {
+		// Big enough pieces that no more than CHD_MAX_DECODE_HANDLES or so run at once.
+		const int minSize = std::max(CHD_MIN_PARALLEL_HUNKS / 2, ((int)pending.size() + CHD_MAX_DECODE_HANDLES - 1) / CHD_MAX_DECODE_HANDLES);
+		ParallelRangeLoop(&g_threadManager, [&](int l, int h) {
+			CHDHandle handle;
+			if (AcquireCHDHandle(impl_.get(), fileLoader_, &handle)) {
+				decodeRange(handle.chd, l, h);
+				ReleaseCHDHandle(impl_.get(), handle);
+			} else {
+				// Slower, but still correct.
+				std::lock_guard<std::mutex> guard(impl_->chdLock);
+				decodeRange(impl_->chd, l, h);
+			}
+		}, 0, (int)pending.size(), minSize, TaskPriority::HIGH);
+	} else {
+		decodeRange(impl_->chd, 0, (int)pending.size());
+	}
+
+	for (const PendingHunk &p : pending) {
+		if (!p.whole && p.hunk <= lastHunk)
+			copyWanted(p.hunk, p.dst);
+		// Partial and read ahead hunks are likely to be wanted soon.
+		if (p.ok && (!p.whole || cacheFullHunks))
+			memcpy(hunkCache_.Insert(p.hunk), p.dst, hunkBytes);
+	}
+
+	if (failed) {
+		NotifyReadError();
 	}
 	return true;
 }
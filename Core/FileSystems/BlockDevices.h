@@ -25,12 +25,15 @@
 
 #include <mutex>
 #include <memory>
+#include <unordered_map>
+#include <vector>
 
 #include "Common/CommonTypes.h"
 
 #include "ext/libkirk/kirk_engine.h"
 
 class FileLoader;
+struct z_stream_s;
 
 class BlockDevice {
 public:
@@ -65,6 +68,43 @@ class BlockDevice {
 	std::string errorString_;
 };
 
+// Keeps the most recently used frames of a compressed image in decompressed form.
+class DecompressedFrameCache {
+public:
+	// Always holds at least one frame.
+	void Init(u32 frameSize, size_t maxBytes);
+	u32 Capacity() const { return (u32)slots_.size(); }
+
+	// Returns nullptr if the frame isn't cached.
+	const u8 *Find(u32 frame);
+	// Returns space to decompress the frame into, dropping the least recently used one if full.
+	u8 *Insert(u32 frame);
+	// Call if filling in the space from Insert failed.
+	void Remove(u32 frame);
+
+private:
+	static constexpr u32 NONE = 0xFFFFFFFF;
+	struct Slot {
+		u32 frame;
+		u32 prev;
+		u32 next;
+	};
+
+	void Unlink(u32 slot);
+	void LinkFront(u32 slot);
+	void LinkBack(u32 slot);
+	u8 *SlotData(u32 slot) { return data_.data() + (size_t)slot * frameSize_; }
+
+	std::vector<u8> data_;
+	std::vector<Slot> slots_;
+	std::unordered_map<u32, u32> lookup_;
+	u32 frameSize_ = 0;
+	u32 used_ = 0;
+	// Most and least recently used.
+	u32 head_ = NONE;
+	u32 tail_ = NONE;
+};
+
 class CISOFileBlockDevice : public BlockDevice {
 public:
 	CISOFileBlockDevice(FileLoader *fileLoader);
@@ -75,10 +115,20 @@ class CISOFileBlockDevice : public BlockDevice {
 	bool IsDisc() const override { return true; }
 
 private:
+	enum class FrameType {
+		PLAIN,
+		DEFLATE,
+		LZ4,
+	};
+
+	FrameType GetFrameType(u32 frame, u32 compressedSize) const;
+	bool DecompressFrame(z_stream_s *z, u32 frame, const u8 *src, u32 srcSize, u8 *dst) const;
+
 	u32 *index = nullptr;
 	u8 *readBuffer = nullptr;
-	u8 *zlibBuffer = nullptr;
-	u32 zlibBufferFrame = 0;
+	u32 readBufferSize_ = 0;
+	z_stream_s *zstream_ = nullptr;
+	DecompressedFrameCache frameCache_;
 	u8 indexShift = 0;
 	u8 blockShift = 0;
 	u32 frameSize = 0;
@@ -208,10 +258,16 @@ class CHDFileBlockDevice : public BlockDevice {
 private:
 	struct ExtendedCoreFile *core_file_ = nullptr;
 	std::unique_ptr<CHDImpl> impl_;
-	u8 *readBuffer = nullptr;
-	u32 currentHunk = 0;
 	u32 blocksPerHunk = 0;
 	u32 numBlocks = 0;
+
+	DecompressedFrameCache hunkCache_;
+	// Space for hunks that only partly go to the caller, or not at all when read ahead.
+	std::vector<u8> scratch_;
+	// Where the last read ended, to detect sequential reads, and how far we've decoded past it.
+	u32 nextBlock_ = 0;
+	u32 readaheadEnd_ = 0;
+	u32 readaheadHunks_ = 0;
 };
 
 BlockDevice *ConstructBlockDevice(FileLoader *fileLoader, std::string *errorString);
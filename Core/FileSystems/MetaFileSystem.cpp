@@ -21,6 +21,7 @@
 #include "Common/StringUtils.h"
 #include "Core/FileSystems/MetaFileSystem.h"
 #include "Core/HLE/sceKernelThread.h"
+#include "Core/MemDirty.h"
 #include "Core/Reporting.h"
 #include "Core/System.h"
 
@@ -530,10 +531,13 @@ size_t MetaFileSystem::ReadFile(u32 handle, u8 *pointer, s64 size)
 {
 	std::lock_guard<std::recursive_mutex> guard(lock);
 	IFileSystem *sys = GetHandleOwner(handle);
-	if (sys)
+	if (sys) {
+		// The host read() would fail on write-watched RAM rather than fault.
+		Memory::DirtyTrackingHostWrite hostWrite(pointer, size > 0 ? (size_t)size : 0);
 		return sys->ReadFile(handle, pointer, size);
-	else
+	} else {
 		return 0;
+	}
 }
 
 size_t MetaFileSystem::WriteFile(u32 handle, const u8 *pointer, s64 size)
@@ -550,10 +554,12 @@ size_t MetaFileSystem::ReadFile(u32 handle, u8 *pointer, s64 size, int &usec)
 {
 	std::lock_guard<std::recursive_mutex> guard(lock);
 	IFileSystem *sys = GetHandleOwner(handle);
-	if (sys)
+	if (sys) {
+		Memory::DirtyTrackingHostWrite hostWrite(pointer, size > 0 ? (size_t)size : 0);
 		return sys->ReadFile(handle, pointer, size, usec);
-	else
+	} else {
 		return 0;
+	}
 }
 
 size_t MetaFileSystem::WriteFile(u32 handle, const u8 *pointer, s64 size, int &usec)
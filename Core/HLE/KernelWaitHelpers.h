@@ -19,16 +19,214 @@
 
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <algorithm> // std::erase/remove
 
 #include "Common/CommonTypes.h"
+#include "Common/Serialize/Serializer.h"
+#include "Common/Serialize/SerializeFuncs.h"
 #include "Core/CoreTiming.h"
+#include "Core/MemMap.h"
 #include "Core/HLE/sceKernelThread.h"
 #include "Core/HLE/ErrorCodes.h"
 
 namespace HLEKernel
 {
 
+inline SceUID WaitingThreadID(SceUID threadID) {
+	return threadID;
+}
+
+// For waiting thread info structs, which must have SceUID threadID.
+template <typename T>
+inline SceUID WaitingThreadID(const T &waitInfo) {
+	return waitInfo.threadID;
+}
+
+// The threads waiting on a kernel object, in order.  Linked through a pool of nodes, with an
+// index by thread, so that checking for, finding, or removing one thread doesn't walk the
+// others.  Objects with many waiting threads would otherwise do that on every wait and timeout.
+// Savestates see a plain vector, the same as before.
+template <typename T>
+class WaitingThreadList {
+	struct Node {
+		T info;
+		int prev;
+		int next;
+	};
+
+public:
+	class iterator {
+	public:
+		iterator(WaitingThreadList *list, int node) : list_(list), node_(node) {}
+		T &operator*() const { return list_->nodes_[node_].info; }
+		T *operator->() const { return &list_->nodes_[node_].info; }
+		iterator &operator++() {
+			node_ = list_->nodes_[node_].next;
+			return *this;
+		}
+		bool operator==(const iterator &other) const { return node_ == other.node_; }
+		bool operator!=(const iterator &other) const { return node_ != other.node_; }
+
+	private:
+		WaitingThreadList *list_;
+		int node_;
+	};
+
+	iterator begin() { return iterator(this, head_); }
+	iterator end() { return iterator(this, -1); }
+
+	size_t size() const { return index_.size(); }
+	bool empty() const { return head_ == -1; }
+	bool contains(SceUID threadID) const { return index_.find(threadID) != index_.end(); }
+
+	// Returns nullptr if the thread isn't in the list.
+	T *find(SceUID threadID) {
+		auto it = index_.find(threadID);
+		return it == index_.end() ? nullptr : &nodes_[it->second].info;
+	}
+
+	void push_back(const T &info) {
+		const SceUID threadID = WaitingThreadID(info);
+		// A thread only waits once, so anything left over for it goes.
+		remove(threadID);
+
+		int node;
+		if (freeHead_ != -1) {
+			node = freeHead_;
+			freeHead_ = nodes_[node].next;
+		} else {
+			node = (int)nodes_.size();
+			nodes_.push_back(Node());
+		}
+		nodes_[node].info = info;
+		nodes_[node].prev = tail_;
+		nodes_[node].next = -1;
+		if (tail_ != -1)
+			nodes_[tail_].next = node;
+		else
+			head_ = node;
+		tail_ = node;
+		index_[threadID] = node;
+	}
+
+	// Returns false if the thread wasn't in the list.
+	bool remove(SceUID threadID, T *info = nullptr) {
+		auto it = index_.find(threadID);
+		if (it == index_.end())
+			return false;
+		const int node = it->second;
+		index_.erase(it);
+		if (info)
+			*info = nodes_[node].info;
+		Unlink(node);
+		return true;
+	}
+
+	// Removes every thread for which func returns true, in a single pass.
+	// func sees the threads in order, and the threads left behind keep that order.
+	template <class Func>
+	void remove_if(Func func) {
+		int node = head_;
+		while (node != -1) {
+			const int next = nodes_[node].next;
+			if (func(nodes_[node].info)) {
+				index_.erase(WaitingThreadID(nodes_[node].info));
+				Unlink(node);
+			}
+			node = next;
+		}
+	}
+
+	// Removes threads from the front for as long as func returns true.
+	template <class Func>
+	void remove_front_while(Func func) {
+		while (head_ != -1 && func(nodes_[head_].info)) {
+			index_.erase(WaitingThreadID(nodes_[head_].info));
+			Unlink(head_);
+		}
+	}
+
+	template <class Compare>
+	void stable_sort(Compare comp) {
+		// Usually nothing has changed since last time.
+		bool sorted = true;
+		for (int node = head_; node != -1 && nodes_[node].next != -1 && sorted; node = nodes_[node].next)
+			sorted = !comp(nodes_[nodes_[node].next].info, nodes_[node].info);
+		if (sorted)
+			return;
+
+		std::vector<int> order;
+		order.reserve(index_.size());
+		for (int node = head_; node != -1; node = nodes_[node].next)
+			order.push_back(node);
+		std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+			return comp(nodes_[a].info, nodes_[b].info);
+		});
+
+		// Relink in the new order, the nodes themselves stay put.
+		int prev = -1;
+		for (int node : order) {
+			nodes_[node].prev = prev;
+			if (prev != -1)
+				nodes_[prev].next = node;
+			prev = node;
+		}
+		nodes_[prev].next = -1;
+		head_ = order.front();
+		tail_ = prev;
+	}
+
+	void clear() {
+		nodes_.clear();
+		index_.clear();
+		head_ = -1;
+		tail_ = -1;
+		freeHead_ = -1;
+	}
+
+	void DoState(PointerWrap &p) {
+		std::vector<T> threads;
+		if (p.mode != PointerWrap::MODE_READ) {
+			threads.reserve(index_.size());
+			for (int node = head_; node != -1; node = nodes_[node].next)
+				threads.push_back(nodes_[node].info);
+		}
+
+		T dv{};
+		Do(p, threads, dv);
+
+		if (p.mode == PointerWrap::MODE_READ) {
+			clear();
+			for (const T &info : threads)
+				push_back(info);
+		}
+	}
+
+private:
+	void Unlink(int node) {
+		Node &n = nodes_[node];
+		if (n.prev != -1)
+			nodes_[n.prev].next = n.next;
+		else
+			head_ = n.next;
+		if (n.next != -1)
+			nodes_[n.next].prev = n.prev;
+		else
+			tail_ = n.prev;
+		n.next = freeHead_;
+		freeHead_ = node;
+	}
+
+	std::vector<Node> nodes_;
+	// Node for each thread in the list.
+	std::unordered_map<SceUID, int> index_;
+	int head_ = -1;
+	int tail_ = -1;
+	// Unused nodes are chained through next.
+	int freeHead_ = -1;
+};
+
 // Should be called from the CoreTiming handler for the wait func.
 template <typename KO, WaitType waitType>
 inline void WaitExecTimeout(SceUID threadID) {
@@ -86,6 +284,31 @@ inline bool WaitPauseHelperUpdate<SceUID, u64>(SceUID pauseKey, SceUID threadID,
 	return true;
 }
 
+// Move a thread from the waiting thread list to the paused thread list.
+// This version is for a WaitingThreadList of structs, which must have u64 pausedTimeout.
+// Should not be called directly.
+template <typename WaitInfoType, typename PauseType>
+inline bool WaitPauseHelperUpdate(SceUID pauseKey, SceUID threadID, WaitingThreadList<WaitInfoType> &waitingThreads, std::map<SceUID, PauseType> &pausedWaits, u64 pauseTimeout) {
+	WaitInfoType waitData;
+	// TODO: Hmm, what about priority/fifo order?  Does it lose its place in line?
+	if (!waitingThreads.remove(threadID, &waitData))
+		return false;
+
+	waitData.pausedTimeout = pauseTimeout;
+	pausedWaits[pauseKey] = waitData;
+	return true;
+}
+
+// Move a thread from the waiting thread list to the paused thread list.
+// This version is for a WaitingThreadList of SceUIDs.  The paused list is a std::map<SceUID, u64>.
+// Should not be called directly.
+inline bool WaitPauseHelperUpdate(SceUID pauseKey, SceUID threadID, WaitingThreadList<SceUID> &waitingThreads, std::map<SceUID, u64> &pausedWaits, u64 pauseTimeout) {
+	// TODO: Hmm, what about priority/fifo order?  Does it lose its place in line?
+	waitingThreads.remove(threadID);
+	pausedWaits[pauseKey] = pauseTimeout;
+	return true;
+}
+
 // Retrieve the paused wait info from the list, and pop it.
 // Returns the pausedTimeout value.
 // Should not be called directly.
@@ -131,8 +354,8 @@ enum WaitBeginEndCallbackResult {
 // to use a specific pausedWaits list (for example, sceMsgPipe has two types of waiting per object.)
 //
 // In most cases, use the other, simpler version of WaitBeginCallback().
-template <typename WaitInfoType, typename PauseType>
-WaitBeginEndCallbackResult WaitBeginCallback(SceUID threadID, SceUID prevCallbackId, int waitTimer, std::vector<WaitInfoType> &waitingThreads, std::map<SceUID, PauseType> &pausedWaits, bool doTimeout = true) {
+template <typename WaitList, typename PauseType>
+WaitBeginEndCallbackResult WaitBeginCallbackHelper(SceUID threadID, SceUID prevCallbackId, int waitTimer, WaitList &waitingThreads, std::map<SceUID, PauseType> &pausedWaits, bool doTimeout) {
 	SceUID pauseKey = prevCallbackId == 0 ? threadID : prevCallbackId;
 
 	// This means two callbacks in a row.  PSP crashes if the same callback waits inside itself (may need more testing.)
@@ -154,6 +377,16 @@ WaitBeginEndCallbackResult WaitBeginCallback(SceUID threadID, SceUID prevCallbac
 	return WAIT_CB_SUCCESS;
 }
 
+template <typename WaitInfoType, typename PauseType>
+WaitBeginEndCallbackResult WaitBeginCallback(SceUID threadID, SceUID prevCallbackId, int waitTimer, std::vector<WaitInfoType> &waitingThreads, std::map<SceUID, PauseType> &pausedWaits, bool doTimeout = true) {
+	return WaitBeginCallbackHelper(threadID, prevCallbackId, waitTimer, waitingThreads, pausedWaits, doTimeout);
+}
+
+template <typename WaitInfoType, typename PauseType>
+WaitBeginEndCallbackResult WaitBeginCallback(SceUID threadID, SceUID prevCallbackId, int waitTimer, WaitingThreadList<WaitInfoType> &waitingThreads, std::map<SceUID, PauseType> &pausedWaits, bool doTimeout = true) {
+	return WaitBeginCallbackHelper(threadID, prevCallbackId, waitTimer, waitingThreads, pausedWaits, doTimeout);
+}
+
 // Meant to be called in a registered begin callback function for a wait type.
 //
 // The goal of this function is to pause the wait.  While inside a callback, waits are released.
@@ -182,8 +415,8 @@ WaitBeginEndCallbackResult WaitBeginCallback(SceUID threadID, SceUID prevCallbac
 // this still validates the wait (since it needs other data from the object.)
 //
 // In most cases, use the other, simpler version of WaitEndCallback().
-template <typename KO, WaitType waitType, typename WaitInfoType, typename PauseType, class TryUnlockFunc>
-WaitBeginEndCallbackResult WaitEndCallback(SceUID threadID, SceUID prevCallbackId, int waitTimer, TryUnlockFunc TryUnlock, WaitInfoType &waitData, std::vector<WaitInfoType> &waitingThreads, std::map<SceUID, PauseType> &pausedWaits) {
+template <typename KO, WaitType waitType, typename WaitInfoType, typename PauseType, class TryUnlockFunc, typename WaitList>
+WaitBeginEndCallbackResult WaitEndCallback(SceUID threadID, SceUID prevCallbackId, int waitTimer, TryUnlockFunc TryUnlock, WaitInfoType &waitData, WaitList &waitingThreads, std::map<SceUID, PauseType> &pausedWaits) {
 	SceUID pauseKey = prevCallbackId == 0 ? threadID : prevCallbackId;
 
 	// Note: Cancel does not affect suspended semaphore waits, probably same for others.
@@ -307,9 +540,22 @@ inline void CleanupWaitingThreads(WaitType waitType, SceUID uid, std::vector<T>
 	waitingThreads.resize(size);
 }
 
+// Removes threads that are not waiting anymore from a WaitingThreadList.
+template <typename T>
+inline void CleanupWaitingThreads(WaitType waitType, SceUID uid, WaitingThreadList<T> &waitingThreads) {
+	waitingThreads.remove_if([&](const T &waitInfo) {
+		return !VerifyWait(waitInfo, waitType, uid);
+	});
+}
+
 template <typename T>
 inline void RemoveWaitingThread(std::vector<T> &waitingThreads, const SceUID threadID) {
 	waitingThreads.erase(std::remove(waitingThreads.begin(), waitingThreads.end(), threadID), waitingThreads.end());
 }
 
+template <typename T>
+inline void RemoveWaitingThread(WaitingThreadList<T> &waitingThreads, const SceUID threadID) {
+	waitingThreads.remove(threadID);
+}
+
 };
@@ -17,8 +17,10 @@
 
 #pragma once
 
-#include "Core/HLE/sceKernel.h"
+#include "Common/BitSet.h"
 #include "Common/Serialize/Serializer.h"
+#include "Common/Serialize/SerializeFuncs.h"
+#include "Core/HLE/sceKernel.h"
 
 struct ThreadQueueList {
 	// Number of queues (number of priority levels starting at 0.)
@@ -27,8 +29,6 @@ struct ThreadQueueList {
 	static const int INITIAL_CAPACITY = 32;
 
 	struct Queue {
-		// Next ever-been-used queue (worse priority.)
-		Queue *next;
 		// First valid item in data.
 		int first;
 		// One after last valid item in data.
@@ -51,7 +51,8 @@ struct ThreadQueueList {
 
 	ThreadQueueList() {
 		memset(queues, 0, sizeof(queues));
-		first = invalid();
+		memset(nonEmpty, 0, sizeof(nonEmpty));
+		best = NUM_QUEUES - 1;
 	}
 
 	~ThreadQueueList() {
@@ -75,37 +76,32 @@ struct ThreadQueueList {
 	}
 
 	inline SceUID pop_first() {
-		Queue *cur = first;
-		while (cur != invalid()) {
-			if (cur->size() > 0)
-				return cur->data[cur->first++];
-			cur = cur->next;
-		}
+		// Usually the best level from last time still has threads.
+		Queue *cur = &queues[best];
+		if (!cur->empty())
+			return cur->data[cur->first++];
+
+		int priority = firstNonEmpty(NUM_QUEUES);
+		if (priority >= 0)
+			return pop(priority);
 
 		_dbg_assert_msg_(false, "ThreadQueueList should not be empty.");
 		return 0;
 	}
 
 	inline SceUID pop_first_better(u32 priority) {
-		Queue *cur = first;
 		// Don't bother looking past (worse than) this priority.
-		Queue *stop = &queues[priority];
-		while (cur < stop) {
-			if (cur->size() > 0)
-				return cur->data[cur->first++];
-			cur = cur->next;
-		}
+		int better = firstNonEmpty(priority);
+		if (better >= 0)
+			return pop(better);
 
 		return 0;
 	}
 
 	inline SceUID peek_first() {
-		Queue *cur = first;
-		while (cur != invalid()) {
-			if (cur->size() > 0)
-				return cur->data[cur->first];
-			cur = cur->next;
-		}
+		int priority = firstNonEmpty(NUM_QUEUES);
+		if (priority >= 0)
+			return queues[priority].data[queues[priority].first];
 
 		return 0;
 	}
@@ -113,6 +109,8 @@ struct ThreadQueueList {
 	inline void push_front(u32 priority, const SceUID threadID) {
 		Queue *cur = &queues[priority];
 		cur->data[--cur->first] = threadID;
+		if (cur->size() == 1)
+			markNonEmpty(priority);
 		// If we ran out of room toward the front, add more room for next time.
 		if (cur->first == 0)
 			rebalance(priority);
@@ -121,21 +119,22 @@ struct ThreadQueueList {
 	inline void push_back(u32 priority, const SceUID threadID) {
 		Queue *cur = &queues[priority];
 		cur->data[cur->end++] = threadID;
+		if (cur->size() == 1)
+			markNonEmpty(priority);
 		if (cur->full())
 			rebalance(priority);
 	}
 
 	inline void remove(u32 priority, const SceUID threadID) {
 		Queue *cur = &queues[priority];
-		_dbg_assert_msg_(cur->next != nullptr, "ThreadQueueList::Queue should already be linked up.");
+		_dbg_assert_msg_(cur->data != nullptr, "ThreadQueueList::Queue should already be linked up.");
 
 		for (int i = cur->first; i < cur->end; ++i) {
 			if (cur->data[i] == threadID) {
-				// How many more after this one?
-				int remaining = cur->end - i;
-				// If there are more, move them into place.
-				if (remaining > 0)
-					memmove(&cur->data[i], &cur->data[i + 1], remaining * sizeof(SceUID));
+				// Move the rest into place. There are rarely more than a few threads per level,
+				// so this is cheaper than calling memmove.
+				for (int j = i + 1; j < cur->end; ++j)
+					cur->data[j - 1] = cur->data[j];
 
 				// Now we're one shorter.
 				--cur->end;
@@ -148,7 +147,7 @@ struct ThreadQueueList {
 
 	inline void rotate(u32 priority) {
 		Queue *cur = &queues[priority];
-		_dbg_assert_msg_(cur->next != nullptr, "ThreadQueueList::Queue should already be linked up.");
+		_dbg_assert_msg_(cur->data != nullptr, "ThreadQueueList::Queue should already be linked up.");
 
 		if (cur->size() > 1) {
 			// Grab the front and push it on the end.
@@ -163,7 +162,8 @@ struct ThreadQueueList {
 			free(queues[i].data);
 		}
 		memset(queues, 0, sizeof(queues));
-		first = invalid();
+		memset(nonEmpty, 0, sizeof(nonEmpty));
+		best = NUM_QUEUES - 1;
 	}
 
 	inline bool empty(u32 priority) const {
@@ -173,7 +173,7 @@ struct ThreadQueueList {
 
 	inline void prepare(u32 priority) {
 		Queue *cur = &queues[priority];
-		if (cur->next == nullptr)
+		if (cur->data == nullptr)
 			link(priority, INITIAL_CAPACITY);
 	}
 
@@ -209,14 +209,56 @@ struct ThreadQueueList {
 				cur->end = cur->first + size;
 			}
 
-			if (size != 0)
+			if (size != 0) {
 				DoArray(p, &cur->data[cur->first], size);
+				if (p.mode == p.MODE_READ)
+					markNonEmpty(i);
+			}
 		}
 	}
 
 private:
-	Queue *invalid() const {
-		return (Queue *)-1;
+	static const int MASK_WORDS = NUM_QUEUES / 64;
+
+	// Returns the best priority level below limit with queued threads, or -1.
+	// Bits are only cleared here, once a level is found empty, so popping and removing stay cheap.
+	inline int firstNonEmpty(u32 limit) {
+		// Usually the best level from last time still has threads.
+		if (best < limit && !queues[best].empty())
+			return (int)best;
+
+		for (int w = 0; w < MASK_WORDS && w * 64 < (int)limit; ++w) {
+			u64 bits = nonEmpty[w];
+			int remaining = (int)limit - w * 64;
+			if (remaining < 64)
+				bits &= (1ULL << remaining) - 1;
+			while (bits != 0) {
+				int priority = w * 64 + LeastSignificantSetBit(bits);
+				if (!queues[priority].empty()) {
+					best = priority;
+					return priority;
+				}
+				markEmpty(priority);
+				bits &= bits - 1;
+			}
+		}
+		return -1;
+	}
+
+	inline SceUID pop(int priority) {
+		Queue *cur = &queues[priority];
+		return cur->data[cur->first++];
+	}
+
+	// Only called when a level goes from empty to one thread, so a busy reschedule doesn't write anything extra.
+	inline void markNonEmpty(u32 priority) {
+		nonEmpty[priority >> 6] |= 1ULL << (priority & 63);
+		if (priority < best)
+			best = priority;
+	}
+
+	inline void markEmpty(u32 priority) {
+		nonEmpty[priority >> 6] &= ~(1ULL << (priority & 63));
 	}
 
 	// Initialize a priority level and link to other queues.
@@ -240,21 +282,6 @@ struct ThreadQueueList {
 		// Start smack in the middle so it can move both directions.
 		cur->first = size / 2;
 		cur->end = size / 2;
-
-		for (int i = (int)priority - 1; i >= 0; --i) {
-			// This queue is before ours, and points past us.
-			// We'll have it point to our new queue, inserting into the chain.
-			if (queues[i].next != nullptr) {
-				cur->next = queues[i].next;
-				queues[i].next = cur;
-				return;
-			}
-		}
-
-		// Never found above - that means there's no better queue yet.
-		// The new one is now first, and whoever was first is after it.
-		cur->next = first;
-		first = cur;
 	}
 
 	// Move or allocate as necessary to maintain free space on both sides.
@@ -281,8 +308,11 @@ struct ThreadQueueList {
 		}
 	}
 
-	// The first queue that's ever been used.
-	Queue *first;
+	// One bit per priority level that may have queued threads, so the best
+	// ready thread is found without walking every level.
+	u64 nonEmpty[MASK_WORDS];
+	// No level better than this has queued threads.
+	u32 best;
 	// The priority level queues of thread ids.
 	Queue queues[NUM_QUEUES];
 };
@@ -32,6 +32,7 @@
 #include "Core/CoreTiming.h"
 #include "Core/MemMapHelpers.h"
 #include "Core/Reporting.h"
+#include "Core/RunAhead.h"
 #include "Core/System.h"
 #include "Core/WaveFile.h"
 #include "Core/ELF/ParamSFO.h"
@@ -424,7 +425,8 @@ void __AudioUpdate(bool resetRecording) {
 		memset(mixBuffer, 0, hwBlockSize * 2 * sizeof(s32));
 	}
 
-	if (g_Config.bEnableSound) {
+	// Frames run ahead are played again for real later.
+	if (g_Config.bEnableSound && !RunAhead::IsSpeculating()) {
 		float multiplier = Volume100ToMultiplier(std::clamp(g_Config.iGameVolume, 0, VOLUMEHI_FULL));
 		if (PSP_CoreParameter().fpsLimit != FPSLimit::NORMAL || PSP_CoreParameter().fastForward) {
 			if (g_Config.iAltSpeedVolume != -1) {
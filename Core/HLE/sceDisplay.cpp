@@ -41,6 +41,7 @@
 #include "Core/CoreParameter.h"
 #include "Core/FrameTiming.h"
 #include "Core/Reporting.h"
+#include "Core/RunAhead.h"
 #include "Core/Core.h"
 #include "Core/System.h"
 #include "Core/HLE/HLE.h"
@@ -616,11 +617,15 @@ void __DisplayFlip(int cyclesLate) {
 
 	Draw::DrawContext *draw = gpu->GetDrawContext();
 
+	// Frames run ahead are only for show, the real frame already took care of timing.
+	const bool speculating = RunAhead::IsSpeculating();
+
 	bool needFlip = fbDirty || noRecentFlip || postEffectRequiresFlip;
 	if (!needFlip) {
 		// Okay, there's no new frame to draw, game might be sitting in a static loading screen
 		// or similar, and not long enough to trigger noRecentFlip. But audio may be playing, so we need to time still.
-		DoFrameIdleTiming();
+		if (!speculating)
+			DoFrameIdleTiming();
 		g_frameTiming.ComputePresentMode(draw, false);
 		return;
 	}
@@ -659,7 +664,8 @@ void __DisplayFlip(int cyclesLate) {
 
 	bool nextFrame = false;
 
-	if (fbReallyDirty || noRecentFlip || postEffectRequiresFlip) {
+	// While running ahead, frames that skipped drawing must still end the run loop, so we can count them.
+	if (fbReallyDirty || noRecentFlip || postEffectRequiresFlip || RunAhead::IsRunning()) {
 		// Check first though, might've just quit / been paused.
 		if (!forceNoFlip) {
 			nextFrame = Core_NextFrame();
@@ -683,8 +689,9 @@ void __DisplayFlip(int cyclesLate) {
 	if (fpsLimit > 0 && fpsLimit != framerate) {
 		scaledTimestep *= (float)framerate / fpsLimit;
 	}
-	bool skipFrame;
-	DoFrameTiming(throttle, &skipFrame, scaledTimestep, nextFrame);
+	bool skipFrame = false;
+	if (!speculating)
+		DoFrameTiming(throttle, &skipFrame, scaledTimestep, nextFrame);
 
 	int maxFrameskip = 8;
 	const int frameSkipNum = g_Config.iFrameSkip;
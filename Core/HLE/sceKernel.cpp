@@ -36,6 +36,7 @@
 #include "Core/PSPLoaders.h"
 #include "Core/CoreTiming.h"
 #include "Core/Reporting.h"
+#include "Core/RunAhead.h"
 #include "Core/SaveState.h"
 #include "Core/System.h"
 #include "GPU/GPUCommon.h"
@@ -228,6 +229,7 @@ void __KernelShutdown()
 	CoreTiming::UnregisterAllEvents();
 	Reporting::Shutdown();
 	SaveState::Shutdown();
+	RunAhead::Shutdown();
 
 	kernelRunning = false;
 }
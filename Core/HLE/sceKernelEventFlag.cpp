@@ -77,13 +77,12 @@ class EventFlag : public KernelObject {
 			return;
 
 		Do(p, nef);
-		EventFlagTh eft = { 0 };
-		Do(p, waitingThreads, eft);
+		waitingThreads.DoState(p);
 		Do(p, pausedWaits);
 	}
 
 	NativeEventFlag nef;
-	std::vector<EventFlagTh> waitingThreads;
+	HLEKernel::WaitingThreadList<EventFlagTh> waitingThreads;
 	// Key is the callback id it was for, or if no callback, the thread id.
 	std::map<SceUID, EventFlagTh> pausedWaits;
 };
@@ -296,14 +295,10 @@ u32 sceKernelSetEventFlag(SceUID id, u32 bitsToSet) {
 
 		e->nef.currentPattern |= bitsToSet;
 
-		for (size_t i = 0; i < e->waitingThreads.size(); ++i) {
-			EventFlagTh *t = &e->waitingThreads[i];
-			if (__KernelUnlockEventFlagForThread(e, *t, error, 0, wokeThreads)) {
-				e->waitingThreads.erase(e->waitingThreads.begin() + i);
-				// Try the one that used to be in this place next.
-				--i;
-			}
-		}
+		// Waiters are matched in order, since a clear-on-match changes the pattern for those after it.
+		e->waitingThreads.remove_if([&](EventFlagTh &th) {
+			return __KernelUnlockEventFlagForThread(e, th, error, 0, wokeThreads);
+		});
 
 		if (wokeThreads)
 			hleReSchedule("event flag set");
@@ -327,18 +322,15 @@ void __KernelEventFlagTimeout(u64 userdata, int cycleslate) {
 		if (timeoutPtr != 0)
 			Memory::Write_U32(0, timeoutPtr);
 
-		for (size_t i = 0; i < e->waitingThreads.size(); i++) {
-			EventFlagTh *t = &e->waitingThreads[i];
-			if (t->threadID == threadID) {
-				bool wokeThreads;
-
-				// This thread isn't waiting anymore, but we'll remove it from waitingThreads later.
-				// The reason is, if it times out, but what it was waiting on is DELETED prior to it
-				// actually running, it will get a DELETE result instead of a TIMEOUT.
-				// So, we need to remember it or we won't be able to mark it DELETE instead later.
-				__KernelUnlockEventFlagForThread(e, *t, error, SCE_KERNEL_ERROR_WAIT_TIMEOUT, wokeThreads);
-				break;
-			}
+		EventFlagTh *t = e->waitingThreads.find(threadID);
+		if (t) {
+			bool wokeThreads;
+
+			// This thread isn't waiting anymore, but we'll remove it from waitingThreads later.
+			// The reason is, if it times out, but what it was waiting on is DELETED prior to it
+			// actually running, it will get a DELETE result instead of a TIMEOUT.
+			// So, we need to remember it or we won't be able to mark it DELETE instead later.
+			__KernelUnlockEventFlagForThread(e, *t, error, SCE_KERNEL_ERROR_WAIT_TIMEOUT, wokeThreads);
 		}
 	}
 }
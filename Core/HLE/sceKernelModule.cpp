@@ -26,6 +26,7 @@
 #include "Common/Serialize/SerializeSet.h"
 #include "Common/File/FileUtil.h"
 #include "Common/StringUtils.h"
+#include "Common/TimeUtil.h"
 #include "Common/System/Request.h"
 #include "Common/System/System.h"
 #include "Common/System/OSD.h"
@@ -452,7 +453,10 @@ void __KernelModuleDoState(PointerWrap &p)
 		Do(p, loadedModules);
 	}
 
-	if (p.mode == p.MODE_READ) {
+	// Speculative states (run-ahead) are restored within the same session, so the stubs in memory are
+	// already right. Rewriting them would only throw away their jit blocks.
+	const bool keepCaches = PSP_CoreParameter().keepCachesOnLoad;
+	if (p.mode == p.MODE_READ && !keepCaches) {
 		u32 error;
 		// We process these late, since they depend on loadedModules for interlinking.
 		for (SceUID moduleId : loadedModules) {
@@ -465,7 +469,8 @@ void __KernelModuleDoState(PointerWrap &p)
 		}
 	}
 
-	if (g_Config.bFuncReplacements) {
+	// Run-ahead redoes the replacements itself, only in the pages it copied back.
+	if (g_Config.bFuncReplacements && !keepCaches) {
 		MIPSAnalyst::ReplaceFunctions();
 	}
 }
@@ -1338,6 +1343,7 @@ static PSPModule *__KernelLoadELFFromPtr(const u8 *ptr, size_t elfSize, u32 load
 	}
 
 	if (!module->isFake) {
+		double scanStartTime = time_now_d();
 		bool scan = true;
 		// If the ELF has debug symbols, don't add entries to the symbol table.
 		bool insertSymbols = scan && !reader.LoadSymbols();
@@ -1391,6 +1397,7 @@ static PSPModule *__KernelLoadELFFromPtr(const u8 *ptr, size_t elfSize, u32 load
 			// TODO: Limit this to the newly loaded range! This is expensive, well, at least in debug builds
 			// and the cause of stutter during Wipeout Pure initialization.
 			MIPSAnalyst::FinalizeScan(insertSymbols);
+			INFO_LOG(Log::Loader, "Scanned and hashed functions in %s (%08x-%08x) in %0.1f ms", modinfo->name, module->textStart, module->textEnd, (time_now_d() - scanStartTime) * 1000.0);
 		}
 	}
 
@@ -1585,6 +1592,11 @@ static PSPModule *__KernelLoadELFFromPtr(const u8 *ptr, size_t elfSize, u32 load
 		}
 	}
 
+	if (!module->isFake && module->textEnd > module->textStart) {
+		// Imports are linked now, so the jit can get a head start on the code.
+		currentMIPS->PrewarmJit(module->textStart, module->textEnd + 4 - module->textStart);
+	}
+
 	System_Notify(SystemNotification::SYMBOL_MAP_UPDATED);
 
 	u32 moduleSize = sizeof(module->nm);
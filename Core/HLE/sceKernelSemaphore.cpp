@@ -73,13 +73,12 @@ struct PSPSemaphore : public KernelObject {
 			return;
 
 		Do(p, ns);
-		SceUID dv = 0;
-		Do(p, waitingThreads, dv);
+		waitingThreads.DoState(p);
 		Do(p, pausedWaits);
 	}
 
 	NativeSemaphore ns;
-	std::vector<SceUID> waitingThreads;
+	HLEKernel::WaitingThreadList<SceUID> waitingThreads;
 	// Key is the callback id it was for, or if no callback, the thread id.
 	std::map<SceUID, u64> pausedWaits;
 };
@@ -161,9 +160,8 @@ void __KernelSemaEndCallback(SceUID threadID, SceUID prevCallbackId)
 static bool __KernelClearSemaThreads(PSPSemaphore *s, int reason) {
 	u32 error;
 	bool wokeThreads = false;
-	std::vector<SceUID>::iterator iter, end;
-	for (iter = s->waitingThreads.begin(), end = s->waitingThreads.end(); iter != end; ++iter)
-		__KernelUnlockSemaForThread(s, *iter, error, reason, wokeThreads);
+	for (SceUID threadID : s->waitingThreads)
+		__KernelUnlockSemaForThread(s, threadID, error, reason, wokeThreads);
 	s->waitingThreads.clear();
 
 	return wokeThreads;
@@ -289,16 +287,13 @@ int sceKernelSignalSema(SceUID id, int signal) {
 		s->ns.currentCount += signal;
 
 		if ((s->ns.attr & PSP_SEMA_ATTR_PRIORITY) != 0)
-			std::stable_sort(s->waitingThreads.begin(), s->waitingThreads.end(), __KernelThreadSortPriority);
+			s->waitingThreads.stable_sort(__KernelThreadSortPriority);
 
 		bool wokeThreads = false;
-retry:
-		for (auto iter = s->waitingThreads.begin(), end = s->waitingThreads.end(); iter != end; ++iter) {
-			if (__KernelUnlockSemaForThread(s, *iter, error, 0, wokeThreads)) {
-				s->waitingThreads.erase(iter);
-				goto retry;
-			}
-		}
+		// The count only goes down while waking, so anyone skipped stays skipped. One pass is enough.
+		s->waitingThreads.remove_if([&](SceUID threadID) {
+			return __KernelUnlockSemaForThread(s, threadID, error, 0, wokeThreads);
+		});
 
 		if (wokeThreads)
 			hleReSchedule("semaphore signaled");
@@ -319,12 +314,10 @@ void __KernelSemaTimeout(u64 userdata, int cycleslate) {
 	PSPSemaphore *s = kernelObjects.Get<PSPSemaphore>(uid, error);
 	if (s && (s->ns.attr & PSP_SEMA_ATTR_PRIORITY) == PSP_SEMA_ATTR_FIFO) {
 		bool wokeThreads;
-		std::vector<SceUID>::iterator iter = s->waitingThreads.begin();
 		// Unlock every waiting thread until the first that must still wait.
-		while (iter != s->waitingThreads.end() && __KernelUnlockSemaForThread(s, *iter, error, 0, wokeThreads)) {
-			s->waitingThreads.erase(iter);
-			iter = s->waitingThreads.begin();
-		}
+		s->waitingThreads.remove_front_while([&](SceUID threadID) {
+			return __KernelUnlockSemaForThread(s, threadID, error, 0, wokeThreads);
+		});
 	}
 }
 
@@ -367,7 +360,7 @@ static int __KernelWaitSema(SceUID id, int wantedCount, u32 timeoutPtr, bool pro
 		} else {
 			SceUID threadID = __KernelGetCurThread();
 			// May be in a tight loop timing out (where we don't remove from waitingThreads yet), don't want to add duplicates.
-			if (std::find(s->waitingThreads.begin(), s->waitingThreads.end(), threadID) == s->waitingThreads.end())
+			if (!s->waitingThreads.contains(threadID))
 				s->waitingThreads.push_back(threadID);
 			__KernelSetSemaTimeout(s, timeoutPtr);
 			__KernelWaitCurThread(WAITTYPE_SEMA, id, wantedCount, timeoutPtr, processCallbacks, "sema waited");
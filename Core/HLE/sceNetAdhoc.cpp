@@ -43,6 +43,7 @@
 #include "Core/CoreTiming.h"
 #include "Core/Core.h"
 #include "Core/Reporting.h"
+#include "Core/MemDirty.h"
 #include "Core/MemMapHelpers.h"
 
 #include "Core/HLE/HLEHelperThread.h"
@@ -865,6 +866,7 @@ int DoBlockingPdpRecv(AdhocSocketRequest& req, s64& result) {
 	if (ret >= 0 && ret <= *req.length) {
 		sinlen = sizeof(sin);
         memset(&sin, 0, sinlen);
+		Memory::DirtyTrackingHostWrite hostWrite(req.buffer, std::max(0, *req.length));
 		ret = recvfrom(pdpsocket.id, (char*)req.buffer, std::max(0, *req.length), MSG_NOSIGNAL, (struct sockaddr*)&sin, &sinlen);
 		// UDP can also receives 0 data, while on TCP receiving 0 data = connection gracefully closed, but not sure whether PDP can send/recv 0 data or not tho
 		*req.length = 0;
@@ -1215,6 +1217,7 @@ int DoBlockingPtpRecv(AdhocSocketRequest& req, s64& result) {
 		ret = SOCKET_ERROR;
 		sockerr = EAGAIN;
 	} else {
+		Memory::DirtyTrackingHostWrite hostWrite(req.buffer, std::max(0, *req.length));
 		ret = recv(ptpsocket.id, (char*)req.buffer, std::max(0, *req.length), MSG_NOSIGNAL);
 		sockerr = socket_errno;
 	}
@@ -2705,6 +2708,7 @@ int sceNetAdhocPdpRecv(int id, void *addr, void * port, void *buf, void *dataLen
 					sinlen = sizeof(sin);
 					memset(&sin, 0, sinlen);
 					// On Windows: Socket Error 10014 may happen when buffer size is less than the minimum allowed/required (ie. negative number on Vulcanus Seek and Destroy), the address is not a valid part of the user address space (ie. on the stack or when buffer overflow occurred), or the address is not properly aligned (ie. multiple of 4 on 32bit and multiple of 8 on 64bit) https://stackoverflow.com/questions/861154/winsock-error-code-10014
+					Memory::DirtyTrackingHostWrite hostWrite(buf, std::max(0, *len));
 					received = recvfrom(pdpsocket.id, (char*)buf, std::max(0, *len), MSG_NOSIGNAL, (struct sockaddr*)&sin, &sinlen);
 					error = socket_errno;
 				}
@@ -5345,6 +5349,7 @@ static int sceNetAdhocPtpRecv(int id, u32 dataAddr, u32 dataSizeAddr, int timeou
 						error = EAGAIN;
 					} else {
 						// Receive Data. POSIX: May received 0 bytes when the remote peer already closed the connection.
+						Memory::DirtyTrackingHostWrite hostWrite(buf, std::max(0, *len));
 						received = recv(ptpsocket.id, (char*)buf, std::max(0, *len), MSG_NOSIGNAL);
 						error = socket_errno;
 					}
@@ -15,6 +15,8 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include <algorithm>
+
 #include "Common/Data/Convert/SmallDataConvert.h"
 #include "Common/Profiler/Profiler.h"
 
@@ -54,6 +56,90 @@ using namespace MIPSAnalyst;
 namespace MIPSComp
 {
 
+// Keep traces reasonably small, they're only compiled once the first block is hot.
+static const int MAX_TRACE_CONTINUES = 8;
+static const u32 MAX_TRACE_BYTES = 0x800;
+
+u32 IRFrontend::TraceContinuation(u32 takenAddr, u32 notTakenAddr) {
+	if (!traceProfile || traceContinues >= MAX_TRACE_CONTINUES)
+		return 0;
+	u32 dest = traceProfile->DominantExit(traceBlockStart);
+	if (dest == 0 || (dest != takenAddr && dest != notTakenAddr))
+		return 0;
+	// Going back into the trace (like to the start, for a loop) is left as an exit, which links to it.
+	if (TraceVisited(dest))
+		return 0;
+	// Invalidation and hashing cover everything between the ranges, so keep them close.
+	u32 distance = dest >= js.blockStart ? dest - js.blockStart : js.blockStart - dest;
+	if (distance > MAX_TRACE_BYTES)
+		return 0;
+	return dest;
+}
+
+void IRFrontend::ContinueTrace(u32 addr) {
+	// Includes the delay slot.
+	EndTraceRange(GetCompilerPC() + 8);
+	// Everything's been flushed just like for an exit, so just carry on as if addr came next.
+	// The compile loop adds 4 afterward.
+	js.compilerPC = addr - 4;
+	traceBlockStart = addr;
+	traceRangeStart = addr;
+	traceContinues++;
+}
+
+void IRFrontend::EndTraceRange(u32 end) {
+	traceRanges.push_back(std::make_pair(traceRangeStart, end));
+	if (traceRangeStart >= js.blockStart) {
+		traceEnd = std::max(traceEnd, end);
+		return;
+	}
+
+	// Code before the start can't be in the block's range, it has to go with any inlined code.
+	blockInlineStart = blockInlineEnd == 0 ? traceRangeStart : std::min(blockInlineStart, traceRangeStart);
+	blockInlineEnd = std::max(blockInlineEnd, end);
+}
+
+bool IRFrontend::TraceVisited(u32 addr) {
+	// The current range, up to and including the delay slot.
+	if (addr >= traceRangeStart && addr < GetCompilerPC() + 8)
+		return true;
+	for (const auto &range : traceRanges) {
+		if (addr >= range.first && addr < range.second)
+			return true;
+	}
+	return false;
+}
+
+// Leaf functions longer than this aren't worth it, the call overhead is small in comparison.
+static const int MAX_INLINE_LEAF_INSTRUCTIONS = 16;
+// All inlined functions share one range for invalidation, so they need to be near each other.
+static const u32 MAX_INLINED_RANGE = 0x400;
+
+bool IRFrontend::TryInlineLeaf(u32 targetAddr) {
+	if (!opts.inlineLeafFunctions || inlineReturnAddr != 0)
+		return false;
+	// The delay slot runs after ra is set, so it could change where we return to.
+	if (MIPSAnalyst::GetOutGPReg(GetOffsetInstruction(1)) == MIPS_REG_RA)
+		return false;
+	u32 size = MIPSAnalyst::GetInlineableLeafSize(targetAddr, MAX_INLINE_LEAF_INSTRUCTIONS);
+	if (size == 0)
+		return false;
+
+	u32 start = blockInlineEnd == 0 ? targetAddr : std::min(blockInlineStart, targetAddr);
+	u32 end = std::max(blockInlineEnd, targetAddr + size);
+	if (end - start > MAX_INLINED_RANGE)
+		return false;
+	blockInlineStart = start;
+	blockInlineEnd = end;
+
+	// The function doesn't touch ra, so its jr ra always comes back here.
+	inlineReturnAddr = GetCompilerPC() + 8;
+	inlineJrAddr = targetAddr + size - 8;
+	// The compile loop adds 4 afterward.
+	js.compilerPC = targetAddr - 4;
+	return true;
+}
+
 void IRFrontend::BranchRSRTComp(MIPSOpcode op, IRComparison cc, bool likely) {
 	if (js.inDelaySlot) {
 		ERROR_LOG_REPORT(Log::JIT, "Branch in RSRTComp delay slot at %08x in block starting at %08x", GetCompilerPC(), js.blockStart);
@@ -100,7 +186,16 @@ void IRFrontend::BranchRSRTComp(MIPSOpcode op, IRComparison cc, bool likely) {
 	js.downcountAmount = 0;
 
 	FlushAll();
-	ir.Write(ComparisonToExit(cc), ir.AddConstant(ResolveNotTakenTarget(branchInfo)), lhs, rhs);
+	u32 notTakenAddr = ResolveNotTakenTarget(branchInfo);
+	// Likely branches only run the delay slot when taken, so can't turn that into the side exit.
+	u32 traceAddr = TraceContinuation(targetAddr, likely ? 0 : notTakenAddr);
+	if (traceAddr != 0 && traceAddr != targetAddr) {
+		// Building a trace, and this is rarely taken.  So exit when it is, and keep going.
+		ir.Write(ComparisonToExit(Invert(cc)), ir.AddConstant(targetAddr), lhs, rhs);
+		ContinueTrace(traceAddr);
+		return;
+	}
+	ir.Write(ComparisonToExit(cc), ir.AddConstant(notTakenAddr), lhs, rhs);
 	// This makes the block "impure" :(
 	if (likely && !branchInfo.delaySlotIsBranch)
 		CompileDelaySlot();
@@ -114,6 +209,10 @@ void IRFrontend::BranchRSRTComp(MIPSOpcode op, IRComparison cc, bool likely) {
 	}
 
 	FlushAll();
+	if (traceAddr != 0) {
+		ContinueTrace(traceAddr);
+		return;
+	}
 	ir.Write(IROp::ExitToConst, ir.AddConstant(targetAddr));
 
 	// Account for the delay slot.
@@ -151,7 +250,14 @@ void IRFrontend::BranchRSZeroComp(MIPSOpcode op, IRComparison cc, bool andLink,
 	js.downcountAmount = 0;
 
 	FlushAll();
-	ir.Write(ComparisonToExit(cc), ir.AddConstant(ResolveNotTakenTarget(branchInfo)), lhs);
+	u32 notTakenAddr = ResolveNotTakenTarget(branchInfo);
+	u32 traceAddr = TraceContinuation(targetAddr, likely ? 0 : notTakenAddr);
+	if (traceAddr != 0 && traceAddr != targetAddr) {
+		ir.Write(ComparisonToExit(Invert(cc)), ir.AddConstant(targetAddr), lhs);
+		ContinueTrace(traceAddr);
+		return;
+	}
+	ir.Write(ComparisonToExit(cc), ir.AddConstant(notTakenAddr), lhs);
 	if (likely && !branchInfo.delaySlotIsBranch)
 		CompileDelaySlot();
 	if (branchInfo.delaySlotIsBranch) {
@@ -165,6 +271,10 @@ void IRFrontend::BranchRSZeroComp(MIPSOpcode op, IRComparison cc, bool andLink,
 
 	// Taken
 	FlushAll();
+	if (traceAddr != 0) {
+		ContinueTrace(traceAddr);
+		return;
+	}
 	ir.Write(IROp::ExitToConst, ir.AddConstant(targetAddr));
 
 	// Account for the delay slot.
@@ -229,8 +339,15 @@ void IRFrontend::BranchFPFlag(MIPSOpcode op, IRComparison cc, bool likely) {
 	js.downcountAmount = 0;
 
 	FlushAll();
+	u32 notTakenAddr = ResolveNotTakenTarget(branchInfo);
+	u32 traceAddr = TraceContinuation(targetAddr, likely ? 0 : notTakenAddr);
+	if (traceAddr != 0 && traceAddr != targetAddr) {
+		ir.Write(ComparisonToExit(Invert(cc)), ir.AddConstant(targetAddr), IRTEMP_LHS, 0);
+		ContinueTrace(traceAddr);
+		return;
+	}
 	// Not taken
-	ir.Write(ComparisonToExit(cc), ir.AddConstant(ResolveNotTakenTarget(branchInfo)), IRTEMP_LHS, 0);
+	ir.Write(ComparisonToExit(cc), ir.AddConstant(notTakenAddr), IRTEMP_LHS, 0);
 	// Taken
 	if (likely && !branchInfo.delaySlotIsBranch)
 		CompileDelaySlot();
@@ -244,6 +361,10 @@ void IRFrontend::BranchFPFlag(MIPSOpcode op, IRComparison cc, bool likely) {
 	}
 
 	FlushAll();
+	if (traceAddr != 0) {
+		ContinueTrace(traceAddr);
+		return;
+	}
 	ir.Write(IROp::ExitToConst, ir.AddConstant(targetAddr));
 
 	// Account for the delay slot.
@@ -291,7 +412,14 @@ void IRFrontend::BranchVFPUFlag(MIPSOpcode op, IRComparison cc, bool likely) {
 
 	ir.Write(IROp::AndConst, IRTEMP_LHS, IRTEMP_LHS, ir.AddConstant(1 << imm3));
 	FlushAll();
-	ir.Write(ComparisonToExit(cc), ir.AddConstant(ResolveNotTakenTarget(branchInfo)), IRTEMP_LHS, 0);
+	u32 notTakenAddr = ResolveNotTakenTarget(branchInfo);
+	u32 traceAddr = TraceContinuation(targetAddr, likely ? 0 : notTakenAddr);
+	if (traceAddr != 0 && traceAddr != targetAddr) {
+		ir.Write(ComparisonToExit(Invert(cc)), ir.AddConstant(targetAddr), IRTEMP_LHS, 0);
+		ContinueTrace(traceAddr);
+		return;
+	}
+	ir.Write(ComparisonToExit(cc), ir.AddConstant(notTakenAddr), IRTEMP_LHS, 0);
 
 	if (likely && !branchInfo.delaySlotIsBranch)
 		CompileDelaySlot();
@@ -306,6 +434,10 @@ void IRFrontend::BranchVFPUFlag(MIPSOpcode op, IRComparison cc, bool likely) {
 
 	// Taken
 	FlushAll();
+	if (traceAddr != 0) {
+		ContinueTrace(traceAddr);
+		return;
+	}
 	ir.Write(IROp::ExitToConst, ir.AddConstant(targetAddr));
 
 	// Account for the delay slot.
@@ -347,6 +479,8 @@ void IRFrontend::Comp_Jump(MIPSOpcode op) {
 	case 3: //jal
 		ir.WriteSetConstant(MIPS_REG_RA, GetCompilerPC() + 8);
 		CompileDelaySlot();
+		if (TryInlineLeaf(targetAddr))
+			return;
 		break;
 
 	default:
@@ -358,7 +492,13 @@ void IRFrontend::Comp_Jump(MIPSOpcode op) {
 	ir.Write(IROp::Downcount, 0, ir.AddConstant(dcAmount));
 	js.downcountAmount = 0;
 
+	// Calls are left alone, only plain jumps are followed in traces.
+	u32 traceAddr = (op >> 26) == 2 ? TraceContinuation(targetAddr, 0) : 0;
 	FlushAll();
+	if (traceAddr != 0) {
+		ContinueTrace(traceAddr);
+		return;
+	}
 	ir.Write(IROp::ExitToConst, ir.AddConstant(targetAddr));
 
 	// Account for the delay slot.
@@ -371,6 +511,15 @@ void IRFrontend::Comp_JumpReg(MIPSOpcode op) {
 		ERROR_LOG_REPORT(Log::JIT, "Branch in JumpReg delay slot at %08x in block starting at %08x", GetCompilerPC(), js.blockStart);
 		return;
 	}
+	if (inlineReturnAddr != 0 && GetCompilerPC() == inlineJrAddr) {
+		// The jr ra of an inlined leaf function, just continue after the call.
+		js.downcountAmount += MIPSGetInstructionCycleEstimate(GetOffsetInstruction(1));
+		CompileDelaySlot();
+		js.compilerPC = inlineReturnAddr - 4;
+		inlineReturnAddr = 0;
+		return;
+	}
+
 	MIPSGPReg rs = _RS;
 	MIPSGPReg rd = _RD;
 	bool andLink = (op & 0x3f) == 9 && rd != MIPS_REG_ZERO;
@@ -0,0 +1,268 @@
+// Copyright (c) 2025- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <algorithm>
+
+#include "ext/xxhash.h"
+#include "Common/File/FileUtil.h"
+#include "Common/File/Path.h"
+#include "Common/Log.h"
+#include "Common/StringUtils.h"
+#include "Common/TimeUtil.h"
+#include "Core/Config.h"
+#include "Core/MemMap.h"
+#include "Core/System.h"
+#include "Core/Util/PathUtil.h"
+#include "Core/MIPS/IR/IRDiskCache.h"
+
+namespace MIPSComp {
+
+IRDiskCache g_irDiskCache;
+
+#define IR_DISK_CACHE_MAGIC 0x4B445249  // "IRDK"
+#define IR_DISK_CACHE_VERSION 1
+
+// Keep the file to a sane size. Games that keep swapping overlays could otherwise grow it forever.
+static const u32 MAX_CACHED_INSTRUCTIONS = 0x200000;
+
+struct IRDiskCacheHeader {
+	u32 magic;
+	u32 version;
+	u64 fingerprint;
+	u32 numEntries;
+	u32 numInstructions;
+};
+
+u64 IRHashMIPSCode(u32 addr, u32 size) {
+	// This is unfortunate. In case there are emuhacks, we have to make a copy.
+	// If we could hash while reading we could avoid this.
+	std::vector<u32> buffer;
+	buffer.resize(size / 4);
+	size_t pos = 0;
+	for (u32 off = 0; off < size; off += 4) {
+		// Let's actually hash the replacement, if any.
+		MIPSOpcode instr = Memory::ReadUnchecked_Instruction(addr + off, false);
+		buffer[pos++] = instr.encoding;
+	}
+	return XXH3_64bits(&buffer[0], size);
+}
+
+static Path CacheFilename(const std::string &discID) {
+	return GetSysDirectory(DIRECTORY_APP_CACHE) / (discID + ".irblocks");
+}
+
+// Everything outside the MIPS code itself that affects the IR we generate.
+static u64 ComputeFingerprint(const IROptions &opts) {
+	std::string desc = StringFromFormat("%s|%d|%08x|%d%d%d%d%d%d|%d|%d",
+		PPSSPP_GIT_VERSION, (int)sizeof(IRInst), opts.disableFlags,
+		opts.unalignedLoadStore, opts.unalignedLoadStoreVec4, opts.preferVec4, opts.preferVec4Dot, opts.optimizeForInterpreter, opts.inlineLeafFunctions,
+		g_Config.bFastMemory, PSP_CoreParameter().compat.flags().MoreAccurateVMMUL);
+	return XXH3_64bits(desc.data(), desc.size());
+}
+
+void IRDiskCache::Init(const std::string &discID) {
+	Clear();
+	active_ = false;
+	dirty_ = false;
+	fingerprint_ = 0;
+	discID_ = g_Config.bIRBlockDiskCache ? discID : "";
+}
+
+void IRDiskCache::Shutdown() {
+	if (active_ && dirty_) {
+		Save();
+	}
+	if (active_) {
+		INFO_LOG(Log::JIT, "IR disk cache: %d blocks reused, %d compiled", hits_, misses_);
+	}
+	Clear();
+	active_ = false;
+	discID_.clear();
+}
+
+void IRDiskCache::Attach(const IROptions &opts) {
+	if (discID_.empty()) {
+		return;
+	}
+
+	u64 fingerprint = ComputeFingerprint(opts);
+	if (active_ && fingerprint == fingerprint_) {
+		return;
+	}
+
+	if (active_ && dirty_) {
+		Save();
+	}
+	Clear();
+	fingerprint_ = fingerprint;
+	active_ = true;
+	Load();
+}
+
+void IRDiskCache::Clear() {
+	entries_.clear();
+	arena_.clear();
+	arena_.shrink_to_fit();
+	byAddr_.clear();
+	hits_ = 0;
+	misses_ = 0;
+	dirty_ = false;
+}
+
+bool IRDiskCache::Lookup(u32 addr, u32 stateFlags, std::vector<IRInst> &instructions, u32 &mipsBytes) {
+	auto iter = byAddr_.find(addr);
+	if (iter != byAddr_.end()) {
+		for (int i : iter->second) {
+			Entry &e = entries_[i];
+			if (e.stateFlags != stateFlags || !Memory::IsValidRange(addr, e.mipsBytes))
+				continue;
+			if (IRHashMIPSCode(addr, e.mipsBytes) != e.hash)
+				continue;
+
+			const IRInst *start = arena_.data() + e.arenaOffset;
+			instructions.assign(start, start + e.numInstructions);
+			mipsBytes = e.mipsBytes;
+			// Not worth rewriting the whole file for, this gets saved along with the next new block.
+			if (e.runs < 0xFFFF)
+				e.runs++;
+			hits_++;
+			return true;
+		}
+	}
+	misses_++;
+	return false;
+}
+
+void IRDiskCache::Add(u32 addr, u32 mipsBytes, u64 hash, u32 stateFlags, const std::vector<IRInst> &instructions) {
+	if (instructions.empty() || arena_.size() + instructions.size() > MAX_CACHED_INSTRUCTIONS) {
+		return;
+	}
+
+	std::vector<int> &atAddr = byAddr_[addr];
+	for (int i : atAddr) {
+		const Entry &e = entries_[i];
+		if (e.hash == hash && e.mipsBytes == mipsBytes && e.stateFlags == stateFlags)
+			return;
+	}
+
+	Entry e{};
+	e.hash = hash;
+	e.addr = addr;
+	e.mipsBytes = mipsBytes;
+	e.stateFlags = stateFlags;
+	e.arenaOffset = (u32)arena_.size();
+	e.numInstructions = (u32)instructions.size();
+	e.runs = 1;
+	arena_.insert(arena_.end(), instructions.begin(), instructions.end());
+	atAddr.push_back((int)entries_.size());
+	entries_.push_back(e);
+	dirty_ = true;
+}
+
+u32 IRDiskCache::GetRunCount(u32 addr) const {
+	auto iter = byAddr_.find(addr);
+	if (iter == byAddr_.end())
+		return 0;
+	u32 runs = 0;
+	for (int i : iter->second)
+		runs = std::max(runs, entries_[i].runs);
+	return runs;
+}
+
+void IRDiskCache::Load() {
+	Path filename = CacheFilename(discID_);
+	File::IOFile f(filename, "rb");
+	if (!f.IsOpen()) {
+		return;
+	}
+
+	double start = time_now_d();
+	IRDiskCacheHeader header;
+	if (!f.ReadArray(&header, 1) || header.magic != IR_DISK_CACHE_MAGIC || header.version != IR_DISK_CACHE_VERSION) {
+		WARN_LOG(Log::JIT, "IR disk cache: bad header in %s, ignoring", filename.c_str());
+		return;
+	}
+	if (header.fingerprint != fingerprint_) {
+		// Different version or settings. We'll just overwrite it on save.
+		INFO_LOG(Log::JIT, "IR disk cache: %s was made with different settings, ignoring", filename.c_str());
+		return;
+	}
+	if (header.numInstructions > MAX_CACHED_INSTRUCTIONS || header.numEntries > header.numInstructions) {
+		ERROR_LOG(Log::JIT, "IR disk cache: corrupt header in %s", filename.c_str());
+		return;
+	}
+
+	entries_.resize(header.numEntries);
+	arena_.resize(header.numInstructions);
+	if (!f.ReadArray(entries_.data(), entries_.size()) || !f.ReadArray(arena_.data(), arena_.size())) {
+		ERROR_LOG(Log::JIT, "IR disk cache: truncated file %s", filename.c_str());
+		Clear();
+		return;
+	}
+
+	// Sanity check everything, we don't want to execute garbage.
+	for (const IRInst &inst : arena_) {
+		if (!GetIRMeta(inst.op)) {
+			ERROR_LOG(Log::JIT, "IR disk cache: invalid IR op in %s", filename.c_str());
+			Clear();
+			return;
+		}
+	}
+	for (int i = 0; i < (int)entries_.size(); i++) {
+		const Entry &e = entries_[i];
+		if (e.numInstructions == 0 || (u64)e.arenaOffset + e.numInstructions > arena_.size() || e.mipsBytes == 0 || (e.mipsBytes & 3) != 0) {
+			ERROR_LOG(Log::JIT, "IR disk cache: invalid block entry in %s", filename.c_str());
+			Clear();
+			return;
+		}
+		byAddr_[e.addr].push_back(i);
+	}
+
+	INFO_LOG(Log::JIT, "IR disk cache: loaded %d blocks (%d instructions) in %0.1f ms", (int)entries_.size(), (int)arena_.size(), (time_now_d() - start) * 1000.0);
+}
+
+void IRDiskCache::Save() {
+	File::CreateFullPath(GetSysDirectory(DIRECTORY_APP_CACHE));
+	Path filename = CacheFilename(discID_);
+	File::IOFile f(filename, "wb");
+	if (!f.IsOpen()) {
+		WARN_LOG(Log::JIT, "IR disk cache: unable to write %s", filename.c_str());
+		return;
+	}
+
+	IRDiskCacheHeader header{};
+	header.magic = IR_DISK_CACHE_MAGIC;
+	header.version = IR_DISK_CACHE_VERSION;
+	header.fingerprint = fingerprint_;
+	header.numEntries = (u32)entries_.size();
+	header.numInstructions = (u32)arena_.size();
+
+	bool success = f.WriteArray(&header, 1);
+	success = success && f.WriteArray(entries_.data(), entries_.size());
+	success = success && f.WriteArray(arena_.data(), arena_.size());
+	f.Close();
+
+	if (success) {
+		INFO_LOG(Log::JIT, "IR disk cache: saved %d blocks to %s", (int)entries_.size(), filename.c_str());
+		dirty_ = false;
+	} else {
+		// Don't leave a half-written file around.
+		File::Delete(filename);
+	}
+}
+
+}  // namespace MIPSComp
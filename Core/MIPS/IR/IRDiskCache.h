@@ -0,0 +1,84 @@
+// Copyright (c) 2025- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Common/CommonTypes.h"
+#include "Core/MIPS/IR/IRInst.h"
+
+namespace MIPSComp {
+
+// Hashes the MIPS code in a range, looking through any jit emuhacks. Used to check if a block is still valid.
+u64 IRHashMIPSCode(u32 addr, u32 size);
+
+// Keeps finished IR blocks (after all the passes) around between runs, in a per-disc-ID file in the app cache.
+// Blocks are keyed on their start address and the hash of the MIPS code they were compiled from, so a block is
+// only reused if the code in memory still matches. This lets us skip the frontend and passes on later boots.
+class IRDiskCache {
+public:
+	void Init(const std::string &discID);
+	void Shutdown();
+
+	// Called whenever an IRJit is created. If the options that affect the generated IR have changed,
+	// what we have gets saved and we start over with a fresh set.
+	void Attach(const IROptions &opts);
+
+	bool IsActive() const { return active_; }
+
+	// stateFlags are from IRFrontend::GetCacheStateFlags(), since some frontend state also affects the IR.
+	bool Lookup(u32 addr, u32 stateFlags, std::vector<IRInst> &instructions, u32 &mipsBytes);
+	void Add(u32 addr, u32 mipsBytes, u64 hash, u32 stateFlags, const std::vector<IRInst> &instructions);
+
+	// Roughly how many boots a block at this address has been reused on, only counting boots that saved the
+	// file because they added new blocks. Serves as a cheap profile of hot code.
+	u32 GetRunCount(u32 addr) const;
+
+private:
+	struct Entry {
+		u64 hash;
+		u32 addr;
+		u32 mipsBytes;
+		u32 stateFlags;
+		u32 arenaOffset;
+		u32 numInstructions;
+		u32 runs;
+	};
+
+	void Load();
+	void Save();
+	void Clear();
+
+	std::string discID_;
+	u64 fingerprint_ = 0;
+	bool active_ = false;
+	bool dirty_ = false;
+
+	std::vector<Entry> entries_;
+	std::vector<IRInst> arena_;
+	std::unordered_map<u32, std::vector<int>> byAddr_;
+
+	int hits_ = 0;
+	int misses_ = 0;
+};
+
+extern IRDiskCache g_irDiskCache;
+
+}  // namespace MIPSComp
@@ -141,6 +141,8 @@ bool IRFrontend::CheckRounding(u32 blockAddress) {
 
 void IRFrontend::Comp_ReplacementFunc(MIPSOpcode op) {
 	int index = op.encoding & MIPS_EMUHACK_VALUE_MASK;
+	// Whether we replace depends on more than the code (flags, breakpoints in the func), so don't cache these.
+	blockUsedReplacement = true;
 
 	const ReplacementTableEntry *entry = GetReplacementFunc(index);
 	if (!entry) {
@@ -252,6 +254,12 @@ void IRFrontend::DoJit(u32 em_address, std::vector<IRInst> &instructions, u32 &m
 	js.blockWrotePrefixes = false;
 	js.inDelaySlot = false;
 	js.PrefixStart();
+	blockStartStateFlags = GetCacheStateFlags();
+	blockUsedReplacement = false;
+	inlineReturnAddr = 0;
+	inlineJrAddr = 0;
+	blockInlineStart = 0;
+	blockInlineEnd = 0;
 	ir.Clear();
 	ir.Reserve(64); // Estimate a reasonable number of IR instructions per block
 
@@ -316,7 +324,7 @@ void IRFrontend::DoJit(u32 em_address, std::vector<IRInst> &instructions, u32 &m
 	if (logBlocks > 0 && dontLogBlocks == 0) {
 		char temp2[256];
 		NOTICE_LOG(Log::JIT, "=============== mips %08x ===============", em_address);
-		for (u32 cpc = em_address; cpc != GetCompilerPC(); cpc += 4) {
+		for (u32 cpc = em_address; cpc < GetCompilerPC(); cpc += 4) {
 			temp2[0] = 0;
 			MIPSDisAsm(Memory::Read_Opcode_JIT(cpc), cpc, temp2, sizeof(temp2), true);
 			NOTICE_LOG(Log::JIT, "M: %08x   %s", cpc, temp2);
@@ -349,6 +357,82 @@ void IRFrontend::DoJit(u32 em_address, std::vector<IRInst> &instructions, u32 &m
 		dontLogBlocks--;
 }
 
+bool IRFrontend::DoTrace(u32 em_address, const IRExitProfile &profile, std::vector<IRInst> &instructions, u32 &mipsBytes) {
+	traceProfile = &profile;
+	traceBlockStart = em_address;
+	traceContinues = 0;
+	traceRanges.clear();
+	traceRangeStart = em_address;
+	traceEnd = em_address;
+	DoJit(em_address, instructions, mipsBytes);
+	traceProfile = nullptr;
+
+	// The trace may have ended anywhere, so the block's range is wherever it went at or after the start.
+	EndTraceRange(js.compilerPC);
+	mipsBytes = traceEnd - em_address;
+
+	// Same conditions as caching: if rounding or prefix assumptions changed partway, it'd be thrown away anyway.
+	return traceContinues > 0 && !instructions.empty() && LastBlockUsable();
+}
+
+// Need at least this many runs before trusting the profile for a block.
+static const u32 EXIT_PROFILE_MIN_RUNS = 8;
+
+void IRExitProfile::Record(u32 blockStart, u32 exitPC) {
+	Exits &exits = exits_[blockStart];
+	exits.total++;
+	// Most blocks only have two exits.  Anything beyond that just counts against the others.
+	for (int i = 0; i < 2; ++i) {
+		if (exits.count[i] == 0 || exits.pc[i] == exitPC) {
+			exits.pc[i] = exitPC;
+			exits.count[i]++;
+			break;
+		}
+	}
+}
+
+u32 IRExitProfile::DominantExit(u32 blockStart) const {
+	auto iter = exits_.find(blockStart);
+	if (iter == exits_.end() || iter->second.total < EXIT_PROFILE_MIN_RUNS)
+		return 0;
+
+	const Exits &exits = iter->second;
+	for (int i = 0; i < 2; ++i) {
+		// At least 7/8 of the time.
+		if (exits.count[i] * 8 >= exits.total * 7)
+			return exits.pc[i];
+	}
+	return 0;
+}
+
+u32 IRFrontend::GetCacheStateFlags() const {
+	return (js.startDefaultPrefix ? 1 : 0) | (js.hasSetRounding ? 2 : 0);
+}
+
+bool IRFrontend::CanUseCachedBlocks() const {
+	// Breakpoints and tracing add instructions that aren't part of the cached IR.
+	return !g_breakpoints.HasBreakPoints() && !g_breakpoints.HasMemChecks() && !mipsTracer.tracing_enabled;
+}
+
+bool IRFrontend::LastBlockCacheable() const {
+	// Inlined code lives outside the block's own range, which is all the cache checks.
+	return blockInlineEnd == 0 && LastBlockUsable();
+}
+
+void IRFrontend::GetLastBlockInlinedRange(u32 *start, u32 *size) const {
+	*start = blockInlineStart;
+	*size = blockInlineEnd - blockInlineStart;
+}
+
+bool IRFrontend::LastBlockUsable() const {
+	if (js.cancel || js.hadBreakpoints || blockUsedReplacement || mipsTracer.tracing_enabled)
+		return false;
+	// If the block changed the rounding or prefix assumptions, CheckRounding() will throw it away anyway.
+	if (GetCacheStateFlags() != blockStartStateFlags || (js.startDefaultPrefix && js.MayHavePrefix()))
+		return false;
+	return true;
+}
+
 void IRFrontend::Comp_RunBlock(MIPSOpcode op) {
 	// This shouldn't be necessary, the dispatcher should catch us before we get here.
 	ERROR_LOG(Log::JIT, "Comp_RunBlock should never be reached!");
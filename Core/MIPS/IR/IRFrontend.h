@@ -1,5 +1,9 @@
 #pragma once
 
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
 #include "Common/CommonTypes.h"
 #include "Core/MIPS/JitCommon/JitCommon.h"
 #include "Core/MIPS/JitCommon/JitState.h"
@@ -8,6 +12,25 @@
 
 namespace MIPSComp {
 
+// Where blocks exited to when they ran, keyed by block start address.  Used to build traces through hot paths.
+class IRExitProfile {
+public:
+	void Record(u32 blockStart, u32 exitPC);
+	// Returns the exit a block takes nearly every time, or 0 if there isn't one (or not enough runs yet.)
+	u32 DominantExit(u32 blockStart) const;
+	void Clear() {
+		exits_.clear();
+	}
+
+private:
+	struct Exits {
+		u32 pc[2]{};
+		u32 count[2]{};
+		u32 total = 0;
+	};
+	std::unordered_map<u32, Exits> exits_;
+};
+
 class IRFrontend : public MIPSFrontendInterface {
 public:
 	IRFrontend(bool startDefaultPrefix);
@@ -90,6 +113,17 @@ class IRFrontend : public MIPSFrontendInterface {
 	bool CheckRounding(u32 blockAddress);  // returns true if we need a do-over
 
 	void DoJit(u32 em_address, std::vector<IRInst> &instructions, u32 &mipsBytes);
+	// Like DoJit(), but keeps going through the dominant exit of each block instead of exiting, leaving side exits.
+	// Returns false if no exit was followed, or the result can't be used as a trace.
+	bool DoTrace(u32 em_address, const IRExitProfile &profile, std::vector<IRInst> &instructions, u32 &mipsBytes);
+
+	// For the IR disk cache. The state flags cover the frontend state that affects the generated IR.
+	u32 GetCacheStateFlags() const;
+	bool CanUseCachedBlocks() const;
+	// Whether the block from the last DoJit only depends on its MIPS code and GetCacheStateFlags().
+	bool LastBlockCacheable() const;
+	// The range covering any leaf functions inlined into the block from the last DoJit, size 0 if none.
+	void GetLastBlockInlinedRange(u32 *start, u32 *size) const;
 
 	void EatPrefix() override {
 		js.EatPrefix();
@@ -121,6 +155,17 @@ class IRFrontend : public MIPSFrontendInterface {
 	void BranchRSZeroComp(MIPSOpcode op, IRComparison cc, bool andLink, bool likely);
 	void BranchRSRTComp(MIPSOpcode op, IRComparison cc, bool likely);
 
+	// Returns where to keep compiling if we're building a trace and the profile says to follow this exit, or 0.
+	u32 TraceContinuation(u32 takenAddr, u32 notTakenAddr);
+	void ContinueTrace(u32 addr);
+	// Ends the run of code the trace is compiling at end, recording it for invalidation.
+	void EndTraceRange(u32 end);
+	bool TraceVisited(u32 addr);
+	// If the target of a jal is a short leaf function, keeps compiling inside it and returns true.
+	bool TryInlineLeaf(u32 targetAddr);
+	// Whether the last block was compiled without breakpoints, tracing, or broken assumptions.
+	bool LastBlockUsable() const;
+
 	// Utilities to reduce duplicated code
 	void CompShiftImm(MIPSOpcode op, IROp shiftType, int sa);
 	void CompShiftVar(MIPSOpcode op, IROp shiftType);
@@ -141,6 +186,26 @@ class IRFrontend : public MIPSFrontendInterface {
 
 	int dontLogBlocks = 0;
 	int logBlocks = 0;
+
+	u32 blockStartStateFlags = 0;
+	bool blockUsedReplacement = false;
+
+	// Only set during DoTrace().
+	const IRExitProfile *traceProfile = nullptr;
+	u32 traceBlockStart = 0;
+	int traceContinues = 0;
+	// Each continuation starts a new range of code.  These are the finished ones.
+	std::vector<std::pair<u32, u32>> traceRanges;
+	u32 traceRangeStart = 0;
+	// End of everything compiled at or after the start, which is the block's own range.
+	u32 traceEnd = 0;
+
+	// Set while compiling an inlined leaf function.
+	u32 inlineReturnAddr = 0;
+	u32 inlineJrAddr = 0;
+	// Covers code from outside the block's own range: inlined functions, and trace code before the start.
+	u32 blockInlineStart = 0;
+	u32 blockInlineEnd = 0;
 };
 
 }  // namespace
@@ -419,6 +419,7 @@ struct IROptions {
 	bool preferVec4;
 	bool preferVec4Dot;
 	bool optimizeForInterpreter;
+	bool inlineLeafFunctions;
 };
 
 const IRMeta *GetIRMeta(IROp op);
@@ -1318,3 +1318,351 @@ u32 IRInterpret(MIPSState *mips, const IRInst *inst) {
 	// We should not reach here anymore.
 	return 0;
 }
+
+// Threaded dispatch. Instead of looping back to the switch, every handler jumps straight to the handler of the
+// next instruction, so each op gets its own indirect branch for the predictor to learn. Only the common ops get
+// a handler - anything else continues the block in IRInterpret above, so the rare ones are only written once.
+// Keep these in sync with the cases above.
+#define IR_THREADED_OPS(X) \
+	X(SetConst) X(SetConstF) X(Add) X(Sub) X(And) X(Or) X(Xor) X(Mov) \
+	X(AddConst) X(OptAddConst) X(SubConst) X(AndConst) X(OptAndConst) X(OrConst) X(OptOrConst) X(XorConst) \
+	X(Neg) X(Not) X(Ext8to32) X(Ext16to32) \
+	X(ShlImm) X(ShrImm) X(SarImm) X(Shl) X(Shr) X(Sar) \
+	X(Slt) X(SltU) X(SltConst) X(SltUConst) X(MovZ) X(MovNZ) X(Max) X(Min) \
+	X(MtLo) X(MtHi) X(MfLo) X(MfHi) X(Mult) X(MultU) \
+	X(Load8) X(Load8Ext) X(Load16) X(Load16Ext) X(Load32) X(LoadFloat) \
+	X(Store8) X(Store16) X(Store32) X(StoreFloat) \
+	X(FAdd) X(FSub) X(FMul) X(FMov) X(FMovFromGPR) X(FMovToGPR) X(OptFCvtSWFromGPR) X(OptFMovToGPRShr8) \
+	X(Downcount) X(SetPC) X(SetPCConst) X(ExitToPC) X(ExitToConst) X(ExitToReg) \
+	X(ExitToConstIfEq) X(ExitToConstIfNeq) X(ExitToConstIfGtZ) X(ExitToConstIfGeZ) X(ExitToConstIfLtZ) X(ExitToConstIfLeZ)
+
+#if defined(__GNUC__) || defined(__clang__)
+
+// Labels can't be referenced from outside the function, so when table is set we just hand out the handlers.
+static u32 RunThreaded(MIPSState *mips, const IRThreadedInst *start, const IRInst *orig, const void *const **table) {
+	static const void *const handlers[] = {
+#define IR_THREADED_LABEL(op) &&Op_##op,
+		IR_THREADED_OPS(IR_THREADED_LABEL)
+#undef IR_THREADED_LABEL
+		&&Fallback,
+	};
+	if (table) {
+		*table = handlers;
+		return 0;
+	}
+
+	const IRThreadedInst *tinst = start;
+	const IRInst *inst = &tinst->inst;
+
+#define DISPATCH() do { inst = &tinst->inst; goto *tinst->handler; } while (false)
+#ifdef _DEBUG
+#define NEXT() do { if (mips->r[0] != 0) Crash(); tinst++; DISPATCH(); } while (false)
+#else
+#define NEXT() do { tinst++; DISPATCH(); } while (false)
+#endif
+
+	DISPATCH();
+
+Op_SetConst:
+	mips->r[inst->dest] = inst->constant;
+	NEXT();
+Op_SetConstF:
+	memcpy(&mips->f[inst->dest], &inst->constant, 4);
+	NEXT();
+Op_Add:
+	mips->r[inst->dest] = mips->r[inst->src1] + mips->r[inst->src2];
+	NEXT();
+Op_Sub:
+	mips->r[inst->dest] = mips->r[inst->src1] - mips->r[inst->src2];
+	NEXT();
+Op_And:
+	mips->r[inst->dest] = mips->r[inst->src1] & mips->r[inst->src2];
+	NEXT();
+Op_Or:
+	mips->r[inst->dest] = mips->r[inst->src1] | mips->r[inst->src2];
+	NEXT();
+Op_Xor:
+	mips->r[inst->dest] = mips->r[inst->src1] ^ mips->r[inst->src2];
+	NEXT();
+Op_Mov:
+	mips->r[inst->dest] = mips->r[inst->src1];
+	NEXT();
+Op_AddConst:
+	mips->r[inst->dest] = mips->r[inst->src1] + inst->constant;
+	NEXT();
+Op_OptAddConst:
+	mips->r[inst->dest] += inst->constant;
+	NEXT();
+Op_SubConst:
+	mips->r[inst->dest] = mips->r[inst->src1] - inst->constant;
+	NEXT();
+Op_AndConst:
+	mips->r[inst->dest] = mips->r[inst->src1] & inst->constant;
+	NEXT();
+Op_OptAndConst:
+	mips->r[inst->dest] &= inst->constant;
+	NEXT();
+Op_OrConst:
+	mips->r[inst->dest] = mips->r[inst->src1] | inst->constant;
+	NEXT();
+Op_OptOrConst:
+	mips->r[inst->dest] |= inst->constant;
+	NEXT();
+Op_XorConst:
+	mips->r[inst->dest] = mips->r[inst->src1] ^ inst->constant;
+	NEXT();
+Op_Neg:
+	mips->r[inst->dest] = (u32)(-(s32)mips->r[inst->src1]);
+	NEXT();
+Op_Not:
+	mips->r[inst->dest] = ~mips->r[inst->src1];
+	NEXT();
+Op_Ext8to32:
+	mips->r[inst->dest] = SignExtend8ToU32(mips->r[inst->src1]);
+	NEXT();
+Op_Ext16to32:
+	mips->r[inst->dest] = SignExtend16ToU32(mips->r[inst->src1]);
+	NEXT();
+
+Op_ShlImm:
+	mips->r[inst->dest] = mips->r[inst->src1] << (int)inst->src2;
+	NEXT();
+Op_ShrImm:
+	mips->r[inst->dest] = mips->r[inst->src1] >> (int)inst->src2;
+	NEXT();
+Op_SarImm:
+	mips->r[inst->dest] = (s32)mips->r[inst->src1] >> (int)inst->src2;
+	NEXT();
+Op_Shl:
+	mips->r[inst->dest] = mips->r[inst->src1] << (mips->r[inst->src2] & 31);
+	NEXT();
+Op_Shr:
+	mips->r[inst->dest] = mips->r[inst->src1] >> (mips->r[inst->src2] & 31);
+	NEXT();
+Op_Sar:
+	mips->r[inst->dest] = (s32)mips->r[inst->src1] >> (mips->r[inst->src2] & 31);
+	NEXT();
+
+Op_Slt:
+	mips->r[inst->dest] = (s32)mips->r[inst->src1] < (s32)mips->r[inst->src2];
+	NEXT();
+Op_SltU:
+	mips->r[inst->dest] = mips->r[inst->src1] < mips->r[inst->src2];
+	NEXT();
+Op_SltConst:
+	mips->r[inst->dest] = (s32)mips->r[inst->src1] < (s32)inst->constant;
+	NEXT();
+Op_SltUConst:
+	mips->r[inst->dest] = mips->r[inst->src1] < inst->constant;
+	NEXT();
+Op_MovZ:
+	if (mips->r[inst->src1] == 0)
+		mips->r[inst->dest] = mips->r[inst->src2];
+	NEXT();
+Op_MovNZ:
+	if (mips->r[inst->src1] != 0)
+		mips->r[inst->dest] = mips->r[inst->src2];
+	NEXT();
+Op_Max:
+	mips->r[inst->dest] = (s32)mips->r[inst->src1] > (s32)mips->r[inst->src2] ? mips->r[inst->src1] : mips->r[inst->src2];
+	NEXT();
+Op_Min:
+	mips->r[inst->dest] = (s32)mips->r[inst->src1] < (s32)mips->r[inst->src2] ? mips->r[inst->src1] : mips->r[inst->src2];
+	NEXT();
+
+Op_MtLo:
+	mips->lo = mips->r[inst->src1];
+	NEXT();
+Op_MtHi:
+	mips->hi = mips->r[inst->src1];
+	NEXT();
+Op_MfLo:
+	mips->r[inst->dest] = mips->lo;
+	NEXT();
+Op_MfHi:
+	mips->r[inst->dest] = mips->hi;
+	NEXT();
+Op_Mult:
+	{
+		s64 result = (s64)(s32)mips->r[inst->src1] * (s64)(s32)mips->r[inst->src2];
+		memcpy(&mips->lo, &result, 8);
+	}
+	NEXT();
+Op_MultU:
+	{
+		u64 result = (u64)mips->r[inst->src1] * (u64)mips->r[inst->src2];
+		memcpy(&mips->lo, &result, 8);
+	}
+	NEXT();
+
+Op_Load8:
+	mips->r[inst->dest] = Memory::ReadUnchecked_U8(mips->r[inst->src1] + inst->constant);
+	NEXT();
+Op_Load8Ext:
+	mips->r[inst->dest] = SignExtend8ToU32(Memory::ReadUnchecked_U8(mips->r[inst->src1] + inst->constant));
+	NEXT();
+Op_Load16:
+	mips->r[inst->dest] = Memory::ReadUnchecked_U16(mips->r[inst->src1] + inst->constant);
+	NEXT();
+Op_Load16Ext:
+	mips->r[inst->dest] = SignExtend16ToU32(Memory::ReadUnchecked_U16(mips->r[inst->src1] + inst->constant));
+	NEXT();
+Op_Load32:
+	mips->r[inst->dest] = Memory::ReadUnchecked_U32(mips->r[inst->src1] + inst->constant);
+	NEXT();
+Op_LoadFloat:
+	mips->f[inst->dest] = Memory::ReadUnchecked_Float(mips->r[inst->src1] + inst->constant);
+	NEXT();
+Op_Store8:
+	Memory::WriteUnchecked_U8(mips->r[inst->src3], mips->r[inst->src1] + inst->constant);
+	NEXT();
+Op_Store16:
+	Memory::WriteUnchecked_U16(mips->r[inst->src3], mips->r[inst->src1] + inst->constant);
+	NEXT();
+Op_Store32:
+	Memory::WriteUnchecked_U32(mips->r[inst->src3], mips->r[inst->src1] + inst->constant);
+	NEXT();
+Op_StoreFloat:
+	Memory::WriteUnchecked_Float(mips->f[inst->src3], mips->r[inst->src1] + inst->constant);
+	NEXT();
+
+Op_FAdd:
+	mips->f[inst->dest] = mips->f[inst->src1] + mips->f[inst->src2];
+	NEXT();
+Op_FSub:
+	mips->f[inst->dest] = mips->f[inst->src1] - mips->f[inst->src2];
+	NEXT();
+Op_FMul:
+	{
+		float a = mips->f[inst->src1];
+		float b = mips->f[inst->src2];
+		if ((b == 0.0f && my_isinf(a)) || (a == 0.0f && my_isinf(b))) {
+			mips->fi[inst->dest] = 0x7fc00000;
+		} else {
+			mips->f[inst->dest] = a * b;
+		}
+	}
+	NEXT();
+Op_FMov:
+	mips->f[inst->dest] = mips->f[inst->src1];
+	NEXT();
+Op_FMovFromGPR:
+	memcpy(&mips->f[inst->dest], &mips->r[inst->src1], 4);
+	NEXT();
+Op_FMovToGPR:
+	memcpy(&mips->r[inst->dest], &mips->f[inst->src1], 4);
+	NEXT();
+Op_OptFCvtSWFromGPR:
+	mips->f[inst->dest] = (float)(int)mips->r[inst->src1];
+	NEXT();
+Op_OptFMovToGPRShr8:
+	{
+		u32 temp;
+		memcpy(&temp, &mips->f[inst->src1], 4);
+		mips->r[inst->dest] = temp >> 8;
+	}
+	NEXT();
+
+Op_Downcount:
+	mips->downcount -= (int)inst->constant;
+	NEXT();
+Op_SetPC:
+	mips->pc = mips->r[inst->src1];
+	NEXT();
+Op_SetPCConst:
+	mips->pc = inst->constant;
+	NEXT();
+Op_ExitToPC:
+	return mips->pc;
+Op_ExitToConst:
+	return inst->constant;
+Op_ExitToReg:
+	return mips->r[inst->src1];
+Op_ExitToConstIfEq:
+	if (mips->r[inst->src1] == mips->r[inst->src2])
+		return inst->constant;
+	NEXT();
+Op_ExitToConstIfNeq:
+	if (mips->r[inst->src1] != mips->r[inst->src2])
+		return inst->constant;
+	NEXT();
+Op_ExitToConstIfGtZ:
+	if ((s32)mips->r[inst->src1] > 0)
+		return inst->constant;
+	NEXT();
+Op_ExitToConstIfGeZ:
+	if ((s32)mips->r[inst->src1] >= 0)
+		return inst->constant;
+	NEXT();
+Op_ExitToConstIfLtZ:
+	if ((s32)mips->r[inst->src1] < 0)
+		return inst->constant;
+	NEXT();
+Op_ExitToConstIfLeZ:
+	if ((s32)mips->r[inst->src1] <= 0)
+		return inst->constant;
+	NEXT();
+
+Fallback:
+	return IRInterpret(mips, orig + (tinst - start));
+
+#undef NEXT
+#undef DISPATCH
+}
+
+struct ThreadedHandlerLookup {
+	ThreadedHandlerLookup() {
+		static const IROp threadedOps[] = {
+#define IR_THREADED_IROP(op) IROp::op,
+			IR_THREADED_OPS(IR_THREADED_IROP)
+#undef IR_THREADED_IROP
+		};
+
+		const void *const *handlers = nullptr;
+		RunThreaded(nullptr, nullptr, nullptr, &handlers);
+		const size_t numOps = ARRAY_SIZE(threadedOps);
+		for (auto &handler : byOp)
+			handler = handlers[numOps];
+		for (size_t i = 0; i < numOps; i++)
+			byOp[(int)threadedOps[i]] = handlers[i];
+	}
+
+	const void *byOp[256];
+};
+
+bool IRThreadedDispatchSupported() {
+	return true;
+}
+
+void IRPredecodeThreaded(const IRInst *inst, int count, IRThreadedInst *out) {
+	static const ThreadedHandlerLookup lookup;
+	for (int i = 0; i < count; i++) {
+		out[i].handler = lookup.byOp[(int)inst[i].op];
+		out[i].inst = inst[i];
+	}
+}
+
+u32 IRInterpretThreaded(MIPSState *mips, const IRThreadedInst *tinst, const IRInst *orig) {
+	return RunThreaded(mips, tinst, orig, nullptr);
+}
+
+#else
+
+bool IRThreadedDispatchSupported() {
+	return false;
+}
+
+void IRPredecodeThreaded(const IRInst *inst, int count, IRThreadedInst *out) {
+	for (int i = 0; i < count; i++) {
+		out[i].handler = nullptr;
+		out[i].inst = inst[i];
+	}
+}
+
+u32 IRInterpretThreaded(MIPSState *mips, const IRThreadedInst *tinst, const IRInst *orig) {
+	return IRInterpret(mips, orig);
+}
+
+#endif
+
+#undef IR_THREADED_OPS
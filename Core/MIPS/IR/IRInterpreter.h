@@ -3,14 +3,28 @@
 #include "Common/CommonTypes.h"
 #include "Core/Core.h"
 #include "Core/MemMap.h"
+#include "Core/MIPS/IR/IRInst.h"
 
 class MIPSState;
-struct IRInst;
 
 u32 IRRunBreakpoint(u32 pc);
 u32 IRRunMemCheck(u32 pc, u32 addr);
 u32 IRInterpret(MIPSState *ms, const IRInst *inst);
 
+// Pre-decoded IR for the threaded dispatcher: each instruction carries the address of its handler.
+// These live in an array parallel to the IR arena, so the same offsets index both.
+struct IRThreadedInst {
+	const void *handler;
+	IRInst inst;
+};
+
+// Threaded dispatch needs computed goto, which MSVC doesn't have. Without it, use IRInterpret.
+bool IRThreadedDispatchSupported();
+void IRPredecodeThreaded(const IRInst *inst, int count, IRThreadedInst *out);
+// orig must point to the IRInst that tinst was decoded from. Ops without a threaded handler
+// continue the block there, in IRInterpret.
+u32 IRInterpretThreaded(MIPSState *ms, const IRThreadedInst *tinst, const IRInst *orig);
+
 void IRApplyRounding();
 void IRRestoreRounding();
 
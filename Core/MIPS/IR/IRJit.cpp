@@ -19,12 +19,12 @@
 #include <set>
 #include <algorithm>
 
-#include "ext/xxhash.h"
 #include "Common/Profiler/Profiler.h"
 
 #include "Common/Log.h"
 #include "Common/Serialize/Serializer.h"
 #include "Common/StringUtils.h"
+#include "Common/Thread/ThreadManager.h"
 
 #include "Core/Config.h"
 #include "Core/Core.h"
@@ -35,19 +35,21 @@
 #include "Core/MIPS/MIPSCodeUtils.h"
 #include "Core/MIPS/MIPSInt.h"
 #include "Core/MIPS/MIPSTables.h"
+#include "Core/MIPS/IR/IRDiskCache.h"
 #include "Core/MIPS/IR/IRRegCache.h"
 #include "Core/MIPS/IR/IRInterpreter.h"
 #include "Core/MIPS/IR/IRJit.h"
 #include "Core/MIPS/IR/IRNativeCommon.h"
 #include "Core/MIPS/JitCommon/JitCommon.h"
 #include "Core/Reporting.h"
+#include "Core/System.h"
 #include "Common/TimeUtil.h"
 #include "Core/MIPS/MIPSTracer.h"
 
 
 namespace MIPSComp {
 
-IRJit::IRJit(MIPSState *mipsState, bool actualJit) : frontend_(mipsState->HasDefaultPrefix()), mips_(mipsState), blocks_(actualJit) {
+IRJit::IRJit(MIPSState *mipsState, bool actualJit) : frontend_(mipsState->HasDefaultPrefix()), mips_(mipsState), blocks_(actualJit), prewarmFrontend_(mipsState->HasDefaultPrefix()) {
 	// u32 size = 128 * 1024;
 	InitIR();
 
@@ -55,6 +57,8 @@ IRJit::IRJit(MIPSState *mipsState, bool actualJit) : frontend_(mipsState->HasDef
 
 	// If this IRJit instance will be used to drive a "JIT using IR", don't optimize for interpretation.
 	jo.optimizeForInterpreter = !actualJit;
+	threadedDispatch_ = !actualJit && g_Config.bIRThreadedDispatch && IRThreadedDispatchSupported();
+	blocks_.SetThreadedDispatch(threadedDispatch_);
 
 	IROptions opts{};
 	opts.disableFlags = g_Config.uJitDisableFlags;
@@ -74,10 +78,14 @@ IRJit::IRJit(MIPSState *mipsState, bool actualJit) : frontend_(mipsState->HasDef
 	opts.preferVec4 = true;
 #endif
 	opts.optimizeForInterpreter = jo.optimizeForInterpreter;
+	opts.inlineLeafFunctions = g_Config.bJitInlineLeafFunctions && !PSP_CoreParameter().compat.flags().DisableLeafInlining;
 	frontend_.SetOptions(opts);
+
+	g_irDiskCache.Attach(opts);
 }
 
 IRJit::~IRJit() {
+	StopPrewarm();
 }
 
 void IRJit::DoState(PointerWrap &p) {
@@ -88,11 +96,34 @@ void IRJit::UpdateFCR31() {
 }
 
 void IRJit::ClearCache() {
+	std::lock_guard<std::recursive_mutex> guard(compileLock_);
 	INFO_LOG(Log::JIT, "IRJit: Clearing the block cache!");
 	blocks_.Clear();
+
+	if (prewarming_) {
+		// Prewarmed results are still good, but the frontend state might've changed (rounding, etc.)
+		std::lock_guard<std::mutex> prewarmGuard(prewarmLock_);
+		prewarmFrontend_ = frontend_;
+		prewarmGeneration_++;
+	}
 }
 
 void IRJit::InvalidateCacheAt(u32 em_address, int length) {
+	std::lock_guard<std::recursive_mutex> guard(compileLock_);
+	if (prewarming_) {
+		// Workers only publish results while holding compileLock_, so collecting now catches everything.
+		CollectPrewarmResults();
+		auto iter = prewarmed_.lower_bound(em_address >= prewarmMaxBytes_ ? em_address - prewarmMaxBytes_ : 0);
+		while (iter != prewarmed_.end() && iter->first < em_address + length) {
+			if (iter->first + iter->second.mipsBytes > em_address) {
+				prewarmStats_.dropped++;
+				iter = prewarmed_.erase(iter);
+			} else {
+				++iter;
+			}
+		}
+	}
+
 	std::vector<int> numbers = blocks_.FindInvalidatedBlockNumbers(em_address, length);
 	if (numbers.empty()) {
 		return;
@@ -116,6 +147,7 @@ void IRJit::Compile(u32 em_address) {
 
 	PROFILE_THIS_SCOPE("jitc");
 
+	std::lock_guard<std::recursive_mutex> guard(compileLock_);
 	std::vector<IRInst> instructions;
 	u32 mipsBytes;
 	if (!CompileBlock(em_address, instructions, mipsBytes)) {
@@ -136,7 +168,20 @@ void IRJit::Compile(u32 em_address) {
 bool IRJit::CompileBlock(u32 em_address, std::vector<IRInst> &instructions, u32 &mipsBytes) {
 	_dbg_assert_(compilerEnabled_);
 
-	frontend_.DoJit(em_address, instructions, mipsBytes);
+	// If the same code was compiled on a previous run, we can skip the frontend and passes.
+	const u32 cacheStateFlags = frontend_.GetCacheStateFlags();
+	bool fromDiskCache = false;
+	if (g_irDiskCache.IsActive() && frontend_.CanUseCachedBlocks()) {
+		fromDiskCache = g_irDiskCache.Lookup(em_address, cacheStateFlags, instructions, mipsBytes);
+	}
+	// Otherwise, a worker might've already compiled it ahead of time.
+	bool fromPrewarm = false;
+	if (!fromDiskCache && prewarming_) {
+		fromPrewarm = TakePrewarmedBlock(em_address, cacheStateFlags, instructions, mipsBytes);
+	}
+	if (!fromDiskCache && !fromPrewarm) {
+		frontend_.DoJit(em_address, instructions, mipsBytes);
+	}
 	_dbg_assert_(!instructions.empty());
 
 	int block_num = blocks_.AllocateBlock(em_address, mipsBytes, instructions);
@@ -147,11 +192,20 @@ bool IRJit::CompileBlock(u32 em_address, std::vector<IRInst> &instructions, u32
 	}
 
 	IRBlock *b = blocks_.GetBlock(block_num);
-	if (mipsTracer.tracing_enabled) {
+	if (!fromDiskCache && !fromPrewarm) {
+		u32 inlineStart, inlineSize;
+		frontend_.GetLastBlockInlinedRange(&inlineStart, &inlineSize);
+		b->SetInlinedRange(inlineStart, inlineSize);
+	}
+	if (mipsTracer.tracing_enabled || g_irDiskCache.IsActive()) {
 		// Hash, then only update page stats, don't link yet.
 		// TODO: Should we always hash?  Then we can reuse blocks.
 		b->UpdateHash();
 	}
+	// Prewarmed blocks already passed the same checks on the worker.
+	if (!fromDiskCache && g_irDiskCache.IsActive() && (fromPrewarm || frontend_.LastBlockCacheable())) {
+		g_irDiskCache.Add(em_address, mipsBytes, b->GetHash(), cacheStateFlags, instructions);
+	}
 
 	if (!CompileNativeBlock(&blocks_, block_num))
 		return false;
@@ -166,6 +220,185 @@ bool IRJit::CompileBlock(u32 em_address, std::vector<IRInst> &instructions, u32
 	return true;
 }
 
+// Don't let a huge module keep the workers (and memory) busy with code that may never run.
+static const size_t MAX_PREWARM_FUNCTIONS = 8192;
+
+// Prewarm workers compile without compileLock_, so they only take it for block lookups.
+static thread_local bool t_prewarmWorker = false;
+
+class IRPrewarmTask : public Task {
+public:
+	IRPrewarmTask(IRJit *jit) : jit_(jit) {}
+
+	TaskType Type() const override { return TaskType::CPU_COMPUTE; }
+	// Anything the game is actually waiting on comes first.
+	TaskPriority Priority() const override { return TaskPriority::LOW; }
+
+	void Run() override {
+		jit_->RunPrewarmCompiles();
+	}
+
+private:
+	IRJit *jit_;
+};
+
+void IRJit::PrewarmFunctions(const std::vector<u32> &entries) {
+	if (entries.empty() || !g_threadManager.IsInitialized() || !frontend_.CanUseCachedBlocks())
+		return;
+
+	// Code that ran on previous boots is likely to be needed first, so start there.
+	std::vector<std::pair<u32, u32>> ordered;
+	ordered.reserve(entries.size());
+	for (u32 addr : entries)
+		ordered.emplace_back(g_irDiskCache.GetRunCount(addr), addr);
+	std::stable_sort(ordered.begin(), ordered.end(), [](const std::pair<u32, u32> &a, const std::pair<u32, u32> &b) {
+		return a.first > b.first;
+	});
+	if (ordered.size() > MAX_PREWARM_FUNCTIONS)
+		ordered.resize(MAX_PREWARM_FUNCTIONS);
+
+	std::lock_guard<std::mutex> guard(prewarmLock_);
+	prewarmFrontend_ = frontend_;
+	prewarmGeneration_++;
+	for (const auto &entry : ordered)
+		prewarmQueue_.push_back(entry.second);
+	prewarming_ = true;
+
+	// Leave a core for the emu and render threads.
+	int maxWorkers = std::max(1, g_threadManager.GetNumLooperThreads() - 2);
+	while (prewarmWorkers_ < maxWorkers) {
+		prewarmWorkers_++;
+		g_threadManager.EnqueueTask(new IRPrewarmTask(this));
+	}
+	prewarmStats_.workers = std::max(prewarmStats_.workers, prewarmWorkers_);
+}
+
+void IRJit::RunPrewarmCompiles() {
+	t_prewarmWorker = true;
+	IRFrontend frontend(false);
+	uint32_t generation = 0;
+	{
+		std::lock_guard<std::mutex> guard(prewarmLock_);
+		frontend = prewarmFrontend_;
+		generation = prewarmGeneration_;
+	}
+
+	while (true) {
+		u32 addr;
+		{
+			std::lock_guard<std::mutex> guard(prewarmLock_);
+			if (prewarmQueue_.empty()) {
+				t_prewarmWorker = false;
+				prewarmWorkers_--;
+				prewarmCond_.notify_all();
+				return;
+			}
+			addr = prewarmQueue_.front();
+			prewarmQueue_.pop_front();
+			if (generation != prewarmGeneration_) {
+				frontend = prewarmFrontend_;
+				generation = prewarmGeneration_;
+			}
+		}
+
+		// Already reached by the CPU, or replaced. The CPU may still get there while we compile, the
+		// hash check when publishing (and again when taking the block) sorts that out.
+		if (!Memory::IsValid4AlignedAddress(addr) || MIPS_IS_EMUHACK(Memory::ReadUnchecked_U32(addr)))
+			continue;
+
+		double start = time_now_d();
+		PrewarmResult result{};
+		result.addr = addr;
+		result.stateFlags = frontend.GetCacheStateFlags();
+		frontend.DoJit(addr, result.instructions, result.mipsBytes);
+		// Same restrictions as the disk cache, the result has to only depend on the code at addr.
+		if (result.instructions.empty() || !frontend.LastBlockCacheable()) {
+			// The block may have changed the frontend's assumptions, so start over from the original state.
+			std::lock_guard<std::mutex> prewarmGuard(prewarmLock_);
+			frontend = prewarmFrontend_;
+			generation = prewarmGeneration_;
+			prewarmStats_.skipped++;
+			continue;
+		}
+		result.hash = IRHashMIPSCode(addr, result.mipsBytes);
+
+		// Publish under compileLock_, so a result can't slip past InvalidateCacheAt() for code that
+		// changed while we were compiling.
+		std::lock_guard<std::recursive_mutex> guard(compileLock_);
+		bool changed = IRHashMIPSCode(addr, result.mipsBytes) != result.hash;
+		std::lock_guard<std::mutex> prewarmGuard(prewarmLock_);
+		if (changed) {
+			prewarmStats_.skipped++;
+			continue;
+		}
+		prewarmStats_.compiled++;
+		prewarmStats_.compileTime += time_now_d() - start;
+		prewarmResults_.push_back(std::move(result));
+	}
+}
+
+void IRJit::CollectPrewarmResults() {
+	std::lock_guard<std::mutex> guard(prewarmLock_);
+	for (PrewarmResult &result : prewarmResults_) {
+		prewarmMaxBytes_ = std::max(prewarmMaxBytes_, result.mipsBytes);
+		prewarmed_[result.addr] = std::move(result);
+	}
+	prewarmResults_.clear();
+
+	if (prewarmQueue_.empty() && prewarmWorkers_ == 0 && prewarmed_.empty()) {
+		// Everything was either used or dropped.
+		LogPrewarmStats();
+		prewarming_ = false;
+	}
+}
+
+bool IRJit::TakePrewarmedBlock(u32 em_address, u32 stateFlags, std::vector<IRInst> &instructions, u32 &mipsBytes) {
+	CollectPrewarmResults();
+	auto iter = prewarmed_.find(em_address);
+	if (iter == prewarmed_.end())
+		return false;
+
+	PrewarmResult result = std::move(iter->second);
+	prewarmed_.erase(iter);
+	// Rounding or prefix assumptions might've changed, or the code might've been overwritten without an icache clear.
+	if (result.stateFlags != stateFlags || !frontend_.CanUseCachedBlocks() || IRHashMIPSCode(em_address, result.mipsBytes) != result.hash) {
+		prewarmStats_.dropped++;
+		return false;
+	}
+
+	instructions = std::move(result.instructions);
+	mipsBytes = result.mipsBytes;
+	prewarmStats_.used++;
+	return true;
+}
+
+void IRJit::LogPrewarmStats() {
+	if (prewarmStats_.compiled != 0) {
+		INFO_LOG(Log::JIT, "IR prewarm: %d functions compiled (%d skipped) on %d workers in %0.1f ms total, %d used, %d dropped",
+			prewarmStats_.compiled, prewarmStats_.skipped, prewarmStats_.workers, prewarmStats_.compileTime * 1000.0, prewarmStats_.used, prewarmStats_.dropped);
+	}
+	prewarmStats_ = {};
+}
+
+void IRJit::StopPrewarm() {
+	std::unique_lock<std::mutex> guard(prewarmLock_);
+	prewarmQueue_.clear();
+	prewarmCond_.wait(guard, [&] { return prewarmWorkers_ == 0; });
+	prewarmResults_.clear();
+	if (prewarming_)
+		LogPrewarmStats();
+	prewarmed_.clear();
+	prewarming_ = false;
+}
+
+inline u32 IRJit::RunBlock(MIPSState *mips, const IRInst *instPtr) {
+	if (threadedDispatch_) {
+		const IRThreadedInst *threadedPtr = blocks_.GetThreadedArenaPtr() + (instPtr - blocks_.GetArenaPtr());
+		return IRInterpretThreaded(mips, threadedPtr, instPtr);
+	}
+	return IRInterpret(mips, instPtr);
+}
+
 void IRJit::RunLoopUntil(u64 globalticks) {
 	PROFILE_THIS_SCOPE("jit");
 
@@ -199,12 +432,12 @@ void IRJit::RunLoopUntil(u64 globalticks) {
 #ifdef IR_PROFILING
 				IRBlock *block = blocks_.GetBlock(blocks_.GetBlockNumFromIRArenaOffset(offset));
 				Instant start = Instant::Now();
-				mips->pc = IRInterpret(mips, instPtr);
+				mips->pc = RunBlock(mips, instPtr);
 				int64_t elapsedNanos = start.ElapsedNanos();
 				block->profileStats_.executions += 1;
 				block->profileStats_.totalNanos += elapsedNanos;
 #else
-				mips->pc = IRInterpret(mips, instPtr);
+				mips->pc = RunBlock(mips, instPtr);
 #endif
 				// Note: this will "jump to zero" on a badly constructed block missing exits.
 				if (!Memory::IsValid4AlignedAddress(mips->pc)) {
@@ -255,10 +488,24 @@ void IRBlockCache::Clear() {
 	byPage_.clear();
 	arena_.clear();
 	arena_.shrink_to_fit();
+	threaded_.clear();
+	threaded_.shrink_to_fit();
+}
+
+void IRBlockCache::Discard() {
+	blocks_.clear();
+	byPage_.clear();
+	arena_.clear();
+	threaded_.clear();
 }
 
 IRBlockCache::IRBlockCache(bool compileToNative) : compileToNative_(compileToNative) {}
 
+void IRBlockCache::SetThreadedDispatch(bool enable) {
+	_dbg_assert_(arena_.empty());
+	threadedDispatch_ = enable;
+}
+
 int IRBlockCache::AllocateBlock(int emAddr, u32 origSize, const std::vector<IRInst> &insts) {
 	// We have 24 bits to represent offsets with.
 	const u32 MAX_ARENA_SIZE = 0x1000000 - 1;
@@ -271,6 +518,10 @@ int IRBlockCache::AllocateBlock(int emAddr, u32 origSize, const std::vector<IRIn
 	for (int i = 0; i < insts.size(); i++) {
 		arena_.push_back(insts[i]);
 	}
+	if (threadedDispatch_) {
+		threaded_.resize(arena_.size());
+		IRPredecodeThreaded(insts.data(), (int)insts.size(), threaded_.data() + offset);
+	}
 	int newBlockIndex = (int)blocks_.size();
 	blocks_.push_back(IRBlock(emAddr, origSize, offset, (u32)insts.size()));
 	return newBlockIndex;
@@ -347,6 +598,16 @@ void IRBlockCache::FinalizeBlock(int blockIndex) {
 	for (u32 page = startPage; page <= endPage; ++page) {
 		byPage_[page].push_back(blockIndex);
 	}
+
+	// Inlined code needs to invalidate the block too.
+	u32 inlineAddr, inlineSize;
+	block.GetInlinedRange(&inlineAddr, &inlineSize);
+	if (inlineSize != 0) {
+		for (u32 page = AddressToPage(inlineAddr); page <= AddressToPage(inlineAddr + inlineSize); ++page) {
+			if (page < startPage || page > endPage)
+				byPage_[page].push_back(blockIndex);
+		}
+	}
 }
 
 // Call after Destroy-ing it.
@@ -370,6 +631,18 @@ void IRBlockCache::RemoveBlockFromPageLookup(int blockIndex) {
 		}
 	}
 
+	u32 inlineAddr, inlineSize;
+	block.GetInlinedRange(&inlineAddr, &inlineSize);
+	if (inlineSize != 0) {
+		for (u32 page = AddressToPage(inlineAddr); page <= AddressToPage(inlineAddr + inlineSize); ++page) {
+			if (page >= startPage && page <= endPage)
+				continue;
+			auto iter = std::find(byPage_[page].begin(), byPage_[page].end(), blockIndex);
+			if (iter != byPage_[page].end())
+				byPage_[page].erase(iter);
+		}
+	}
+
 	// Additionally, we'd like to zap the block in the IR arena.
 	// However, this breaks if calling sceKernelIcacheClearAll(), since as soon as we return, we'll be executing garbage.
 	/*
@@ -574,17 +847,12 @@ void IRBlock::Destroy(int cookie) {
 
 u64 IRBlock::CalculateHash() const {
 	if (origAddr_) {
-		// This is unfortunate. In case there are emuhacks, we have to make a copy.
-		// If we could hash while reading we could avoid this.
-		std::vector<u32> buffer;
-		buffer.resize(origSize_ / 4);
-		size_t pos = 0;
-		for (u32 off = 0; off < origSize_; off += 4) {
-			// Let's actually hash the replacement, if any.
-			MIPSOpcode instr = Memory::ReadUnchecked_Instruction(origAddr_ + off, false);
-			buffer[pos++] = instr.encoding;
+		u64 hash = IRHashMIPSCode(origAddr_, origSize_);
+		if (inlineSize_ != 0) {
+			u64 inlineHash = IRHashMIPSCode(inlineAddr_, inlineSize_);
+			hash ^= (inlineHash << 1) | (inlineHash >> 63);
 		}
-		return XXH3_64bits(&buffer[0], origSize_);
+		return hash;
 	}
 	return 0;
 }
@@ -592,10 +860,19 @@ u64 IRBlock::CalculateHash() const {
 bool IRBlock::OverlapsRange(u32 addr, u32 size) const {
 	addr &= 0x3FFFFFFF;
 	u32 origAddr = origAddr_ & 0x3FFFFFFF;
-	return addr + size > origAddr && addr < origAddr + origSize_;
+	if (addr + size > origAddr && addr < origAddr + origSize_)
+		return true;
+	if (inlineSize_ != 0) {
+		u32 inlineAddr = inlineAddr_ & 0x3FFFFFFF;
+		return addr + size > inlineAddr && addr < inlineAddr + inlineSize_;
+	}
+	return false;
 }
 
 MIPSOpcode IRJit::GetOriginalOp(MIPSOpcode op) {
+	std::unique_lock<std::recursive_mutex> guard(compileLock_, std::defer_lock);
+	if (t_prewarmWorker)
+		guard.lock();
 	IRBlock *b = blocks_.GetBlock(blocks_.FindByCookie(op.encoding & 0xFFFFFF));
 	if (b) {
 		return b->GetOriginalFirstOp();
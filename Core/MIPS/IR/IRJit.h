@@ -17,7 +17,11 @@
 
 #pragma once
 
+#include <condition_variable>
 #include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
 #include <unordered_map>
 
 #include "Common/CommonTypes.h"
@@ -26,6 +30,7 @@
 #include "Core/MIPS/JitCommon/JitCommon.h"
 #include "Core/MIPS/IR/IRRegCache.h"
 #include "Core/MIPS/IR/IRFrontend.h"
+#include "Core/MIPS/IR/IRInterpreter.h"
 #include "Core/MIPS/MIPSVFPUUtils.h"
 
 #ifndef offsetof
@@ -57,6 +62,8 @@ class IRBlock {
 		hash_ = b.hash_;
 		origAddr_ = b.origAddr_;
 		origSize_ = b.origSize_;
+		inlineAddr_ = b.inlineAddr_;
+		inlineSize_ = b.inlineSize_;
 		origFirstOpcode_ = b.origFirstOpcode_;
 		nativeOffset_ = b.nativeOffset_;
 		numIRInstructions_ = b.numIRInstructions_;
@@ -92,6 +99,16 @@ class IRBlock {
 	u32 GetOriginalStart() const {
 		return origAddr_;
 	}
+	// Code from elsewhere that was compiled into this block (inlined leaf functions, traces), if any.
+	// Must be set before hashing and finalizing, since it's part of both.
+	void SetInlinedRange(u32 start, u32 size) {
+		inlineAddr_ = start;
+		inlineSize_ = size;
+	}
+	void GetInlinedRange(u32 *start, u32 *size) const {
+		*start = inlineAddr_;
+		*size = inlineSize_;
+	}
 	u64 GetHash() const {
 		return hash_;
 	}
@@ -113,6 +130,8 @@ class IRBlock {
 	u64 hash_ = 0;
 	u32 origAddr_ = 0;
 	u32 origSize_ = 0;
+	u32 inlineAddr_ = 0;
+	u32 inlineSize_ = 0;
 	MIPSOpcode origFirstOpcode_ = MIPSOpcode(0x68FFFFFF);
 	u32 numIRInstructions_ = 0;
 };
@@ -125,6 +144,8 @@ class IRBlockCache : public JitBlockCacheDebugInterface {
 	}
 
 	void Clear();
+	// Like Clear(), but for blocks that were never finalized, so memory isn't touched.
+	void Discard();
 	std::vector<int> FindInvalidatedBlockNumbers(u32 address, u32 length);
 	void FinalizeBlock(int blockNum);
 	int GetNumBlocks() const override { return (int)blocks_.size(); }
@@ -147,6 +168,12 @@ class IRBlockCache : public JitBlockCacheDebugInterface {
 	const IRInst *GetArenaPtr() const {
 		return arena_.data();
 	}
+	// Only filled in when threaded dispatch is on. Parallel to the arena, so block offsets work for both.
+	const IRThreadedInst *GetThreadedArenaPtr() const {
+		return threaded_.data();
+	}
+	// Must be set before any blocks are allocated.
+	void SetThreadedDispatch(bool enable);
 	bool IsValidBlock(int blockNum) const override {
 		return blockNum >= 0 && blockNum < (int)blocks_.size() && blocks_[blockNum].IsValid();
 	}
@@ -199,8 +226,10 @@ class IRBlockCache : public JitBlockCacheDebugInterface {
 private:
 	u32 AddressToPage(u32 addr) const;
 	bool compileToNative_;
+	bool threadedDispatch_ = false;
 	std::vector<IRBlock> blocks_;
 	std::vector<IRInst> arena_;
+	std::vector<IRThreadedInst> threaded_;
 	std::unordered_map<u32, std::vector<int>> byPage_;
 };
 
@@ -223,8 +252,14 @@ class IRJit : public JitInterface {
 	JitBlockCacheDebugInterface *GetBlockCacheDebugInterface() override { return &blocks_; }
 	MIPSOpcode GetOriginalOp(MIPSOpcode op) override;
 
-	std::vector<u32> SaveAndClearEmuHackOps() override { return blocks_.SaveAndClearEmuHackOps(); }
-	void RestoreSavedEmuHackOps(std::vector<u32> saved) override { blocks_.RestoreSavedEmuHackOps(saved); }
+	std::vector<u32> SaveAndClearEmuHackOps() override {
+		std::lock_guard<std::recursive_mutex> guard(compileLock_);
+		return blocks_.SaveAndClearEmuHackOps();
+	}
+	void RestoreSavedEmuHackOps(std::vector<u32> saved) override {
+		std::lock_guard<std::recursive_mutex> guard(compileLock_);
+		blocks_.RestoreSavedEmuHackOps(saved);
+	}
 
 	void ClearCache() override;
 	void InvalidateCacheAt(u32 em_address, int length = 4) override;
@@ -240,15 +275,23 @@ class IRJit : public JitInterface {
 	void LinkBlock(u8 *exitPoint, const u8 *checkedEntry) override;
 	void UnlinkBlock(u8 *checkedEntry, u32 originalAddress) override;
 
+	void PrewarmFunctions(const std::vector<u32> &entries) override;
+	// Called on a worker thread while prewarming.
+	void RunPrewarmCompiles();
+
 	// This gets overridden by the native-backed IR jits.
 	const u8 *GetCodeBase() const override { return nullptr; }
 
 protected:
 	bool CompileBlock(u32 em_address, std::vector<IRInst> &instructions, u32 &mipsBytes);
+	// Must be called before anything the prewarm workers use is destroyed.
+	void StopPrewarm();
+	u32 RunBlock(MIPSState *mips, const IRInst *instPtr);
 	virtual bool CompileNativeBlock(IRBlockCache *irBlockCache, int block_num) { return true; }
 	virtual void FinalizeNativeBlock(IRBlockCache *irBlockCache, int block_num) {}
 
 	bool compileToNative_;
+	bool threadedDispatch_ = false;
 
 	JitOptions jo;
 
@@ -259,6 +302,51 @@ class IRJit : public JitInterface {
 
 	bool compilerEnabled_ = true;
 
+	// Held by the CPU thread whenever it touches blocks, and by prewarm workers only to look up blocks or publish.
+	std::recursive_mutex compileLock_;
+
+private:
+	struct PrewarmResult {
+		u32 addr;
+		u32 mipsBytes;
+		u32 stateFlags;
+		u64 hash;
+		std::vector<IRInst> instructions;
+	};
+
+	// Moves finished results over to prewarmed_. CPU thread only.
+	void CollectPrewarmResults();
+	// If a worker already compiled this address and it's still valid, hands over the IR.
+	bool TakePrewarmedBlock(u32 em_address, u32 stateFlags, std::vector<IRInst> &instructions, u32 &mipsBytes);
+	void LogPrewarmStats();
+
+	// Prewarm: functions found at module load get compiled to IR on workers. The results are only
+	// used once the CPU actually reaches them, so nothing changes in memory or timing until then.
+	std::mutex prewarmLock_;
+	std::condition_variable prewarmCond_;
+	std::deque<u32> prewarmQueue_;
+	std::vector<PrewarmResult> prewarmResults_;
+	// Workers copy this, so they start out with the same options and assumptions as frontend_.
+	IRFrontend prewarmFrontend_;
+	int prewarmWorkers_ = 0;
+	// Bumped when prewarmFrontend_ changes, so workers pick up the new state.
+	uint32_t prewarmGeneration_ = 0;
+
+	// Only touched on the CPU thread. Ordered so invalidations can find overlapping results quickly.
+	std::map<u32, PrewarmResult> prewarmed_;
+	u32 prewarmMaxBytes_ = 0;
+	bool prewarming_ = false;
+
+	// compiled, skipped, and compileTime are updated by workers, under prewarmLock_.
+	struct {
+		int compiled;
+		int skipped;
+		int used;
+		int dropped;
+		int workers;
+		double compileTime;
+	} prewarmStats_{};
+
 	// where to write branch-likely trampolines. not used atm
 	// u32 blTrampolines_;
 	// int blTrampolineCount_;
@@ -18,13 +18,17 @@
 #include <atomic>
 #include <climits>
 #include <thread>
+#include "Common/MemoryUtil.h"
 #include "Common/Profiler/Profiler.h"
 #include "Common/StringUtils.h"
+#include "Common/Thread/ThreadManager.h"
 #include "Common/TimeUtil.h"
+#include "Core/Config.h"
 #include "Core/Core.h"
 #include "Core/Debugger/SymbolMap.h"
 #include "Core/MemMap.h"
 #include "Core/MIPS/MIPSTables.h"
+#include "Core/MIPS/IR/IRInterpreter.h"
 #include "Core/MIPS/IR/IRNativeCommon.h"
 
 using namespace MIPSComp;
@@ -164,6 +168,11 @@ uint32_t IRNativeBackend::DoIRInst(uint64_t value) {
 	return IRInterpret(currentMIPS, &inst[0]);
 }
 
+uint32_t IRNativeBackend::RunInterpretedBlock(uint32_t block_num) {
+	// Only IRNativeJit backends emit calls to this.
+	return static_cast<IRNativeJit *>(jit)->RunInterpretedBlock((int)block_num);
+}
+
 int IRNativeBackend::ReportBadAddress(uint32_t addr, uint32_t alignment, uint32_t isWrite) {
 	const auto toss = [&](MemoryExceptionType t) {
 		Core_MemoryException(addr, alignment, currentMIPS->pc, t);
@@ -481,17 +490,47 @@ void IRNativeBackend::CompileIRInst(IRInst inst) {
 	}
 }
 
+class IRNativeCompileTask : public Task {
+public:
+	IRNativeCompileTask(IRNativeJit *jit) : jit_(jit) {}
+
+	TaskType Type() const override { return TaskType::CPU_COMPUTE; }
+	TaskPriority Priority() const override { return TaskPriority::NORMAL; }
+
+	void Run() override {
+		jit_->RunBackgroundCompiles();
+	}
+
+private:
+	IRNativeJit *jit_;
+};
+
 IRNativeJit::IRNativeJit(MIPSState *mipsState)
-	: IRJit(mipsState, true), debugInterface_(blocks_) {}
+	: IRJit(mipsState, true), debugInterface_(blocks_) {
+	tierUpThreshold_ = std::max(0, g_Config.iJitTierUpThreshold);
+	// The worker writes code while we run other code, no good if pages can't be both.
+	backgroundCompile_ = g_Config.bJitBackgroundCompile && !PlatformIsWXExclusive() && g_threadManager.IsInitialized();
+	// Traces are built when promoting blocks on this thread, so not in background mode (yet.)
+	traces_ = tierUpThreshold_ > 0 && !backgroundCompile_ && g_Config.bJitTraces;
+}
 
 void IRNativeJit::Init(IRNativeBackend &backend) {
 	backend_ = &backend;
-	debugInterface_.Init(backend_);
+	if (!backend_->SupportsInterpretedBlocks())
+		backgroundCompile_ = false;
+	debugInterface_.Init(backend_, (tierUpThreshold_ > 0 || backgroundCompile_) && backend_->SupportsInterpretedBlocks());
 	backend_->GenerateFixedCode(mips_);
 
 	// Wanted this to be a reference, but vtbls get in the way.  Shouldn't change.
 	hooks_ = backend.GetNativeHooks();
 
+	// The worker gets its own emitter and code space, so it never has to wait for this thread or vice versa.
+	if (backgroundCompile_) {
+		workerBackend_.reset(backend_->CreateWorkerBackend(workerBlocks_));
+		if (!workerBackend_)
+			backgroundCompile_ = false;
+	}
+
 	if (enableDebugProfiler && hooks_.profilerPC) {
 		debugProfilerThreadStatus = true;
 		debugProfilerThread = std::thread([&] {
@@ -508,9 +547,215 @@ void IRNativeJit::Init(IRNativeBackend &backend) {
 }
 
 bool IRNativeJit::CompileNativeBlock(IRBlockCache *irblockCache, int block_num) {
+	// In tiered mode, start out interpreting and only compile once the block gets hot.
+	// In background mode, start out interpreting while a worker compiles it.
+	if ((tierUpThreshold_ > 0 || backgroundCompile_) && backend_->SupportsInterpretedBlocks()) {
+		// Clearing the cache is also the only way to give the worker more space.
+		if (workerFull_)
+			return false;
+		if (!backend_->CompileInterpretedBlock(irblockCache, block_num))
+			return false;
+		if (backgroundCompile_ && tierUpThreshold_ == 0)
+			QueueBackgroundCompile(block_num);
+		return true;
+	}
 	return backend_->CompileBlock(irblockCache, block_num);
 }
 
+uint32_t IRNativeJit::RunInterpretedBlock(int block_num) {
+	IRBlock *block = blocks_.GetBlockUnchecked(block_num);
+#ifdef IR_PROFILING
+	Instant start = Instant::Now();
+	uint32_t pc = IRInterpret(mips_, blocks_.GetBlockInstructionPtr(*block));
+	int64_t nanos = start.ElapsedNanos();
+#else
+	uint32_t pc = IRInterpret(mips_, blocks_.GetBlockInstructionPtr(*block));
+	int64_t nanos = 0;
+#endif
+
+	if (backgroundCompile_) {
+		// Never wait on the worker here, we'll just try again on the next interpreted block.
+		std::unique_lock<std::recursive_mutex> guard(compileLock_, std::try_to_lock);
+		if (guard.owns_lock()) {
+			InstallBackgroundCompiles();
+			int runs = block->IsValid() ? backend_->CountInterpretedRun(block_num, nanos) : 0;
+			// With a threshold, blocks are only queued once they get hot.
+			if (tierUpThreshold_ > 0 && runs == tierUpThreshold_)
+				QueueBackgroundCompile(block_num);
+		}
+		return pc;
+	}
+
+	// The block might've been invalidated while running (icache clear from a syscall, etc.)
+	if (!block->IsValid())
+		return pc;
+
+	if (traces_)
+		exitProfile_.Record(block->GetOriginalStart(), pc);
+	if (backend_->CountInterpretedRun(block_num, nanos) >= tierUpThreshold_) {
+		PROFILE_THIS_SCOPE("jitc");
+		// Prewarm workers may be reading blocks.
+		std::lock_guard<std::recursive_mutex> guard(compileLock_);
+		const u32 startPC = block->GetOriginalStart();
+		// Note: this may allocate a block, so no more using block after.
+		if (traces_ && CompileTrace(block_num)) {
+			promotedBlocks_++;
+			tracesCompiled_++;
+		} else if (backend_->PromoteInterpretedBlock(&blocks_, block_num, jo)) {
+			promotedBlocks_++;
+		} else {
+			// Out of space.  The next regular compile will clear the cache, until then keep interpreting.
+			DEBUG_LOG(Log::JIT, "Unable to promote block %d (%08x) to native code", block_num, startPC);
+		}
+	}
+	return pc;
+}
+
+bool IRNativeJit::CompileTrace(int block_num) {
+	const u32 startPC = blocks_.GetBlock(block_num)->GetOriginalStart();
+	// Same restrictions as the disk cache, we don't want breakpoints or tracing to get lost.
+	if (!frontend_.CanUseCachedBlocks())
+		return false;
+
+	std::vector<IRInst> instructions;
+	u32 mipsBytes;
+	if (!frontend_.DoTrace(startPC, exitProfile_, instructions, mipsBytes))
+		return false;
+
+	int trace_num = blocks_.AllocateBlock(startPC, mipsBytes, instructions);
+	if ((trace_num & ~MIPS_EMUHACK_VALUE_MASK) != 0) {
+		// Out of block numbers.  The next regular compile will clear the cache.
+		return false;
+	}
+
+	IRBlock *trace = blocks_.GetBlock(trace_num);
+	u32 inlineStart, inlineSize;
+	frontend_.GetLastBlockInlinedRange(&inlineStart, &inlineSize);
+	trace->SetInlinedRange(inlineStart, inlineSize);
+	if (!backend_->CompileBlock(&blocks_, trace_num)) {
+		// Just leave it invalid.  Nothing points at it, since it was never finalized.
+		trace->Destroy(trace->GetNativeOffset());
+		return false;
+	}
+
+	// The trace takes over from the block it starts with.  Anything still going to its stub gets forwarded.
+	backend_->ForwardInterpretedBlock(&blocks_, block_num, trace_num);
+	IRBlock *block = blocks_.GetBlock(block_num);
+	blocks_.RemoveBlockFromPageLookup(block_num);
+	block->Destroy(block->GetNativeOffset());
+
+	// This writes the emuhack and relinks any exits to the start address to the trace.
+	blocks_.FinalizeBlock(trace_num);
+	FinalizeNativeBlock(&blocks_, trace_num);
+	return true;
+}
+
+void IRNativeJit::QueueBackgroundCompile(int block_num) {
+	const IRBlock *block = blocks_.GetBlock(block_num);
+	const IRInst *instructions = blocks_.GetBlockInstructionPtr(*block);
+	u32 start;
+
+	BackgroundCompileJob job;
+	job.block_num = block_num;
+	block->GetRange(&start, &job.mipsBytes);
+	job.startPC = block->GetOriginalStart();
+	job.instructions.assign(instructions, instructions + block->GetNumIRInstructions());
+	job.queuedTime = time_now_d();
+
+	std::lock_guard<std::mutex> guard(queueLock_);
+	compileQueue_.push_back(std::move(job));
+	if (!workerRunning_) {
+		workerRunning_ = true;
+		g_threadManager.EnqueueTask(new IRNativeCompileTask(this));
+	}
+}
+
+void IRNativeJit::RunBackgroundCompiles() {
+	while (true) {
+		BackgroundCompileJob job;
+		{
+			std::lock_guard<std::mutex> guard(queueLock_);
+			if (compileQueue_.empty()) {
+				workerRunning_ = false;
+				queueCond_.notify_all();
+				return;
+			}
+			job = std::move(compileQueue_.front());
+			compileQueue_.pop_front();
+		}
+
+		// Nothing here is shared with the CPU thread, the block was copied when queued.
+		// Whether it's still wanted is checked when installing.
+		job.startTime = time_now_d();
+		if (workerBlocks_.AllocateBlock(job.startPC, job.mipsBytes, job.instructions) == 0)
+			job.success = workerBackend_->CompileWorkerBlock(&workerBlocks_, &job.nativeOffset, &job.checkedOffset, &job.exits);
+		workerBlocks_.Discard();
+		if (!job.success)
+			workerFull_ = true;
+		job.instructions.clear();
+
+		std::lock_guard<std::mutex> queueGuard(queueLock_);
+		compileResults_.push_back(std::move(job));
+	}
+}
+
+void IRNativeJit::InstallBackgroundCompiles() {
+	std::vector<BackgroundCompileJob> results;
+	{
+		std::lock_guard<std::mutex> guard(queueLock_);
+		if (compileResults_.empty())
+			return;
+		results.swap(compileResults_);
+	}
+
+	// We're on the CPU thread and not inside any block's code, so it's safe to patch entries now.
+	double now = time_now_d();
+	for (const BackgroundCompileJob &job : results) {
+		const IRBlock *block = blocks_.GetBlock(job.block_num);
+		const IRNativeBlock *nativeBlock = backend_->GetNativeBlock(job.block_num);
+		if (!job.success || !block || !block->IsValid() || !nativeBlock || !nativeBlock->interpreted) {
+			// The code just goes to waste.  If we ran out of space, the next compile will clear the cache.
+			backgroundStats_.dropped++;
+			continue;
+		}
+
+		backend_->AdoptBlockExits(job.block_num, job.exits);
+		backend_->InstallPromotedBlock(&blocks_, job.block_num, job.nativeOffset, job.checkedOffset, jo);
+		promotedBlocks_++;
+
+		double queueWait = job.startTime - job.queuedTime;
+		backgroundStats_.installed++;
+		backgroundStats_.queueWaitTotal += queueWait;
+		backgroundStats_.queueWaitMax = std::max(backgroundStats_.queueWaitMax, queueWait);
+		backgroundStats_.readyWaitTotal += now - job.queuedTime;
+	}
+}
+
+void IRNativeJit::LogBackgroundCompileStats() {
+	if (backgroundStats_.installed != 0) {
+		double installed = (double)backgroundStats_.installed;
+		INFO_LOG(Log::JIT, "Background jit: %d blocks installed, %d dropped. Queue wait: avg %0.3f ms, max %0.3f ms. Until installed: avg %0.3f ms",
+			backgroundStats_.installed, backgroundStats_.dropped,
+			backgroundStats_.queueWaitTotal * 1000.0 / installed, backgroundStats_.queueWaitMax * 1000.0,
+			backgroundStats_.readyWaitTotal * 1000.0 / installed);
+	}
+	backgroundStats_ = {};
+}
+
+void IRNativeJit::StopBackgroundCompile() {
+	if (!backgroundCompile_)
+		return;
+
+	{
+		std::unique_lock<std::mutex> guard(queueLock_);
+		compileQueue_.clear();
+		queueCond_.wait(guard, [&] { return !workerRunning_; });
+		compileResults_.clear();
+	}
+	LogBackgroundCompileStats();
+	backgroundCompile_ = false;
+}
+
 void IRNativeJit::FinalizeNativeBlock(IRBlockCache *irblockCache, int block_num) {
 	backend_->FinalizeBlock(irblockCache, block_num, jo);
 }
@@ -524,11 +769,54 @@ void IRNativeJit::RunLoopUntil(u64 globalticks) {
 	hooks_.enterDispatcher();
 }
 
+void IRNativeJit::Compile(u32 em_address) {
+	std::lock_guard<std::recursive_mutex> guard(compileLock_);
+	IRJit::Compile(em_address);
+	if (backgroundCompile_)
+		InstallBackgroundCompiles();
+}
+
 void IRNativeJit::ClearCache() {
+	std::lock_guard<std::recursive_mutex> guard(compileLock_);
+	if (backgroundCompile_) {
+		// Anything queued or finished was for the old code, which we're about to throw away.
+		// The worker's code space goes too, so it has to be done with its current block first.
+		{
+			std::unique_lock<std::mutex> queueGuard(queueLock_);
+			compileQueue_.clear();
+			queueCond_.wait(queueGuard, [&] { return !workerRunning_; });
+			compileResults_.clear();
+		}
+		workerBackend_->ClearAllBlocks();
+		workerFull_ = false;
+	}
+	if ((tierUpThreshold_ > 0 || backgroundCompile_) && blocks_.GetNumBlocks() != 0) {
+		INFO_LOG(Log::JIT, "Tiered jit: %d of %d blocks were promoted to native code, %d as traces", promotedBlocks_, blocks_.GetNumBlocks(), tracesCompiled_);
+	}
+	exitProfile_.Clear();
+	tracesCompiled_ = 0;
+	if (backgroundCompile_)
+		LogBackgroundCompileStats();
+	promotedBlocks_ = 0;
 	IRJit::ClearCache();
 	backend_->ClearAllBlocks();
 }
 
+void IRNativeJit::InvalidateCacheAt(u32 em_address, int length) {
+	std::lock_guard<std::recursive_mutex> guard(compileLock_);
+	IRJit::InvalidateCacheAt(em_address, length);
+}
+
+std::vector<u32> IRNativeJit::SaveAndClearEmuHackOps() {
+	std::lock_guard<std::recursive_mutex> guard(compileLock_);
+	return IRJit::SaveAndClearEmuHackOps();
+}
+
+void IRNativeJit::RestoreSavedEmuHackOps(std::vector<u32> saved) {
+	std::lock_guard<std::recursive_mutex> guard(compileLock_);
+	IRJit::RestoreSavedEmuHackOps(saved);
+}
+
 bool IRNativeJit::DescribeCodePtr(const u8 *ptr, std::string &name) {
 	if (ptr != nullptr && backend_->DescribeCodePtr(ptr, name))
 		return true;
@@ -667,6 +955,90 @@ void IRNativeBackend::FinalizeBlock(IRBlockCache *irBlockCache, int block_num, c
 	}
 }
 
+int IRNativeBackend::CountInterpretedRun(int block_num, int64_t nanos) {
+	if (block_num < 0 || block_num >= (int)nativeBlocks_.size() || !nativeBlocks_[block_num].interpreted)
+		return 0;
+	IRNativeBlock &nativeBlock = nativeBlocks_[block_num];
+	nativeBlock.interpretedStats.executions++;
+	nativeBlock.interpretedStats.totalNanos += nanos;
+	return (int)(nativeBlock.interpretedStats.executions - nativeBlock.failedPromoteRuns);
+}
+
+void IRNativeBackend::ForwardInterpretedBlock(IRBlockCache *irBlockCache, int block_num, int target_num) {
+	IRNativeBlock &nativeBlock = nativeBlocks_[block_num];
+	nativeBlock.interpreted = false;
+	OverwriteExit(irBlockCache->GetBlock(block_num)->GetNativeOffset(), nativeBlock.stubPatchLen, target_num);
+}
+
+bool IRNativeBackend::PromoteInterpretedBlock(IRBlockCache *irBlockCache, int block_num, const JitOptions &jo) {
+	int nativeOffset, checkedOffset;
+	if (!CompilePromotedBlock(irBlockCache, block_num, &nativeOffset, &checkedOffset)) {
+		// Don't retry on every single run.
+		nativeBlocks_[block_num].failedPromoteRuns = nativeBlocks_[block_num].interpretedStats.executions;
+		return false;
+	}
+
+	InstallPromotedBlock(irBlockCache, block_num, nativeOffset, checkedOffset, jo);
+	return true;
+}
+
+bool IRNativeBackend::CompileWorkerBlock(IRBlockCache *workerBlocks, int *nativeOffset, int *checkedOffset, std::vector<IRNativeBlockExit> *exits) {
+	// Links are never made here, the exits go along with the code to the backend that installs it.
+	EraseAllLinks(-1);
+	bool success = CompileBlock(workerBlocks, 0);
+	if (success) {
+		*nativeOffset = workerBlocks->GetBlock(0)->GetNativeOffset();
+		*checkedOffset = nativeBlocks_[0].checkedOffset;
+		*exits = std::move(nativeBlocks_[0].exits);
+	}
+	EraseAllLinks(-1);
+	return success;
+}
+
+void IRNativeBackend::AdoptBlockExits(int block_num, const std::vector<IRNativeBlockExit> &exits) {
+	for (const IRNativeBlockExit &blockExit : exits)
+		AddLinkableExit(block_num, blockExit.dest, blockExit.offset, blockExit.len);
+}
+
+bool IRNativeBackend::CompilePromotedBlock(IRBlockCache *irBlockCache, int block_num, int *nativeOffset, int *checkedOffset) {
+	IRBlock *block = irBlockCache->GetBlock(block_num);
+	const int stubOffset = block->GetNativeOffset();
+	const int stubCheckedOffset = nativeBlocks_[block_num].checkedOffset;
+
+	bool success = CompileBlock(irBlockCache, block_num);
+	if (success) {
+		*nativeOffset = block->GetNativeOffset();
+		*checkedOffset = nativeBlocks_[block_num].checkedOffset;
+	} else {
+		nativeBlocks_[block_num].exits.clear();
+	}
+
+	// Put things back the way they were, the stub stays in charge until the new code is installed.
+	block->SetNativeOffset(stubOffset);
+	nativeBlocks_[block_num].checkedOffset = stubCheckedOffset;
+	return success;
+}
+
+void IRNativeBackend::InstallPromotedBlock(IRBlockCache *irBlockCache, int block_num, int nativeOffset, int checkedOffset, const JitOptions &jo) {
+	IRBlock *block = irBlockCache->GetBlock(block_num);
+	IRNativeBlock &nativeBlock = nativeBlocks_[block_num];
+	const int stubOffset = block->GetNativeOffset();
+
+	nativeBlock.interpreted = false;
+	nativeBlock.checkedOffset = checkedOffset;
+	block->SetNativeOffset(nativeOffset);
+
+	// The emuhack cookie is the native offset, so it needs to be updated.
+	block->RestoreOriginalFirstOp(stubOffset);
+	block->Finalize(nativeOffset);
+
+	// Anything that still enters the stub should go straight to the new code.
+	OverwriteExit(stubOffset, nativeBlock.stubPatchLen, block_num);
+
+	// And now relink, exits to the stub's checked entry get pointed to the native code.
+	FinalizeBlock(irBlockCache, block_num, jo);
+}
+
 const IRNativeBlock *IRNativeBackend::GetNativeBlock(int block_num) const {
 	if (block_num < 0 || block_num >= (int)nativeBlocks_.size())
 		return nullptr;
@@ -706,9 +1078,14 @@ void IRNativeBackend::EraseAllLinks(int block_num) {
 IRNativeBlockCacheDebugInterface::IRNativeBlockCacheDebugInterface(const IRBlockCache &irBlocks)
 	: irBlocks_(irBlocks) {}
 
-void IRNativeBlockCacheDebugInterface::Init(const IRNativeBackend *backend) {
+void IRNativeBlockCacheDebugInterface::Init(const IRNativeBackend *backend, bool interpretedStats) {
 	codeBlock_ = &backend->CodeBlock();
 	backend_ = backend;
+	interpretedStats_ = interpretedStats;
+}
+
+bool IRNativeBlockCacheDebugInterface::SupportsProfiling() const {
+	return interpretedStats_ || irBlocks_.SupportsProfiling();
 }
 
 bool IRNativeBlockCacheDebugInterface::IsValidBlock(int blockNum) const {
@@ -728,7 +1105,14 @@ int IRNativeBlockCacheDebugInterface::GetBlockNumberFromStartAddress(u32 em_addr
 }
 
 JitBlockProfileStats IRNativeBlockCacheDebugInterface::GetBlockProfileStats(int blockNum) const {
-	return irBlocks_.GetBlockProfileStats(blockNum);
+	JitBlockProfileStats stats = irBlocks_.GetBlockProfileStats(blockNum);
+	// In tiered mode, the runs before a block was compiled.
+	const IRNativeBlock *nativeBlock = backend_->GetNativeBlock(blockNum);
+	if (nativeBlock) {
+		stats.executions += nativeBlock->interpretedStats.executions;
+		stats.totalNanos += nativeBlock->interpretedStats.totalNanos;
+	}
+	return stats;
 }
 
 void IRNativeBlockCacheDebugInterface::GetBlockCodeRange(int blockNum, int *startOffset, int *size) const {
@@ -737,14 +1121,23 @@ void IRNativeBlockCacheDebugInterface::GetBlockCodeRange(int blockNum, int *star
 
 	// If endOffset is before, the checked entry is before the block start.
 	if (endOffset < blockOffset) {
-		// We assume linear allocation.  Maybe a bit dangerous, should always be right.
-		if (blockNum + 1 >= GetNumBlocks()) {
-			// Last block, get from current code pointer.
-			endOffset = (int)codeBlock_->GetOffset(codeBlock_->GetCodePtr());
-		} else {
-			endOffset = irBlocks_.GetBlock(blockNum + 1)->GetNativeOffset();
-			_assert_msg_(endOffset >= blockOffset, "Next block not sequential, block=%d/%08x, next=%d/%08x", blockNum, blockOffset, blockNum + 1, endOffset);
+		// Blocks are normally allocated linearly, but in tiered mode promoted blocks are compiled later.
+		// So find whatever comes next, or use the current code pointer if it's the last.
+		// Background compiled blocks are past the code pointer, in the worker's part of the space.
+		endOffset = (int)codeBlock_->GetOffset(codeBlock_->GetCodePtr());
+		if (endOffset <= blockOffset)
+			endOffset = INT_MAX;
+		for (int i = 0; i < GetNumBlocks(); ++i) {
+			const IRNativeBlock *nativeBlock = backend_->GetNativeBlock(i);
+			int offsets[2] = { irBlocks_.GetBlock(i)->GetNativeOffset(), nativeBlock ? nativeBlock->checkedOffset : -1 };
+			for (int offset : offsets) {
+				if (offset > blockOffset && offset < endOffset)
+					endOffset = offset;
+			}
 		}
+		// The last one the worker compiled, we don't know where it ends.
+		if (endOffset == INT_MAX)
+			endOffset = blockOffset;
 	}
 
 	*startOffset = blockOffset;
@@ -17,6 +17,11 @@
 
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
 
 #include "Core/MIPS/IR/IRJit.h"
@@ -58,6 +63,14 @@ struct IRNativeBlockExit {
 struct IRNativeBlock {
 	int checkedOffset = 0;
 	std::vector<IRNativeBlockExit> exits;
+	// Tiered mode: the block starts as a stub that runs IRInterpret, until it's been run enough times.
+	bool interpreted = false;
+	// Runs while interpreted, and with IR_PROFILING, the time they took.  Shown with the other block profile stats.
+	JitBlockProfileStats interpretedStats{};
+	// Runs before the last failed promotion, which don't count toward the next try.
+	int64_t failedPromoteRuns = 0;
+	// Bytes at the start of the stub that can be overwritten with a jump to the native code.
+	int stubPatchLen = 0;
 };
 
 class IRNativeBackend {
@@ -77,6 +90,27 @@ class IRNativeBackend {
 	virtual void InvalidateBlock(IRBlockCache *irBlockCache, int block_num) = 0;
 	void FinalizeBlock(IRBlockCache *irBlockCache, int block_num, const JitOptions &jo);
 
+	// Tiered mode support. Backends that can't emit interpreter stubs always compile natively.
+	virtual bool SupportsInterpretedBlocks() const { return false; }
+	virtual bool CompileInterpretedBlock(IRBlockCache *irBlockCache, int block_num) { return false; }
+	// Returns the number of times the block has run interpreted since it was compiled (or last failed to promote), including this one.
+	int CountInterpretedRun(int block_num, int64_t nanos = 0);
+	// Points an interpreted block's stub at another block, once that one has replaced it (i.e. a trace.)
+	void ForwardInterpretedBlock(IRBlockCache *irBlockCache, int block_num, int target_num);
+	// Compiles native code for an interpreted block and points its entry and links at it.
+	bool PromoteInterpretedBlock(IRBlockCache *irBlockCache, int block_num, const JitOptions &jo);
+	// The two halves of the above.  The first leaves the stub in charge.  Installing must be on the CPU thread.
+	bool CompilePromotedBlock(IRBlockCache *irBlockCache, int block_num, int *nativeOffset, int *checkedOffset);
+	void InstallPromotedBlock(IRBlockCache *irBlockCache, int block_num, int nativeOffset, int checkedOffset, const JitOptions &jo);
+
+	// Background compile support: a second backend that emits into the end of this one's code space, so its
+	// code can be installed here, but shares no other state. Returns nullptr if not supported.
+	virtual IRNativeBackend *CreateWorkerBackend(IRBlockCache &workerBlocks) { return nullptr; }
+	// On the worker backend: compiles block 0 of its own cache, and returns what's needed to install it.
+	bool CompileWorkerBlock(IRBlockCache *workerBlocks, int *nativeOffset, int *checkedOffset, std::vector<IRNativeBlockExit> *exits);
+	// Takes over the exits of a block the worker backend compiled, before installing it.
+	void AdoptBlockExits(int block_num, const std::vector<IRNativeBlockExit> &exits);
+
 	virtual void UpdateFCR31(MIPSState *mipsState) {}
 
 	const IRNativeHooks &GetNativeHooks() const {
@@ -148,6 +182,9 @@ class IRNativeBackend {
 	// Callback to log AND perform an IR interpreter inst.  Returns 0 or a PC to jump to.
 	static uint32_t DoIRInst(uint64_t inst);
 
+	// Callback from an interpreted block stub (tiered mode.)  Returns the PC to jump to.
+	static uint32_t RunInterpretedBlock(uint32_t block_num);
+
 	static int ReportBadAddress(uint32_t addr, uint32_t alignment, uint32_t isWrite);
 
 	void AddLinkableExit(int block_num, uint32_t pc, int exitStartOffset, int exitLen);
@@ -162,7 +199,8 @@ class IRNativeBackend {
 class IRNativeBlockCacheDebugInterface : public JitBlockCacheDebugInterface {
 public:
 	IRNativeBlockCacheDebugInterface(const MIPSComp::IRBlockCache &irBlocks);
-	void Init(const IRNativeBackend *backend);
+	// interpretedStats is whether blocks may start out interpreted (tiered mode), which counts their runs.
+	void Init(const IRNativeBackend *backend, bool interpretedStats);
 	int GetNumBlocks() const override;
 	int GetBlockNumberFromStartAddress(u32 em_address) const override;
 	JitBlockDebugInfo GetBlockDebugInfo(int blockNum) const override;
@@ -170,6 +208,7 @@ class IRNativeBlockCacheDebugInterface : public JitBlockCacheDebugInterface {
 	JitBlockProfileStats GetBlockProfileStats(int blockNum) const override;
 	void ComputeStats(BlockCacheStats &bcStats) const override;
 	bool IsValidBlock(int blockNum) const override;
+	bool SupportsProfiling() const override;
 
 private:
 	void GetBlockCodeRange(int blockNum, int *startOffset, int *size) const;
@@ -177,6 +216,7 @@ class IRNativeBlockCacheDebugInterface : public JitBlockCacheDebugInterface {
 	const MIPSComp::IRBlockCache &irBlocks_;
 	const CodeBlockCommon *codeBlock_ = nullptr;
 	const IRNativeBackend *backend_ = nullptr;
+	bool interpretedStats_ = false;
 };
 
 class IRNativeJit : public IRJit {
@@ -185,7 +225,12 @@ class IRNativeJit : public IRJit {
 
 	void RunLoopUntil(u64 globalticks) override;
 
+	void Compile(u32 em_address) override;
 	void ClearCache() override;
+	void InvalidateCacheAt(u32 em_address, int length = 4) override;
+
+	std::vector<u32> SaveAndClearEmuHackOps() override;
+	void RestoreSavedEmuHackOps(std::vector<u32> saved) override;
 
 	bool DescribeCodePtr(const u8 *ptr, std::string &name) override;
 	bool CodeInRange(const u8 *ptr) const override;
@@ -199,14 +244,71 @@ class IRNativeJit : public IRJit {
 
 	const u8 *GetCodeBase() const override;
 
+	uint32_t RunInterpretedBlock(int block_num);
+	// Called on a worker thread in background compile mode.
+	void RunBackgroundCompiles();
+
 protected:
 	void Init(IRNativeBackend &backend);
+	// Must be called before the backend is destroyed.
+	void StopBackgroundCompile();
 	bool CompileNativeBlock(IRBlockCache *irBlockCache, int block_num) override;
 	void FinalizeNativeBlock(IRBlockCache *irBlockCache, int block_num) override;
 
 	IRNativeBackend *backend_ = nullptr;
 	IRNativeHooks hooks_;
 	IRNativeBlockCacheDebugInterface debugInterface_;
+
+	// Tiered mode: number of interpreted runs before a block gets native code.  0 means always native.
+	int tierUpThreshold_ = 0;
+	int promotedBlocks_ = 0;
+
+	// Tiered mode: where interpreted blocks exit to, so hot ones can be compiled as traces.
+	bool traces_ = false;
+	IRExitProfile exitProfile_;
+	int tracesCompiled_ = 0;
+
+private:
+	struct BackgroundCompileJob {
+		int block_num = -1;
+		// A copy of the block, since the cache can change while the worker compiles.
+		u32 startPC = 0;
+		u32 mipsBytes = 0;
+		std::vector<IRInst> instructions;
+		double queuedTime = 0.0;
+		double startTime = 0.0;
+		bool success = false;
+		int nativeOffset = 0;
+		int checkedOffset = 0;
+		std::vector<IRNativeBlockExit> exits;
+	};
+
+	bool CompileTrace(int block_num);
+	void QueueBackgroundCompile(int block_num);
+	void InstallBackgroundCompiles();
+	void LogBackgroundCompileStats();
+
+	// Background mode: blocks are interpreted while a worker compiles them, then swapped in on this thread.
+	bool backgroundCompile_ = false;
+	// Only used by the worker while it's running, and by ClearCache() once it has stopped.
+	std::unique_ptr<IRNativeBackend> workerBackend_;
+	IRBlockCache workerBlocks_{ true };
+	// Set when the worker's code space ran out, until the cache is cleared.
+	std::atomic<bool> workerFull_{ false };
+
+	std::mutex queueLock_;
+	std::condition_variable queueCond_;
+	std::deque<BackgroundCompileJob> compileQueue_;
+	std::vector<BackgroundCompileJob> compileResults_;
+	bool workerRunning_ = false;
+
+	struct {
+		int installed;
+		int dropped;
+		double queueWaitTotal;
+		double queueWaitMax;
+		double readyWaitTotal;
+	} backgroundStats_{};
 };
 
 } // namespace MIPSComp
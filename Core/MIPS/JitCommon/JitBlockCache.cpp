@@ -42,6 +42,9 @@
 
 constexpr u32 INVALID_EXIT = 0xFFFFFFFF;
 constexpr u32 SENTINEL_VAL = 0xc0ffeefe;
+constexpr int INVALID_LINK = -1;
+// Small pages, since most blocks are small and overlays are invalidated in big chunks.
+constexpr u32 BLOCK_PAGE_SHIFT = 10;
 
 static uint64_t HashJitBlock(const JitBlock &b) {
 	PROFILE_THIS_SCOPE("jithash");
@@ -95,12 +98,12 @@ void JitBlockCache::Shutdown() {
 // This clears the JIT cache. It's called from JitCache.cpp when the JIT cache
 // is full and when saving and loading states.
 void JitBlockCache::Clear() {
-	// Note: We intentionally clear the block_map_ first to avoid O(N^2) behavior in RemoveBlockMap
-	block_map_.clear();
+	// Note: We intentionally clear the page lookup first to avoid pointless work in RemoveBlockMap.
+	byPage_.clear();
 	for (int i = 0; i < num_blocks_; i++) {
 		DestroyBlock(i, DestroyType::CLEAR);
 	}
-	links_to_.clear();
+	linkHeads_.clear();
 	num_blocks_ = 0;
 
 	blockMemRanges_[JITBLOCK_RANGE_SCRATCH] = std::make_pair(0xFFFFFFFF, 0x00000000);
@@ -126,6 +129,7 @@ int JitBlockCache::AllocateBlock(u32 startAddress) {
 		b.exitAddress[i] = INVALID_EXIT;
 		b.exitPtrs[i] = 0;
 		b.linkStatus[i] = false;
+		b.nextLinkTo[i] = INVALID_LINK;
 	}
 	b.blockNum = numBlocks;
 	b.sentinel = SENTINEL_VAL;
@@ -134,11 +138,19 @@ int JitBlockCache::AllocateBlock(u32 startAddress) {
 	return numBlocks;
 }
 
+void JitBlockCache::GetBlockPages(const JitBlock &b, u32 *startPage, u32 *endPage) const {
+	// Convert the logical address to a physical address for the page lookup.
+	const u32 pAddr = b.originalAddress & 0x1FFFFFFF;
+	*startPage = pAddr >> BLOCK_PAGE_SHIFT;
+	*endPage = (pAddr + 4 * std::max((u32)b.originalSize, 1U) - 1) >> BLOCK_PAGE_SHIFT;
+}
+
 void JitBlockCache::AddBlockMap(int block_num) {
-	const JitBlock &b = blocks_[block_num];
-	// Convert the logical address to a physical address for the block map
-	u32 pAddr = b.originalAddress & 0x1FFFFFFF;
-	block_map_[std::make_pair(pAddr + 4 * b.originalSize, pAddr)] = block_num;
+	u32 startPage, endPage;
+	GetBlockPages(blocks_[block_num], &startPage, &endPage);
+	for (u32 page = startPage; page <= endPage; ++page) {
+		byPage_[page].push_back(block_num);
+	}
 }
 
 void JitBlockCache::RemoveBlockMap(int block_num) {
@@ -147,19 +159,18 @@ void JitBlockCache::RemoveBlockMap(int block_num) {
 		return;
 	}
 
-	const u32 pAddr = b.originalAddress & 0x1FFFFFFF;
-	auto it = block_map_.find(std::make_pair(pAddr + 4 * b.originalSize, pAddr));
-	if (it != block_map_.end() && it->second == (u32)block_num) {
-		block_map_.erase(it);
-	} else {
-		// It wasn't in there, or it has the wrong key.  Let's search...
-		// TODO: This is O(n), so O(n^2) when called for every block.
-		for (auto it = block_map_.begin(); it != block_map_.end(); ++it) {
-			if (it->second == (u32)block_num) {
-				_dbg_assert_(false);
-				block_map_.erase(it);
-				break;
-			}
+	u32 startPage, endPage;
+	GetBlockPages(b, &startPage, &endPage);
+	for (u32 page = startPage; page <= endPage; ++page) {
+		auto iter = byPage_.find(page);
+		if (iter == byPage_.end())
+			continue;
+		std::vector<int> &blocksInPage = iter->second;
+		auto found = std::find(blocksInPage.begin(), blocksInPage.end(), block_num);
+		if (found != blocksInPage.end()) {
+			// Order doesn't matter, so avoid shifting the rest down.
+			*found = blocksInPage.back();
+			blocksInPage.pop_back();
 		}
 	}
 }
@@ -184,7 +195,9 @@ void JitBlockCache::FinalizeBlock(int block_num, bool block_link) {
 	if (block_link) {
 		for (int i = 0; i < MAX_JIT_BLOCK_EXITS; i++) {
 			if (b.exitAddress[i] != INVALID_EXIT) {
-				links_to_.emplace(b.exitAddress[i], block_num);
+				auto head = linkHeads_.emplace(b.exitAddress[i], INVALID_LINK).first;
+				b.nextLinkTo[i] = head->second;
+				head->second = block_num * MAX_JIT_BLOCK_EXITS + i;
 			}
 		}
 
@@ -333,33 +346,44 @@ void JitBlockCache::LinkBlockExits(int i) {
 void JitBlockCache::LinkBlock(int i) {
 	LinkBlockExits(i);
 	JitBlock &b = blocks_[i];
-	// equal_range(b) returns pair<iterator,iterator> representing the range
-	// of element with key b
-	auto ppp = links_to_.equal_range(b.originalAddress);
-	if (ppp.first == ppp.second)
+	auto head = linkHeads_.find(b.originalAddress);
+	if (head == linkHeads_.end())
 		return;
-	for (auto iter = ppp.first; iter != ppp.second; ++iter) {
-		// INFO_LOG(Log::JIT, "Linking block %i to block %i", iter->second, i);
-		LinkBlockExits(iter->second);
+
+	// Walk the exits going here, and drop the ones from destroyed blocks while we're at it.
+	// Otherwise, overlays that get swapped a lot would make these chains grow forever.
+	int *prev = &head->second;
+	int link = *prev;
+	while (link != INVALID_LINK) {
+		JitBlock &sourceBlock = blocks_[link / MAX_JIT_BLOCK_EXITS];
+		int next = sourceBlock.nextLinkTo[link % MAX_JIT_BLOCK_EXITS];
+		if (sourceBlock.invalid) {
+			*prev = next;
+		} else {
+			// INFO_LOG(Log::JIT, "Linking block %i to block %i", link / MAX_JIT_BLOCK_EXITS, i);
+			LinkBlockExits(link / MAX_JIT_BLOCK_EXITS);
+			prev = &sourceBlock.nextLinkTo[link % MAX_JIT_BLOCK_EXITS];
+		}
+		link = next;
 	}
+	if (head->second == INVALID_LINK)
+		linkHeads_.erase(head);
 }
 
 void JitBlockCache::UnlinkBlock(int i) {
 	JitBlock &b = blocks_[i];
-	auto ppp = links_to_.equal_range(b.originalAddress);
-	if (ppp.first == ppp.second)
+	auto head = linkHeads_.find(b.originalAddress);
+	if (head == linkHeads_.end())
 		return;
-	for (auto iter = ppp.first; iter != ppp.second; ++iter) {
-		if ((size_t)iter->second >= num_blocks_) {
-			// Something probably went very wrong. Try to stumble along nevertheless.
-			ERROR_LOG(Log::JIT, "UnlinkBlock: Invalid block number %d", iter->second);
-			continue;
-		}
-		JitBlock &sourceBlock = blocks_[iter->second];
-		for (int e = 0; e < MAX_JIT_BLOCK_EXITS; e++) {
-			if (sourceBlock.exitAddress[e] == b.originalAddress)
-				sourceBlock.linkStatus[e] = false;
+	for (int link = head->second; link != INVALID_LINK; ) {
+		if (link / MAX_JIT_BLOCK_EXITS >= num_blocks_) {
+			// Something probably went very wrong. Bail, the chain can't be trusted.
+			ERROR_LOG(Log::JIT, "UnlinkBlock: Invalid block number %d", link / MAX_JIT_BLOCK_EXITS);
+			break;
 		}
+		JitBlock &sourceBlock = blocks_[link / MAX_JIT_BLOCK_EXITS];
+		sourceBlock.linkStatus[link % MAX_JIT_BLOCK_EXITS] = false;
+		link = sourceBlock.nextLinkTo[link % MAX_JIT_BLOCK_EXITS];
 	}
 }
 
@@ -462,25 +486,44 @@ void JitBlockCache::InvalidateICache(u32 address, const u32 length) {
 		return;
 	}
 
-	// Blocks may start and end in overlapping ways, and destroying one invalidates iterators.
-	// So after destroying one, we start over.
-	do {
-	restart:
-		auto next = block_map_.lower_bound(std::make_pair(pAddr, 0));
-		auto last = block_map_.upper_bound(std::make_pair(pEnd + MAX_BLOCK_INSTRUCTIONS, 0));
-		// Note that if next is end(), last will be end() too (equal.)
-		for (; next != last; ++next) {
-			const u32 blockStart = next->first.second;
-			const u32 blockEnd = next->first.first;
+	if (byPage_.empty() || length == 0) {
+		return;
+	}
+
+	// Destroying blocks modifies the page lists, so collect them first.
+	// Blocks that span pages show up more than once, so we check invalid as we go below.
+	std::vector<int> found;
+	auto checkPage = [&](const std::vector<int> &blocksInPage) {
+		for (int block_num : blocksInPage) {
+			const JitBlock &b = blocks_[block_num];
+			const u32 blockStart = b.originalAddress & 0x1FFFFFFF;
+			const u32 blockEnd = blockStart + 4 * b.originalSize;
 			if (blockStart < pEnd && blockEnd > pAddr) {
-				DestroyBlock(next->second, DestroyType::INVALIDATE);
-				// Our iterator is now invalid.  Break and search again.
-				// Most of the time there shouldn't be a bunch of matching blocks.
-				goto restart;
+				found.push_back(block_num);
 			}
 		}
-		// We got here - it wasn't in the map at all (or anymore.)
-	} while (false);
+	};
+
+	const u32 startPage = pAddr >> BLOCK_PAGE_SHIFT;
+	const u32 endPage = (pEnd - 1) >> BLOCK_PAGE_SHIFT;
+	if (endPage - startPage >= byPage_.size()) {
+		// Huge range (like a module unload), cheaper to just look at the pages that have blocks.
+		for (const auto &iter : byPage_) {
+			if (iter.first >= startPage && iter.first <= endPage)
+				checkPage(iter.second);
+		}
+	} else {
+		for (u32 page = startPage; page <= endPage; ++page) {
+			auto iter = byPage_.find(page);
+			if (iter != byPage_.end())
+				checkPage(iter->second);
+		}
+	}
+
+	for (int block_num : found) {
+		if (!blocks_[block_num].invalid)
+			DestroyBlock(block_num, DestroyType::INVALIDATE);
+	}
 }
 
 void JitBlockCache::InvalidateChangedBlocks() {
@@ -60,6 +60,8 @@ struct JitBlock {
 
 	u8 *exitPtrs[MAX_JIT_BLOCK_EXITS];      // to be able to rewrite the exit jump
 	u32 exitAddress[MAX_JIT_BLOCK_EXITS];   // 0xFFFFFFFF == unknown
+	// Next exit (block_num * MAX_JIT_BLOCK_EXITS + exit) going to the same address, or -1. See JitBlockCache::linkHeads_.
+	int nextLinkTo[MAX_JIT_BLOCK_EXITS];
 	u32 sentinel;
 
 	u32 originalAddress;
@@ -188,14 +190,17 @@ class JitBlockCache : public JitBlockCacheDebugInterface {
 
 	void AddBlockMap(int block_num);
 	void RemoveBlockMap(int block_num);
+	void GetBlockPages(const JitBlock &b, u32 *startPage, u32 *endPage) const;
 
 	MIPSOpcode GetEmuHackOpForBlock(int block_num) const;
 
 	int num_blocks_ = 0;
 	CodeBlockCommon *codeBlock_;
 	JitBlock *blocks_ = nullptr;
-	std::unordered_multimap<u32, int> links_to_;
-	std::map<std::pair<u32,u32>, u32> block_map_; // (end_addr, start_addr) -> number
+	// Exit address -> first exit linking there, the rest are chained through JitBlock::nextLinkTo.
+	std::unordered_map<u32, int> linkHeads_;
+	// Physical page -> blocks overlapping it, for invalidation.
+	std::unordered_map<u32, std::vector<int>> byPage_;
 
 	enum {
 		JITBLOCK_RANGE_SCRATCH = 0,
@@ -147,6 +147,9 @@ namespace MIPSComp {
 		// like that.
 		virtual void LinkBlock(u8 *exitPoint, const u8 *entryPoint) = 0;
 		virtual void UnlinkBlock(u8 *checkedEntry, u32 originalAddress) = 0;
+
+		// Optional: start compiling these function entries ahead of time, without affecting emulation.
+		virtual void PrewarmFunctions(const std::vector<u32> &entries) {}
 	};
 
 	typedef void (MIPSFrontendInterface::*MIPSCompileFunc)(MIPSOpcode opcode);
@@ -70,6 +70,10 @@ void JitState::Begin(JitBlock *block) {
 		useStaticAlloc = !Disabled(JitDisable::STATIC_ALLOC);
 		// iOS/etc. may disable at runtime if Memory::base is not nicely aligned.
 		enablePointerify = !Disabled(JitDisable::POINTERIFY);
+#elif PPSSPP_ARCH(AMD64)
+		// No pointerify here, the x64 backend uses MEMBASEREG addressing instead.
+		// Static alloc is still experimental on x64, so it's opt-in.
+		useStaticAlloc = g_Config.bJitStaticAllocX64 && !Disabled(JitDisable::STATIC_ALLOC);
 #endif
 #if PPSSPP_ARCH(RISCV64)
 		// Seems to perform slightly better than a checked entry at the start.
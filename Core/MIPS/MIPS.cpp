@@ -24,8 +24,10 @@
 #include "Common/CommonTypes.h"
 #include "Common/Serialize/Serializer.h"
 #include "Common/Serialize/SerializeFuncs.h"
+#include "Core/Config.h"
 #include "Core/ConfigValues.h"
 #include "Core/MIPS/MIPS.h"
+#include "Core/MIPS/MIPSAnalyst.h"
 #include "Core/MIPS/MIPSInt.h"
 #include "Core/MIPS/MIPSTables.h"
 #include "Core/MIPS/MIPSDebugInterface.h"
@@ -274,7 +276,7 @@ void MIPSState::DoState(PointerWrap &p) {
 		return;
 
 	// Reset the jit if we're loading.
-	if (p.mode == p.MODE_READ)
+	if (p.mode == p.MODE_READ && !PSP_CoreParameter().keepCachesOnLoad)
 		Reset();
 	// Assume we're not saving state during a CPU core reset, so no lock.
 	if (MIPSComp::jit)
@@ -376,6 +378,13 @@ void MIPSState::InvalidateICache(u32 address, int length) {
 	}
 }
 
+void MIPSState::PrewarmJit(u32 address, u32 length) {
+	std::lock_guard<std::recursive_mutex> guard(MIPSComp::jitLock);
+	if (MIPSComp::jit && g_Config.bJitPrewarm && length != 0) {
+		MIPSComp::jit->PrewarmFunctions(MIPSAnalyst::GetFunctionEntries(address, address + length - 1));
+	}
+}
+
 void MIPSState::ClearJitCache() {
 	std::lock_guard<std::recursive_mutex> guard(MIPSComp::jitLock);
 	if (MIPSComp::jit) {
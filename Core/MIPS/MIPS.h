@@ -262,6 +262,8 @@ class MIPSState
 	int RunLoopUntil(u64 globalTicks);
 	// To clear jit caches, etc.
 	void InvalidateICache(u32 address, int length = 4);
+	// Lets the jit compile the functions the analyst found in a freshly loaded module ahead of time.
+	void PrewarmJit(u32 address, u32 length);
 	void ClearJitCache();
 
 	void ProcessPendingClears();
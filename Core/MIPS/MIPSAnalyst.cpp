@@ -25,6 +25,7 @@
 #include "Common/File/FileUtil.h"
 #include "Common/Log.h"
 #include "Common/StringUtils.h"
+#include "Common/Thread/ParallelLoop.h"
 #include "Common/TimeUtil.h"
 #include "Core/Config.h"
 #include "Core/MemMap.h"
@@ -45,10 +46,6 @@ typedef std::vector<MIPSAnalyst::AnalyzedFunction> FunctionsVector;
 static FunctionsVector functions;
 std::recursive_mutex functions_lock;
 
-// One function can appear in multiple copies in memory, and they will all have 
-// the same hash and should all be replaced if possible.
-static std::unordered_multimap<u64, MIPSAnalyst::AnalyzedFunction *> hashToFunction;
-
 struct HashMapFunc {
 	char name[64];
 	u64 hash;
@@ -590,6 +587,37 @@ namespace MIPSAnalyst {
 		return (op >> 26) == 0 && (op & 0x3f) == 12;
 	}
 
+	static bool IsInlineableLeafOp(MIPSOpcode op) {
+		// Replacements and other emuhacks need to run as themselves.
+		if (MIPS_IS_EMUHACK(op.encoding))
+			return false;
+		MIPSInfo info = MIPSGetInfo(op);
+		// No flags at all means break, eret, and similar oddities.
+		if (info.value == 0 || (info & (IS_CONDBRANCH | IS_JUMP | IS_SYSCALL | BAD_INSTRUCTION | OUT_OTHER | OUT_VFPU_PREFIX)) != 0)
+			return false;
+		MIPSGPReg out = GetOutGPReg(op);
+		return out != MIPS_REG_RA && out != MIPS_REG_SP;
+	}
+
+	u32 GetInlineableLeafSize(u32 addr, int maxInstructions) {
+		const u32 JR_RA = 0x03E00008;
+		for (int i = 0; i < maxInstructions - 1; ++i) {
+			u32 pc = addr + i * 4;
+			if (!Memory::IsValidAddress(pc) || !Memory::IsValidAddress(pc + 4))
+				return 0;
+			MIPSOpcode op = Memory::Read_Opcode_JIT(pc);
+			if (op.encoding == JR_RA) {
+				if (!IsInlineableLeafOp(Memory::Read_Opcode_JIT(pc + 4)))
+					return 0;
+				// Include the delay slot.
+				return (i + 2) * 4;
+			}
+			if (!IsInlineableLeafOp(op))
+				return 0;
+		}
+		return 0;
+	}
+
 	static bool IsSWInstr(MIPSOpcode op) {
 		return (op & MIPSTABLE_IMM_MASK) == 0xAC000000;
 	}
@@ -749,21 +777,15 @@ namespace MIPSAnalyst {
 	void Reset() {
 		std::lock_guard<std::recursive_mutex> guard(functions_lock);
 		functions.clear();
-		hashToFunction.clear();
 	}
 
-	void UpdateHashToFunctionMap() {
-		std::lock_guard<std::recursive_mutex> guard(functions_lock);
-		hashToFunction.clear();
-		// Really need to detect C++11 features with better defines.
-#if !PPSSPP_PLATFORM(IOS)
-		hashToFunction.reserve(functions.size());
-#endif
-		for (auto iter = functions.begin(); iter != functions.end(); iter++) {
-			AnalyzedFunction &f = *iter;
-			if (f.hasHash && f.size > 16) {
-				hashToFunction.emplace(f.hash, &f);
-			}
+	// Runs loop over ranges of functions, on workers if there are enough of them to be worth it.
+	static void ParallelFunctionLoop(const std::function<void(int, int)> &loop, int minSize) {
+		const int count = (int)functions.size();
+		if (count <= minSize || !g_threadManager.IsInitialized()) {
+			loop(0, count);
+		} else {
+			ParallelRangeLoop(&g_threadManager, loop, 0, count, minSize);
 		}
 	}
 
@@ -874,40 +896,43 @@ namespace MIPSAnalyst {
 		return DetermineRegisterUsage(reg, addr, instrs) == USAGE_CLOBBERED;
 	}
 
-	void HashFunctions() {
-		std::lock_guard<std::recursive_mutex> guard(functions_lock);
-		std::vector<u32> buffer;
+	static void HashFunction(AnalyzedFunction &f, std::vector<u32> &buffer) {
+		if (!Memory::IsValidRange(f.start, f.end - f.start + 4)) {
+			return;
+		}
 
-		for (auto iter = functions.begin(), end = functions.end(); iter != end; iter++) {
-			AnalyzedFunction &f = *iter;
-			if (!Memory::IsValidRange(f.start, f.end - f.start + 4)) {
-				continue;
+		// This is unfortunate.  In case of emuhacks or relocs, we have to make a copy.
+		buffer.resize((f.end - f.start + 4) / 4);
+		size_t pos = 0;
+		for (u32 addr = f.start; addr <= f.end; addr += 4) {
+			u32 validbits = 0xFFFFFFFF;
+			MIPSOpcode instr = Memory::ReadUnchecked_Instruction(addr, true);
+			if (MIPS_IS_EMUHACK(instr)) {
+				f.hasHash = false;
+				return;
 			}
 
-			// This is unfortunate.  In case of emuhacks or relocs, we have to make a copy.
-			buffer.resize((f.end - f.start + 4) / 4);
-			size_t pos = 0;
-			for (u32 addr = f.start; addr <= f.end; addr += 4) {
-				u32 validbits = 0xFFFFFFFF;
-				MIPSOpcode instr = Memory::ReadUnchecked_Instruction(addr, true);
-				if (MIPS_IS_EMUHACK(instr)) {
-					f.hasHash = false;
-					goto skip;
-				}
+			MIPSInfo flags = MIPSGetInfo(instr);
+			if (flags & IN_IMM16)
+				validbits &= ~0xFFFF;
+			if (flags & IN_IMM26)
+				validbits &= ~0x03FFFFFF;
+			buffer[pos++] = instr & validbits;
+		}
 
-				MIPSInfo flags = MIPSGetInfo(instr);
-				if (flags & IN_IMM16)
-					validbits &= ~0xFFFF;
-				if (flags & IN_IMM26)
-					validbits &= ~0x03FFFFFF;
-				buffer[pos++] = instr & validbits;
-			}
+		f.hash = CityHash64((const char *) &buffer[0], buffer.size() * sizeof(u32));
+		f.hasHash = true;
+	}
 
-			f.hash = CityHash64((const char *) &buffer[0], buffer.size() * sizeof(u32));
-			f.hasHash = true;
-skip:
-			;
-		}
+	void HashFunctions() {
+		std::lock_guard<std::recursive_mutex> guard(functions_lock);
+
+		// Each function only touches its own hash, so this splits up nicely.
+		ParallelFunctionLoop([&](int l, int h) {
+			std::vector<u32> buffer;
+			for (int i = l; i < h; ++i)
+				HashFunction(functions[i], buffer);
+		}, 256);
 	}
 
 	static const char *DefaultFunctionName(char buffer[256], u32 startAddr) {
@@ -999,16 +1024,22 @@ namespace MIPSAnalyst {
 		return furthestJumpbackAddr;
 	}
 
-	// endAddr is exclusive.
-	bool ScanForFunctions(u32 startAddr, u32 endAddr, bool insertSymbols) {
-		_assert_((startAddr & 3) == 0);
-		_assert_((endAddr & 3) == 0);
-
-		std::lock_guard<std::recursive_mutex> guard(functions_lock);
-
-		FunctionsVector new_functions;
+	// The result of scanning part of a text range. functions[i] was found by a scan that started fresh at resets[i].
+	struct FunctionScanChunk {
+		FunctionsVector functions;
+		std::vector<u32> resets;
+		// Whether each function was in the symbol map already with a different size.
+		std::vector<bool> sizeMismatch;
+		// Where the next function would start. At or after stopAddr, unless the scan reached endAddr.
+		u32 next;
+	};
 
+	// Scans for functions starting at startAddr, until the first function boundary at or after stopAddr.
+	// The scanner's state is reset at each boundary, so two scans that hit the same boundary agree from then on.
+	// Only reads memory and the symbol map, so this is safe to run on several threads at once.
+	static void ScanFunctionChunk(u32 startAddr, u32 stopAddr, u32 endAddr, FunctionScanChunk &chunk) {
 		AnalyzedFunction currentFunction = {startAddr};
+		u32 resetAddr = startAddr;
 
 		u32 furthestBranch = 0;
 		bool looking = false;
@@ -1116,6 +1147,7 @@ namespace MIPSAnalyst {
 				// Check if we already have symbol info starting here.  If so, skip insertion.
 				// We used to use the symbols to find the functions, but sometimes we'd find
 				// wrong ones due to two modules with the same name.
+				bool sizeMismatch = false;
 				u32 existingSize = g_symbolMap->GetFunctionSize(currentFunction.start);
 				if (existingSize != SymbolMap::INVALID_ADDRESS) {
 					currentFunction.foundInSymbolMap = true;
@@ -1123,12 +1155,12 @@ namespace MIPSAnalyst {
 					// If we run into a func with a different size, skip updating the hash map.
 					// This will prevent us saving incorrectly named funcs with wrong hashes.
 					u32 detectedSize = currentFunction.end - currentFunction.start + 4;
-					if (existingSize != detectedSize) {
-						insertSymbols = false;
-					}
+					sizeMismatch = existingSize != detectedSize;
 				}
 
-				new_functions.push_back(currentFunction);
+				chunk.functions.push_back(currentFunction);
+				chunk.resets.push_back(resetAddr);
+				chunk.sizeMismatch.push_back(sizeMismatch);
 
 				furthestBranch = 0;
 				addr += 4;
@@ -1138,12 +1170,96 @@ namespace MIPSAnalyst {
 				decreasedSp = false;
 				currentFunction.start = addr + 4;
 				currentFunction.foundInSymbolMap = false;
+				resetAddr = currentFunction.start;
+				if (resetAddr >= stopAddr) {
+					chunk.next = resetAddr;
+					return;
+				}
 			}
 		}
 
 		if (addr < endAddr) {
 			currentFunction.end = addr + 4;
-			new_functions.push_back(currentFunction);
+			chunk.functions.push_back(currentFunction);
+			chunk.resets.push_back(resetAddr);
+			chunk.sizeMismatch.push_back(false);
+		}
+		chunk.next = std::max(addr, endAddr);
+	}
+
+	// Splitting up smaller ranges isn't worth the overhead.
+	static const u32 MIN_PARALLEL_SCAN_BYTES = 0x40000;
+	static const u32 SCAN_CHUNK_BYTES = 0x10000;
+
+	// endAddr is exclusive.
+	bool ScanForFunctions(u32 startAddr, u32 endAddr, bool insertSymbols, u32 chunkBytes) {
+		_assert_((startAddr & 3) == 0);
+		_assert_((endAddr & 3) == 0);
+
+		std::lock_guard<std::recursive_mutex> guard(functions_lock);
+
+		FunctionsVector new_functions;
+		auto appendChunk = [&](const FunctionScanChunk &chunk, size_t from) {
+			for (size_t i = from; i < chunk.functions.size(); ++i) {
+				new_functions.push_back(chunk.functions[i]);
+				if (chunk.sizeMismatch[i])
+					insertSymbols = false;
+			}
+		};
+
+		const bool threaded = g_threadManager.IsInitialized();
+		bool split;
+		if (chunkBytes != 0) {
+			_assert_((chunkBytes & 3) == 0);
+			split = endAddr > startAddr && endAddr - startAddr > chunkBytes;
+		} else {
+			chunkBytes = SCAN_CHUNK_BYTES;
+			split = endAddr > startAddr && endAddr - startAddr >= MIN_PARALLEL_SCAN_BYTES && threaded;
+		}
+
+		if (!split) {
+			FunctionScanChunk chunk;
+			ScanFunctionChunk(startAddr, endAddr, endAddr, chunk);
+			appendChunk(chunk, 0);
+		} else {
+			// Each chunk is scanned as if a function started right at its start. That's usually wrong, but the
+			// scans tend to agree again at the next function boundary. Stitching in order keeps this deterministic.
+			int numChunks = (int)((endAddr - startAddr + chunkBytes - 1) / chunkBytes);
+			std::vector<FunctionScanChunk> chunks(numChunks);
+			auto chunkStart = [&](int i) {
+				return startAddr + (u32)i * chunkBytes;
+			};
+			auto chunkStop = [&](int i) {
+				return i == numChunks - 1 ? endAddr : chunkStart(i + 1);
+			};
+			auto scanChunks = [&](int l, int h) {
+				for (int i = l; i < h; ++i)
+					ScanFunctionChunk(chunkStart(i), chunkStop(i), endAddr, chunks[i]);
+			};
+			if (threaded)
+				ParallelRangeLoop(&g_threadManager, scanChunks, 0, numChunks, 1);
+			else
+				scanChunks(0, numChunks);
+
+			u32 next = startAddr;
+			for (int i = 0; i < numChunks && next < endAddr; ++i) {
+				// The previous function ran past this whole chunk.
+				if (next >= chunkStop(i))
+					continue;
+
+				const FunctionScanChunk &chunk = chunks[i];
+				auto match = std::lower_bound(chunk.resets.begin(), chunk.resets.end(), next);
+				if (match != chunk.resets.end() && *match == next) {
+					appendChunk(chunk, match - chunk.resets.begin());
+					next = chunk.next;
+				} else {
+					// The speculative scan never synced up, so redo this part from where we really are.
+					FunctionScanChunk rescan;
+					ScanFunctionChunk(next, chunkStop(i), endAddr, rescan);
+					appendChunk(rescan, 0);
+					next = rescan.next;
+				}
+			}
 		}
 
 		for (auto iter = new_functions.begin(); iter != new_functions.end(); iter++) {
@@ -1233,7 +1349,6 @@ namespace MIPSAnalyst {
 
 		// Most of the time, functions from the same module will be contiguous in the vector, in address order.
 		FunctionsVector::iterator prevMatch = functions.end();
-		size_t originalSize = functions.size();
 		for (auto iter = functions.begin(); iter != functions.end(); ++iter) {
 			const bool hadPrevMatch = prevMatch != functions.end();
 			const bool match = iter->start >= startAddr && iter->start < endAddr;
@@ -1253,12 +1368,17 @@ namespace MIPSAnalyst {
 		}
 
 		RestoreReplacedInstructions(startAddr, endAddr);
+	}
 
-		if (functions.empty()) {
-			hashToFunction.clear();
-		} else if (originalSize != functions.size()) {
-			UpdateHashToFunctionMap();
+	// endAddr is inclusive.
+	std::vector<u32> GetFunctionEntries(u32 startAddr, u32 endAddr) {
+		std::lock_guard<std::recursive_mutex> guard(functions_lock);
+		std::vector<u32> entries;
+		for (const AnalyzedFunction &f : functions) {
+			if (f.start >= startAddr && f.start <= endAddr)
+				entries.push_back(f.start);
 		}
+		return entries;
 	}
 
 	bool GetAnalyzedFunctionAt(u32 addr, AnalyzedFunction *out) {
@@ -1280,6 +1400,16 @@ namespace MIPSAnalyst {
 		}
 	}
 
+	void ReplaceFunctionsInRange(u32 startAddr, u32 endAddr) {
+		std::lock_guard<std::recursive_mutex> guard(functions_lock);
+
+		for (const AnalyzedFunction &f : functions) {
+			// Exit hooks can be anywhere in the function, so check for any overlap.
+			if (f.start < endAddr && f.start + f.size > startAddr)
+				WriteReplaceInstructions(f.start, f.hash, f.size);
+		}
+	}
+
 	void UpdateHashMap() {
 		std::lock_guard<std::recursive_mutex> guard(functions_lock);
 
@@ -1338,27 +1468,41 @@ namespace MIPSAnalyst {
 	}
 
 	void ApplyHashMap() {
-		UpdateHashToFunctionMap();
+		std::lock_guard<std::recursive_mutex> guard(functions_lock);
 
-		for (auto mf = hashMap.begin(), end = hashMap.end(); mf != end; ++mf) {
-			auto range = hashToFunction.equal_range(mf->hash);
-			if (range.first == range.second) {
-				continue;
+		// Each hash and size appears once in the map, so each function can only match one entry.
+		// One function can appear in multiple copies in memory, and they will all have
+		// the same hash, so each copy finds the same entry and gets renamed.
+		// Do the lookups on workers, then rename in function order so the symbol map ends up the same every time.
+		std::vector<const HashMapFunc *> matches(functions.size());
+		ParallelFunctionLoop([&](int l, int h) {
+			HashMapFunc key{};
+			for (int i = l; i < h; ++i) {
+				const AnalyzedFunction &f = functions[i];
+				if (!f.hasHash || f.size <= 16)
+					continue;
+				key.hash = f.hash;
+				key.size = f.size;
+				auto mf = hashMap.find(key);
+				if (mf != hashMap.end())
+					matches[i] = &*mf;
 			}
+		}, 1024);
+
+		for (size_t i = 0; i < functions.size(); ++i) {
+			if (!matches[i])
+				continue;
 
 			// Yay, found a function.
-			for (auto iter = range.first; iter != range.second; ++iter) {
-				AnalyzedFunction &f = *iter->second;
-				if (f.hash == mf->hash && f.size == mf->size) {
-					truncate_cpy(f.name, mf->name);
-
-					std::string existingLabel = g_symbolMap->GetLabelString(f.start);
-					char defaultLabel[256];
-					// If it was renamed, keep it.  Only change the name if it's still the default.
-					if (existingLabel.empty() || existingLabel == DefaultFunctionName(defaultLabel, f.start)) {
-						g_symbolMap->SetLabelName(mf->name, f.start);
-					}
-				}
+			AnalyzedFunction &f = functions[i];
+			const HashMapFunc *mf = matches[i];
+			truncate_cpy(f.name, mf->name);
+
+			std::string existingLabel = g_symbolMap->GetLabelString(f.start);
+			char defaultLabel[256];
+			// If it was renamed, keep it.  Only change the name if it's still the default.
+			if (existingLabel.empty() || existingLabel == DefaultFunctionName(defaultLabel, f.start)) {
+				g_symbolMap->SetLabelName(mf->name, f.start);
 			}
 		}
 	}
@@ -104,9 +104,11 @@ namespace MIPSAnalyst {
 	// so that we don't just dump them all in the cache.
 	void RegisterFunction(u32 startAddr, u32 size, const char *name);
 	// Returns new insertSymbols value for FinalizeScan().
-	bool ScanForFunctions(u32 startAddr, u32 endAddr, bool insertSymbols);
+	// chunkBytes forces the range to be split and stitched in chunks of that size (for tests), 0 picks automatically.
+	bool ScanForFunctions(u32 startAddr, u32 endAddr, bool insertSymbols, u32 chunkBytes = 0);
 	void FinalizeScan(bool insertSymbols);
 	void ForgetFunctions(u32 startAddr, u32 endAddr);
+	std::vector<u32> GetFunctionEntries(u32 startAddr, u32 endAddr);
 
 	bool GetAnalyzedFunctionAt(u32 addr, AnalyzedFunction *out);
 
@@ -116,6 +118,8 @@ namespace MIPSAnalyst {
 
 	const char *LookupHash(u64 hash, u32 funcSize);
 	void ReplaceFunctions();
+	// Only for functions overlapping [startAddr, endAddr), after that memory was copied back over.
+	void ReplaceFunctionsInRange(u32 startAddr, u32 endAddr);
 
 	void UpdateHashMap();
 	void ApplyHashMap();
@@ -129,6 +133,9 @@ namespace MIPSAnalyst {
 	bool IsDelaySlotNiceVFPU(MIPSOpcode branchOp, MIPSOpcode op);
 	bool IsDelaySlotNiceFPU(MIPSOpcode branchOp, MIPSOpcode op);
 	bool IsSyscall(MIPSOpcode op);
+	// If addr starts a short leaf function (straight-line code ending in jr ra, no calls, syscalls, or writes to ra/sp),
+	// returns its size in bytes including the delay slot.  Otherwise 0.  Used to inline it into callers.
+	u32 GetInlineableLeafSize(u32 addr, int maxInstructions);
 
 	bool OpWouldChangeMemory(u32 pc, u32 addr, u32 size);
 	int OpMemoryAccessSize(u32 pc);
@@ -34,6 +34,10 @@ using namespace X64IRJitConstants;
 static constexpr int MIN_BLOCK_NORMAL_LEN = 10;
 // As long as we can fit a JMP, we should be fine.
 static constexpr int MIN_BLOCK_EXIT_LEN = 5;
+// Since we store the offset, this is as big as it can be.
+static constexpr int CODE_SIZE = 1024 * 1024 * 16;
+// Carved off the end for background compiles.
+static constexpr int WORKER_CODE_SIZE = 1024 * 1024 * 4;
 
 X64JitBackend::X64JitBackend(JitOptions &jitopt, IRBlockCache &blocks)
 	: IRNativeBackend(blocks), jo(jitopt), regs_(&jo) {
@@ -43,20 +47,52 @@ X64JitBackend::X64JitBackend(JitOptions &jitopt, IRBlockCache &blocks)
 	}
 	jo.optimizeForInterpreter = false;
 
-	// Since we store the offset, this is as big as it can be.
-	AllocCodeSpace(1024 * 1024 * 16);
+	AllocCodeSpace(CODE_SIZE);
+	codeEnd_ = CODE_SIZE;
 
 	regs_.Init(this);
 }
 
-X64JitBackend::~X64JitBackend() {}
+X64JitBackend::X64JitBackend(X64JitBackend &owner, IRBlockCache &workerBlocks)
+	: IRNativeBackend(workerBlocks), jo(owner.jo), regs_(&jo) {
+	ShareCodeSpace(owner, owner.codeEnd_);
+	sharedCode_ = true;
+	jitStartOffset_ = owner.codeEnd_;
+	codeEnd_ = owner.codeEnd_ + WORKER_CODE_SIZE;
+
+	// Blocks compiled here run with the owner's dispatcher and constants.
+	hooks_ = owner.hooks_;
+	outerLoop_ = owner.outerLoop_;
+	outerLoopPCInSCRATCH1_ = owner.outerLoopPCInSCRATCH1_;
+	dispatcherCheckCoreState_ = owner.dispatcherCheckCoreState_;
+	dispatcherPCInSCRATCH1_ = owner.dispatcherPCInSCRATCH1_;
+	dispatcherNoCheck_ = owner.dispatcherNoCheck_;
+	restoreRoundingMode_ = owner.restoreRoundingMode_;
+	applyRoundingMode_ = owner.applyRoundingMode_;
+	saveStaticRegisters_ = owner.saveStaticRegisters_;
+	loadStaticRegisters_ = owner.loadStaticRegisters_;
+	constants = owner.constants;
+
+	regs_.Init(this);
+}
+
+X64JitBackend::~X64JitBackend() {
+	if (sharedCode_)
+		ReleaseSharedCodeSpace();
+}
+
+IRNativeBackend *X64JitBackend::CreateWorkerBackend(IRBlockCache &workerBlocks) {
+	_assert_(!sharedCode_ && codeEnd_ == CODE_SIZE);
+	codeEnd_ -= WORKER_CODE_SIZE;
+	return new X64JitBackend(*this, workerBlocks);
+}
 
 static void NoBlockExits() {
 	_assert_msg_(false, "Never exited block, invalid IR?");
 }
 
 bool X64JitBackend::CompileBlock(IRBlockCache *irBlockCache, int block_num) {
-	if (GetSpaceLeft() < 0x800)
+	if (SpaceLeft() < 0x800)
 		return false;
 
 	IRBlock *block = irBlockCache->GetBlock(block_num);
@@ -102,7 +138,7 @@ bool X64JitBackend::CompileBlock(IRBlockCache *irBlockCache, int block_num) {
 			regs_.FlushAll(jo.Disabled(JitDisable::REGALLOC_GPR), jo.Disabled(JitDisable::REGALLOC_FPR));
 
 		// Safety check, in case we get a bunch of really large jit ops without a lot of branching.
-		if (GetSpaceLeft() < 0x800) {
+		if (SpaceLeft() < 0x800) {
 			compilingBlockNum_ = -1;
 			return false;
 		}
@@ -174,6 +210,52 @@ bool X64JitBackend::CompileBlock(IRBlockCache *irBlockCache, int block_num) {
 	return true;
 }
 
+bool X64JitBackend::CompileInterpretedBlock(IRBlockCache *irBlockCache, int block_num) {
+	if (SpaceLeft() < 0x800)
+		return false;
+
+	IRBlock *block = irBlockCache->GetBlock(block_num);
+	u32 startPC = block->GetOriginalStart();
+
+	// Same checked entry as a regular block, so exits can link to it.
+	SetBlockCheckedOffset(block_num, (int)GetOffset(GetCodePointer()));
+	WriteDebugPC(startPC);
+	if (jo.downcountInRegister) {
+		TEST(32, R(DOWNCOUNTREG), R(DOWNCOUNTREG));
+	} else {
+		CMP(32, MDisp(CTXREG, downcountOffset), Imm32(0));
+	}
+	FixupBranch normalEntry = J_CC(CC_NS);
+	MOV(32, R(SCRATCH1), Imm32(startPC));
+	JMP(outerLoopPCInSCRATCH1_, true);
+	SetJumpTarget(normalEntry);
+
+	const u8 *blockStart = GetCodePointer();
+	block->SetNativeOffset((int)GetOffset(blockStart));
+
+	// Space for invalidation, or a jump to the native code once the block is promoted.
+	// We're still inside the call below when that happens, so it can't overlap the rest.
+	NOP(MIN_BLOCK_NORMAL_LEN);
+
+	SaveStaticRegisters();
+	WriteDebugProfilerStatus(IRProfilerStatus::IR_INTERPRET);
+	ABI_CallFunctionC((const void *)&RunInterpretedBlock, (u32)block_num);
+	WriteDebugProfilerStatus(IRProfilerStatus::IN_JIT);
+	LoadStaticRegisters();
+
+	// Result (the next PC) in RAX aka SCRATCH1.  Syscalls may have changed the core state.
+	_assert_(RAX == SCRATCH1);
+	MovToPC(SCRATCH1);
+	JMP(dispatcherCheckCoreState_, true);
+
+	IRNativeBlock &nativeBlock = nativeBlocks_[block_num];
+	nativeBlock.interpreted = true;
+	nativeBlock.interpretedStats = JitBlockProfileStats{};
+	nativeBlock.failedPromoteRuns = 0;
+	nativeBlock.stubPatchLen = MIN_BLOCK_NORMAL_LEN;
+	return true;
+}
+
 void X64JitBackend::WriteConstExit(uint32_t pc) {
 	int block_num = blocks_.GetBlockNumberFromStartAddress(pc);
 	const IRNativeBlock *nativeBlock = GetNativeBlock(block_num);
@@ -380,7 +462,7 @@ void X64JitBackend::WriteDebugProfilerStatus(IRProfilerStatus status) {
 
 void X64JitBackend::SaveStaticRegisters() {
 	if (jo.useStaticAlloc) {
-		//CALL(saveStaticRegisters_);
+		CALL(saveStaticRegisters_);
 	} else if (jo.downcountInRegister) {
 		// Inline the single operation
 		MOV(32, MDisp(CTXREG, downcountOffset), R(DOWNCOUNTREG));
@@ -389,7 +471,7 @@ void X64JitBackend::SaveStaticRegisters() {
 
 void X64JitBackend::LoadStaticRegisters() {
 	if (jo.useStaticAlloc) {
-		//CALL(loadStaticRegisters_);
+		CALL(loadStaticRegisters_);
 	} else if (jo.downcountInRegister) {
 		MOV(32, R(DOWNCOUNTREG), MDisp(CTXREG, downcountOffset));
 	}
@@ -56,12 +56,23 @@ class X64JitBackend : public Gen::XCodeBlock, public IRNativeBackend {
 	void ClearAllBlocks() override;
 	void InvalidateBlock(IRBlockCache *irBlockCache, int block_num) override;
 
+	bool SupportsInterpretedBlocks() const override { return true; }
+	bool CompileInterpretedBlock(IRBlockCache *irBlockCache, int block_num) override;
+	IRNativeBackend *CreateWorkerBackend(IRBlockCache &workerBlocks) override;
+
 protected:
 	const CodeBlockCommon &CodeBlock() const override {
 		return *this;
 	}
 
 private:
+	// For CreateWorkerBackend(), shares owner's code space and fixed code.
+	X64JitBackend(X64JitBackend &owner, IRBlockCache &workerBlocks);
+
+	int SpaceLeft() const {
+		return codeEnd_ - (int)GetOffset(GetCodePointer());
+	}
+
 	void RestoreRoundingMode(bool force = false);
 	void ApplyRoundingMode(bool force = false);
 	void MovFromPC(Gen::X64Reg r);
@@ -160,6 +171,9 @@ class X64JitBackend : public Gen::XCodeBlock, public IRNativeBackend {
 	Constants constants;
 
 	int jitStartOffset_ = 0;
+	// Where our part of the code space ends. The rest belongs to the worker backend, if any.
+	int codeEnd_ = 0;
+	bool sharedCode_ = false;
 	int compilingBlockNum_ = -1;
 	int logBlocks_ = 0;
 	// Only useful in breakpoints, where it's set immediately prior.
@@ -172,6 +186,9 @@ class X64IRJit : public IRNativeJit {
 		: IRNativeJit(mipsState), x64Backend_(jo, blocks_) {
 		Init(x64Backend_);
 	}
+	~X64IRJit() {
+		StopBackgroundCompile();
+	}
 
 private:
 	X64JitBackend x64Backend_;
@@ -62,6 +62,14 @@ const int *X64IRRegCache::GetAllocationOrder(MIPSLoc type, MIPSMap flags, int &c
 			ESI, EDI, EDX, EBX, ECX,
 #endif
 		};
+#if PPSSPP_ARCH(AMD64)
+		// The callee-saved regs chosen in GetStaticAllocations must be omitted here.
+		static const int allocationOrderStaticAlloc[] = {
+			R8, R9, R10, R11, RDX, RCX,
+			// Intentionally last.
+			R15,
+		};
+#endif
 
 		if ((flags & X64Map::MASK) == X64Map::SHIFT) {
 			// It's a single option for shifts.
@@ -84,6 +92,10 @@ const int *X64IRRegCache::GetAllocationOrder(MIPSLoc type, MIPSMap flags, int &c
 			return lowSubRegAllocationOrder;
 		}
 #else
+		if (jo_->useStaticAlloc) {
+			count = ARRAY_SIZE(allocationOrderStaticAlloc) - (jo_->reserveR15ForAsm ? 1 : 0);
+			return allocationOrderStaticAlloc;
+		}
 		if (jo_->reserveR15ForAsm) {
 			count = ARRAY_SIZE(allocationOrder) - 1;
 			return allocationOrder;
@@ -119,6 +131,46 @@ const int *X64IRRegCache::GetAllocationOrder(MIPSLoc type, MIPSMap flags, int &c
 	}
 }
 
+const X64IRRegCache::StaticAllocation *X64IRRegCache::GetStaticAllocations(int &count) const {
+#if PPSSPP_ARCH(AMD64)
+	// Only callee-saved regs, so these survive calls without the save/load thunks.
+	// Never RCX or RDX, those are needed for shifts and mul/div.
+	static const StaticAllocation allocs[] = {
+		{ MIPS_REG_SP, R12, MIPSLoc::REG },
+		{ MIPS_REG_V0, R13, MIPSLoc::REG },
+#ifdef _WIN32
+		{ MIPS_REG_V1, RDI, MIPSLoc::REG },
+		{ MIPS_REG_A0, RSI, MIPSLoc::REG },
+#else
+		{ MIPS_REG_A0, RBP, MIPSLoc::REG },
+#endif
+	};
+
+	if (jo_->useStaticAlloc) {
+		count = ARRAY_SIZE(allocs);
+		return allocs;
+	}
+#endif
+	return IRNativeRegCacheBase::GetStaticAllocations(count);
+}
+
+void X64IRRegCache::EmitLoadStaticRegisters() {
+	int count = 0;
+	const StaticAllocation *allocs = GetStaticAllocations(count);
+	for (int i = 0; i < count; ++i) {
+		_assert_(!allocs[i].pointerified);
+		emit_->MOV(32, ::R(FromNativeReg(allocs[i].nr)), MDisp(CTXREG, -128 + GetMipsRegOffset(allocs[i].mr)));
+	}
+}
+
+void X64IRRegCache::EmitSaveStaticRegisters() {
+	int count = 0;
+	const StaticAllocation *allocs = GetStaticAllocations(count);
+	for (int i = 0; i < count; ++i) {
+		emit_->MOV(32, MDisp(CTXREG, -128 + GetMipsRegOffset(allocs[i].mr)), ::R(FromNativeReg(allocs[i].nr)));
+	}
+}
+
 void X64IRRegCache::FlushBeforeCall() {
 	// These registers are not preserved by function calls.
 #if PPSSPP_ARCH(AMD64)
@@ -109,7 +109,11 @@ class X64IRRegCache : public IRNativeRegCacheBase {
 
 	static bool HasLowSubregister(Gen::X64Reg reg);
 
+	void EmitLoadStaticRegisters();
+	void EmitSaveStaticRegisters();
+
 protected:
+	const StaticAllocation *GetStaticAllocations(int &count) const override;
 	const int *GetAllocationOrder(MIPSLoc type, MIPSMap flags, int &count, int &base) const override;
 	void AdjustNativeRegAsPtr(IRNativeReg nreg, bool state) override;
 
@@ -0,0 +1,276 @@
+// Copyright (C) 2026 PPSSPP Project
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include "ppsspp_config.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+#include "Common/BitSet.h"
+#include "Common/Log.h"
+#include "Common/MachineContext.h"
+#include "Common/MemoryUtil.h"
+#include "Core/MemDirty.h"
+#include "Core/MemMap.h"
+
+namespace Memory {
+
+#if defined(MACHINE_CONTEXT_SUPPORTED) && !defined(MASKED_PSP_MEMORY)
+#define DIRTY_TRACKING_SUPPORTED
+#endif
+
+std::atomic<bool> g_dirtyTrackingProtected{ false };
+
+// All the mirrors of RAM are mapped separately, and each needs its own protection.
+static const u32 ramMirrors[] = { 0x08000000, 0x48000000, 0x88000000, 0xC8000000 };
+// Larger RAM sizes are mapped as several views of this size (see Memory::Init.)
+// VirtualProtect can't span views, so we split ranges at these boundaries.
+static const u32 RAM_VIEW_CHUNK = 0x01F00000;
+
+static const int MAX_CONSUMERS = 4;
+static const size_t MAX_TRACKED_SIZE = 0x10000000;
+static const size_t MAX_WORDS = (MAX_TRACKED_SIZE >> DIRTY_PAGE_SHIFT) / 64;
+
+struct DirtyConsumer {
+	bool used = false;
+	std::vector<u64> dirty;
+};
+
+static std::mutex dirtyLock;
+static DirtyConsumer consumers[MAX_CONSUMERS];
+// Set by the fault handler, collected into the consumers on snapshot.
+static std::atomic<u64> pendingBits[MAX_WORDS];
+// Host system calls currently writing into RAM. Snapshots leave protection alone while any run.
+static std::atomic<int> hostWritesInFlight;
+// These only change while unprotected, so the fault handler can read them freely.
+static uintptr_t trackedSize;
+static uintptr_t granularity = DIRTY_PAGE_SIZE;
+
+bool DirtyTracking_Supported() {
+#ifdef DIRTY_TRACKING_SUPPORTED
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool DirtyTracking_Active() {
+	std::lock_guard<std::mutex> guard(dirtyLock);
+	for (const auto &c : consumers) {
+		if (c.used)
+			return true;
+	}
+	return false;
+}
+
+static void ProtectRange(uintptr_t offset, uintptr_t size, uint32_t flags) {
+	for (u32 mirror : ramMirrors) {
+		uintptr_t pos = offset;
+		const uintptr_t end = offset + size;
+		while (pos < end) {
+			uintptr_t chunkEnd = std::min(end, (pos / RAM_VIEW_CHUNK + 1) * RAM_VIEW_CHUNK);
+			ProtectMemoryPages(base + mirror + pos, chunkEnd - pos, flags);
+			pos = chunkEnd;
+		}
+	}
+}
+
+static inline void MarkPages(uintptr_t offset, uintptr_t size) {
+	uintptr_t first = offset >> DIRTY_PAGE_SHIFT;
+	uintptr_t last = (offset + size - 1) >> DIRTY_PAGE_SHIFT;
+	for (uintptr_t page = first; page <= last; ) {
+		uintptr_t bit = page & 63;
+		uintptr_t count = std::min((uintptr_t)64 - bit, last - page + 1);
+		u64 mask = count == 64 ? ~0ULL : ((1ULL << count) - 1) << bit;
+		pendingBits[page >> 6].fetch_or(mask, std::memory_order_relaxed);
+		page += count;
+	}
+}
+
+static bool FindTrackedOffset(uintptr_t hostAddress, uintptr_t *offset) {
+	const uintptr_t b = (uintptr_t)base;
+	for (u32 mirror : ramMirrors) {
+		uintptr_t rel = hostAddress - (b + mirror);
+		if (rel < trackedSize) {
+			*offset = rel;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool DirtyTracking_HandleFault(uintptr_t hostAddress) {
+	// Runs inside the signal handler, so no locks or allocations here.
+	if (!g_dirtyTrackingProtected)
+		return false;
+	uintptr_t offset;
+	if (!FindTrackedOffset(hostAddress, &offset))
+		return false;
+
+	offset &= ~(granularity - 1);
+	// Unprotect before marking, so a concurrent snapshot can't lose this write.
+	ProtectRange(offset, granularity, MEM_PROT_READ | MEM_PROT_WRITE);
+	MarkPages(offset, granularity);
+	return true;
+}
+
+static void UnprotectHostWrite(const void *ptr, size_t size) {
+	uintptr_t offset;
+	if (size == 0 || !FindTrackedOffset((uintptr_t)ptr, &offset))
+		return;
+
+	uintptr_t end = std::min(offset + size, trackedSize);
+	offset &= ~(granularity - 1);
+	end = (end + granularity - 1) & ~(granularity - 1);
+	ProtectRange(offset, end - offset, MEM_PROT_READ | MEM_PROT_WRITE);
+	MarkPages(offset, end - offset);
+}
+
+void DirtyTracking_MarkHostWriteSlow(const void *ptr, size_t size) {
+	UnprotectHostWrite(ptr, size);
+}
+
+void DirtyTracking_BeginHostWrite(const void *ptr, size_t size) {
+	// Count first, so a snapshot that starts protecting after this either sees us, or we see it.
+	hostWritesInFlight++;
+	if (!g_dirtyTrackingProtected)
+		return;
+
+	// Wait out any snapshot in progress, later ones will see the count and not reprotect.
+	std::lock_guard<std::mutex> guard(dirtyLock);
+	if (g_dirtyTrackingProtected)
+		UnprotectHostWrite(ptr, size);
+}
+
+void DirtyTracking_EndHostWrite() {
+	hostWritesInFlight--;
+}
+
+static void ResetConsumers(size_t words) {
+	for (auto &c : consumers) {
+		if (c.used)
+			c.dirty.assign(words, ~0ULL);
+	}
+}
+
+static void SuspendLocked() {
+	if (g_dirtyTrackingProtected) {
+		ProtectRange(0, trackedSize, MEM_PROT_READ | MEM_PROT_WRITE);
+		g_dirtyTrackingProtected = false;
+		INFO_LOG(Log::MemMap, "Dirty page tracking suspended");
+	}
+	for (auto &bits : pendingBits)
+		bits.store(0, std::memory_order_relaxed);
+	ResetConsumers(DirtyTracking_BitmapWords(g_MemorySize));
+}
+
+int DirtyTracking_Start() {
+	if (!DirtyTracking_Supported())
+		return -1;
+
+	std::lock_guard<std::mutex> guard(dirtyLock);
+	for (int i = 0; i < MAX_CONSUMERS; ++i) {
+		if (!consumers[i].used) {
+			consumers[i].used = true;
+			// We don't know what the consumer has seen, so everything starts dirty.
+			// Protection is applied on the first snapshot.
+			consumers[i].dirty.assign(DirtyTracking_BitmapWords(g_MemorySize), ~0ULL);
+			return i;
+		}
+	}
+	return -1;
+}
+
+void DirtyTracking_Stop(int consumer) {
+	if (consumer < 0 || consumer >= MAX_CONSUMERS)
+		return;
+
+	std::lock_guard<std::mutex> guard(dirtyLock);
+	consumers[consumer].used = false;
+	consumers[consumer].dirty.clear();
+	for (const auto &c : consumers) {
+		if (c.used)
+			return;
+	}
+	SuspendLocked();
+}
+
+void DirtyTracking_Suspend() {
+	std::lock_guard<std::mutex> guard(dirtyLock);
+	SuspendLocked();
+}
+
+void DirtyTracking_Snapshot(int consumer, std::vector<u64> &bitmap) {
+	const size_t words = DirtyTracking_BitmapWords(g_MemorySize);
+	bitmap.assign(words, ~0ULL);
+	if (consumer < 0 || consumer >= MAX_CONSUMERS || !IsActive())
+		return;
+
+	std::lock_guard<std::mutex> guard(dirtyLock);
+	DirtyConsumer &c = consumers[consumer];
+	if (!c.used)
+		return;
+
+	if (!g_dirtyTrackingProtected || c.dirty.size() != words) {
+		// First snapshot, or memory was remapped.  Everything is dirty, start protecting.
+		SuspendLocked();
+		trackedSize = std::min((size_t)g_MemorySize, MAX_TRACKED_SIZE);
+		granularity = std::max((uintptr_t)DIRTY_PAGE_SIZE, (uintptr_t)GetMemoryProtectPageSize());
+		// Set before protecting, so faults from other threads are handled, and before checking
+		// for host writes (see DirtyTracking_BeginHostWrite.)
+		g_dirtyTrackingProtected = true;
+		if (hostWritesInFlight != 0) {
+			// Try again next time, everything stays dirty until then.
+			g_dirtyTrackingProtected = false;
+			return;
+		}
+		ProtectRange(0, trackedSize, MEM_PROT_READ);
+		INFO_LOG(Log::MemMap, "Dirty page tracking started (%d KB pages)", (int)(granularity / 1024));
+	} else {
+		// A host write may be using any of the unprotected pages, so leave them all for now.
+		// They stay pending, and are reported again (and protected) on a later snapshot.
+		const bool reprotect = hostWritesInFlight == 0;
+		for (size_t w = 0; w < words; ++w) {
+			u64 bits = reprotect ? pendingBits[w].exchange(0, std::memory_order_relaxed) : pendingBits[w].load(std::memory_order_relaxed);
+			if (!bits)
+				continue;
+			for (auto &other : consumers) {
+				if (other.used)
+					other.dirty[w] |= bits;
+			}
+			if (!reprotect)
+				continue;
+
+			// Write protect the runs of pages that were written again. The handler always
+			// marks whole protection granules, so these are aligned.
+			while (bits) {
+				int start = LeastSignificantSetBit(bits);
+				u64 run = bits >> start;
+				int len = run == ~0ULL ? 64 : LeastSignificantSetBit(~run);
+				uintptr_t offset = ((uintptr_t)w * 64 + start) << DIRTY_PAGE_SHIFT;
+				ProtectRange(offset, (uintptr_t)len << DIRTY_PAGE_SHIFT, MEM_PROT_READ);
+				bits = len == 64 ? 0 : bits & ~(((1ULL << len) - 1) << start);
+			}
+		}
+	}
+
+	bitmap.swap(c.dirty);
+	c.dirty.assign(words, 0);
+}
+
+}  // namespace Memory
@@ -0,0 +1,95 @@
+// Copyright (C) 2026 PPSSPP Project
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Common/CommonTypes.h"
+
+// Host-side tracking of which pages of PSP RAM have been written.
+//
+// While anyone is tracking, all RAM views are write protected. The first write to a page
+// after a snapshot faults, Memory::HandleFault marks the page and unprotects it, and the
+// write is retried. This catches every writer (JIT, interpreter, HLE, GPU readbacks) without
+// touching the store paths, and costs nothing when nobody is tracking.
+//
+// Only available where we handle faults and RAM is mapped directly (no masking).
+
+namespace Memory {
+
+enum {
+	DIRTY_PAGE_SHIFT = 12,
+	DIRTY_PAGE_SIZE = 1 << DIRTY_PAGE_SHIFT,
+};
+
+// Page N of the bitmaps below covers PSP_GetKernelMemoryBase() + (N << DIRTY_PAGE_SHIFT).
+inline size_t DirtyTracking_BitmapWords(u32 memorySize) {
+	return ((memorySize >> DIRTY_PAGE_SHIFT) + 63) / 64;
+}
+
+bool DirtyTracking_Supported();
+
+// Each consumer gets its own view of the dirty pages. Returns -1 if unsupported or full.
+// The first snapshot after starting reports every page as dirty.
+int DirtyTracking_Start();
+void DirtyTracking_Stop(int consumer);
+bool DirtyTracking_Active();
+
+// Returns the pages written since this consumer's previous snapshot and starts a new
+// interval. Must not race with Memory::Init/Shutdown.
+void DirtyTracking_Snapshot(int consumer, std::vector<u64> &bitmap);
+
+// Drops the write protection, for example before the RAM views are unmapped. Consumers
+// stay registered, and everything is reported dirty on their next snapshot.
+void DirtyTracking_Suspend();
+
+// Called from the fault handler. Returns true if the fault was a tracked write, in which case
+// the access can simply be retried.
+bool DirtyTracking_HandleFault(uintptr_t hostAddress);
+
+void DirtyTracking_MarkHostWriteSlow(const void *ptr, size_t size);
+void DirtyTracking_BeginHostWrite(const void *ptr, size_t size);
+void DirtyTracking_EndHostWrite();
+
+extern std::atomic<bool> g_dirtyTrackingProtected;
+
+// Marks a range as written and drops its protection. Plain memcpy and friends don't need it,
+// but it's a good idea before large bulk writes. Not enough for system calls, see below.
+inline void DirtyTracking_MarkHostWrite(const void *ptr, size_t size) {
+	if (g_dirtyTrackingProtected)
+		DirtyTracking_MarkHostWriteSlow(ptr, size);
+}
+
+// Host code that writes into PSP RAM from a system call (read, recv...) must keep one of these
+// alive across the call, since the kernel fails those calls with EFAULT instead of raising a
+// fault we can handle. This also stops a snapshot on another thread (the IO thread reads while
+// the emulator thread snapshots) from protecting the range again before the call is done.
+class DirtyTrackingHostWrite {
+public:
+	DirtyTrackingHostWrite(const void *ptr, size_t size) {
+		DirtyTracking_BeginHostWrite(ptr, size);
+	}
+	~DirtyTrackingHostWrite() {
+		DirtyTracking_EndHostWrite();
+	}
+};
+
+}  // namespace Memory
@@ -39,6 +39,7 @@
 #include "Common/Log.h"
 #include "Core/Config.h"
 #include "Core/Core.h"
+#include "Core/MemDirty.h"
 #include "Core/MemFault.h"
 #include "Core/MemMap.h"
 #include "Core/MIPS/JitCommon/JitCommon.h"
@@ -111,6 +112,10 @@ static bool DisassembleNativeAt(const uint8_t *codePtr, int instructionSize, std
 }
 
 bool HandleFault(uintptr_t hostAddress, void *ctx) {
+	// Writes to write-watched RAM are expected and simply resume.
+	if (DirtyTracking_HandleFault(hostAddress))
+		return true;
+
 	if (inCrashHandler)
 		return false;
 	inCrashHandler = true;
@@ -36,6 +36,7 @@
 #include "Core/HDRemaster.h"
 #include "Core/HLE/ReplaceTables.h"
 #include "Core/MemMap.h"
+#include "Core/MemDirty.h"
 #include "Core/MemFault.h"
 #include "Core/MIPS/MIPS.h"
 #include "Core/MIPS/JitCommon/JitCommon.h"
@@ -338,14 +339,19 @@ void Reinit() {
 
 static void DoMemoryVoid(PointerWrap &p, uint32_t start, uint32_t size) {
 	uint8_t *d = GetPointerWrite(start);
-	uint8_t *&storage = *p.ptr;
 
 	// We only handle aligned data and sizes.
 	if ((size & 0x3F) != 0 || ((uintptr_t)d & 0x3F) != 0)
 		return p.DoVoid(d, size);
 
+	// This may move the buffer, so must happen before we look at it.
+	p.ReserveWrite(size);
+	uint8_t *&storage = *p.ptr;
+
 	switch (p.mode) {
 	case PointerWrap::MODE_READ:
+		// Unprotect everything at once, rather than taking a fault per page.
+		DirtyTracking_MarkHostWrite(d, size);
 		ParallelMemcpy(&g_threadManager, d, storage, size);
 		break;
 	case PointerWrap::MODE_WRITE:
@@ -366,7 +372,7 @@ static void DoMemoryVoid(PointerWrap &p, uint32_t start, uint32_t size) {
 	storage += size;
 }
 
-void DoState(PointerWrap &p) {
+void DoState(PointerWrap &p, bool includeMemory) {
 	auto s = p.Section("Memory", 1, 3);
 	if (!s)
 		return;
@@ -398,10 +404,12 @@ void DoState(PointerWrap &p) {
 		}
 	}
 
-	DoMemoryVoid(p, PSP_GetKernelMemoryBase(), g_MemorySize);
+	if (includeMemory)
+		DoMemoryVoid(p, PSP_GetKernelMemoryBase(), g_MemorySize);
 	p.DoMarker("RAM");
 
-	DoMemoryVoid(p, PSP_GetVidMemBase(), VRAM_SIZE);
+	if (includeMemory)
+		DoMemoryVoid(p, PSP_GetVidMemBase(), VRAM_SIZE);
 	p.DoMarker("VRAM");
 	DoArray(p, m_pPhysicalScratchPad, SCRATCHPAD_SIZE);
 	p.DoMarker("ScratchPad");
@@ -410,6 +418,7 @@ void DoState(PointerWrap &p) {
 void Shutdown() {
 	std::lock_guard<std::recursive_mutex> guard(g_shutdownLock);
 	u32 flags = 0;
+	DirtyTracking_Suspend();
 	MemoryMap_Shutdown();
 	base = nullptr;
 	DEBUG_LOG(Log::MemMap, "Memory system shut down.");
@@ -113,7 +113,8 @@ ENUM_CLASS_BITOPS(MemMapSetupFlags);
 // Init and Shutdown
 bool Init(MemMapSetupFlags flags);
 void Shutdown();
-void DoState(PointerWrap &p);
+// With includeMemory false, the contents of RAM and VRAM are left out (rewind keeps them itself.)
+void DoState(PointerWrap &p, bool includeMemory = true);
 
 // False when shutdown has already been called.
 bool IsActive();
@@ -0,0 +1,397 @@
+// Copyright (C) 2026 PPSSPP Project
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Common/BitSet.h"
+#include "Common/Data/Text/StringWriter.h"
+#include "Common/Log.h"
+#include "Common/Thread/ParallelLoop.h"
+#include "Common/Thread/ThreadManager.h"
+#include "Common/TimeUtil.h"
+#include "Core/Config.h"
+#include "Core/Core.h"
+#include "Core/CoreParameter.h"
+#include "Core/MemDirty.h"
+#include "Core/MemMap.h"
+#include "Core/RetroAchievements.h"
+#include "Core/RunAhead.h"
+#include "Core/SaveState.h"
+#include "Core/SaveStateRewind.h"
+#include "Core/System.h"
+#include "Core/HLE/sceNet.h"
+#include "Core/MIPS/MIPS.h"
+#include "Core/MIPS/MIPSAnalyst.h"
+#include "Core/MIPS/JitCommon/JitCommon.h"
+#include "GPU/GPUCommon.h"
+#include "GPU/GPUState.h"
+#include "GPU/Debugger/Record.h"
+
+namespace RunAhead {
+
+static const u32 PAGE_SHIFT = Memory::DIRTY_PAGE_SHIFT;
+static const u32 PAGE_SIZE = 1 << PAGE_SHIFT;
+// After a failed save or restore, don't try again right away.
+static const int RETRY_DELAY_FRAMES = 300;
+
+// Memory as of the last save, with emuhacks cleaned out. Restoring copies back only the pages
+// that differ, and only invalidates the jit blocks in those.
+class SnapshotMemory : public SaveState::StateMemory {
+public:
+	~SnapshotMemory() {
+		Clear();
+	}
+
+	void DoMemory(PointerWrap &p) override;
+	bool IsSpeculative() const override {
+		return true;
+	}
+
+	void Clear();
+
+	int RestoredPages() const {
+		return restoredPages_;
+	}
+
+private:
+	u8 *PagePointer(u32 index) const;
+	void CollectDirty();
+	void DropUnchanged();
+	void Capture();
+	void RestorePages();
+
+	// RAM followed by VRAM.
+	std::vector<u8> shadow_;
+	bool shadowValid_ = false;
+	u32 shadowRamSize_ = 0;
+	u32 ramPages_ = 0;
+	u32 totalPages_ = 0;
+	std::vector<u64> dirty_;
+	int tracker_ = -1;
+	int restoredPages_ = 0;
+	// Runs of RAM copied back by the last restore, as [start, end) addresses.
+	std::vector<std::pair<u32, u32>> restoredRanges_;
+};
+
+static SnapshotMemory snapshotMemory;
+static std::vector<u8> state;
+static bool running = false;
+static bool speculating = false;
+static int retryDelay = 0;
+
+static double avgSaveTime = 0.0;
+static double avgFramesTime = 0.0;
+static double avgRestoreTime = 0.0;
+static double avgRestoredPages = 0.0;
+
+static void Average(double &avg, double value) {
+	avg = avg * 0.95 + value * 0.05;
+}
+
+void SnapshotMemory::Clear() {
+	if (tracker_ >= 0) {
+		Memory::DirtyTracking_Stop(tracker_);
+		tracker_ = -1;
+	}
+	shadow_.clear();
+	shadow_.shrink_to_fit();
+	shadowValid_ = false;
+	shadowRamSize_ = 0;
+}
+
+void SnapshotMemory::DoMemory(PointerWrap &p) {
+	switch (p.mode) {
+	case PointerWrap::MODE_WRITE:
+		Capture();
+		break;
+	case PointerWrap::MODE_READ:
+		if (!shadowValid_ || shadowRamSize_ != Memory::g_MemorySize) {
+			ERROR_LOG(Log::SaveState, "Run-ahead: No memory to restore");
+			p.SetError(PointerWrap::ERROR_FAILURE);
+			break;
+		}
+		RestorePages();
+		break;
+	default:
+		break;
+	}
+}
+
+u8 *SnapshotMemory::PagePointer(u32 index) const {
+	if (index < ramPages_)
+		return Memory::GetPointerWriteUnchecked(PSP_GetKernelMemoryBase() + (index << PAGE_SHIFT));
+	return Memory::GetPointerWriteUnchecked(PSP_GetVidMemBase() + ((index - ramPages_) << PAGE_SHIFT));
+}
+
+void SnapshotMemory::CollectDirty() {
+	const size_t words = (totalPages_ + 63) / 64;
+	if (tracker_ >= 0)
+		Memory::DirtyTracking_Snapshot(tracker_, dirty_);
+	else
+		dirty_.clear();
+	// The tracker only covers RAM. VRAM is small, so it's always compared.
+	dirty_.resize(words, ~0ULL);
+	for (size_t w = ramPages_ / 64; w < words; ++w)
+		dirty_[w] = ~0ULL;
+}
+
+void SnapshotMemory::DropUnchanged() {
+	const size_t words = dirty_.size();
+	// This is the bulk of the work when not tracking, so split it up.
+	ParallelRangeLoop(&g_threadManager, [&](int l, int h) {
+		for (int w = l; w < h; ++w) {
+			u64 bits = dirty_[w];
+			while (bits) {
+				const int bit = LeastSignificantSetBit(bits);
+				bits &= bits - 1;
+				const u32 index = (u32)(w * 64 + bit);
+				if (index >= totalPages_ || memcmp(PagePointer(index), &shadow_[(size_t)index << PAGE_SHIFT], PAGE_SIZE) == 0)
+					dirty_[w] &= ~(1ULL << bit);
+			}
+		}
+	}, 0, (int)words, 16);
+}
+
+void SnapshotMemory::Capture() {
+	const u32 ramSize = Memory::g_MemorySize;
+	ramPages_ = ramSize >> PAGE_SHIFT;
+	totalPages_ = ramPages_ + (Memory::VRAM_SIZE >> PAGE_SHIFT);
+	if (shadow_.size() != (size_t)totalPages_ * PAGE_SIZE || shadowRamSize_ != ramSize) {
+		shadow_.resize((size_t)totalPages_ * PAGE_SIZE);
+		shadowRamSize_ = ramSize;
+		shadowValid_ = false;
+	}
+	if (tracker_ < 0 && Memory::DirtyTracking_Supported())
+		tracker_ = Memory::DirtyTracking_Start();
+
+	CollectDirty();
+	if (shadowValid_)
+		DropUnchanged();
+	else
+		std::fill(dirty_.begin(), dirty_.end(), ~0ULL);
+
+	std::lock_guard<std::recursive_mutex> guard(MIPSComp::jitLock);
+	for (size_t w = 0; w < dirty_.size(); ++w) {
+		u64 bits = dirty_[w];
+		while (bits) {
+			const u32 index = (u32)(w * 64 + LeastSignificantSetBit(bits));
+			bits &= bits - 1;
+			if (index >= totalPages_)
+				break;
+
+			u8 *dst = &shadow_[(size_t)index << PAGE_SHIFT];
+			memcpy(dst, PagePointer(index), PAGE_SIZE);
+			if (index < ramPages_)
+				SaveState::CleanEmuHacks((u32 *)dst, PAGE_SIZE / 4, PSP_GetKernelMemoryBase() + (index << PAGE_SHIFT));
+		}
+	}
+	shadowValid_ = true;
+}
+
+void SnapshotMemory::RestorePages() {
+	CollectDirty();
+	DropUnchanged();
+
+	restoredPages_ = 0;
+	restoredRanges_.clear();
+	std::lock_guard<std::recursive_mutex> guard(MIPSComp::jitLock);
+	u32 page[PAGE_SIZE / 4];
+	for (size_t w = 0; w < dirty_.size(); ++w) {
+		u64 bits = dirty_[w];
+		while (bits) {
+			const u32 index = (u32)(w * 64 + LeastSignificantSetBit(bits));
+			bits &= bits - 1;
+			if (index >= totalPages_)
+				break;
+
+			u8 *dst = PagePointer(index);
+			const u8 *src = &shadow_[(size_t)index << PAGE_SHIFT];
+			if (index < ramPages_) {
+				const u32 address = PSP_GetKernelMemoryBase() + (index << PAGE_SHIFT);
+				memcpy(page, dst, PAGE_SIZE);
+				SaveState::CleanEmuHacks(page, PAGE_SIZE / 4, address);
+				// Only new jit blocks here, those are still good.
+				if (memcmp(page, src, PAGE_SIZE) == 0)
+					continue;
+				currentMIPS->InvalidateICache(address, PAGE_SIZE);
+				if (!restoredRanges_.empty() && restoredRanges_.back().second == address)
+					restoredRanges_.back().second += PAGE_SIZE;
+				else
+					restoredRanges_.emplace_back(address, address + PAGE_SIZE);
+			}
+			Memory::DirtyTracking_MarkHostWrite(dst, PAGE_SIZE);
+			memcpy(dst, src, PAGE_SIZE);
+			restoredPages_++;
+		}
+	}
+
+	// The shadow is kept without replacement hooks, and the module state doesn't redo them on a
+	// speculative load, so only the pages copied back need them again.
+	if (g_Config.bFuncReplacements) {
+		for (const auto &range : restoredRanges_)
+			MIPSAnalyst::ReplaceFunctionsInRange(range.first, range.second);
+	}
+
+	// Memory matches the shadow again, so the next save doesn't need to look at what we just wrote.
+	if (tracker_ >= 0)
+		Memory::DirtyTracking_Snapshot(tracker_, dirty_);
+}
+
+static bool CanRunAhead() {
+	if (g_Config.iRunAheadFrames <= 0 || coreState != CORE_RUNNING_CPU)
+		return false;
+	if (PSP_CoreParameter().frozen || PSP_CoreParameter().freezeNext)
+		return false;
+	// Hardcore mode doesn't allow loading states, and other players would see the extra frames.
+	if (Achievements::HardcoreModeActive() || !NetworkAllowSaveState())
+		return false;
+	if (gpu && gpu->GetRecorder()->IsActivePending())
+		return false;
+	if (retryDelay > 0) {
+		retryDelay--;
+		return false;
+	}
+	return true;
+}
+
+void RunFrames() {
+	if (!CanRunAhead()) {
+		if (g_Config.iRunAheadFrames <= 0 && !state.empty())
+			Shutdown();
+		PSP_RunLoopWhileState();
+		return;
+	}
+
+	running = true;
+	// The real frame is never seen, the last frame run ahead is shown in its place.
+	gstate_c.skipDrawReason |= SKIPDRAW_SKIPFRAME;
+	PSP_RunLoopWhileState();
+	if (coreState != CORE_NEXTFRAME) {
+		running = false;
+		return;
+	}
+	// This is frameskip's decision for the next frame, which is the one we'll show.
+	const bool skipShown = (gstate_c.skipDrawReason & SKIPDRAW_SKIPFRAME) != 0;
+
+	const double startTime = time_now_d();
+	coreState = CORE_RUNNING_CPU;
+	CChunkFileReader::Error err = SaveState::SaveToRam(state, &snapshotMemory);
+	const double savedTime = time_now_d();
+	if (err != CChunkFileReader::ERROR_NONE) {
+		WARN_LOG(Log::SaveState, "Run-ahead: Failed to save state, pausing run-ahead");
+		retryDelay = RETRY_DELAY_FRAMES;
+		coreState = CORE_NEXTFRAME;
+		running = false;
+		return;
+	}
+
+	speculating = true;
+	const int frames = g_Config.iRunAheadFrames;
+	for (int i = 0; i < frames; ++i) {
+		if (i == frames - 1 && !skipShown)
+			gstate_c.skipDrawReason &= ~SKIPDRAW_SKIPFRAME;
+		else
+			gstate_c.skipDrawReason |= SKIPDRAW_SKIPFRAME;
+
+		PSP_RunLoopWhileState();
+		if (coreState != CORE_NEXTFRAME)
+			break;
+		if (i != frames - 1)
+			coreState = CORE_RUNNING_CPU;
+	}
+	running = false;
+
+	Average(avgSaveTime, savedTime - startTime);
+	Average(avgFramesTime, time_now_d() - savedTime);
+
+	if (coreState != CORE_NEXTFRAME) {
+		// Hit a breakpoint or an exception, or ran out of cycles. The real frames will get there too,
+		// so just go back right away.
+		Restore();
+		if (coreState == CORE_RUNNING_CPU)
+			coreState = CORE_NEXTFRAME;
+	}
+}
+
+void Restore() {
+	if (!speculating)
+		return;
+	speculating = false;
+	if (coreState == CORE_POWERDOWN || !PSP_IsInited())
+		return;
+
+	const double startTime = time_now_d();
+	std::string errorString;
+	CChunkFileReader::Error err = SaveState::LoadFromRam(state, &errorString, &snapshotMemory);
+	if (err != CChunkFileReader::ERROR_NONE) {
+		// Nothing better to do than to keep going from where we are.
+		ERROR_LOG(Log::SaveState, "Run-ahead: Failed to restore state (%s), pausing run-ahead", errorString.c_str());
+		snapshotMemory.Clear();
+		retryDelay = RETRY_DELAY_FRAMES;
+		return;
+	}
+
+	Average(avgRestoreTime, time_now_d() - startTime);
+	Average(avgRestoredPages, snapshotMemory.RestoredPages());
+}
+
+void Shutdown() {
+	running = false;
+	speculating = false;
+	retryDelay = 0;
+	snapshotMemory.Clear();
+	state.clear();
+	state.shrink_to_fit();
+	avgSaveTime = 0.0;
+	avgFramesTime = 0.0;
+	avgRestoreTime = 0.0;
+	avgRestoredPages = 0.0;
+}
+
+bool IsSpeculating() {
+	return speculating;
+}
+
+bool IsRunning() {
+	return running;
+}
+
+void SaveMemoryForTest() {
+	u8 *ptr = nullptr;
+	PointerWrap p(&ptr, PointerWrap::MODE_WRITE);
+	snapshotMemory.DoMemory(p);
+}
+
+int RestoreMemoryForTest() {
+	u8 *ptr = nullptr;
+	PointerWrap p(&ptr, PointerWrap::MODE_READ);
+	snapshotMemory.DoMemory(p);
+	return p.error == PointerWrap::ERROR_NONE ? snapshotMemory.RestoredPages() : -1;
+}
+
+void GetDebugStats(StringWriter &w) {
+	if (g_Config.iRunAheadFrames <= 0)
+		return;
+	w.F("Run-ahead: %d frames, save %0.2f ms, frames %0.2f ms, restore %0.2f ms (%d pages)\n",
+		g_Config.iRunAheadFrames, avgSaveTime * 1000.0, avgFramesTime * 1000.0, avgRestoreTime * 1000.0, (int)avgRestoredPages);
+}
+
+}  // namespace RunAhead
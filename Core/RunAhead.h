@@ -0,0 +1,50 @@
+// Copyright (C) 2026 PPSSPP Project
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+class StringWriter;
+
+// Run-ahead hides the game's own input lag. Each host frame, the real frame is run without
+// drawing, the state is saved to RAM, and g_Config.iRunAheadFrames more frames are run with
+// the same input. Only the last one is drawn and presented, and then the state is restored,
+// so the game really only advanced one frame.
+//
+// RAM and VRAM are kept out of the state, the pages written while running ahead are copied
+// back from a shadow instead (see MemDirty.h.) The jit and GPU caches are kept across the restore.
+namespace RunAhead {
+
+// Replaces PSP_RunLoopWhileState. Leaves coreState as it would be after one frame.
+void RunFrames();
+// Call once the last frame has been presented.
+void Restore();
+void Shutdown();
+
+// True while running frames that will be thrown away. These must not have side effects
+// outside the emulated PSP, like pushing audio.
+bool IsSpeculating();
+// True during RunFrames. Every frame ends the run loop then, even ones that skip drawing.
+bool IsRunning();
+
+void GetDebugStats(StringWriter &w);
+
+// For tests: the memory half of a run-ahead save and restore, without the rest of the state.
+// Returns the number of pages copied back, or -1 if there was nothing to restore.
+void SaveMemoryForTest();
+int RestoreMemoryForTest();
+
+}  // namespace RunAhead
@@ -16,13 +16,17 @@
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
 #include <algorithm>
+#include <deque>
 #include <vector>
 #include <thread>
 #include <mutex>
 #include <string>
+#include <map>
 #include <set>
 
 #include "Common/Data/Text/I18n.h"
+#include "Common/Thread/Promise.h"
+#include "Common/Thread/ThreadManager.h"
 #include "Common/Thread/ThreadUtil.h"
 #include "Common/Data/Text/Parsers.h"
 #include "Common/System/System.h"
@@ -94,6 +98,8 @@ static std::map<std::string, uint64_t, std::less<>> g_files;  // the value is th
 
 struct SaveStart {
 	void DoState(PointerWrap &p);
+
+	StateMemory *memory = nullptr;
 };
 
 enum class OperationType {
@@ -116,16 +122,38 @@ struct Operation {
 
 static std::vector<Operation> g_pendingOperations;
 
+// A save that has been captured, but is still being compressed and written out in the background.
+// The task only writes the file, the rest happens on the emu thread when it's collected.
+struct AsyncSave {
+	std::vector<u8> data;
+	CChunkFileReader::Error error = CChunkFileReader::ERROR_NONE;
+	SaveState::Callback callback;
+	std::string successMessage;
+	std::string failureMessage;
+};
+
+// Only touched from the emu thread.
+static std::deque<Promise<AsyncSave *> *> g_asyncSaves;
+static const size_t MAX_ASYNC_SAVES = 2;
+// States are large, so we keep a buffer around for the next one.
+static std::vector<u8> g_asyncSaveBuffer;
+
 int g_screenshotFailures;
 
-	CChunkFileReader::Error SaveToRam(std::vector<u8> &data) {
+	CChunkFileReader::Error SaveToRam(std::vector<u8> &data, StateMemory *memory) {
 		SaveStart state;
+		state.memory = memory;
 		return CChunkFileReader::MeasureAndSavePtr(state, &data);
 	}
 
-	CChunkFileReader::Error LoadFromRam(std::vector<u8> &data, std::string *errorString) {
+	CChunkFileReader::Error LoadFromRam(std::vector<u8> &data, std::string *errorString, StateMemory *memory) {
 		SaveStart state;
-		return CChunkFileReader::LoadPtr(&data[0], state, errorString);
+		state.memory = memory;
+		CoreParameter &coreParam = PSP_CoreParameter();
+		coreParam.keepCachesOnLoad = memory && memory->IsSpeculative();
+		CChunkFileReader::Error result = CChunkFileReader::LoadPtr(&data[0], state, errorString);
+		coreParam.keepCachesOnLoad = false;
+		return result;
 	}
 
 	// TODO: Should this be configurable?
@@ -140,7 +168,8 @@ int g_screenshotFailures;
 
 		if (s >= 2) {
 			// This only increments on save, of course.
-			++saveStateGeneration;
+			if (!memory || !memory->IsSpeculative())
+				++saveStateGeneration;
 			Do(p, saveStateGeneration);
 			// This saves the first git version to create this save state (or generation of save states.)
 			if (saveStateInitialGitVersion.empty())
@@ -163,8 +192,16 @@ int g_screenshotFailures;
 
 		// Memory is a bit tricky when jit is enabled, since there's emuhacks in it.
 		// These must be saved before copying out memory and restored after.
-		auto savedReplacements = SaveAndClearReplacements();
-		if (MIPSComp::jit && p.mode == p.MODE_WRITE) {
+		// Rewind and run-ahead keep RAM outside the state and clean their own copy, so they don't need this.
+		// Speculative loads keep the jit blocks, which must not lose their replacements either.
+		const bool keepReplacements = memory && (p.mode != p.MODE_READ || memory->IsSpeculative());
+		std::map<u32, u32> savedReplacements;
+		if (!keepReplacements)
+			savedReplacements = SaveAndClearReplacements();
+		if (memory) {
+			Memory::DoState(p, false);
+			memory->DoMemory(p);
+		} else if (MIPSComp::jit && p.mode == p.MODE_WRITE) {
 			std::lock_guard<std::recursive_mutex> guard(MIPSComp::jitLock);
 			if (MIPSComp::jit) {
 				std::vector<u32> savedBlocks;
@@ -184,7 +221,7 @@ int g_screenshotFailures;
 
 		// Don't bother restoring if reading, we'll deal with that in KernelModuleDoState.
 		// In theory, different functions might have been runtime loaded in the state.
-		if (p.mode != p.MODE_READ) {
+		if (p.mode != p.MODE_READ && !keepReplacements) {
 			RestoreSavedReplacements(savedReplacements);
 		}
 
@@ -197,6 +234,59 @@ int g_screenshotFailures;
 		pspFileSystem.DoState(p);
 	}
 
+	// Waits until at most maxPending background saves are left, and calls the callbacks of the
+	// finished ones. Don't call with the mutex held, callbacks may queue more operations.
+	static void WaitForAsyncSaves(size_t maxPending) {
+		while (!g_asyncSaves.empty()) {
+			Promise<AsyncSave *> *oldest = g_asyncSaves.front();
+			AsyncSave *save;
+			if (g_asyncSaves.size() > maxPending) {
+				save = oldest->BlockUntilReady();
+			} else if (!(save = oldest->Poll())) {
+				break;
+			}
+			delete oldest;
+			g_asyncSaves.pop_front();
+
+			if (g_asyncSaveBuffer.capacity() < save->data.capacity())
+				g_asyncSaveBuffer.swap(save->data);
+			if (save->callback) {
+				bool success = save->error == CChunkFileReader::ERROR_NONE;
+				save->callback(success ? Status::SUCCESS : Status::FAILURE, success ? save->successMessage : save->failureMessage, "");
+			}
+			delete save;
+		}
+	}
+
+	// Captures the state right away, which is mostly copying memory, and leaves compression and
+	// writing the file to a background task. The callback is called once that's collected.
+	static CChunkFileReader::Error SaveAsync(const Operation &op, const std::string &title, const std::string &successMessage, const std::string &failureMessage) {
+		// Don't let a burst of saves pile up buffers.
+		WaitForAsyncSaves(MAX_ASYNC_SAVES - 1);
+
+		AsyncSave *save = new AsyncSave();
+		save->data.swap(g_asyncSaveBuffer);
+
+		CChunkFileReader::Error result = SaveToRam(save->data);
+		if (result != CChunkFileReader::ERROR_NONE) {
+			g_asyncSaveBuffer.swap(save->data);
+			delete save;
+			return result;
+		}
+
+		save->callback = op.callback;
+		save->successMessage = successMessage;
+		save->failureMessage = failureMessage;
+		const Path path = op.path;
+		g_asyncSaves.push_back(Promise<AsyncSave *>::Spawn(&g_threadManager, [=]() {
+			save->error = CChunkFileReader::SaveFile(path, title, PPSSPP_GIT_VERSION, save->data.data(), save->data.size());
+			if (save->error != CChunkFileReader::ERROR_NONE)
+				ERROR_LOG(Log::SaveState, "Save state failure: unable to write '%s'", path.c_str());
+			return save;
+		}, TaskType::IO_BLOCKING));
+		return CChunkFileReader::ERROR_NONE;
+	}
+
 	void Enqueue(const SaveState::Operation &op) {
 		if (!NetworkAllowSaveState()) {
 			return;
@@ -797,6 +887,8 @@ int g_screenshotFailures;
 	// *must* not run further, in order not to disturb the current state operation.
 	void Process() {
 		rewindStates.Process();
+		// Take back the buffers of finished background saves.
+		WaitForAsyncSaves(MAX_ASYNC_SAVES);
 
 		if (!needsProcess)
 			return;
@@ -823,10 +915,14 @@ int g_screenshotFailures;
 
 			std::string slot_prefix = op.slot >= 0 ? StringFromFormat("(%d) ", op.slot + 1) : "";
 			std::string errorString;
+			// Set when a background save will call the callback.
+			bool callbackPending = false;
 
 			switch (op.type) {
 			case OperationType::Load:
 				INFO_LOG(Log::SaveState, "Loading state from '%s'", op.path.c_str());
+				// We might be loading a state that's still being written.
+				WaitForAsyncSaves(0);
 				// Use the state's latest version as a guess for saveStateInitialGitVersion.
 				result = CChunkFileReader::Load(op.path, &saveStateInitialGitVersion, state, &errorString);
 				if (result == CChunkFileReader::ERROR_NONE) {
@@ -872,7 +968,12 @@ int g_screenshotFailures;
 					std::size_t lslash = title.find_last_of('/');
 					title = title.substr(lslash + 1);
 				}
-				result = CChunkFileReader::Save(op.path, title, PPSSPP_GIT_VERSION, state);
+				if (g_Config.bSaveStatesInBackground) {
+					result = SaveAsync(op, title, slot_prefix + std::string(sc->T("Saved State")), i18nSaveFailure);
+					callbackPending = result == CChunkFileReader::ERROR_NONE;
+				} else {
+					result = CChunkFileReader::Save(op.path, title, PPSSPP_GIT_VERSION, state);
+				}
 				if (result == CChunkFileReader::ERROR_NONE) {
 					callbackMessage = slot_prefix + std::string(sc->T("Saved State"));
 					callbackResult = Status::SUCCESS;
@@ -943,7 +1044,7 @@ int g_screenshotFailures;
 				break;
 			}
 
-			if (op.callback) {
+			if (op.callback && !callbackPending) {
 				op.callback(callbackResult, callbackMessage, callbackMetadata);
 			}
 		}
@@ -983,8 +1084,14 @@ int g_screenshotFailures;
 	}
 
 	void Shutdown() {
+		// Make sure everything is on disk before we go.
+		WaitForAsyncSaves(0);
+
 		std::lock_guard<std::mutex> guard(mutex);
 		rewindStates.Clear();
+
+		g_asyncSaveBuffer.clear();
+		g_asyncSaveBuffer.shrink_to_fit();
 	}
 
 	double SecondsSinceLastSavestate() {
@@ -83,11 +83,23 @@ namespace SaveState {
 	void Load(const Path &filename, int slot, Callback callback = Callback());
 
 	// Save the current state to the specified file (async.)
-	// Warning: callback will be called on a different thread.
+	// With bSaveStatesInBackground, emulation continues while the file is written, and the
+	// callback is called once it's done. Either way, it's called on the emu thread.
 	void Save(const Path &filename, int slot, Callback callback = Callback());
 
-	CChunkFileReader::Error SaveToRam(std::vector<u8> &state);
-	CChunkFileReader::Error LoadFromRam(std::vector<u8> &state, std::string *errorString);
+	// Keeps RAM and VRAM out of an in-memory state, for callers that track memory themselves
+	// (the rewind buffer, run-ahead.) DoMemory is called in their place.
+	class StateMemory {
+	public:
+		virtual ~StateMemory() {}
+		virtual void DoMemory(PointerWrap &p) = 0;
+		// Speculative states are loaded back within the same host frame. Loading one keeps the jit
+		// and GPU caches, and saving one doesn't count as a new save state generation.
+		virtual bool IsSpeculative() const { return false; }
+	};
+
+	CChunkFileReader::Error SaveToRam(std::vector<u8> &state, StateMemory *memory = nullptr);
+	CChunkFileReader::Error LoadFromRam(std::vector<u8> &state, std::string *errorString, StateMemory *memory = nullptr);
 
 	// For testing / automated tests.  Runs a save state verification pass (async.)
 	// Warning: callback will be called on a different thread.
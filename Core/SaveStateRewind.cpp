@@ -1,3 +1,11 @@
+#include <algorithm>
+#include <cstring>
+
+#include <zstd.h>
+
+#include "Common/BitSet.h"
+#include "Common/Thread/ParallelLoop.h"
+#include "Common/Thread/ThreadManager.h"
 #include "Common/Thread/ThreadUtil.h"
 #include "Common/Data/Text/I18n.h"
 #include "Common/StringUtils.h"
@@ -5,9 +13,36 @@
 #include "Core/SaveStateRewind.h"
 #include "Core/Core.h"
 #include "Core/Config.h"
+#include "Core/MemDirty.h"
+#include "Core/MemMap.h"
+#include "Core/MIPS/MIPS.h"
+#include "Core/MIPS/JitCommon/JitBlockCache.h"
+#include "Core/MIPS/JitCommon/JitCommon.h"
 
 namespace SaveState {
 
+void CleanEmuHacks(u32 *words, u32 count, u32 address) {
+	JitBlockCacheDebugInterface *blocks = MIPSComp::jit ? MIPSComp::jit->GetBlockCacheDebugInterface() : nullptr;
+	for (u32 i = 0; i < count; ++i) {
+		if (!MIPS_IS_EMUHACK(words[i]))
+			continue;
+		const u32 addr = address + i * 4;
+		// Data can look like an emuhack too, so make sure there's really a block here.
+		if (MIPS_IS_RUNBLOCK(words[i]) && (!blocks || blocks->GetBlockNumberFromStartAddress(addr) < 0))
+			continue;
+		words[i] = Memory::Read_Instruction(addr, true).encoding;
+	}
+}
+
+StateRingbuffer::~StateRingbuffer() {
+	if (compressThread_.joinable()) {
+		compressThread_.join();
+	}
+	if (cctx_) {
+		ZSTD_freeCCtx(cctx_);
+	}
+}
+
 CChunkFileReader::Error StateRingbuffer::Save() {
 	rewindLastTime_ = time_now_d();
 
@@ -18,56 +53,82 @@ CChunkFileReader::Error StateRingbuffer::Save() {
 
 	std::lock_guard<std::mutex> guard(lock_);
 
-	int n = next_++ % size_;
-	if ((next_ % size_) == first_)
-		++first_;
-
-	std::vector<u8> *compressBuffer = &buffer_;
-	CChunkFileReader::Error err;
-
-	if (base_ == -1 || ++baseUsage_ > BASE_USAGE_INTERVAL)
-	{
-		base_ = (base_ + 1) % ARRAY_SIZE(bases_);
-		baseUsage_ = 0;
-		err = SaveToRam(bases_[base_]);
-		// Let's not bother savestating twice.
-		compressBuffer = &bases_[base_];
-	} else
-		err = SaveToRam(buffer_);
-
-	if (err == CChunkFileReader::ERROR_NONE) {
-		ScheduleCompress(&states_[n].stateBuffer, compressBuffer, &bases_[base_]);
-		states_[n].savedTime = time_now_d();
-	} else {
-		states_[n].clear();
+	if (untrackedSaves_ > 0)
+		--untrackedSaves_;
+	else if (tracker_ < 0 && Memory::DirtyTracking_Supported())
+		tracker_ = Memory::DirtyTracking_Start();
+	if (shadowRamSize_ != Memory::g_MemorySize) {
+		// Memory was resized, older states can't be reached anymore.
+		ClearLocked();
+		shadowRamSize_ = Memory::g_MemorySize;
+	}
+
+	const size_t budget = (size_t)std::max(g_Config.iRewindBufferSizeMB, 1) * 1024 * 1024;
+	while (states_.size() > 1 && usedBytes_ > budget) {
+		usedBytes_ -= states_.front().Bytes();
+		states_.pop_front();
+	}
+
+	double start_time = time_now_d();
+	undoBuffer_.clear();
+	CChunkFileReader::Error err = SaveToRam(buffer_, this);
+	if (err != CChunkFileReader::ERROR_NONE) {
+		// The shadow may be partially updated, so nothing older is valid now.
+		ClearLocked();
+		return err;
 	}
 
-	baseMapping_[n] = base_;
+	RewindState *previous = states_.empty() ? nullptr : &states_.back();
+	states_.emplace_back();
+	RewindState *newest = &states_.back();
+	newest->stateSize = buffer_.size();
+	newest->savedTime = time_now_d();
+	if (previous)
+		previous->undoSize = undoBuffer_.size();
+	count_ = (int)states_.size();
+
+	DEBUG_LOG(Log::SaveState, "Rewind: Saved state (%d bytes, %d bytes of changed memory) in %0.2f ms.", (int)buffer_.size(), (int)undoBuffer_.size(), (time_now_d() - start_time) * 1000.0);
+	ScheduleCompress(newest, previous);
 	return err;
 }
 
 CChunkFileReader::Error StateRingbuffer::Restore(std::string *errorString, std::string *metadata) {
+	if (compressThread_.joinable())
+		compressThread_.join();
+
 	std::lock_guard<std::mutex> guard(lock_);
 
 	// No valid states left.
-	if (Empty())
+	if (states_.empty())
 		return CChunkFileReader::ERROR_BAD_FILE;
 
-	int n = (--next_ + size_) % size_;
-	if (states_[n].empty())
-		return CChunkFileReader::ERROR_BAD_FILE;
+	if (g_Config.bRewindEveryFrame) {
+		// Single frames are too small a step to be useful.
+		const double target = states_.back().savedTime - EVERY_FRAME_RESTORE_STEP;
+		while (states_.size() > 1 && states_.back().savedTime > target)
+			PopNewest();
+	}
 
 	auto pa = GetI18NCategory(I18NCat::PAUSE);
 
+	const RewindState &s = states_.back();
+	const double savedTime = s.savedTime;
 	static std::vector<u8> buffer;
-	LockedDecompress(buffer, states_[n].stateBuffer, bases_[baseMapping_[n]]);
-	CChunkFileReader::Error error = LoadFromRam(buffer, errorString);
+	CChunkFileReader::Error error;
+	if (Decompress(buffer, s.state, s.stateSize)) {
+		error = LoadFromRam(buffer, errorString, this);
+	} else {
+		*errorString = "Failed to decompress rewind state";
+		error = CChunkFileReader::ERROR_BROKEN_STATE;
+	}
+	// Memory now matches the shadow, step it back to the previous state.
+	PopNewest();
 	*metadata = pa->T("Rewind");
 
-	if (states_[n].savedTime) {
+	if (savedTime) {
 		auto di = GetI18NCategory(I18NCat::DIALOG);
 		metadata->append(" (");
-		metadata->append(ApplySafeSubstitutions(di->T("%1 seconds ago"), static_cast<int>(time_now_d() - states_[n].savedTime)));
+		metadata->append(ApplySafeSubstitutions(di->T("%1 seconds ago"), static_cast<int>(time_now_d() - savedTime)));
 		metadata->append(")");
 	}
 
@@ -75,63 +136,228 @@ CChunkFileReader::Error StateRingbuffer::Restore(std::string *errorString, std::
 	return error;
 }
 
-void StateRingbuffer::ScheduleCompress(std::vector<u8> *result, const std::vector<u8> *state, const std::vector<u8> *base) {
+void StateRingbuffer::DoMemory(PointerWrap &p) {
+	switch (p.mode) {
+	case PointerWrap::MODE_WRITE:
+		CaptureMemory();
+		break;
+	case PointerWrap::MODE_READ:
+		if (!shadowValid_ || shadowRamSize_ != Memory::g_MemorySize) {
+			ERROR_LOG(Log::SaveState, "Rewind: No memory to restore");
+			p.SetError(PointerWrap::ERROR_FAILURE);
+			break;
+		}
+		RestoreMemory();
+		break;
+	default:
+		break;
+	}
+}
+
+void StateRingbuffer::CaptureMemory() {
+	const u32 ramSize = Memory::g_MemorySize;
+	const u32 ramPages = ramSize >> PAGE_SHIFT;
+	const u32 totalPages = ramPages + (Memory::VRAM_SIZE >> PAGE_SHIFT);
+	const size_t words = (totalPages + 63) / 64;
+
+	if (shadow_.size() != (size_t)totalPages * PAGE_SIZE || shadowRamSize_ != ramSize) {
+		shadow_.resize((size_t)totalPages * PAGE_SIZE);
+		shadowRamSize_ = ramSize;
+		shadowValid_ = false;
+	}
+
+	// The tracker only covers RAM. VRAM is small, so it's always compared.
+	if (tracker_ >= 0) {
+		Memory::DirtyTracking_Snapshot(tracker_, dirty_);
+		u32 trackedPages = 0;
+		for (u64 bits : dirty_)
+			trackedPages += CountSetBits(bits);
+		// A restore writes all of RAM, that doesn't say anything about the game.
+		if (shadowValid_ && !restoredMemory_ && trackedPages > TRACKED_PAGES_LIMIT) {
+			// Too many faults, comparing everything is cheaper for this game right now.
+			Memory::DirtyTracking_Stop(tracker_);
+			tracker_ = -1;
+			untrackedSaves_ = UNTRACKED_SAVES_BEFORE_RETRY;
+		}
+	} else {
+		dirty_.clear();
+	}
+	dirty_.resize(words, ~0ULL);
+	for (size_t w = ramPages / 64; w < words; ++w)
+		dirty_[w] = ~0ULL;
+	if (!shadowValid_) {
+		std::fill(dirty_.begin(), dirty_.end(), ~0ULL);
+	} else if (forceDirty_.size() == words) {
+		for (size_t w = 0; w < words; ++w)
+			dirty_[w] |= forceDirty_[w];
+	}
+	forceDirty_.assign(words, 0);
+	restoredMemory_ = false;
+
+	auto pagePointer = [=](u32 index) {
+		if (index < ramPages)
+			return Memory::GetPointerUnchecked(PSP_GetKernelMemoryBase() + (index << PAGE_SHIFT));
+		return Memory::GetPointerUnchecked(PSP_GetVidMemBase() + ((index - ramPages) << PAGE_SHIFT));
+	};
+
+	if (shadowValid_) {
+		// Drop the pages that are unchanged. This is the bulk of the work when not tracking, so split it up.
+		ParallelRangeLoop(&g_threadManager, [&](int l, int h) {
+			for (int w = l; w < h; ++w) {
+				u64 bits = dirty_[w];
+				while (bits) {
+					const int bit = LeastSignificantSetBit(bits);
+					bits &= bits - 1;
+					const u32 index = (u32)(w * 64 + bit);
+					if (index >= totalPages || memcmp(pagePointer(index), &shadow_[(size_t)index << PAGE_SHIFT], PAGE_SIZE) == 0)
+						dirty_[w] &= ~(1ULL << bit);
+				}
+			}
+		}, 0, (int)words, 16);
+	}
+
+	// Only record undo pages if there's an older state to go back to.
+	const bool recordUndo = shadowValid_ && !states_.empty();
+	std::lock_guard<std::recursive_mutex> guard(MIPSComp::jitLock);
+	u32 page[PAGE_SIZE / 4];
+	for (size_t w = 0; w < words; ++w) {
+		u64 bits = dirty_[w];
+		while (bits) {
+			const u32 index = (u32)(w * 64 + LeastSignificantSetBit(bits));
+			bits &= bits - 1;
+			if (index >= totalPages)
+				break;
+
+			u8 *dst = &shadow_[(size_t)index << PAGE_SHIFT];
+			memcpy(page, pagePointer(index), PAGE_SIZE);
+			// The raw page may differ only by emuhacks.
+			if (index < ramPages)
+				CleanEmuHacks(page, PAGE_SIZE / 4, PSP_GetKernelMemoryBase() + (index << PAGE_SHIFT));
+			if (shadowValid_ && memcmp(page, dst, PAGE_SIZE) == 0)
+				continue;
+
+			if (recordUndo) {
+				size_t pos = undoBuffer_.size();
+				undoBuffer_.resize(pos + sizeof(u32) + PAGE_SIZE);
+				memcpy(&undoBuffer_[pos], &index, sizeof(u32));
+				memcpy(&undoBuffer_[pos + sizeof(u32)], dst, PAGE_SIZE);
+			}
+			memcpy(dst, page, PAGE_SIZE);
+		}
+	}
+	shadowValid_ = true;
+}
+
+void StateRingbuffer::RestoreMemory() {
+	const u32 ramSize = shadowRamSize_;
+	u8 *ram = Memory::GetPointerWriteUnchecked(PSP_GetKernelMemoryBase());
+	// Unprotect everything at once, rather than taking a fault per page.
+	Memory::DirtyTracking_MarkHostWrite(ram, ramSize);
+	restoredMemory_ = true;
+	ParallelMemcpy(&g_threadManager, ram, shadow_.data(), ramSize);
+	memcpy(Memory::GetPointerWriteUnchecked(PSP_GetVidMemBase()), shadow_.data() + ramSize, Memory::VRAM_SIZE);
+}
+
+void StateRingbuffer::PopNewest() {
+	usedBytes_ -= states_.back().Bytes();
+	states_.pop_back();
+	count_ = (int)states_.size();
+	if (states_.empty()) {
+		shadowValid_ = false;
+		return;
+	}
+
+	RewindState &s = states_.back();
+	if (s.undoSize != 0) {
+		if (!Decompress(undoBuffer_, s.undo, s.undoSize)) {
+			ERROR_LOG(Log::SaveState, "Rewind: Failed to decompress memory, dropping older states");
+			ClearLocked();
+			return;
+		}
+
+		const size_t words = (shadow_.size() / PAGE_SIZE + 63) / 64;
+		if (forceDirty_.size() != words)
+			forceDirty_.assign(words, 0);
+		for (size_t pos = 0; pos + sizeof(u32) + PAGE_SIZE <= undoBuffer_.size(); pos += sizeof(u32) + PAGE_SIZE) {
+			u32 index;
+			memcpy(&index, &undoBuffer_[pos], sizeof(u32));
+			if (((size_t)index + 1) * PAGE_SIZE > shadow_.size())
+				continue;
+			memcpy(&shadow_[(size_t)index << PAGE_SHIFT], &undoBuffer_[pos + sizeof(u32)], PAGE_SIZE);
+			// Memory still has the newer contents here, so the next save must look at it.
+			forceDirty_[index / 64] |= 1ULL << (index & 63);
+		}
+	}
+
+	usedBytes_ -= s.undo.size();
+	s.undo.clear();
+	s.undo.shrink_to_fit();
+	s.undoSize = 0;
+}
+
+void StateRingbuffer::ScheduleCompress(RewindState *newest, RewindState *previous) {
 	if (compressThread_.joinable())
 		compressThread_.join();
 	compressThread_ = std::thread([=] {
 		SetCurrentThreadName("SaveStateCompress");
 
 		// Should do no I/O, so no JNI thread context needed.
-		Compress(*result, *state, *base);
+		double start_time = time_now_d();
+		StateBuffer state, undo;
+		Compress(state, buffer_);
+		if (previous && !undoBuffer_.empty())
+			Compress(undo, undoBuffer_);
+
+		std::lock_guard<std::mutex> guard(lock_);
+		// Bail if we were cleared before locking.
+		if (states_.empty() || newest != &states_.back())
+			return;
+		newest->state = std::move(state);
+		usedBytes_ += newest->state.size();
+		if (previous) {
+			previous->undo = std::move(undo);
+			usedBytes_ += previous->undo.size();
+		}
+
+		double taken_s = time_now_d() - start_time;
+		DEBUG_LOG(Log::SaveState, "Rewind: Compressed save to %d bytes (%d total) in %0.2f ms.", (int)(newest->Bytes() + (previous ? previous->Bytes() : 0)), (int)usedBytes_, taken_s * 1000.0);
 	});
 }
 
-void StateRingbuffer::Compress(std::vector<u8> &result, const std::vector<u8> &state, const std::vector<u8> &base) {
-	std::lock_guard<std::mutex> guard(lock_);
-	// Bail if we were cleared before locking.
-	if (first_ == 0 && next_ == 0)
-		return;
-
-	double start_time = time_now_d();
-	result.clear();
-	result.reserve(512 * 1024);
-	for (size_t i = 0; i < state.size(); i += BLOCK_SIZE)
-	{
-		int blockSize = std::min(BLOCK_SIZE, (int)(state.size() - i));
-		if (i + blockSize > base.size() || memcmp(&state[i], &base[i], blockSize) != 0) {
-			result.push_back(1);
-			result.insert(result.end(), state.begin() + i, state.begin() + i + blockSize);
-		} else {
-			result.push_back(0);
-		}
+void StateRingbuffer::Compress(StateBuffer &result, const StateBuffer &data) {
+	if (!cctx_) {
+		cctx_ = ZSTD_createCCtx();
+		// Speed matters more than ratio here, most of the saving is from only keeping changed pages.
+		ZSTD_CCtx_setParameter(cctx_, ZSTD_c_compressionLevel, 1);
 	}
 
-	double taken_s = time_now_d() - start_time;
-	DEBUG_LOG(Log::SaveState, "Rewind: Compressed save from %d bytes to %d in %0.2f ms.", (int)state.size(), (int)result.size(), taken_s * 1000.0);
-}
-
-void StateRingbuffer::LockedDecompress(std::vector<u8> &result, const std::vector<u8> &compressed, const std::vector<u8> &base) {
-	result.clear();
-	result.reserve(base.size());
-	auto basePos = base.begin();
-	for (size_t i = 0; i < compressed.size(); ) {
-		if (compressed[i] == 0) {
-			++i;
-			int blockSize = std::min(BLOCK_SIZE, (int)(base.size() - result.size()));
-			result.insert(result.end(), basePos, basePos + blockSize);
-			basePos += blockSize;
-		} else {
-			++i;
-			int blockSize = std::min(BLOCK_SIZE, (int)(compressed.size() - i));
-			result.insert(result.end(), compressed.begin() + i, compressed.begin() + i + blockSize);
-			i += blockSize;
-			// This check is to avoid advancing basePos out of range, which MSVC catches.
-			// When this happens, we're at the end of decoding anyway.
-			if (base.end() - basePos >= blockSize) {
-				basePos += blockSize;
-			}
-		}
+	result.resize(ZSTD_compressBound(data.size()));
+	size_t size = ZSTD_compress2(cctx_, result.data(), result.size(), data.data(), data.size());
+	if (ZSTD_isError(size)) {
+		ERROR_LOG(Log::SaveState, "Rewind: Compression failed: %s", ZSTD_getErrorName(size));
+		result.clear();
+		return;
 	}
+	result.resize(size);
+	result.shrink_to_fit();
+}
+
+bool StateRingbuffer::Decompress(StateBuffer &result, const StateBuffer &compressed, size_t size) {
+	if (compressed.empty())
+		return false;
+	result.resize(size);
+	size_t status = ZSTD_decompress(result.data(), size, compressed.data(), compressed.size());
+	return !ZSTD_isError(status) && status == size;
+}
+
+void StateRingbuffer::ClearLocked() {
+	states_.clear();
+	count_ = 0;
+	usedBytes_ = 0;
+	buffer_.clear();
+	undoBuffer_.clear();
+	shadowValid_ = false;
+	forceDirty_.clear();
 }
 
 void StateRingbuffer::Clear() {
@@ -140,24 +366,22 @@ void StateRingbuffer::Clear() {
 
 	// This lock is mainly for shutdown.
 	std::lock_guard<std::mutex> guard(lock_);
-	first_ = 0;
-	next_ = 0;
-	for (auto &b : bases_) {
-		b.clear();
+	ClearLocked();
+	StateBuffer().swap(shadow_);
+	shadowRamSize_ = 0;
+	untrackedSaves_ = 0;
+	if (tracker_ >= 0) {
+		Memory::DirtyTracking_Stop(tracker_);
+		tracker_ = -1;
 	}
-	baseMapping_.clear();
-	baseMapping_.resize(size_);
-	for (auto &s : states_) {
-		s.clear();
-	}
-	buffer_.clear();
-	base_ = -1;
-	baseUsage_ = 0;
 	rewindLastTime_ = time_now_d();
 }
 
 void StateRingbuffer::Process() {
 	if (g_Config.iRewindSnapshotInterval <= 0) {
+		// If rewind was turned off, stop tracking and free the memory.
+		if (tracker_ >= 0 || !shadow_.empty())
+			Clear();
 		return;
 	}
 	if (coreState != CORE_RUNNING_CPU) {
@@ -167,7 +391,7 @@ void StateRingbuffer::Process() {
 	// For fast-forwarding, otherwise they may be useless and too close.
 	double now = time_now_d();
 	double diff = now - rewindLastTime_;
-	if (diff < g_Config.iRewindSnapshotInterval)
+	if (!g_Config.bRewindEveryFrame && diff < g_Config.iRewindSnapshotInterval)
 		return;
 
 	DEBUG_LOG(Log::SaveState, "Saving rewind state");
@@ -1,41 +1,40 @@
 #pragma once
 
+#include <atomic>
+#include <deque>
 #include <mutex>
 #include <thread>
 #include "Common/Serialize/Serializer.h"
 #include "Common/CommonTypes.h"
 #include "Common/TimeUtil.h"
+#include "Core/SaveState.h"
+
+struct ZSTD_CCtx_s;
 
 namespace SaveState {
 
+// Replaces jit and replacement emuhacks in a copied page of RAM with the original ops,
+// same as SaveAndClearEmuHackOps would, but without writing to RAM. Call with the jitLock held.
+void CleanEmuHacks(u32 *words, u32 count, u32 address);
+
 // This ring buffer of states is for rewind save states, which are kept in RAM.
-// Save states are compressed against one of two reference saves (bases_), and the reference
-// is switched to a fresh save every N saves, where N is BASE_USAGE_INTERVAL.
-// The compression is a simple block based scheme where 0 means to copy a block from the base,
-// and 1 means that the following bytes are the next block. See Compress/LockedDecompress.
-class StateRingbuffer {
+// RAM and VRAM are kept out of the serialized states. Instead, shadow_ holds memory as of the
+// newest state, and every older state holds an undo record: the pages that changed before the
+// next state, with their old contents. Restoring pops the newest state and applies the undo
+// record of the one before it to the shadow, so older states are reached one step at a time.
+// Changed pages are found with host dirty page tracking where supported (see MemDirty.h),
+// and states and undo records are zstd compressed on a thread, within a memory budget.
+class StateRingbuffer : public StateMemory {
 public:
-	StateRingbuffer() {
-		size_ = REWIND_NUM_STATES;
-		states_.resize(size_);
-		baseMapping_.resize(size_);
-	}
-
-	~StateRingbuffer() {
-		if (compressThread_.joinable()) {
-			compressThread_.join();
-		}
-	}
+	StateRingbuffer() {}
+	~StateRingbuffer();
 
 	CChunkFileReader::Error Save();
 	CChunkFileReader::Error Restore(std::string *errorString, std::string *metadata);
-	void ScheduleCompress(std::vector<u8> *result, const std::vector<u8> *state, const std::vector<u8> *base);
-	void Compress(std::vector<u8> &result, const std::vector<u8> &state, const std::vector<u8> &base);
-	void LockedDecompress(std::vector<u8> &result, const std::vector<u8> &compressed, const std::vector<u8> &base);
 	void Clear();
 
 	bool Empty() const {
-		return next_ == first_;
+		return count_ == 0;
 	}
 
 	void Process();
@@ -43,35 +42,60 @@ class StateRingbuffer {
 
 	double NextStateTimestamp() const;
 
+	// Called from the savestate code, in place of serializing RAM and VRAM.
+	void DoMemory(PointerWrap &p) override;
+
 private:
-	const int BLOCK_SIZE = 8192;
-	const int REWIND_NUM_STATES = 20;
-	// TODO: Instead, based on size of compressed state?
-	const int BASE_USAGE_INTERVAL = 15;
+	static const int PAGE_SHIFT = 12;
+	static const u32 PAGE_SIZE = 1 << PAGE_SHIFT;
+	// With snapshots every frame, each restore goes back at least this far.
+	static constexpr double EVERY_FRAME_RESTORE_STEP = 1.0;
+	// Write-watch costs a fault and a few mprotects per page, while comparing all of memory
+	// costs a few ms. Above this many written pages per save, we compare for a while instead.
+	static const u32 TRACKED_PAGES_LIMIT = 128;
+	static const int UNTRACKED_SAVES_BEFORE_RETRY = 600;
 
 	typedef std::vector<u8> StateBuffer;
 
 	struct RewindState {
-		StateBuffer stateBuffer;
-		double savedTime;
-
-		bool empty() const { return stateBuffer.empty(); }
-		void clear() { stateBuffer.clear(); savedTime = 0.0; }
+		StateBuffer state;
+		size_t stateSize = 0;
+		// Empty for the newest state.
+		StateBuffer undo;
+		size_t undoSize = 0;
+		double savedTime = 0.0;
+
+		size_t Bytes() const { return state.size() + undo.size(); }
 	};
 
-	int first_ = 0;
-	int next_ = 0;
-	int size_;
+	void ClearLocked();
+	void CaptureMemory();
+	void RestoreMemory();
+	void PopNewest();
+	void ScheduleCompress(RewindState *newest, RewindState *previous);
+	void Compress(StateBuffer &result, const StateBuffer &data);
+	bool Decompress(StateBuffer &result, const StateBuffer &compressed, size_t size);
+
+	std::deque<RewindState> states_;
+	std::atomic<int> count_{};
+	size_t usedBytes_ = 0;
 
-	std::vector<RewindState> states_;
-	StateBuffer bases_[2];
-	std::vector<int> baseMapping_;
 	std::mutex lock_;
 	std::thread compressThread_;
-	std::vector<u8> buffer_;
-
-	int base_ = -1;
-	int baseUsage_ = 0;
+	ZSTD_CCtx_s *cctx_ = nullptr;
+	StateBuffer buffer_;
+	StateBuffer undoBuffer_;
+
+	// RAM followed by VRAM, as of the newest state.
+	StateBuffer shadow_;
+	bool shadowValid_ = false;
+	u32 shadowRamSize_ = 0;
+	// Pages that differ between shadow_ and memory regardless of what the tracker says.
+	std::vector<u64> forceDirty_;
+	std::vector<u64> dirty_;
+	int tracker_ = -1;
+	int untrackedSaves_ = 0;
+	bool restoredMemory_ = false;
 
 	double rewindLastTime_ = 0.0f;
 };
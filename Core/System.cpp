@@ -43,11 +43,13 @@
 #include "Common/TimeUtil.h"
 #include "Common/Thread/ThreadUtil.h"
 #include "Common/GraphicsContext.h"
+#include "Core/MemDirty.h"
 #include "Core/MemFault.h"
 #include "Core/HDRemaster.h"
 #include "Core/MIPS/MIPS.h"
 #include "Core/MIPS/MIPSAnalyst.h"
 #include "Core/MIPS/MIPSVFPUUtils.h"
+#include "Core/MIPS/IR/IRDiskCache.h"
 #include "Core/Debugger/SymbolMap.h"
 #include "Core/System.h"
 #include "Core/HLE/HLE.h"
@@ -61,6 +63,8 @@
 #include "Core/Util/PathUtil.h"
 #include "Core/CoreTiming.h"
 #include "Core/CoreParameter.h"
+#include "Core/FileLoaders/LocalFileLoader.h"
+#include "Core/FileLoaders/PrefetchingFileLoader.h"
 #include "Core/FileLoaders/RamCachingFileLoader.h"
 #include "Core/LuaContext.h"
 #include "Core/FileSystems/MetaFileSystem.h"
@@ -295,6 +299,15 @@ static bool CPU_Init(FileLoader *fileLoader, IdentifiedFileType type, std::strin
 	case IdentifiedFileType::PSP_ISO:
 	case IdentifiedFileType::PSP_ISO_NP:
 	case IdentifiedFileType::PSP_DISC_DIRECTORY:
+	{
+		// Learn and replay the read order of the disc. Not for headless, which is mostly used for tests,
+		// or remote images, where reading ahead would compete with the game for the connection.
+		PrefetchingFileLoader *prefetcher = nullptr;
+		if (type != IdentifiedFileType::PSP_DISC_DIRECTORY && g_Config.bDiscReadaheadProfile && !g_CoreParameter.headLess && !fileLoader->IsRemote()) {
+			prefetcher = new PrefetchingFileLoader(fileLoader);
+			fileLoader = prefetcher;
+		}
+
 		// Doesn't seem to take ownership of fileLoader?
 		if (!MountGameISO(fileLoader, errorString)) {
 			*errorString = "Failed to mount ISO file: " + *errorString;
@@ -302,6 +315,9 @@ static bool CPU_Init(FileLoader *fileLoader, IdentifiedFileType type, std::strin
 		}
 		if (LoadParamSFOFromDisc()) {
 			InitMemorySizeForGame();
+			if (prefetcher) {
+				prefetcher->Start(g_paramSFO.GetDiscID());
+			}
 		}
 
 		if (type == IdentifiedFileType::PSP_ISO_NP && ((DumpFileType)g_Config.iDumpFileTypes & DumpFileType::PBP_ISO)) {
@@ -327,6 +343,7 @@ static bool CPU_Init(FileLoader *fileLoader, IdentifiedFileType type, std::strin
 			}
 		}
 		break;
+	}
 	case IdentifiedFileType::PSP_PBP:
 	case IdentifiedFileType::PSP_PBP_DIRECTORY:
 		// This is normal for homebrew.
@@ -433,6 +450,7 @@ static bool CPU_Init(FileLoader *fileLoader, IdentifiedFileType type, std::strin
 
 	LoadSymbolsIfSupported();
 
+	MIPSComp::g_irDiskCache.Init(discId);
 	mipsr4k.Reset();
 
 	CoreTiming::Init();
@@ -523,6 +541,8 @@ static bool CPU_Init(FileLoader *fileLoader, IdentifiedFileType type, std::strin
 }
 
 void CPU_Shutdown(bool success) {
+	// Must be unprotected before the fault handler goes away.
+	Memory::DirtyTracking_Suspend();
 	UninstallExceptionHandler();
 
 	GPURecord::Replay_Unload();
@@ -541,6 +561,7 @@ void CPU_Shutdown(bool success) {
 
 	pspFileSystem.Shutdown();
 	mipsr4k.Shutdown();
+	MIPSComp::g_irDiskCache.Shutdown();
 	Memory::Shutdown();
 	HLEPlugins::Shutdown();
 
@@ -638,12 +659,23 @@ bool PSP_InitStart(const CoreParameter &coreParam) {
 		IdentifiedFileType fileType;
 		FileLoader *loadedFile = ResolveFileLoaderTarget(ConstructFileLoader(filename), &fileType, errorString);
 
+		const bool cacheFullIso = g_Config.bCacheFullIsoInRam && System_GetPropertyBool(SYSPROP_ENOUGH_RAM_FOR_FULL_ISO);
+		bool mappedWholeIso = false;
+		if (g_Config.bMemoryMapDiscImages && (fileType == IdentifiedFileType::PSP_ISO || fileType == IdentifiedFileType::PSP_ISO_NP)) {
+			// When mapped, "cache in RAM" just means faulting in the page cache, no need for our own copy.
+			LocalFileLoader *localFile = dynamic_cast<LocalFileLoader *>(loadedFile);
+			if (localFile && localFile->MapIntoMemory(cacheFullIso)) {
+				mappedWholeIso = cacheFullIso;
+			}
+		}
+
 		if (System_GetPropertyBool(SYSPROP_ENOUGH_RAM_FOR_FULL_ISO)) {
 			if (g_Config.bCacheFullIsoInRam) {
 				switch (fileType) {
 				case IdentifiedFileType::PSP_ISO:
 				case IdentifiedFileType::PSP_ISO_NP:
-					loadedFile = new RamCachingFileLoader(loadedFile);
+					if (!mappedWholeIso)
+						loadedFile = new RamCachingFileLoader(loadedFile);
 					break;
 				default:
 					INFO_LOG(Log::Loader, "RAM caching is on, but file is not an ISO, so ignoring");
@@ -17,6 +17,7 @@
 
 #include <cstring>
 
+#include "Common/BitScan.h"
 #include "Common/Log.h"
 #include "Common/Serialize/Serializer.h"
 #include "Common/Serialize/SerializeFuncs.h"
@@ -25,7 +26,13 @@
 #include "Core/Util/BlockAllocator.h"
 #include "Core/Reporting.h"
 
-// Slow freaking thing but works (eventually) :)
+// Blocks form an address ordered list, which is also what gets saved.  The list is
+// indexed by address, and free blocks are kept in size bins, so allocations find the
+// same block a front-to-back (or back-to-front) walk would, without the walk.
+
+static inline int FreeBinForSize(u32 size) {
+	return size == 0 ? 0 : 31 - (int)clz32_nonzero(size);
+}
 
 BlockAllocator::~BlockAllocator()
 {
@@ -39,6 +46,8 @@ void BlockAllocator::Init(u32 rangeStart, u32 rangeSize, bool suballoc) {
 	//Initial block, covering everything
 	top_ = new Block(rangeStart_, rangeSize_, false, NULL, NULL);
 	bottom_ = top_;
+	blocks_[top_->start] = top_;
+	AddFree(top_);
 	suballoc_ = suballoc;
 }
 
@@ -51,6 +60,9 @@ void BlockAllocator::Shutdown()
 		bottom_ = next;
 	}
 	top_ = NULL;
+	blocks_.clear();
+	for (auto &bin : freeBins_)
+		bin.clear();
 }
 
 u32 BlockAllocator::AllocAligned(u32 &size, u32 sizeGrain, u32 grain, bool fromTop, const char *tag)
@@ -73,62 +85,60 @@ u32 BlockAllocator::AllocAligned(u32 &size, u32 sizeGrain, u32 grain, bool fromT
 	if (!fromTop)
 	{
 		//Allocate from bottom of mem
-		for (Block *bp = bottom_; bp != NULL; bp = bp->next)
+		Block *bp = FindFreeBlock(size, grain, false);
+		if (bp != NULL)
 		{
 			Block &b = *bp;
 			u32 offset = b.start % grain;
 			if (offset != 0)
 				offset = grain - offset;
 			u32 needed = offset + size;
-			if (b.taken == false && b.size >= needed)
+			RemoveFree(bp);
+			if (b.size == needed)
 			{
-				if (b.size == needed)
-				{
-					if (offset >= grain_)
-						InsertFreeBefore(&b, offset);
-					b.taken = true;
-					b.SetAllocated(tag, suballoc_);
-					return b.start;
-				}
-				else
-				{
-					InsertFreeAfter(&b, b.size - needed);
-					if (offset >= grain_)
-						InsertFreeBefore(&b, offset);
-					b.taken = true;
-					b.SetAllocated(tag, suballoc_);
-					return b.start;
-				}
+				if (offset >= grain_)
+					InsertFreeBefore(&b, offset);
+				b.taken = true;
+				b.SetAllocated(tag, suballoc_);
+				return b.start;
+			}
+			else
+			{
+				InsertFreeAfter(&b, b.size - needed);
+				if (offset >= grain_)
+					InsertFreeBefore(&b, offset);
+				b.taken = true;
+				b.SetAllocated(tag, suballoc_);
+				return b.start;
 			}
 		}
 	}
 	else
 	{
 		// Allocate from top of mem.
-		for (Block *bp = top_; bp != NULL; bp = bp->prev)
+		Block *bp = FindFreeBlock(size, grain, true);
+		if (bp != NULL)
 		{
 			Block &b = *bp;
 			u32 offset = (b.start + b.size - size) % grain;
 			u32 needed = offset + size;
-			if (b.taken == false && b.size >= needed)
+			RemoveFree(bp);
+			if (b.size == needed)
 			{
-				if (b.size == needed)
-				{
-					if (offset >= grain_)
-						InsertFreeAfter(&b, offset);
-					b.taken = true;
-					b.SetAllocated(tag, suballoc_);
-					return b.start;
-				}
-				else
-				{
-					InsertFreeBefore(&b, b.size - needed);
-					if (offset >= grain_)
-						InsertFreeAfter(&b, offset);
-					b.taken = true;
-					b.SetAllocated(tag, suballoc_);
-					return b.start;
-				}
+				if (offset >= grain_)
+					InsertFreeAfter(&b, offset);
+				b.taken = true;
+				b.SetAllocated(tag, suballoc_);
+				return b.start;
+			}
+			else
+			{
+				InsertFreeBefore(&b, b.size - needed);
+				if (offset >= grain_)
+					InsertFreeAfter(&b, offset);
+				b.taken = true;
+				b.SetAllocated(tag, suballoc_);
+				return b.start;
 			}
 		}
 	}
@@ -189,6 +199,7 @@ u32 BlockAllocator::AllocAt(u32 position, u32 size, const char *tag)
 			//good to go
 			else if (b.start == alignedPosition)
 			{
+				RemoveFree(bp);
 				if (b.size != alignedSize)
 					InsertFreeAfter(&b, b.size - alignedSize);
 				b.taken = true;
@@ -198,6 +209,7 @@ u32 BlockAllocator::AllocAt(u32 position, u32 size, const char *tag)
 			}
 			else
 			{
+				RemoveFree(bp);
 				InsertFreeBefore(&b, alignedPosition - b.start);
 				if (b.size > alignedSize)
 					InsertFreeAfter(&b, b.size - alignedSize);
@@ -228,6 +240,8 @@ void BlockAllocator::MergeFreeBlocks(Block *fromBlock)
 	while (prev != NULL && prev->taken == false)
 	{
 		VERBOSE_LOG(Log::sceKernel, "Block Alloc found adjacent free blocks - merging");
+		RemoveFree(prev);
+		blocks_.erase(fromBlock->start);
 		prev->size += fromBlock->size;
 		if (fromBlock->next == NULL)
 			top_ = prev;
@@ -248,6 +262,8 @@ void BlockAllocator::MergeFreeBlocks(Block *fromBlock)
 	while (next != NULL && next->taken == false)
 	{
 		VERBOSE_LOG(Log::sceKernel, "Block Alloc found adjacent free blocks - merging");
+		RemoveFree(next);
+		blocks_.erase(next->start);
 		fromBlock->size += next->size;
 		fromBlock->next = next->next;
 		delete next;
@@ -258,6 +274,86 @@ void BlockAllocator::MergeFreeBlocks(Block *fromBlock)
 		top_ = fromBlock;
 	else
 		next->prev = fromBlock;
+
+	AddFree(fromBlock);
+}
+
+BlockAllocator::Block *BlockAllocator::FindFreeBlock(u32 size, u32 grain, bool fromTop) const
+{
+	// Alignment wastes less than a grain, so blocks at least this big always fit.
+	const u64 sureFit = (u64)size + grain - 1;
+	const int firstBin = FreeBinForSize(size);
+
+	Block *best = NULL;
+	auto isBetter = [&](const Block *b) {
+		return best == NULL || (fromTop ? b->start > best->start : b->start < best->start);
+	};
+
+	// Bins where everything fits only need their lowest (or highest) block checked.
+	for (int i = firstBin; i < NUM_FREE_BINS; ++i) {
+		const BlockMap &bin = freeBins_[i];
+		if (bin.empty() || (1ULL << i) < sureFit)
+			continue;
+		Block *b = fromTop ? bin.rbegin()->second : bin.begin()->second;
+		if (isBetter(b))
+			best = b;
+	}
+
+	// The rest have to be scanned, but only up to the best block so far.
+	auto fits = [&](const Block *b) {
+		u32 offset;
+		if (fromTop) {
+			offset = (b->start + b->size - size) % grain;
+		} else {
+			offset = b->start % grain;
+			if (offset != 0)
+				offset = grain - offset;
+		}
+		return b->size >= offset + size;
+	};
+	for (int i = firstBin; i < NUM_FREE_BINS && (1ULL << i) < sureFit; ++i) {
+		const BlockMap &bin = freeBins_[i];
+		if (fromTop) {
+			for (auto it = bin.rbegin(); it != bin.rend() && isBetter(it->second); ++it) {
+				if (fits(it->second)) {
+					best = it->second;
+					break;
+				}
+			}
+		} else {
+			for (auto it = bin.begin(); it != bin.end() && isBetter(it->second); ++it) {
+				if (fits(it->second)) {
+					best = it->second;
+					break;
+				}
+			}
+		}
+	}
+
+	return best;
+}
+
+void BlockAllocator::AddFree(Block *b)
+{
+	freeBins_[FreeBinForSize(b->size)][b->start] = b;
+}
+
+void BlockAllocator::RemoveFree(Block *b)
+{
+	freeBins_[FreeBinForSize(b->size)].erase(b->start);
+}
+
+void BlockAllocator::RebuildIndex()
+{
+	blocks_.clear();
+	for (auto &bin : freeBins_)
+		bin.clear();
+	for (Block *bp = bottom_; bp != NULL; bp = bp->next)
+	{
+		blocks_[bp->start] = bp;
+		if (!bp->taken)
+			AddFree(bp);
+	}
 }
 
 bool BlockAllocator::Free(u32 position)
@@ -305,6 +401,9 @@ BlockAllocator::Block *BlockAllocator::InsertFreeBefore(Block *b, u32 size)
 
 	b->start += size;
 	b->size -= size;
+	blocks_[inserted->start] = inserted;
+	blocks_[b->start] = b;
+	AddFree(inserted);
 	return inserted;
 }
 
@@ -318,11 +417,14 @@ BlockAllocator::Block *BlockAllocator::InsertFreeAfter(Block *b, u32 size)
 		inserted->next->prev = inserted;
 
 	b->size -= size;
+	blocks_[inserted->start] = inserted;
+	AddFree(inserted);
 	return inserted;
 }
 
 void BlockAllocator::CheckBlocks() const
 {
+#ifdef _DEBUG
 	for (const Block *bp = bottom_; bp != NULL; bp = bp->next)
 	{
 		const Block &b = *bp;
@@ -334,6 +436,7 @@ void BlockAllocator::CheckBlocks() const
 			ERROR_LOG_REPORT(Log::HLE, "Bogus block in allocator");
 		}
 	}
+#endif
 }
 
 const char *BlockAllocator::GetBlockTag(u32 addr) const {
@@ -341,31 +444,21 @@ const char *BlockAllocator::GetBlockTag(u32 addr) const {
 	return b->tag;
 }
 
-inline BlockAllocator::Block *BlockAllocator::GetBlockFromAddress(u32 addr)
+BlockAllocator::Block *BlockAllocator::GetBlockFromAddress(u32 addr)
 {
-	for (Block *bp = bottom_; bp != NULL; bp = bp->next)
-	{
-		Block &b = *bp;
-		if (b.start <= addr && b.start + b.size > addr)
-		{
-			// Got one!
-			return bp;
-		}
-	}
-	return NULL;
+	return const_cast<Block *>(const_cast<const BlockAllocator *>(this)->GetBlockFromAddress(addr));
 }
 
 const BlockAllocator::Block *BlockAllocator::GetBlockFromAddress(u32 addr) const
 {
-	for (const Block *bp = bottom_; bp != NULL; bp = bp->next)
-	{
-		const Block &b = *bp;
-		if (b.start <= addr && b.start + b.size > addr)
-		{
-			// Got one!
-			return bp;
-		}
-	}
+	// The last block starting at or before addr is the only one that can contain it.
+	auto it = blocks_.upper_bound(addr);
+	if (it == blocks_.begin())
+		return NULL;
+	--it;
+	const Block *b = it->second;
+	if (b->start <= addr && b->start + b->size > addr)
+		return b;
 	return NULL;
 }
 
@@ -389,6 +482,10 @@ u32 BlockAllocator::GetBlockSizeFromAddress(u32 addr) const
 
 void BlockAllocator::ListBlocks() const
 {
+	// Failed allocations call this, don't walk everything just to log nothing.
+	if (!GenericLogEnabled(Log::sceKernel, LogLevel::LDEBUG))
+		return;
+
 	DEBUG_LOG(Log::sceKernel,"-----------");
 	for (const Block *bp = bottom_; bp != NULL; bp = bp->next)
 	{
@@ -401,13 +498,13 @@ void BlockAllocator::ListBlocks() const
 u32 BlockAllocator::GetLargestFreeBlockSize() const
 {
 	u32 maxFreeBlock = 0;
-	for (const Block *bp = bottom_; bp != NULL; bp = bp->next)
+	// Only the largest non-empty bin can hold the largest block.
+	for (int i = NUM_FREE_BINS - 1; i >= 0 && maxFreeBlock == 0; --i)
 	{
-		const Block &b = *bp;
-		if (!b.taken)
+		for (const auto &it : freeBins_[i])
 		{
-			if (b.size > maxFreeBlock)
-				maxFreeBlock = b.size;
+			if (it.second->size > maxFreeBlock)
+				maxFreeBlock = it.second->size;
 		}
 	}
 	if (maxFreeBlock & (grain_ - 1))
@@ -418,13 +515,10 @@ u32 BlockAllocator::GetLargestFreeBlockSize() const
 u32 BlockAllocator::GetTotalFreeBytes() const
 {
 	u32 sum = 0;
-	for (const Block *bp = bottom_; bp != NULL; bp = bp->next)
+	for (const BlockMap &bin : freeBins_)
 	{
-		const Block &b = *bp;
-		if (!b.taken)
-		{
-			sum += b.size;
-		}
+		for (const auto &it : bin)
+			sum += it.second->size;
 	}
 	if (sum & (grain_ - 1))
 		WARN_LOG_REPORT(Log::HLE, "GetTotalFreeBytes: free size %08x does not align to grain %08x.", sum, grain_);
@@ -477,6 +571,9 @@ void BlockAllocator::DoState(PointerWrap &p)
 	Do(p, rangeStart_);
 	Do(p, rangeSize_);
 	Do(p, grain_);
+
+	if (p.mode == p.MODE_READ)
+		RebuildIndex();
 }
 
 BlockAllocator::Block::Block(u32 _start, u32 _size, bool _taken, Block *_prev, Block *_next)
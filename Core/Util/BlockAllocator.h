@@ -19,6 +19,8 @@
 
 class PointerWrap;
 
+#include <map>
+
 #include "Common/CommonTypes.h"
 
 class BlockAllocator
@@ -71,8 +73,15 @@ class BlockAllocator
 		Block *next;
 	};
 
+	// Free blocks are binned by floor(log2(size)), each bin ordered by address.
+	static const int NUM_FREE_BINS = 32;
+	typedef std::map<u32, Block *> BlockMap;
+
 	Block *bottom_ = nullptr;
 	Block *top_ = nullptr;
+	// Every block by start address, for address lookups.
+	BlockMap blocks_;
+	BlockMap freeBins_[NUM_FREE_BINS];
 	u32 rangeStart_ = 0;
 	u32 rangeSize_ = 0;
 
@@ -80,6 +89,10 @@ class BlockAllocator
 	bool suballoc_ = false;
 
 	void MergeFreeBlocks(Block *fromBlock);
+	Block *FindFreeBlock(u32 size, u32 grain, bool fromTop) const;
+	void AddFree(Block *b);
+	void RemoveFree(Block *b);
+	void RebuildIndex();
 	Block *GetBlockFromAddress(u32 addr);
 	const Block *GetBlockFromAddress(u32 addr) const;
 	Block *InsertFreeBefore(Block *b, u32 size);
@@ -535,7 +535,7 @@ void GPUCommonHW::DoState(PointerWrap &p) {
 
 	// TODO: Some of these things may not be necessary.
 	// None of these are necessary when saving.
-	if (p.mode == p.MODE_READ && !PSP_CoreParameter().frozen) {
+	if (p.mode == p.MODE_READ && !PSP_CoreParameter().frozen && !PSP_CoreParameter().keepCachesOnLoad) {
 		textureCache_->Clear(true);
 
 		gstate_c.Dirty(DIRTY_TEXTURE_IMAGE);
@@ -17,9 +17,11 @@
 #include "Core/Config.h"
 #include "Core/MemFault.h"
 #include "Core/Reporting.h"
+#include "Core/RunAhead.h"
 #include "Core/CwCheat.h"
 #include "Core/Core.h"
 #include "Core/ELF/ParamSFO.h"
+#include "Core/FileLoaders/LocalFileLoader.h"
 #include "Core/System.h"
 #include "Core/Util/GameDB.h"
 #include "GPU/GPU.h"
@@ -57,6 +59,13 @@ static void DrawDebugStats(UIContext *ctx, const Bounds &bounds) {
 		kernelStats.summedSlowestSyscallTime * 1000.0f);
 
 	__DisplayGetDebugStats(w);
+	RunAhead::GetDebugStats(w);
+
+	u64 mappedBytes, residentBytes;
+	LocalFileLoader::GetMappedStats(&mappedBytes, &residentBytes);
+	if (mappedBytes != 0) {
+		w.F("Mapped disc image: %d MB, %d MB resident\n", (int)(mappedBytes >> 20), (int)(residentBytes >> 20));
+	}
 
 	ctx->Draw()->DrawTextRect(ubuntu24, w.as_view(), bounds.x + 11, bounds.y + 31, left, bounds.h - 30, 0xc0000000, FLAG_DYNAMIC_ASCII);
 	ctx->Draw()->DrawTextRect(ubuntu24, w.as_view(), bounds.x + 10, bounds.y + 30, left, bounds.h - 30, 0xFFFFFFFF, FLAG_DYNAMIC_ASCII);
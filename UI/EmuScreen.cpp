@@ -72,6 +72,7 @@ using namespace std::placeholders;
 #include "Core/HLE/sceNetAdhoc.h"
 #include "Core/Debugger/SymbolMap.h"
 #include "Core/RetroAchievements.h"
+#include "Core/RunAhead.h"
 #include "Core/SaveState.h"
 #include "Core/Screenshot.h"
 #include "UI/ImDebugger/ImDebugger.h"
@@ -1775,7 +1776,7 @@ ScreenRenderFlags EmuScreen::RunEmulation(bool skipBufferEffects) {
 			}
 		}
 
-		PSP_RunLoopWhileState();
+		RunAhead::RunFrames();
 
 		// Hopefully, after running, coreState is now CORE_NEXTFRAME
 		switch (coreState) {
@@ -1826,6 +1827,9 @@ ScreenRenderFlags EmuScreen::RunEmulation(bool skipBufferEffects) {
 			}
 		}
 
+		// The frames run ahead have been shown, go back to the real one.
+		RunAhead::Restore();
+
 		if (SaveState::PollRestartNeeded() && !bootPending_) {
 			Achievements::UnloadGame();
 			PSP_Shutdown(true);
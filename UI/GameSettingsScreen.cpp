@@ -1352,6 +1352,7 @@ void GameSettingsScreen::CreateSystemSettings(UI::ViewGroup *systemSettings) {
 
 	systemSettings->Add(new CheckBox(&g_Config.bEnableStateUndo, sy->T("Savestate slot backups")));
 	systemSettings->Add(new CheckBox(&g_Config.bConfirmLoadState, sy->T("Ask to confirm on load")));
+	systemSettings->Add(new CheckBox(&g_Config.bSaveStatesInBackground, sy->T("Save states in the background")));
 
 	PopupSliderChoice* savestateSlotCount = systemSettings->Add(new PopupSliderChoice(&g_Config.iSaveStateSlotCount, 1, 30, 5, sy->T("Savestate slot count"), screenManager()));
 	savestateSlotCount->OnChange.Add([](UI::EventParams &e) {
@@ -1368,6 +1369,12 @@ void GameSettingsScreen::CreateSystemSettings(UI::ViewGroup *systemSettings) {
 	PopupSliderChoice *rewindInterval = systemSettings->Add(new PopupSliderChoice(&g_Config.iRewindSnapshotInterval, 0, 60, 0, sy->T("Rewind Snapshot Interval"), screenManager(), di->T("seconds, 0:off")));
 	rewindInterval->SetFormat(di->T("%d seconds"));
 	rewindInterval->SetZeroLabel(sy->T("Off"));
+	CheckBox *rewindEveryFrame = systemSettings->Add(new CheckBox(&g_Config.bRewindEveryFrame, sy->T("Rewind snapshot every frame")));
+	rewindEveryFrame->SetEnabledFunc([] { return g_Config.iRewindSnapshotInterval > 0; });
+	PopupSliderChoice *rewindBufferSize = systemSettings->Add(new PopupSliderChoice(&g_Config.iRewindBufferSizeMB, 32, 4096, 512, sy->T("Rewind buffer size"), 32, screenManager(), "MB"));
+	rewindBufferSize->SetEnabledFunc([] { return g_Config.iRewindSnapshotInterval > 0; });
+	PopupSliderChoice *runAheadFrames = systemSettings->Add(new PopupSliderChoice(&g_Config.iRunAheadFrames, 0, 4, 0, sy->T("Run-ahead frames"), screenManager()));
+	runAheadFrames->SetZeroLabel(sy->T("Off"));
 
 	systemSettings->Add(new ItemHeader(sy->T("General")));
 
@@ -193,10 +193,8 @@ void DrawSchedulerView(ImConfig &cfg) {
 	}
 	s64 ticks = CoreTiming::GetTicks();
 	if (ImGui::BeginChild("event_list", ImVec2(300.0f, 0.0))) {
-		const CoreTiming::Event *event = CoreTiming::GetFirstEvent();
-		while (event) {
-			ImGui::Text("%s (%lld): %d", CoreTiming::GetEventTypes()[event->type].name, event->time - ticks, (int)event->userdata);
-			event = event->next;
+		for (const CoreTiming::BaseEvent &event : CoreTiming::GetPendingEvents()) {
+			ImGui::Text("%s (%lld): %d", CoreTiming::GetEventTypes()[event.type].name, event.time - ticks, (int)event.userdata);
 		}
 		ImGui::EndChild();
 	}
@@ -43,6 +43,8 @@
 #include "Core/System.h"
 #include "Core/WebServer.h"
 #include "Core/HLE/sceUtility.h"
+#include "Core/MIPS/JitCommon/JitBlockCache.h"
+#include "Core/MIPS/JitCommon/JitCommon.h"
 #include "Core/SaveState.h"
 #include "GPU/GPUCommon.h"
 #include "GPU/Common/FramebufferManagerCommon.h"
@@ -58,6 +60,10 @@
 #endif
 
 static HeadlessHost *g_headlessHost;
+// Emulated CPU cycles the last test ran for, for --bench.
+static u64 g_lastTestTicks;
+// Block runs the jit reported profile stats for (in tiered mode, the ones that were interpreted.)
+static int64_t g_lastTestProfiledRuns;
 
 #if PPSSPP_PLATFORM(ANDROID)
 JNIEnv *getEnv() {
@@ -149,9 +155,14 @@ int printUsage(const char *progname, const char *reason)
 	fprintf(stderr, "  -v, --verbose         show the full passed/failed result\n");
 	fprintf(stderr, "  -i                    use the interpreter\n");
 	fprintf(stderr, "  --ir                  use ir interpreter\n");
+	fprintf(stderr, "  --ir-switch           use ir interpreter, without threaded dispatch\n");
 	fprintf(stderr, "  -j                    use jit (default)\n");
+	fprintf(stderr, "  --jit-ir              use ir jit\n");
+	fprintf(stderr, "  --jit-tiered[=N]      use ir jit, interpreting blocks until they've run N times\n");
+	fprintf(stderr, "  --jit-background      use ir jit, compiling blocks on a worker thread\n");
 	fprintf(stderr, "  -c, --compare         compare with output in file.expected\n");
-	fprintf(stderr, "  --bench               run multiple times and output speed\n");
+	fprintf(stderr, "  --bench               run multiple times and output speed and emulated cycles/sec\n");
+	fprintf(stderr, "                        (with --jit-tiered, also with --ir and --jit-ir to compare)\n");
 	fprintf(stderr, "\nSee headless.txt for details.\n");
 
 	return 1;
@@ -277,6 +288,13 @@ bool RunAutoTest(HeadlessHost *headlessHost, CoreParameter &coreParameter, const
 		draw->EndFrame();
 	}
 
+	g_lastTestTicks = CoreTiming::GetTicks();
+	g_lastTestProfiledRuns = 0;
+	JitBlockCacheDebugInterface *blockCache = MIPSComp::jit ? MIPSComp::jit->GetBlockCacheDebugInterface() : nullptr;
+	if (blockCache && blockCache->SupportsProfiling()) {
+		for (int i = 0; i < blockCache->GetNumBlocks(); ++i)
+			g_lastTestProfiledRuns += blockCache->GetBlockProfileStats(i).executions;
+	}
 	PSP_Shutdown(true);
 
 	if (!opt.bench)
@@ -370,6 +388,9 @@ int main(int argc, const char* argv[])
 	int debuggerPort = -1;
 	bool oldAtrac = false;
 	bool outputDebugStringLog = false;
+	int tierUpThreshold = 0;
+	bool backgroundCompile = false;
+	bool irThreadedDispatch = true;
 
 	std::vector<std::string> testFilenames;
 	std::vector<std::string> ignoredTests;
@@ -401,8 +422,22 @@ int main(int argc, const char* argv[])
 			cpuCore = CPUCore::JIT;
 		else if (!strcmp(argv[i], "--jit-ir"))
 			cpuCore = CPUCore::JIT_IR;
+		else if (!strcmp(argv[i], "--jit-tiered")) {
+			cpuCore = CPUCore::JIT_IR;
+			tierUpThreshold = 100;
+		} else if (!strncmp(argv[i], "--jit-tiered=", strlen("--jit-tiered=")) && strlen(argv[i]) > strlen("--jit-tiered=")) {
+			cpuCore = CPUCore::JIT_IR;
+			tierUpThreshold = (int)strtoul(argv[i] + strlen("--jit-tiered="), NULL, 10);
+		} else if (!strcmp(argv[i], "--jit-background")) {
+			cpuCore = CPUCore::JIT_IR;
+			backgroundCompile = true;
+		}
 		else if (!strcmp(argv[i], "--ir"))
 			cpuCore = CPUCore::IR_INTERPRETER;
+		else if (!strcmp(argv[i], "--ir-switch")) {
+			cpuCore = CPUCore::IR_INTERPRETER;
+			irThreadedDispatch = false;
+		}
 		else if (!strcmp(argv[i], "-c") || !strcmp(argv[i], "--compare"))
 			testOptions.compare = true;
 		else if (!strcmp(argv[i], "--bench"))
@@ -557,6 +592,11 @@ int main(int argc, const char* argv[])
 	g_Config.internalDataDirectory.clear();
 	g_Config.bUseOldAtrac = oldAtrac;
 	g_Config.iForceEnableHLE = 0xFFFFFFFF;  // Run all modules as HLE. We don't have anything to load in this context.
+	g_Config.iJitTierUpThreshold = tierUpThreshold;
+	g_Config.bJitBackgroundCompile = backgroundCompile;
+	g_Config.bIRThreadedDispatch = irThreadedDispatch;
+	// Tests and benchmarks should always measure a cold start.
+	g_Config.bIRBlockDiskCache = false;
 
 	// g_Config.bUseOldAtrac = true;
 
@@ -628,20 +668,45 @@ int main(int argc, const char* argv[])
 			printf("%s:\n", coreParameter.fileToStart.c_str());
 		bool passed = RunAutoTest(headlessHost, coreParameter, testOptions);
 		if (testOptions.bench) {
-			double st = time_now_d();
-			double deadline = st + testOptions.timeout;
-			double runs = 0.0;
-			for (int i = 0; i < 100; ++i) {
-				RunAutoTest(headlessHost, coreParameter, testOptions);
-				runs++;
-
-				if (time_now_d() > deadline)
-					break;
+			auto runBench = [&](const char *mode) {
+				double st = time_now_d();
+				double deadline = st + testOptions.timeout;
+				double runs = 0.0;
+				double ticks = 0.0;
+				double profiledRuns = 0.0;
+				for (int i = 0; i < 100; ++i) {
+					RunAutoTest(headlessHost, coreParameter, testOptions);
+					runs++;
+					ticks += (double)g_lastTestTicks;
+					profiledRuns += (double)g_lastTestProfiledRuns;
+
+					if (time_now_d() > deadline)
+						break;
+				}
+				double et = time_now_d();
+
+				std::string testName = GetTestName(coreParameter.fileToStart);
+				if (mode)
+					testName += StringFromFormat(" (%s)", mode);
+				// Close enough to instructions per second, since most ops are counted as one cycle.
+				printf("  %s - %f seconds average, %0.2f M cycles/sec", testName.c_str(), (et - st) / runs, ticks / (et - st) / 1000000.0);
+				if (profiledRuns > 0.0)
+					printf(", %0.0f interpreted block runs", profiledRuns / runs);
+				printf("\n");
+			};
+
+			if (cpuCore == CPUCore::JIT_IR && tierUpThreshold > 0) {
+				// See what tiering buys over never and always compiling.
+				coreParameter.cpuCore = CPUCore::IR_INTERPRETER;
+				runBench("interpreter only");
+				coreParameter.cpuCore = CPUCore::JIT_IR;
+				g_Config.iJitTierUpThreshold = 0;
+				runBench("jit only");
+				g_Config.iJitTierUpThreshold = tierUpThreshold;
+				runBench("tiered");
+			} else {
+				runBench(nullptr);
 			}
-			double et = time_now_d();
-
-			std::string testName = GetTestName(coreParameter.fileToStart);
-			printf("  %s - %f seconds average\n", testName.c_str(), (et - st) / runs);
 		}
 		if (testOptions.compare) {
 			std::string testName = GetTestName(coreParameter.fileToStart);
@@ -21,11 +21,14 @@
 
 #include "Common/System/NativeApp.h"
 #include "Common/System/System.h"
+#include "Common/Thread/ThreadManager.h"
+#include "Common/CPUDetect.h"
 #include "Common/TimeUtil.h"
 #include "Core/ConfigValues.h"
 #include "Core/Debugger/SymbolMap.h"
 #include "Core/MIPS/JitCommon/JitCommon.h"
 #include "Core/MIPS/JitCommon/JitBlockCache.h"
+#include "Core/MIPS/MIPSAnalyst.h"
 #include "Core/MIPS/MIPSCodeUtils.h"
 #include "Core/MIPS/MIPSDebugInterface.h"
 #include "Core/MIPS/MIPSAsm.h"
@@ -36,7 +39,13 @@
 #include "Core/System.h"
 #include "Core/CoreTiming.h"
 #include "Core/Config.h"
+#include "Core/RunAhead.h"
 #include "Core/HLE/HLE.h"
+#include "Core/HLE/sceKernel.h"
+#include "Core/HLE/sceKernelEventFlag.h"
+#include "Core/HLE/sceKernelMemory.h"
+#include "Core/HLE/sceKernelSemaphore.h"
+#include "Core/HLE/sceKernelThread.h"
 
 // Temporary hacks around annoying linking errors.  Copied from Headless.
 void NativeFrame(GraphicsContext *graphicsContext) { }
@@ -226,3 +235,505 @@ bool TestJit() {
 
 	return jit_speed >= interp_speed;
 }
+
+// Simulates overlay swaps: lots of small linked blocks, invalidated in large ranges and recompiled.
+bool TestJitInvalidate() {
+	SetupJitHarness();
+
+	g_Config.bFastMemory = true;
+	mipsr4k.UpdateCore(CPUCore::JIT);
+
+	const int numBlocks = 8192;
+	const u32 blockBytes = 16;
+	const u32 base = PSP_GetUserMemoryBase();
+	const u32 size = numBlocks * blockBytes;
+
+	// Each block is an addiu, then a jump to the next one.
+	for (int i = 0; i < numBlocks; ++i) {
+		u32 addr = base + i * blockBytes;
+		u32 next = i == numBlocks - 1 ? base : addr + blockBytes;
+		Memory::Write_U32(0x24210001, addr);  // addiu at, at, 1
+		Memory::Write_U32(0x08000000 | ((next & 0x0FFFFFFF) >> 2), addr + 4);  // j next
+		Memory::Write_U32(0, addr + 8);  // nop
+		Memory::Write_U32(0, addr + 12);
+	}
+
+	bool success = true;
+	double compileTime = 0.0, largeTime = 0.0, smallTime = 0.0;
+	const int rounds = 10;
+	for (int round = 0; round < rounds; ++round) {
+		double st = time_now_d();
+		for (int i = 0; i < numBlocks; ++i) {
+			MIPSComp::jit->Compile(base + i * blockBytes);
+		}
+		compileTime += time_now_d() - st;
+
+		st = time_now_d();
+		if (round & 1) {
+			// Module unload / load style, one big range.
+			MIPSComp::jit->InvalidateCacheAt(base, size);
+			largeTime += time_now_d() - st;
+		} else {
+			// Overlay copied in with many smaller memcpys.
+			for (u32 offset = 0; offset < size; offset += 0x1000) {
+				MIPSComp::jit->InvalidateCacheAt(base + offset, 0x1000);
+			}
+			smallTime += time_now_d() - st;
+		}
+
+		// Everything should have been invalidated, so no emuhacks left.
+		for (int i = 0; i < numBlocks; ++i) {
+			if (Memory::Read_U32(base + i * blockBytes) != 0x24210001) {
+				printf("Block %d at %08x not invalidated in round %d\n", i, base + i * blockBytes, round);
+				success = false;
+				break;
+			}
+		}
+		if (!success)
+			break;
+	}
+
+	printf("Jit block cache, %d blocks: compile %0.2f ms, invalidate large %0.2f ms, invalidate 4KB chunks %0.2f ms (per round)\n",
+		numBlocks, compileTime * 1000.0 / rounds, largeTime * 2000.0 / rounds, smallTime * 2000.0 / rounds);
+
+	MIPSComp::jit->ClearCache();
+	DestroyJitHarness();
+	return success;
+}
+
+// A loop whose body jumps back out of its first block, so the trace has to follow a backward edge.
+bool TestJitTraceLoop() {
+#if PPSSPP_PLATFORM(MAC)
+	return true;
+#else
+	SetupJitHarness();
+
+	const int oldThreshold = g_Config.iJitTierUpThreshold;
+	const bool oldTraces = g_Config.bJitTraces;
+	const bool oldBackground = g_Config.bJitBackgroundCompile;
+	g_Config.iJitTierUpThreshold = 16;
+	g_Config.bJitTraces = true;
+	g_Config.bJitBackgroundCompile = false;
+	g_Config.bFastMemory = true;
+	mipsr4k.UpdateCore(CPUCore::JIT_IR);
+
+	const u32 base = PSP_GetUserMemoryBase();
+	const u32 tail = base + 0x20;
+	const u32 head = base + 0x40;
+	const int iterations = 1000;
+
+	// a0 counts down, v0 adds up.
+	Memory::Write_U32(MIPS_MAKE_ADDIU(MIPS_REG_A0, MIPS_REG_ZERO, iterations), base);
+	Memory::Write_U32(MIPS_MAKE_ADDIU(MIPS_REG_V0, MIPS_REG_ZERO, 0), base + 4);
+	Memory::Write_U32(MIPS_MAKE_J(head), base + 8);
+	Memory::Write_U32(MIPS_MAKE_NOP(), base + 12);
+	// The second half of the loop body comes first.
+	Memory::Write_U32(MIPS_MAKE_ADDIU(MIPS_REG_V0, MIPS_REG_V0, 3), tail);
+	Memory::Write_U32(MIPS_MAKE_ADDIU(MIPS_REG_A0, MIPS_REG_A0, 0xFFFF), tail + 4);
+	Memory::Write_U32(MIPS_MAKE_BNEZ(tail + 8, head, MIPS_REG_A0), tail + 8);
+	Memory::Write_U32(MIPS_MAKE_NOP(), tail + 12);
+	Memory::Write_U32(MIPS_MAKE_SYSCALL("UnitTestFakeSyscalls", "UnitTestTerminator"), tail + 16);
+	Memory::Write_U32(MIPS_MAKE_BREAK(1), tail + 20);
+	Memory::Write_U32(MIPS_MAKE_ADDIU(MIPS_REG_V0, MIPS_REG_V0, 1), head);
+	Memory::Write_U32(MIPS_MAKE_J(tail), head + 4);
+	Memory::Write_U32(MIPS_MAKE_NOP(), head + 8);
+
+	auto runLoop = [&]() {
+		currentMIPS->pc = base;
+		MIPSComp::JitAt();
+		coreState = CORE_RUNNING_CPU;
+		while (coreState == CORE_RUNNING_CPU)
+			mipsr4k.RunLoopUntil(1000000);
+		return (int)currentMIPS->r[MIPS_REG_V0];
+	};
+
+	bool success = true;
+	// The first run interprets until the head gets hot, the others run the trace.
+	for (int round = 0; round < 3; ++round) {
+		int result = runLoop();
+		if (result != iterations * 4) {
+			printf("Round %d: loop result %d, expected %d\n", round, result, iterations * 4);
+			success = false;
+		}
+	}
+
+	JitBlockCacheDebugInterface *blocks = MIPSComp::jit->GetBlockCacheDebugInterface();
+	if (!MIPS_IS_RUNBLOCK(Memory::Read_U32(head)) || blocks->GetBlockNumberFromStartAddress(head) < 0) {
+		printf("No block at the loop head\n");
+		success = false;
+	}
+
+	// The trace at the head includes the tail, so changing the tail has to throw it away.
+	Memory::Write_U32(MIPS_MAKE_ADDIU(MIPS_REG_V0, MIPS_REG_V0, 5), tail);
+	MIPSComp::jit->InvalidateCacheAt(tail, 4);
+	if (MIPS_IS_RUNBLOCK(Memory::Read_U32(head))) {
+		printf("Trace at the loop head survived a change to its tail\n");
+		success = false;
+	}
+	int result = runLoop();
+	if (result != iterations * 6) {
+		printf("After the change: loop result %d, expected %d\n", result, iterations * 6);
+		success = false;
+	}
+
+	MIPSComp::jit->ClearCache();
+	g_Config.iJitTierUpThreshold = oldThreshold;
+	g_Config.bJitTraces = oldTraces;
+	g_Config.bJitBackgroundCompile = oldBackground;
+	DestroyJitHarness();
+	return success;
+#endif
+}
+
+struct FunctionScanResult {
+	bool insertSymbols;
+	std::vector<MIPSAnalyst::AnalyzedFunction> functions;
+	std::vector<std::string> names;
+};
+
+static FunctionScanResult ScanFunctionsForTest(u32 start, u32 end, u32 chunkBytes) {
+	MIPSAnalyst::Reset();
+	g_symbolMap->Clear();
+
+	FunctionScanResult result;
+	result.insertSymbols = MIPSAnalyst::ScanForFunctions(start, end, true, chunkBytes);
+	MIPSAnalyst::FinalizeScan(result.insertSymbols);
+
+	for (u32 entry : MIPSAnalyst::GetFunctionEntries(start, end - 1)) {
+		MIPSAnalyst::AnalyzedFunction f{};
+		MIPSAnalyst::GetAnalyzedFunctionAt(entry, &f);
+		result.functions.push_back(f);
+		result.names.push_back(g_symbolMap->GetLabelString(entry));
+	}
+	return result;
+}
+
+// Scanning in chunks has to find exactly what a single serial pass finds, wherever the chunk edges fall.
+bool TestFunctionScanChunks() {
+	SetupJitHarness();
+
+	bool oldHashMap = g_Config.bFuncHashMap;
+	bool oldReplacements = g_Config.bFuncReplacements;
+	g_Config.bFuncHashMap = false;
+	g_Config.bFuncReplacements = false;
+
+	const u32 base = PSP_GetUserMemoryBase();
+	const u32 size = 0x10000;
+	u32 seed = 0x12345678;
+	auto rand = [&]() {
+		seed = seed * 1103515245 + 12345;
+		return (seed >> 16) & 0x7FFF;
+	};
+
+	// Leaf functions of varied length, some with branches inside, many crossing the small chunk sizes below.
+	u32 addr = base;
+	while (addr + 0x400 < base + size) {
+		int count = 2 + rand() % 120;
+		for (int i = 0; i < count; ++i) {
+			int left = count - i;
+			if (left > 4 && rand() % 8 == 0) {
+				// beq a0, zero, forward (still inside the function), then a nop delay slot.
+				int offset = 1 + rand() % (left - 2);
+				Memory::Write_U32(0x10800000 | (offset & 0xFFFF), addr);
+				Memory::Write_U32(MIPS_MAKE_NOP(), addr + 4);
+				addr += 8;
+				++i;
+			} else {
+				// addiu v0, v0, i
+				Memory::Write_U32(0x24420000 | (i & 0xFFFF), addr);
+				addr += 4;
+			}
+		}
+		Memory::Write_U32(MIPS_MAKE_JR_RA(), addr);
+		Memory::Write_U32(MIPS_MAKE_NOP(), addr + 4);
+		addr += 8;
+	}
+	const u32 end = addr;
+
+	bool success = true;
+	FunctionScanResult serial = ScanFunctionsForTest(base, end, end - base);
+	if (serial.functions.size() < 50) {
+		printf("Serial scan only found %d functions\n", (int)serial.functions.size());
+		success = false;
+	}
+
+	static const u32 chunkSizes[] = { 0x100, 0x104, 0x400, 0x1000 };
+	for (u32 chunkBytes : chunkSizes) {
+		int straddling = 0;
+		for (const auto &f : serial.functions) {
+			if ((f.start - base) / chunkBytes != (f.end - base) / chunkBytes)
+				straddling++;
+		}
+		if (straddling == 0) {
+			printf("No function crosses a %x byte chunk\n", chunkBytes);
+			success = false;
+		}
+
+		FunctionScanResult chunked = ScanFunctionsForTest(base, end, chunkBytes);
+		if (chunked.insertSymbols != serial.insertSymbols || chunked.functions.size() != serial.functions.size()) {
+			printf("Chunk size %x: found %d functions, serial found %d\n", chunkBytes, (int)chunked.functions.size(), (int)serial.functions.size());
+			success = false;
+			continue;
+		}
+		for (size_t i = 0; i < serial.functions.size(); ++i) {
+			const auto &a = serial.functions[i];
+			const auto &b = chunked.functions[i];
+			if (a.start != b.start || a.end != b.end || a.size != b.size || a.hash != b.hash || a.hasHash != b.hasHash || a.isStraightLeaf != b.isStraightLeaf || serial.names[i] != chunked.names[i]) {
+				printf("Chunk size %x: function %08x-%08x (%s) differs from serial %08x-%08x (%s)\n", chunkBytes, b.start, b.end, chunked.names[i].c_str(), a.start, a.end, serial.names[i].c_str());
+				success = false;
+				break;
+			}
+		}
+	}
+
+	MIPSAnalyst::Reset();
+	g_Config.bFuncHashMap = oldHashMap;
+	g_Config.bFuncReplacements = oldReplacements;
+	DestroyJitHarness();
+	return success;
+}
+
+// A run-ahead restore copies back only what changed, so blocks elsewhere, like on import stubs, have to survive it.
+bool TestRunAheadRestore() {
+	SetupJitHarness();
+	g_threadManager.Init(cpu_info.num_cores, cpu_info.logical_cpu_count);
+
+	g_Config.bFastMemory = true;
+	mipsr4k.UpdateCore(CPUCore::JIT);
+
+	const u32 base = PSP_GetUserMemoryBase();
+	const u32 stub = base;
+	const u32 func = base + 0x10000;
+	const u32 data = base + 0x20000;
+	const u32 later = base + 0x30000;
+
+	Memory::Write_U32(MIPS_MAKE_JR_RA(), stub);
+	Memory::Write_U32(MIPS_MAKE_SYSCALL("UnitTestFakeSyscalls", "UnitTestTerminator"), stub + 4);
+	for (u32 addr : { func, later }) {
+		Memory::Write_U32(0x24420001, addr);  // addiu v0, v0, 1
+		Memory::Write_U32(MIPS_MAKE_JR_RA(), addr + 4);
+		Memory::Write_U32(MIPS_MAKE_NOP(), addr + 8);
+	}
+	Memory::Write_U32(0x12345678, data);
+
+	MIPSComp::jit->Compile(stub);
+	MIPSComp::jit->Compile(func);
+
+	bool success = true;
+	JitBlockCacheDebugInterface *blocks = MIPSComp::jit->GetBlockCacheDebugInterface();
+	auto hasBlock = [&](u32 addr) {
+		return MIPS_IS_RUNBLOCK(Memory::Read_U32(addr)) && blocks->GetBlockNumberFromStartAddress(addr) >= 0;
+	};
+	if (!hasBlock(stub) || !hasBlock(func)) {
+		printf("Blocks weren't compiled\n");
+		success = false;
+	}
+
+	for (int round = 0; round < 3 && success; ++round) {
+		RunAhead::SaveMemoryForTest();
+
+		// What a speculative frame might do: write data, patch code, and compile something new.
+		Memory::Write_U32(0xDEADBEEF, data);
+		Memory::Write_U32(0x24420002, func + 4);
+		if (!hasBlock(later))
+			MIPSComp::jit->Compile(later);
+
+		int restored = RunAhead::RestoreMemoryForTest();
+		if (restored != 2) {
+			printf("Round %d: restored %d pages, expected 2\n", round, restored);
+			success = false;
+		}
+		if (!hasBlock(stub) || !hasBlock(later)) {
+			printf("Round %d: blocks in untouched pages were lost\n", round);
+			success = false;
+		}
+		if (Memory::Read_U32(data) != 0x12345678 || Memory::Read_U32(func) != 0x24420001 || Memory::Read_U32(func + 4) != MIPS_MAKE_JR_RA()) {
+			printf("Round %d: memory wasn't restored\n", round);
+			success = false;
+		}
+
+		MIPSComp::jit->Compile(func);
+	}
+
+	RunAhead::Shutdown();
+	MIPSComp::jit->ClearCache();
+	g_threadManager.Teardown();
+	DestroyJitHarness();
+	return success;
+}
+
+static int benchAlarmEvent = -1;
+static int benchVTimerEvent = -1;
+static int benchFired = 0;
+static bool benchReschedule = false;
+
+static void CoreTimingBenchCallback(u64 userdata, int cyclesLate) {
+	benchFired++;
+	if (!benchReschedule)
+		return;
+	// Like an alarm handler asking for the next one, and now and then a game moving a vtimer.
+	CoreTiming::ScheduleEvent(500 + (userdata * 7919) % 5000, (userdata & 1) ? benchVTimerEvent : benchAlarmEvent, userdata);
+	if ((benchFired & 3) == 0) {
+		u64 other = (userdata * 31 + 7) % 256;
+		int otherEvent = (other & 1) ? benchVTimerEvent : benchAlarmEvent;
+		if (CoreTiming::UnscheduleEvent(otherEvent, other) != 0)
+			CoreTiming::ScheduleEvent(1000 + (other * 131) % 3000, otherEvent, other);
+	}
+}
+
+// Not really a test, times alarm and vtimer style events going through CoreTiming.
+bool TestCoreTimingBench() {
+	SetupJitHarness();
+	benchAlarmEvent = CoreTiming::RegisterEvent("BenchAlarm", &CoreTimingBenchCallback);
+	benchVTimerEvent = CoreTiming::RegisterEvent("BenchVTimer", &CoreTimingBenchCallback);
+
+	auto runUntil = [](int count) {
+		while (benchFired < count) {
+			// Pretend the whole slice ran.
+			currentMIPS->downcount = 0;
+			CoreTiming::Advance();
+		}
+	};
+
+	bool success = true;
+	const int bulkCount = 20000;
+	benchFired = 0;
+	benchReschedule = false;
+	double st = time_now_d();
+	for (int i = 0; i < bulkCount; ++i)
+		CoreTiming::ScheduleEvent(1000 + (i * 7919) % 1000000, (i & 1) ? benchVTimerEvent : benchAlarmEvent, i);
+	// Cancel every third one.
+	for (int i = 0; i < bulkCount; i += 3)
+		CoreTiming::UnscheduleEvent((i & 1) ? benchVTimerEvent : benchAlarmEvent, i);
+	double scheduleTime = time_now_d() - st;
+
+	const int bulkFired = bulkCount - (bulkCount + 2) / 3;
+	st = time_now_d();
+	runUntil(bulkFired);
+	double runTime = time_now_d() - st;
+	if (benchFired != bulkFired || CoreTiming::IsScheduled(benchAlarmEvent) || CoreTiming::IsScheduled(benchVTimerEvent)) {
+		printf("Fired %d events, expected %d\n", benchFired, bulkFired);
+		success = false;
+	}
+
+	printf("CoreTiming, %d events: schedule and cancel %0.2f ms, run %0.2f ms\n", bulkCount, scheduleTime * 1000.0, runTime * 1000.0);
+
+	for (int pending : { 1, 10, 50, 256 }) {
+		CoreTiming::ClearPendingEvents();
+		benchFired = 0;
+		benchReschedule = true;
+		for (int i = 0; i < pending; ++i)
+			CoreTiming::ScheduleEvent(100 + i * 37, (i & 1) ? benchVTimerEvent : benchAlarmEvent, i);
+
+		const int steadyCount = 1000000;
+		st = time_now_d();
+		runUntil(steadyCount);
+		double steadyTime = time_now_d() - st;
+		printf("CoreTiming, %d pending: fire and reschedule %0.1f ns per event\n", pending, steadyTime * 1e9 / benchFired);
+	}
+
+	benchReschedule = false;
+	CoreTiming::ClearPendingEvents();
+	DestroyJitHarness();
+	return success;
+}
+
+// Many threads waiting on one semaphore and one event flag, like a game's worker pool.
+bool TestKernelWaitMany() {
+	SetupJitHarness();
+	HLEInit();
+	__KernelMemoryInit();
+	__KernelThreadingInit();
+	__KernelSemaInit();
+	__KernelEventFlagInit();
+
+	const int THREADS = 256;
+	u32 error;
+	SceUID rootID = __KernelSetupRootThread(0, 0, nullptr, 0x20, 0x4000, PSP_THREAD_ATTR_USER);
+	PSPThread *root = kernelObjects.Get<PSPThread>(rootID, error);
+
+	std::vector<SceUID> threads;
+	for (int i = 0; i < THREADS; ++i) {
+		SceUID id = __KernelCreateThreadInternal("waiter", 0, PSP_GetUserMemoryBase(), 0x30 + (i * 7) % 16, 0x1000, PSP_THREAD_ATTR_USER);
+		__KernelStartThread(id, 0, 0);
+		threads.push_back(id);
+	}
+
+	// Switches to each thread in turn, lets it start a wait, and comes back to root.
+	auto waitAll = [&](auto wait) {
+		double st = time_now_d();
+		for (int i = 0; i < THREADS; ++i) {
+			__KernelSwitchContext(kernelObjects.Get<PSPThread>(threads[i], error), "test wait");
+			wait(i);
+			__KernelSwitchContext(root, "test wait done");
+		}
+		return time_now_d() - st;
+	};
+	auto countWaiting = [&]() {
+		int count = 0;
+		for (SceUID id : threads)
+			count += KernelIsThreadWaiting(id) ? 1 : 0;
+		return count;
+	};
+
+	bool success = true;
+	const u32 PSP_SEMA_ATTR_PRIORITY = 0x100;
+	SceUID sema = hleCall(ThreadManForUser, int, sceKernelCreateSema, "waitmany", PSP_SEMA_ATTR_PRIORITY, 0, THREADS, 0);
+	double waitTime = waitAll([&](int i) {
+		return hleCall(ThreadManForUser, int, sceKernelWaitSema, sema, 1, 0);
+	});
+	if (countWaiting() != THREADS) {
+		printf("Only %d threads waiting on the semaphore\n", countWaiting());
+		success = false;
+	}
+
+	// Each signal should wake the best priority thread, first come first served within a priority.
+	std::vector<SceUID> order = threads;
+	std::stable_sort(order.begin(), order.end(), [](SceUID a, SceUID b) {
+		return __KernelGetThreadPrio(a) < __KernelGetThreadPrio(b);
+	});
+	double st = time_now_d();
+	for (int i = 0; i < THREADS && success; ++i) {
+		hleCall(ThreadManForUser, int, sceKernelSignalSema, sema, 1);
+		if (KernelIsThreadWaiting(order[i])) {
+			printf("Signal %d didn't wake the right thread\n", i);
+			success = false;
+		}
+	}
+	double signalTime = time_now_d() - st;
+	if (success && countWaiting() != 0) {
+		printf("%d threads still waiting on the semaphore\n", countWaiting());
+		success = false;
+	}
+	printf("Semaphore, %d threads: wait %0.1f ns, signal %0.1f ns per thread\n", THREADS, waitTime * 1e9 / THREADS, signalTime * 1e9 / THREADS);
+
+	const u32 PSP_EVENT_WAITMULTIPLE = 0x200;
+	const u32 PSP_EVENT_WAITOR = 0x01;
+	SceUID flag = hleCall(ThreadManForUser, int, sceKernelCreateEventFlag, "waitmany", PSP_EVENT_WAITMULTIPLE, 0, 0);
+	waitTime = waitAll([&](int i) {
+		return hleCall(ThreadManForUser, int, sceKernelWaitEventFlag, flag, 1U << (i & 31), PSP_EVENT_WAITOR, 0, 0);
+	});
+	if (countWaiting() != THREADS) {
+		printf("Only %d threads waiting on the event flag\n", countWaiting());
+		success = false;
+	}
+
+	st = time_now_d();
+	for (int bit = 0; bit < 32 && success; ++bit) {
+		hleCall(ThreadManForUser, u32, sceKernelSetEventFlag, flag, 1U << bit);
+		// Everyone waiting on this bit or a lower one is awake now.
+		int expected = THREADS - (THREADS / 32) * (bit + 1);
+		if (countWaiting() != expected) {
+			printf("Setting bit %d left %d threads waiting, expected %d\n", bit, countWaiting(), expected);
+			success = false;
+		}
+	}
+	double setTime = time_now_d() - st;
+	printf("Event flag, %d threads: wait %0.1f ns per thread, set %0.1f ns per bit\n", THREADS, waitTime * 1e9 / THREADS, setTime * 1e9 / 32);
+
+	kernelObjects.Clear();
+	__KernelThreadingShutdown();
+	__KernelMemoryShutdown();
+	DestroyJitHarness();
+	return success;
+}
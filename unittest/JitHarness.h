@@ -18,3 +18,9 @@
 #pragma once
 
 bool TestJit();
+bool TestJitInvalidate();
+bool TestJitTraceLoop();
+bool TestFunctionScanChunks();
+bool TestRunAheadRestore();
+bool TestCoreTimingBench();
+bool TestKernelWaitMany();
@@ -44,6 +44,8 @@
 #include <string>
 #include <sstream>
 
+#include "zlib.h"
+
 #if PPSSPP_PLATFORM(ANDROID)
 #include <jni.h>
 #endif
@@ -54,8 +56,10 @@
 #include "Common/Data/Convert/SmallDataConvert.h"
 #include "Common/Data/Text/Parsers.h"
 #include "Common/Data/Text/WrapText.h"
+#include "Common/Data/Encoding/Compression.h"
 #include "Common/Data/Encoding/Utf8.h"
 #include "Common/Buffer.h"
+#include "Common/File/FileUtil.h"
 #include "Common/File/Path.h"
 #include "Common/Log/LogManager.h"
 #include "Common/Math/SIMDHeaders.h"
@@ -80,15 +84,24 @@
 #include "Common/Log.h"
 #include "Common/StringUtils.h"
 #include "Core/Config.h"
+#include "Core/CoreTiming.h"
 #include "Common/Data/Convert/ColorConv.h"
 #include "Common/File/VFS/VFS.h"
 #include "Common/File/VFS/DirectoryReader.h"
 #include "Common/Math/fast/fast_matrix.h"
+#include "Core/Debugger/MemBlockInfo.h"
+#include "Core/FileLoaders/PrefetchingFileLoader.h"
+#include "Core/FileSystems/BlockDevices.h"
 #include "Core/FileSystems/ISOFileSystem.h"
+#include "Core/HLE/KernelWaitHelpers.h"
+#include "Core/HLE/ThreadQueueList.h"
 #include "Core/MemMap.h"
 #include "Core/KeyMap.h"
+#include "Core/Util/BlockAllocator.h"
 #include "Core/Util/PathUtil.h"
+#include "Core/MIPS/MIPS.h"
 #include "Core/MIPS/MIPSVFPUUtils.h"
+#include "Core/MIPS/IR/IRInterpreter.h"
 #include "GPU/Common/TextureDecoder.h"
 #include "GPU/Common/GPUStateUtils.h"
 #include "GPU/Math3D.h"
@@ -663,6 +676,360 @@ bool TestCLZ() {
 	return true;
 }
 
+static bool TestIRInterpretThreaded() {
+	if (!IRThreadedDispatchSupported()) {
+		printf("Threaded dispatch not supported, skipping\n");
+		return true;
+	}
+
+	// Clz has no threaded handler, so the rest of the block runs through the switch.
+	static const IRInst block[] = {
+		{ IROp::SetConst, { MIPS_REG_A0 }, 0, 0, 0x1234 },
+		{ IROp::OptAddConst, { MIPS_REG_A0 }, MIPS_REG_A0, 0, 5 },
+		{ IROp::ShlImm, { MIPS_REG_A1 }, MIPS_REG_A0, 4 },
+		{ IROp::Slt, { MIPS_REG_A2 }, MIPS_REG_A0, MIPS_REG_A1 },
+		{ IROp::ExitToConstIfEq, { 0 }, MIPS_REG_A2, MIPS_REG_ZERO, 0x08800000 },
+		{ IROp::Clz, { MIPS_REG_A3 }, MIPS_REG_A1 },
+		{ IROp::Sub, { MIPS_REG_T0 }, MIPS_REG_A1, MIPS_REG_A3 },
+		{ IROp::ExitToConst, { 0 }, 0, 0, 0x08804000 },
+	};
+	const int count = (int)ARRAY_SIZE(block);
+
+	std::vector<IRThreadedInst> threaded(count);
+	IRPredecodeThreaded(block, count, threaded.data());
+
+	MIPSState *viaSwitch = new MIPSState();
+	MIPSState *viaThreaded = new MIPSState();
+	memset(viaSwitch->r, 0, sizeof(viaSwitch->r));
+	memset(viaThreaded->r, 0, sizeof(viaThreaded->r));
+	u32 switchPC = IRInterpret(viaSwitch, block);
+	u32 threadedPC = IRInterpretThreaded(viaThreaded, threaded.data(), block);
+	EXPECT_EQ_HEX(switchPC, 0x08804000);
+	EXPECT_EQ_HEX(threadedPC, switchPC);
+	for (int i = 0; i < 32; i++) {
+		EXPECT_EQ_HEX(viaThreaded->r[i], viaSwitch->r[i]);
+	}
+	EXPECT_EQ_HEX(viaThreaded->r[MIPS_REG_T0], (0x1239 << 4) - 15);
+	delete viaSwitch;
+	delete viaThreaded;
+	return true;
+}
+
+static std::vector<u64> coreTimingFired;
+
+static void CoreTimingTestCallback(u64 userdata, int cyclesLate) {
+	coreTimingFired.push_back(userdata);
+}
+
+static bool TestCoreTiming() {
+	MIPSState *oldMIPS = currentMIPS;
+	currentMIPS = &mipsr4k;
+	CoreTiming::Init();
+	const int alarmEvent = CoreTiming::RegisterEvent("TestAlarm", &CoreTimingTestCallback);
+	const int vtimerEvent = CoreTiming::RegisterEvent("TestVTimer", &CoreTimingTestCallback);
+	coreTimingFired.clear();
+
+	const int COUNT = 2000;
+	struct Expected {
+		s64 time;
+		u64 userdata;
+	};
+	std::vector<Expected> expected;
+
+	for (int i = 0; i < COUNT; ++i) {
+		s64 when = 1000 + (i * 7919) % 15000;
+		CoreTiming::ScheduleEvent(when, (i & 1) ? vtimerEvent : alarmEvent, i);
+		if ((i % 3) != 0)
+			expected.push_back(Expected{ when, (u64)i });
+	}
+	// Cancel every third one, like games resetting their vtimers.
+	for (int i = 0; i < COUNT; i += 3) {
+		s64 left = CoreTiming::UnscheduleEvent((i & 1) ? vtimerEvent : alarmEvent, i);
+		EXPECT_EQ_INT(left, 1000 + (i * 7919) % 15000);
+	}
+	EXPECT_EQ_INT(CoreTiming::UnscheduleEvent(alarmEvent, 0), 0);
+
+	// Equal times fire in the order they were scheduled.
+	std::stable_sort(expected.begin(), expected.end(), [](const Expected &a, const Expected &b) {
+		return a.time < b.time;
+	});
+
+	while (CoreTiming::IsScheduled(alarmEvent) || CoreTiming::IsScheduled(vtimerEvent)) {
+		// Pretend the whole slice ran.
+		currentMIPS->downcount = 0;
+		CoreTiming::Advance();
+	}
+
+	EXPECT_EQ_INT(coreTimingFired.size(), expected.size());
+	for (size_t i = 0; i < expected.size(); ++i) {
+		EXPECT_EQ_INT(coreTimingFired[i], expected[i].userdata);
+	}
+
+	CoreTiming::Shutdown();
+	currentMIPS = oldMIPS;
+	return true;
+}
+
+static bool TestThreadQueueList() {
+	ThreadQueueList queue;
+	const int THREADS = 512;
+	auto priorityOf = [](int i) {
+		return (u32)(16 + (i * 37) % 96);
+	};
+
+	for (int i = 0; i < THREADS; ++i) {
+		queue.prepare(priorityOf(i));
+		queue.push_back(priorityOf(i), i + 1);
+	}
+
+	// Best priority first, then in the order they were queued.
+	EXPECT_EQ_INT(queue.peek_first(), 1);
+	EXPECT_EQ_INT(queue.pop_first_better(16), 0);
+	EXPECT_EQ_INT(queue.pop_first_better(17), 1);
+	queue.push_front(16, 1);
+
+	// Drop every fourth thread, like waits starting on a semaphore.
+	for (int i = 0; i < THREADS; i += 4)
+		queue.remove(priorityOf(i), i + 1);
+
+	std::vector<SceUID> order;
+	for (int i = 0; i < THREADS; ++i) {
+		if ((i % 4) != 0)
+			order.push_back(i + 1);
+	}
+	std::stable_sort(order.begin(), order.end(), [&](SceUID a, SceUID b) {
+		return priorityOf(a - 1) < priorityOf(b - 1);
+	});
+
+	for (SceUID expected : order) {
+		EXPECT_EQ_INT(queue.pop_first(), expected);
+	}
+	EXPECT_EQ_INT(queue.peek_first(), 0);
+	EXPECT_TRUE(queue.empty(priorityOf(1)));
+
+	// Now the reschedule pattern: wake a thread, run the best, put it back.
+	const int ROUNDS = 10000;
+	for (int i = 0; i < THREADS; i += 2)
+		queue.push_back(priorityOf(i), i + 1);
+	SceUID sum = 0;
+	for (int r = 0; r < ROUNDS; ++r) {
+		int i = (r * 2 + 1) % THREADS;
+		queue.push_back(priorityOf(i), i + 1);
+		SceUID best = queue.pop_first();
+		sum += best;
+		queue.push_back(priorityOf(best - 1), best);
+		queue.remove(priorityOf(i), i + 1);
+	}
+	EXPECT_TRUE(sum != 0);
+	return true;
+}
+
+static bool TestWaitingThreadList() {
+	struct Waiter {
+		SceUID threadID;
+		u32 bits;
+	};
+	HLEKernel::WaitingThreadList<Waiter> list;
+	const int THREADS = 256;
+	for (int i = 0; i < THREADS; ++i)
+		list.push_back(Waiter{ i + 1, 1U << (i & 31) });
+	EXPECT_EQ_INT((int)list.size(), THREADS);
+
+	// Waiting again moves a thread to the back.
+	list.push_back(Waiter{ 1, 2 });
+	EXPECT_EQ_INT(list.begin()->threadID, 2);
+	EXPECT_EQ_INT(list.find(1)->bits, 2);
+	EXPECT_EQ_INT((int)list.size(), THREADS);
+
+	Waiter removed{};
+	EXPECT_TRUE(list.remove(100, &removed));
+	EXPECT_EQ_INT(removed.bits, 1U << (99 & 31));
+	EXPECT_FALSE(list.remove(100));
+	EXPECT_FALSE(list.contains(100));
+	EXPECT_TRUE(list.find(100) == nullptr);
+
+	// Wakes see threads in order, and the rest keep it.
+	std::vector<SceUID> seen;
+	list.remove_if([&](const Waiter &w) {
+		seen.push_back(w.threadID);
+		return (w.threadID & 1) == 0;
+	});
+	EXPECT_EQ_INT((int)seen.size(), THREADS - 1);
+	EXPECT_EQ_INT(seen.front(), 2);
+	EXPECT_EQ_INT(seen.back(), 1);
+	std::vector<SceUID> order;
+	for (const Waiter &w : list)
+		order.push_back(w.threadID);
+	EXPECT_EQ_INT((int)order.size(), (int)list.size());
+	EXPECT_EQ_INT(order.front(), 3);
+	EXPECT_EQ_INT(order.back(), 1);
+	for (size_t i = 1; i + 1 < order.size(); ++i)
+		EXPECT_EQ_INT(order[i], order[i - 1] + 2);
+
+	// Highest bits first, ties stay in wait order.
+	list.stable_sort([](const Waiter &a, const Waiter &b) {
+		return a.bits > b.bits;
+	});
+	const Waiter *prev = nullptr;
+	for (const Waiter &w : list) {
+		if (prev) {
+			EXPECT_TRUE(prev->bits > w.bits || (prev->bits == w.bits && prev->threadID < w.threadID));
+		}
+		prev = &w;
+	}
+
+	list.remove_front_while([](const Waiter &w) {
+		return w.bits >= (1U << 30);
+	});
+	EXPECT_TRUE(list.begin()->bits < (1U << 30));
+
+	// Freed nodes get reused.
+	size_t before = list.size();
+	list.push_back(Waiter{ 1000, 0 });
+	EXPECT_EQ_INT((int)list.size(), (int)before + 1);
+	list.clear();
+	EXPECT_TRUE(list.empty());
+	EXPECT_TRUE(list.begin() == list.end());
+	return true;
+}
+
+static bool TestBlockAllocator() {
+	MIPSState *oldMIPS = currentMIPS;
+	currentMIPS = &mipsr4k;
+
+	const u32 BASE = 0x08800000;
+	const u32 SIZE = 0x01800000;
+	const int COUNT = 1000;
+	BlockAllocator alloc(0x100);
+	alloc.Init(BASE, SIZE, false);
+
+	struct Hole {
+		u32 start;
+		u32 size;
+	};
+	std::vector<Hole> taken;
+	u32 bottomEnd = BASE;
+	u32 topStart = BASE + SIZE;
+
+	for (int i = 0; i < COUNT; ++i) {
+		u32 size = 0x100 + ((i * 7919) % 16) * 0x100;
+		bool fromTop = (i & 1) != 0;
+		u32 addr = alloc.Alloc(size, fromTop, "test");
+		// Nothing has been freed, so everything packs from each end.
+		EXPECT_EQ_INT(addr, fromTop ? topStart - size : bottomEnd);
+		if (fromTop)
+			topStart = addr;
+		else
+			bottomEnd = addr + size;
+		taken.push_back(Hole{ addr, size });
+	}
+
+	// Free every other block from each end, leaving holes that can't merge.
+	std::vector<Hole> holes;
+	holes.push_back(Hole{ bottomEnd, topStart - bottomEnd });
+	for (int i = 0; i < COUNT; i += 4) {
+		EXPECT_TRUE(alloc.Free(taken[i].start + 0x10));
+		EXPECT_TRUE(alloc.FreeExact(taken[i + 1].start));
+		holes.push_back(taken[i]);
+		holes.push_back(taken[i + 1]);
+	}
+	std::sort(holes.begin(), holes.end(), [](const Hole &a, const Hole &b) {
+		return a.start < b.start;
+	});
+
+	u32 freeBytes = 0;
+	u32 largest = 0;
+	for (const Hole &h : holes) {
+		freeBytes += h.size;
+		largest = std::max(largest, h.size);
+	}
+	EXPECT_EQ_INT(alloc.GetTotalFreeBytes(), freeBytes);
+	EXPECT_EQ_INT(alloc.GetLargestFreeBlockSize(), largest);
+
+	// Placement must match a plain first fit (or last fit from the top.)
+	for (int i = 0; i < COUNT; ++i) {
+		u32 size = 0x100 + ((i * 104729) % 12) * 0x100;
+		bool fromTop = (i % 3) == 0;
+		int found = -1;
+		for (int j = 0; j < (int)holes.size(); ++j) {
+			int h = fromTop ? (int)holes.size() - 1 - j : j;
+			if (holes[h].size >= size) {
+				found = h;
+				break;
+			}
+		}
+		if (found == -1)
+			break;
+
+		u32 addr = alloc.Alloc(size, fromTop, "churn");
+		Hole &h = holes[found];
+		EXPECT_EQ_INT(addr, fromTop ? h.start + h.size - size : h.start);
+		EXPECT_EQ_INT(alloc.GetBlockStartFromAddress(addr + size - 1), addr);
+		EXPECT_FALSE(alloc.IsBlockFree(addr));
+		if (!fromTop)
+			h.start += size;
+		h.size -= size;
+		if (h.size == 0)
+			holes.erase(holes.begin() + found);
+	}
+
+	alloc.Shutdown();
+	currentMIPS = oldMIPS;
+	return true;
+}
+
+static bool TestMemBlockInfo() {
+	MIPSState *oldMIPS = currentMIPS;
+	currentMIPS = &mipsr4k;
+	const bool oldAllocsOnly = g_Config.bDebugMemInfoAllocsOnly;
+	g_Config.bDebugMemInfoAllocsOnly = false;
+	MemBlockInfoInit();
+
+	const u32 BASE = 0x08800000;
+	const int COUNT = 5000;
+	static const char *const tags[] = { "Memcpy/A", "Memcpy/B", "Memset/C", "GPUBlockTransfer/D" };
+
+	// Every other 0x100 block, so nothing merges.
+	for (int i = 0; i < COUNT; ++i) {
+		NotifyMemInfo(MemBlockFlags::WRITE, BASE + i * 0x200, 0x100, tags[i & 3]);
+	}
+
+	std::vector<MemBlockInfo> all = FindMemInfoByFlag(MemBlockFlags::WRITE, BASE, COUNT * 0x200);
+	EXPECT_EQ_INT(all.size(), COUNT);
+
+	for (int i = 0; i < COUNT; i += 7) {
+		std::vector<MemBlockInfo> info = FindMemInfoByFlag(MemBlockFlags::WRITE, BASE + i * 0x200 + 0x80, 1);
+		EXPECT_EQ_INT(info.size(), 1);
+		EXPECT_EQ_INT(info[0].start, BASE + i * 0x200);
+		EXPECT_TRUE(info[0].tag == tags[i & 3]);
+	}
+
+	// Overwriting the gaps with the same tag merges everything back together.
+	for (int i = 0; i < COUNT; ++i) {
+		NotifyMemInfo(MemBlockFlags::WRITE, BASE + i * 0x200 + 0x100, 0x100, "Merge");
+		NotifyMemInfo(MemBlockFlags::WRITE, BASE + i * 0x200, 0x100, "Merge");
+	}
+	all = FindMemInfoByFlag(MemBlockFlags::WRITE, BASE, COUNT * 0x200);
+	EXPECT_EQ_INT(all.size(), 1);
+	EXPECT_EQ_INT(all[0].size, COUNT * 0x200);
+
+	// Allocs only mode still tracks allocations, but skips writes.
+	g_Config.bDebugMemInfoAllocsOnly = true;
+	EXPECT_FALSE(MemBlockInfoDetailed(0x1000));
+	NotifyMemInfo(MemBlockFlags::WRITE, BASE, 0x1000, "Skipped");
+	NotifyMemInfo(MemBlockFlags::ALLOC, BASE, 0x1000, "Alloc");
+	std::vector<MemBlockInfo> info = FindMemInfo(BASE, 1);
+	EXPECT_EQ_INT(info.size(), 2);
+	for (const MemBlockInfo &block : info) {
+		EXPECT_TRUE(block.tag == (block.flags == MemBlockFlags::ALLOC ? "Alloc" : "Merge"));
+	}
+
+	MemBlockInfoShutdown();
+	g_Config.bDebugMemInfoAllocsOnly = oldAllocsOnly;
+	currentMIPS = oldMIPS;
+	return true;
+}
+
 static bool TestMemMap() {
 	Memory::g_MemorySize = Memory::RAM_DOUBLE_SIZE;
 
@@ -1310,6 +1677,288 @@ bool TestFriendlyPath() {
 	return true;
 }
 
+bool TestLZ4Block() {
+	uint8_t out[64];
+	size_t outSize = 0;
+
+	// Literals only.
+	static const uint8_t literals[] = { 0x50, 'h', 'e', 'l', 'l', 'o' };
+	EXPECT_TRUE(decompress_lz4_block(literals, sizeof(literals), out, sizeof(out), &outSize));
+	EXPECT_EQ_INT((int)outSize, 5);
+	EXPECT_TRUE(memcmp(out, "hello", 5) == 0);
+
+	// A match of 5 (4 + 1) at offset 4, then a last literal.
+	static const uint8_t match[] = { 0x41, 'a', 'b', 'c', 'd', 0x04, 0x00, 0x10, 'x' };
+	EXPECT_TRUE(decompress_lz4_block(match, sizeof(match), out, sizeof(out), &outSize));
+	EXPECT_EQ_INT((int)outSize, 10);
+	EXPECT_TRUE(memcmp(out, "abcdabcdax", 10) == 0);
+
+	// Offset 1 repeats a byte, and the match length continues in the next byte.
+	static const uint8_t rle[] = { 0x1F, 'z', 0x01, 0x00, 0x10, 0x00 };
+	EXPECT_TRUE(decompress_lz4_block(rle, sizeof(rle), out, sizeof(out), &outSize));
+	EXPECT_EQ_INT((int)outSize, 36);
+	bool allZ = true;
+	for (int i = 0; i < 36; ++i)
+		allZ = allZ && out[i] == 'z';
+	EXPECT_TRUE(allZ);
+
+	// Exactly filling the output is fine.
+	EXPECT_TRUE(decompress_lz4_block(rle, sizeof(rle), out, 36, &outSize));
+	EXPECT_EQ_INT((int)outSize, 36);
+	// But a match can't run past the end.
+	EXPECT_FALSE(decompress_lz4_block(rle, sizeof(rle), out, 20, &outSize));
+
+	// Offset before the start of the output.
+	static const uint8_t badOffset[] = { 0x10, 'a', 0x02, 0x00, 0x10, 'b' };
+	EXPECT_FALSE(decompress_lz4_block(badOffset, sizeof(badOffset), out, sizeof(out), &outSize));
+
+	// Literals running past the end of the input.
+	static const uint8_t truncated[] = { 0x50, 'a', 'b' };
+	EXPECT_FALSE(decompress_lz4_block(truncated, sizeof(truncated), out, sizeof(out), &outSize));
+	return true;
+}
+
+// A disc image in memory.
+class MemoryFileLoader : public FileLoader {
+public:
+	MemoryFileLoader(const std::string &data) : data_(data) {}
+	bool Exists() override { return true; }
+	bool IsDirectory() override { return false; }
+	s64 FileSize() override { return (s64)data_.size(); }
+	Path GetPath() const override { return Path("memory.iso"); }
+	size_t ReadAt(s64 absolutePos, size_t bytes, size_t count, void *data, Flags flags = Flags::NONE) override {
+		if (absolutePos < 0 || (size_t)absolutePos >= data_.size() || bytes == 0)
+			return 0;
+		count = std::min(count, (data_.size() - (size_t)absolutePos) / bytes);
+		memcpy(data, data_.data() + absolutePos, bytes * count);
+		return count;
+	}
+
+private:
+	std::string data_;
+};
+
+bool TestDecompressedFrameCache() {
+	const u32 FRAME = 16;
+	DecompressedFrameCache cache;
+	cache.Init(FRAME, 3 * FRAME);
+	EXPECT_EQ_INT(cache.Capacity(), 3);
+	EXPECT_TRUE(cache.Find(1) == nullptr);
+
+	for (u32 frame = 1; frame <= 3; ++frame)
+		memset(cache.Insert(frame), frame, FRAME);
+	// All three fit, and keep their data.
+	for (u32 frame = 1; frame <= 3; ++frame) {
+		const u8 *data = cache.Find(frame);
+		EXPECT_TRUE(data != nullptr);
+		EXPECT_EQ_INT(data[0], frame);
+		EXPECT_EQ_INT(data[FRAME - 1], frame);
+	}
+
+	// Now 1 is the least recently used. Touch it, so 2 goes instead.
+	EXPECT_TRUE(cache.Find(1) != nullptr);
+	memset(cache.Insert(4), 4, FRAME);
+	EXPECT_TRUE(cache.Find(2) == nullptr);
+	EXPECT_TRUE(cache.Find(1) != nullptr);
+	EXPECT_TRUE(cache.Find(3) != nullptr);
+	EXPECT_EQ_INT(cache.Find(4)[0], 4);
+
+	// Inserting what's already there gives back the same space.
+	const u8 *four = cache.Find(4);
+	EXPECT_TRUE(cache.Insert(4) == four);
+
+	// A removed frame's slot is reused first, so nothing else gets pushed out.
+	cache.Remove(3);
+	EXPECT_TRUE(cache.Find(3) == nullptr);
+	memset(cache.Insert(5), 5, FRAME);
+	EXPECT_TRUE(cache.Find(1) != nullptr);
+	EXPECT_TRUE(cache.Find(4) != nullptr);
+	EXPECT_EQ_INT(cache.Find(5)[0], 5);
+	// Removing something that isn't there is fine.
+	cache.Remove(3);
+	cache.Remove(100);
+
+	// After that, it's back to least recently used: 1 was used the longest ago.
+	memset(cache.Insert(6), 6, FRAME);
+	EXPECT_TRUE(cache.Find(1) == nullptr);
+	EXPECT_TRUE(cache.Find(4) != nullptr);
+	EXPECT_TRUE(cache.Find(5) != nullptr);
+	EXPECT_TRUE(cache.Find(6) != nullptr);
+
+	// Too small for even a single frame still gives one.
+	cache.Init(FRAME, 0);
+	EXPECT_EQ_INT(cache.Capacity(), 1);
+	EXPECT_TRUE(cache.Find(4) == nullptr);
+	memset(cache.Insert(7), 7, FRAME);
+	EXPECT_EQ_INT(cache.Find(7)[0], 7);
+	memset(cache.Insert(8), 8, FRAME);
+	EXPECT_TRUE(cache.Find(7) == nullptr);
+	EXPECT_EQ_INT(cache.Find(8)[0], 8);
+	cache.Remove(8);
+	EXPECT_TRUE(cache.Find(8) == nullptr);
+	memset(cache.Insert(9), 9, FRAME);
+	EXPECT_EQ_INT(cache.Find(9)[0], 9);
+	return true;
+}
+
+// Builds a CSO with one 2048 byte frame per block. Frames are given as they're stored, with flags for the high index bit.
+static std::string MakeTestCSO(int ver, const std::vector<std::string> &frames, const std::vector<bool> &highBit) {
+	const u32 FRAME = 2048;
+	const u32 headerSize = 0x18;
+	const u32 indexSize = (u32)(frames.size() + 1) * 4;
+	std::string cso(headerSize + indexSize, 0);
+	memcpy(&cso[0], "CISO", 4);
+	const u32 total[2] = { (u32)frames.size() * FRAME, 0 };
+	memcpy(&cso[4], &headerSize, 4);
+	memcpy(&cso[8], total, 8);
+	memcpy(&cso[0x10], &FRAME, 4);
+	cso[0x14] = (char)ver;
+	for (size_t i = 0; i <= frames.size(); ++i) {
+		u32 pos = (u32)cso.size();
+		if (i < frames.size() && highBit[i])
+			pos |= 0x80000000;
+		memcpy(&cso[headerSize + i * 4], &pos, 4);
+		if (i < frames.size())
+			cso += frames[i];
+	}
+	return cso;
+}
+
+static std::string DeflateRaw(const std::string &data) {
+	z_stream z{};
+	deflateInit2(&z, 9, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+	std::string out(deflateBound(&z, (uLong)data.size()), 0);
+	z.next_in = (Bytef *)data.data();
+	z.avail_in = (uInt)data.size();
+	z.next_out = (Bytef *)&out[0];
+	z.avail_out = (uInt)out.size();
+	deflate(&z, Z_FINISH);
+	out.resize(z.total_out);
+	deflateEnd(&z);
+	return out;
+}
+
+static bool CheckCSOBlocks(const std::string &cso, const std::vector<std::string> &expected) {
+	CISOFileBlockDevice device(new MemoryFileLoader(cso));
+	EXPECT_TRUE(device.IsOK());
+	EXPECT_EQ_INT(device.GetNumBlocks(), (u32)expected.size());
+	u8 block[2048];
+	for (size_t i = 0; i < expected.size(); ++i) {
+		EXPECT_TRUE(device.ReadBlock((int)i, block));
+		EXPECT_TRUE(memcmp(block, expected[i].data(), sizeof(block)) == 0);
+	}
+	return true;
+}
+
+bool TestCSOFrameTypes() {
+	std::string plain(2048, 0);
+	for (size_t i = 0; i < plain.size(); ++i)
+		plain[i] = (char)(i * 7);
+	std::string text;
+	while (text.size() < 2048)
+		text += "Compressible text, over and over. ";
+	text.resize(2048);
+	const std::string deflated = DeflateRaw(text);
+	EXPECT_TRUE(deflated.size() < 2048);
+	// A literal, then a match at offset 1 filling up the rest (4 + 15 + 7 * 255 + 243 = 2047.)
+	std::string lz4 = "\x1Fz";
+	lz4 += std::string("\x01\x00", 2);
+	lz4 += std::string(7, (char)0xFF);
+	lz4 += "\xF3";
+	lz4 += std::string(1, 0);
+	const std::string zs(2048, 'z');
+
+	// v1: the high bit means plain, anything else is deflate.
+	RET(CheckCSOBlocks(MakeTestCSO(1, { plain, deflated }, { true, false }), { plain, text }));
+
+	// v2: plain if it's not smaller than a frame, whatever the high bit says. Otherwise it means LZ4.
+	RET(CheckCSOBlocks(MakeTestCSO(2, { plain, deflated, lz4, plain }, { false, false, true, true }), { plain, text, zs, plain }));
+	return true;
+}
+
+static bool CheckReadaheadRuns(const std::vector<PrefetchingFileLoader::Run> &runs, const std::vector<u32> &expected) {
+	EXPECT_EQ_INT((int)runs.size() * 2, (int)expected.size());
+	for (size_t i = 0; i < runs.size(); ++i) {
+		EXPECT_EQ_INT(runs[i].start, expected[i * 2]);
+		EXPECT_EQ_INT(runs[i].count, expected[i * 2 + 1]);
+	}
+	return true;
+}
+
+bool TestReadaheadProfile() {
+	const s64 BLOCK = 65536;
+	const s64 imageSize = 64 * BLOCK;
+	const Path filename("readahead_test.tmp");
+	const std::string zeroes(imageSize, 0);
+	u8 buf[256];
+	std::vector<u8> big(3 * BLOCK);
+
+	// Record a first session, nothing to load yet.
+	{
+		PrefetchingFileLoader loader(new MemoryFileLoader(zeroes));
+		EXPECT_FALSE(loader.LoadProfile(filename));
+		loader.ReadAt(5 * BLOCK, 3 * BLOCK, big.data());
+		loader.ReadAt(2 * BLOCK + 100, sizeof(buf), buf);
+		loader.ReadAt(10 * BLOCK, sizeof(buf), buf);
+		// Already read blocks don't count again.
+		loader.ReadAt(6 * BLOCK, sizeof(buf), buf);
+		EXPECT_TRUE(loader.SaveProfile(filename));
+	}
+
+	// It loads back the same, and a new session goes first, followed by what it didn't read.
+	{
+		PrefetchingFileLoader loader(new MemoryFileLoader(zeroes));
+		EXPECT_TRUE(loader.LoadProfile(filename));
+		RET(CheckReadaheadRuns(loader.Profile(), { 5, 3, 2, 1, 10, 1 }));
+		loader.ReadAt(2 * BLOCK, sizeof(buf), buf);
+		loader.ReadAt(3 * BLOCK, sizeof(buf), buf);
+		loader.ReadAt(6 * BLOCK, sizeof(buf), buf);
+		EXPECT_TRUE(loader.SaveProfile(filename));
+	}
+	{
+		PrefetchingFileLoader loader(new MemoryFileLoader(zeroes));
+		EXPECT_TRUE(loader.LoadProfile(filename));
+		RET(CheckReadaheadRuns(loader.Profile(), { 2, 2, 6, 1, 5, 1, 7, 1, 10, 1 }));
+	}
+
+	// A different image size means a different dump, so it's ignored.
+	{
+		PrefetchingFileLoader loader(new MemoryFileLoader(std::string(imageSize + BLOCK, 0)));
+		EXPECT_FALSE(loader.LoadProfile(filename));
+		EXPECT_TRUE(loader.Profile().empty());
+	}
+
+	// Reads are clipped to the image.
+	{
+		PrefetchingFileLoader loader(new MemoryFileLoader(zeroes));
+		loader.ReadAt(62 * BLOCK, 3 * BLOCK - 1, big.data());
+		EXPECT_TRUE(loader.SaveProfile(filename));
+		EXPECT_TRUE(loader.LoadProfile(filename));
+		RET(CheckReadaheadRuns(loader.Profile(), { 62, 2 }));
+	}
+	std::string data;
+	EXPECT_TRUE(File::ReadBinaryFileToString(filename, &data));
+	// Runs past the end of the image, or empty ones, are rejected. The single run follows the header.
+	EXPECT_EQ_INT((int)data.size(), 24 + 8);
+	u32 badRuns[][2] = { { 62, 3 }, { 64, 1 }, { 3, 0 } };
+	for (auto &bad : badRuns) {
+		memcpy(&data[24], bad, 8);
+		EXPECT_TRUE(File::WriteStringToFile(false, data, filename));
+		PrefetchingFileLoader loader(new MemoryFileLoader(zeroes));
+		EXPECT_FALSE(loader.LoadProfile(filename));
+		EXPECT_TRUE(loader.Profile().empty());
+	}
+	// Truncated.
+	EXPECT_TRUE(File::WriteStringToFile(false, data.substr(0, 28), filename));
+	{
+		PrefetchingFileLoader loader(new MemoryFileLoader(zeroes));
+		EXPECT_FALSE(loader.LoadProfile(filename));
+	}
+
+	File::Delete(filename);
+	return true;
+}
+
 // Check that RTTI is working.
 bool TestLang() {
 	struct Base { virtual ~Base() = default; };
@@ -1363,12 +2012,24 @@ TestItem availableTests[] = {
 	TEST_ITEM(MathUtil),
 	TEST_ITEM(Parsers),
 	TEST_ITEM(IRPassSimplify),
+	TEST_ITEM(IRInterpretThreaded),
 	TEST_ITEM(Jit),
+	TEST_ITEM(JitInvalidate),
+	TEST_ITEM(JitTraceLoop),
+	TEST_ITEM(FunctionScanChunks),
+	TEST_ITEM(RunAheadRestore),
+	TEST_ITEM(CoreTimingBench),
+	TEST_ITEM(KernelWaitMany),
 	TEST_ITEM(VFPUMatrixTranspose),
 	TEST_ITEM(ParseLBN),
 	TEST_ITEM(QuickTexHash),
 	TEST_ITEM(CLZ),
+	TEST_ITEM(BlockAllocator),
+	TEST_ITEM(MemBlockInfo),
 	TEST_ITEM(MemMap),
+	TEST_ITEM(CoreTiming),
+	TEST_ITEM(ThreadQueueList),
+	TEST_ITEM(WaitingThreadList),
 	TEST_ITEM(ShaderGenerators),
 	TEST_ITEM(SoftwareGPUJit),
 	TEST_ITEM(Path),
@@ -1393,6 +2054,10 @@ TestItem availableTests[] = {
 	TEST_ITEM(FriendlyPath),
 	TEST_ITEM(LinAlg),
 	TEST_ITEM(Lang),
+	TEST_ITEM(LZ4Block),
+	TEST_ITEM(DecompressedFrameCache),
+	TEST_ITEM(CSOFrameTypes),
+	TEST_ITEM(ReadaheadProfile),
 };
 
 int main(int argc, const char *argv[]) {